@@ -0,0 +1,313 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if ENET_LIB_CHOICE == ENET_LIB_CHOICE_ORIGINAL
+	#include <enet/enet.h>
+#else
+	#include <enet.h>
+#endif
+
+
+// Checksum benchmark
+// Measures the throughput in GB/s of the checksums a host can set as
+// ENetHost::checksum, for blocks from a small datagram up to a large
+// fragment, against the byte-at-a-time CRC32 loop ENet used to ship. Each
+// block is checksummed as ENet does it: the protocol header and the
+// commands as separate buffers.
+//
+// enet_crc32 and enet_crc32c pick their implementation when ENet is
+// initialized, by what the CPU supports. Before measuring, enet_crc32 is
+// checked against the byte loop for every length and alignment its
+// implementations treat differently, and enet_crc32c against its standard
+// test vector.
+
+
+#ifdef _WINDOWS
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+typedef struct
+{
+	const size_t *sizes;
+	size_t size_count;
+	double bytes;
+	int iterations;
+} Config;
+typedef enet_uint32 (ENET_CALLBACK *ChecksumCallback)(const ENetBuffer *, size_t);
+typedef struct
+{
+	const char *name;
+	const char *description;
+	ChecksumCallback checksum;
+} ChecksumInfo;
+bool benchmark(const ChecksumInfo *info, const Config *config);
+bool verify(void);
+// The protocol header that ENet checksums in a buffer of its own
+#define HEADER_SIZE 4
+#define LARGEST_SIZE 65536
+
+
+static enet_uint32 byte_table[256];
+
+static void build_byte_table(void)
+{
+	for (enet_uint32 i = 0; i < 256; i++)
+	{
+		enet_uint32 crc = i;
+		for (int j = 0; j < 8; j++)
+		{
+			crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+		}
+		byte_table[i] = crc;
+	}
+}
+
+// The CRC32 that ENet shipped before the checksum module, one table lookup
+// per byte
+static enet_uint32 ENET_CALLBACK crc32_byte_loop(const ENetBuffer *buffers, size_t buffer_count)
+{
+	enet_uint32 crc = 0xFFFFFFFF;
+	for (size_t i = 0; i < buffer_count; i++)
+	{
+		const enet_uint8 *data = buffers[i].data;
+		for (size_t j = 0; j < buffers[i].dataLength; j++)
+		{
+			crc = (crc >> 8) ^ byte_table[(crc & 0xFF) ^ data[j]];
+		}
+	}
+	return ENET_HOST_TO_NET_32(~crc);
+}
+
+static const ChecksumInfo checksums[] =
+{
+	{ "byte-loop", "CRC32 a byte at a time, as ENet used to", crc32_byte_loop },
+	{ "crc32", "enet_crc32", enet_crc32 },
+#if ENET_LIB_CHOICE == ENET_LIB_CHOICE_ORIGINAL
+	{ "crc32c", "enet_crc32c", enet_crc32c },
+#endif
+};
+#define CHECKSUM_COUNT (sizeof checksums / sizeof checksums[0])
+
+static const size_t sizes[] = { 64, 128, 256, 576, 1024, 1400, 4096, 16384, LARGEST_SIZE };
+#define SIZE_COUNT (sizeof sizes / sizeof sizes[0])
+
+
+static void usage(const char *program)
+{
+	fprintf(stderr,
+		"Usage: %s [options] [checksum...]\n"
+		"  -s SIZE   only measure blocks of SIZE bytes, at most %d\n"
+		"  -m MB     megabytes to checksum per measurement (default 256)\n"
+		"  -i COUNT  measurements per block size, the best is reported (default 3)\n"
+		"  -l        list the checksums\n",
+		program, LARGEST_SIZE);
+}
+
+int main(int argc, char *argv[])
+{
+	Config config = { sizes, SIZE_COUNT, 256.0 * 1024 * 1024, 3 };
+	size_t size = 0;
+	int first_name = argc;
+	for (int i = 1; i < argc; i++)
+	{
+		const char *arg = argv[i];
+		if (strcmp(arg, "-l") == 0)
+		{
+			for (size_t j = 0; j < CHECKSUM_COUNT; j++)
+			{
+				printf("%-16s%s\n", checksums[j].name, checksums[j].description);
+			}
+			return 0;
+		}
+		if (arg[0] != '-')
+		{
+			first_name = i;
+			break;
+		}
+		if (arg[1] == '\0' || arg[2] != '\0' || i + 1 >= argc)
+		{
+			usage(argv[0]);
+			return 1;
+		}
+		const char *value = argv[++i];
+		switch (arg[1])
+		{
+			case 's':
+				size = strtoul(value, NULL, 10);
+				config.sizes = &size;
+				config.size_count = 1;
+				break;
+			case 'm':
+				config.bytes = atof(value) * 1024 * 1024;
+				break;
+			case 'i':
+				config.iterations = atoi(value);
+				break;
+			default:
+				usage(argv[0]);
+				return 1;
+		}
+	}
+	if ((config.sizes == &size && (size <= HEADER_SIZE || size > LARGEST_SIZE)) ||
+		config.bytes <= 0 || config.iterations <= 0)
+	{
+		usage(argv[0]);
+		return 1;
+	}
+	for (int i = first_name; i < argc; i++)
+	{
+		size_t j = 0;
+		while (j < CHECKSUM_COUNT && strcmp(argv[i], checksums[j].name) != 0)
+		{
+			j++;
+		}
+		if (j == CHECKSUM_COUNT)
+		{
+			fprintf(stderr, "Unknown checksum %s, -l lists them\n", argv[i]);
+			return 1;
+		}
+	}
+
+	if (enet_initialize() != 0)
+	{
+		fprintf(stderr, "An error occurred while initializing ENet\n");
+		return 1;
+	}
+	build_byte_table();
+
+	bool ok = verify();
+	printf("%-12s", "GB/s");
+	for (size_t k = 0; k < config.size_count; k++)
+	{
+		printf(" %8lu", (unsigned long)config.sizes[k]);
+	}
+	printf("\n");
+	for (size_t j = 0; j < CHECKSUM_COUNT && ok; j++)
+	{
+		bool selected = first_name == argc;
+		for (int i = first_name; i < argc && !selected; i++)
+		{
+			selected = strcmp(argv[i], checksums[j].name) == 0;
+		}
+		if (selected && !benchmark(&checksums[j], &config))
+		{
+			ok = false;
+		}
+	}
+
+	enet_deinitialize();
+	return ok ? 0 : 1;
+}
+
+
+static double now_ns(void)
+{
+#ifdef _WINDOWS
+	static LARGE_INTEGER frequency;
+	LARGE_INTEGER counter;
+	if (frequency.QuadPart == 0)
+	{
+		QueryPerformanceFrequency(&frequency);
+	}
+	QueryPerformanceCounter(&counter);
+	return (double)counter.QuadPart * 1e9 / (double)frequency.QuadPart;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+#endif
+}
+
+static enet_uint8 block[LARGEST_SIZE];
+
+static void fill_block(enet_uint32 seed)
+{
+	// xorshift32, so the blocks are the same everywhere
+	enet_uint32 x = seed != 0 ? seed : 1;
+	for (size_t i = 0; i < LARGEST_SIZE; i++)
+	{
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		block[i] = (enet_uint8)x;
+	}
+}
+
+static size_t split_block(ENetBuffer *buffers, size_t offset, size_t size)
+{
+	buffers[0].data = block + offset;
+	buffers[0].dataLength = HEADER_SIZE;
+	buffers[1].data = block + offset + HEADER_SIZE;
+	buffers[1].dataLength = size - HEADER_SIZE;
+	return 2;
+}
+
+bool verify(void)
+{
+	// Every length and alignment up to a few blocks of the widest
+	// implementation, then some larger blocks
+	ENetBuffer buffers[2];
+	fill_block(1);
+	for (size_t size = HEADER_SIZE + 1; size <= LARGEST_SIZE; size += size < 512 ? 1 : 997)
+	{
+		for (size_t offset = 0; offset < 16; offset += size < 512 ? 1 : 5)
+		{
+			size_t count = split_block(buffers, offset, size < LARGEST_SIZE - offset ? size : LARGEST_SIZE - offset);
+			enet_uint32 expected = crc32_byte_loop(buffers, count);
+			if (enet_crc32(buffers, count) != expected)
+			{
+				fprintf(stderr, "enet_crc32 differs from the byte loop for %lu bytes at offset %lu\n",
+					(unsigned long)buffers[1].dataLength + HEADER_SIZE, (unsigned long)offset);
+				return false;
+			}
+		}
+	}
+#if ENET_LIB_CHOICE == ENET_LIB_CHOICE_ORIGINAL
+	// CRC32C has no reference here, so check it on its standard test vector
+	static const char check[] = "123456789";
+	buffers[0].data = (void *)check;
+	buffers[0].dataLength = sizeof check - 1;
+	if (enet_crc32c(buffers, 1) != ENET_HOST_TO_NET_32(0xE3069283))
+	{
+		fprintf(stderr, "enet_crc32c fails its test vector\n");
+		return false;
+	}
+#endif
+	return true;
+}
+
+bool benchmark(const ChecksumInfo *info, const Config *config)
+{
+	ENetBuffer buffers[2];
+	volatile enet_uint32 sink = 0;
+	fill_block(2);
+	printf("%-12s", info->name);
+	for (size_t k = 0; k < config->size_count; k++)
+	{
+		size_t size = config->sizes[k];
+		size_t count = split_block(buffers, 0, size);
+		size_t calls = (size_t)(config->bytes / size) + 1;
+		double best = 0;
+		for (int i = 0; i < config->iterations; i++)
+		{
+			double start = now_ns();
+			for (size_t j = 0; j < calls; j++)
+			{
+				sink ^= info->checksum(buffers, count);
+			}
+			double rate = (double)calls * size / (now_ns() - start);
+			if (rate > best)
+			{
+				best = rate;
+			}
+		}
+		printf(" %8.2f", best);
+		fflush(stdout);
+	}
+	printf("\n");
+	(void)sink;
+	return true;
+}
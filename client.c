@@ -9,6 +9,10 @@
 #include "common.h"
 #include "rlutil.h"
 
+#ifndef _WIN32
+#define Sleep(x) usleep((x)*1000)
+#endif
+
 
 // Simple LAN chat client
 // The client sends string messages to the server, and the server passes
@@ -0,0 +1,919 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if ENET_LIB_CHOICE == ENET_LIB_CHOICE_ORIGINAL
+	#include <enet/enet.h>
+#else
+	#include <enet.h>
+#endif
+
+
+// Compression benchmark
+// Replays chat datagrams through each compressor and reports the compression
+// ratio, compress and decompress throughput, and per datagram latency by
+// datagram size.
+//
+// Datagrams are read from a corpus file, or generated to look like the
+// traffic server.c broadcasts. A corpus file holds one record per datagram:
+// a 2 byte length in network byte order followed by the datagram as ENet
+// hands it to the compressor, i.e. the commands after the protocol header.
+// The presence workload instead generates the packets an application sends
+// on one channel, which is what delta encoding (enet_peer_delta_encode)
+// works on.
+//
+// To benchmark another compressor, write a create function that fills in a
+// Codec for it and add it to the codecs table.
+
+
+#ifdef _WINDOWS
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+typedef struct
+{
+	ENetBuffer *datagrams;
+	size_t count;
+	size_t capacity;
+	size_t total;
+} Corpus;
+bool corpus_add(Corpus *corpus, const void *data, size_t length);
+bool corpus_read(Corpus *corpus, const char *path);
+bool corpus_write(const Corpus *corpus, const char *path);
+bool corpus_generate(Corpus *corpus, size_t count, size_t mtu, enet_uint32 seed);
+bool corpus_generate_presence(Corpus *corpus, size_t count, enet_uint32 seed);
+void corpus_destroy(Corpus *corpus);
+bool dictionary_read(const char *path);
+typedef size_t (ENET_CALLBACK *CompressCallback)(void *, const ENetBuffer *, size_t, size_t, enet_uint8 *, size_t);
+typedef size_t (ENET_CALLBACK *DecompressCallback)(void *, const enet_uint8 *, size_t, enet_uint8 *, size_t);
+typedef struct
+{
+	// Packet compressors compress and decompress with context; stream
+	// compressors use a stream per end, both created from context
+	void *context;
+	void *send;
+	void *receive;
+	CompressCallback compress;
+	DecompressCallback decompress;
+	// Set for stream compressors, whose streams are reset before each pass
+	void (ENET_CALLBACK *reset)(void *stream);
+	void (ENET_CALLBACK *destroy_stream)(void *stream);
+	// Set for codecs whose receiving end also keeps datagrams sent uncompressed
+	void (*uncompressed)(void *stream, const ENetBuffer *datagram);
+	void (ENET_CALLBACK *destroy)(void *context);
+} Codec;
+typedef struct
+{
+	const char *name;
+	const char *description;
+	bool (*create)(Codec *codec, const Corpus *corpus);
+} CodecInfo;
+bool benchmark(const CodecInfo *info, const Corpus *corpus, int iterations);
+#define DATAGRAM_BUFFER_SIZE ENET_PROTOCOL_MAXIMUM_MTU
+#define BUCKET_COUNT 6
+// The dictionary read with -d, as train_dictionary writes it
+static enet_uint8 *dictionary_file;
+static size_t dictionary_file_length;
+
+
+// Passes datagrams through unchanged, to show the cost of the harness itself
+static int copy_context;
+
+static size_t ENET_CALLBACK copy_compress(void *context, const ENetBuffer *inBuffers, size_t inBufferCount, size_t inLimit, enet_uint8 *outData, size_t outLimit)
+{
+	(void)context;
+	if (inLimit > outLimit)
+	{
+		return 0;
+	}
+	size_t length = 0;
+	for (size_t i = 0; i < inBufferCount; i++)
+	{
+		memcpy(outData + length, inBuffers[i].data, inBuffers[i].dataLength);
+		length += inBuffers[i].dataLength;
+	}
+	return length;
+}
+
+static size_t ENET_CALLBACK copy_decompress(void *context, const enet_uint8 *inData, size_t inLimit, enet_uint8 *outData, size_t outLimit)
+{
+	(void)context;
+	if (inLimit > outLimit)
+	{
+		return 0;
+	}
+	memcpy(outData, inData, inLimit);
+	return inLimit;
+}
+
+static bool create_copy(Codec *codec, const Corpus *corpus)
+{
+	(void)corpus;
+	codec->context = &copy_context;
+	codec->compress = copy_compress;
+	codec->decompress = copy_decompress;
+	return true;
+}
+
+static bool create_range_coder(Codec *codec, const Corpus *corpus)
+{
+	(void)corpus;
+	codec->context = enet_range_coder_create();
+	codec->compress = enet_range_coder_compress;
+	codec->decompress = enet_range_coder_decompress;
+	codec->destroy = enet_range_coder_destroy;
+	return codec->context != NULL;
+}
+
+#if ENET_LIB_CHOICE == ENET_LIB_CHOICE_ORIGINAL
+static bool create_lz(Codec *codec, const Corpus *corpus)
+{
+	(void)corpus;
+	codec->context = enet_lz_create();
+	codec->compress = enet_lz_compress;
+	codec->decompress = enet_lz_decompress;
+	codec->destroy = enet_lz_destroy;
+	return codec->context != NULL;
+}
+
+// Creates an LZ context with the dictionary read with -d, or else with one
+// trained on the first quarter of the corpus, as an application would train
+// on traffic it captured earlier
+static void *create_lz_trained(const Corpus *corpus)
+{
+	if (dictionary_file != NULL)
+	{
+		return enet_lz_create_with_dictionary(dictionary_file, dictionary_file_length);
+	}
+	enet_uint8 dictionary[16384];
+	size_t samples = corpus->count / 4 > 0 ? corpus->count / 4 : corpus->count;
+	size_t length = enet_lz_train_dictionary(corpus->datagrams, samples, dictionary, sizeof dictionary);
+	if (length == 0)
+	{
+		fprintf(stderr, "Failed to train dictionary\n");
+		return NULL;
+	}
+	return enet_lz_create_with_dictionary(dictionary, length);
+}
+
+static bool create_lz_dictionary(Codec *codec, const Corpus *corpus)
+{
+	codec->context = create_lz_trained(corpus);
+	codec->compress = enet_lz_compress;
+	codec->decompress = enet_lz_decompress;
+	codec->destroy = enet_lz_destroy;
+	return codec->context != NULL;
+}
+
+static bool create_lz_stream(Codec *codec, const Corpus *corpus)
+{
+	(void)corpus;
+	codec->context = enet_lz_create();
+	codec->destroy = enet_lz_destroy;
+	if (codec->context == NULL)
+	{
+		return false;
+	}
+	codec->send = enet_lz_stream_create(codec->context);
+	codec->receive = enet_lz_stream_create(codec->context);
+	codec->compress = enet_lz_stream_compress;
+	codec->decompress = enet_lz_stream_decompress;
+	codec->reset = enet_lz_stream_reset;
+	codec->destroy_stream = enet_lz_stream_destroy;
+	return codec->send != NULL && codec->receive != NULL;
+}
+
+static bool create_lz_stream_dictionary(Codec *codec, const Corpus *corpus)
+{
+	codec->context = create_lz_trained(corpus);
+	codec->destroy = enet_lz_destroy;
+	if (codec->context == NULL)
+	{
+		return false;
+	}
+	codec->send = enet_lz_stream_create(codec->context);
+	codec->receive = enet_lz_stream_create(codec->context);
+	codec->compress = enet_lz_stream_compress;
+	codec->decompress = enet_lz_stream_decompress;
+	codec->reset = enet_lz_stream_reset;
+	codec->destroy_stream = enet_lz_stream_destroy;
+	return codec->send != NULL && codec->receive != NULL;
+}
+
+// Each end of a delta encoded channel keeps the last packet sent on it
+typedef struct
+{
+	enet_uint8 data[DATAGRAM_BUFFER_SIZE];
+	size_t length;
+} DeltaBase;
+
+static void keep_delta_base(DeltaBase *base, const void *data, size_t length)
+{
+	memcpy(base->data, data, length);
+	base->length = length;
+}
+
+static size_t ENET_CALLBACK delta_compress(void *context, const ENetBuffer *inBuffers, size_t inBufferCount, size_t inLimit, enet_uint8 *outData, size_t outLimit)
+{
+	// Packets are delta encoded whole, before ENet splits them into buffers
+	(void)inBufferCount;
+	DeltaBase *base = context;
+	size_t length = enet_delta_encode(base->data, base->length, inBuffers[0].data, inLimit, outData, outLimit);
+	keep_delta_base(base, inBuffers[0].data, inLimit);
+	return length;
+}
+
+static size_t ENET_CALLBACK delta_decompress(void *context, const enet_uint8 *inData, size_t inLimit, enet_uint8 *outData, size_t outLimit)
+{
+	DeltaBase *base = context;
+	size_t length = enet_delta_decode(base->data, base->length, inData, inLimit, outData, outLimit);
+	keep_delta_base(base, outData, length);
+	return length;
+}
+
+static void delta_uncompressed(void *context, const ENetBuffer *datagram)
+{
+	// ENet sends these unchanged behind a one byte marker, and both ends
+	// still keep them as the base
+	keep_delta_base(context, datagram->data, datagram->dataLength);
+}
+
+static void ENET_CALLBACK delta_reset(void *context)
+{
+	((DeltaBase *)context)->length = 0;
+}
+
+static void ENET_CALLBACK delta_destroy(void *context)
+{
+	free(context);
+}
+
+static bool create_delta(Codec *codec, const Corpus *corpus)
+{
+	(void)corpus;
+	codec->send = calloc(1, sizeof(DeltaBase));
+	codec->receive = calloc(1, sizeof(DeltaBase));
+	codec->compress = delta_compress;
+	codec->decompress = delta_decompress;
+	codec->reset = delta_reset;
+	codec->destroy_stream = delta_destroy;
+	codec->uncompressed = delta_uncompressed;
+	return codec->send != NULL && codec->receive != NULL;
+}
+#endif
+
+static const CodecInfo codecs[] =
+{
+	{ "copy", "no compression, measures the harness", create_copy },
+	{ "range", "enet_range_coder_*", create_range_coder },
+#if ENET_LIB_CHOICE == ENET_LIB_CHOICE_ORIGINAL
+	{ "lz", "enet_lz_*", create_lz },
+	{ "lz-dict", "enet_lz_* with a trained dictionary", create_lz_dictionary },
+	{ "lz-stream", "enet_lz_stream_*", create_lz_stream },
+	{ "lz-stream-dict", "enet_lz_stream_* with a trained dictionary", create_lz_stream_dictionary },
+	{ "delta", "enet_delta_* against the previous packet", create_delta },
+#endif
+};
+#define CODEC_COUNT (sizeof codecs / sizeof codecs[0])
+
+
+static void usage(const char *program)
+{
+	fprintf(stderr,
+		"Usage: %s [options] [compressor...]\n"
+		"  -c FILE   replay the datagrams in a corpus file\n"
+		"  -p        generate presence updates instead of chat datagrams\n"
+		"  -w FILE   write the datagrams to a corpus file\n"
+		"  -d FILE   use the dictionary in FILE instead of training one\n"
+		"  -n COUNT  number of datagrams to generate (default 20000)\n"
+		"  -m MTU    largest datagram to generate (default %d)\n"
+		"  -s SEED   seed for generating datagrams (default 1)\n"
+		"  -i COUNT  timed passes over the datagrams (default 5)\n"
+		"  -l        list the compressors\n",
+		program, ENET_HOST_DEFAULT_MTU);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *read_path = NULL;
+	bool presence = false;
+	const char *write_path = NULL;
+	const char *dictionary_path = NULL;
+	size_t count = 20000;
+	size_t mtu = ENET_HOST_DEFAULT_MTU;
+	enet_uint32 seed = 1;
+	int iterations = 5;
+	int first_name = argc;
+	for (int i = 1; i < argc; i++)
+	{
+		const char *arg = argv[i];
+		if (strcmp(arg, "-l") == 0)
+		{
+			for (size_t j = 0; j < CODEC_COUNT; j++)
+			{
+				printf("%-16s%s\n", codecs[j].name, codecs[j].description);
+			}
+			return 0;
+		}
+		if (strcmp(arg, "-p") == 0)
+		{
+			presence = true;
+			continue;
+		}
+		if (arg[0] != '-')
+		{
+			first_name = i;
+			break;
+		}
+		if (arg[1] == '\0' || arg[2] != '\0' || i + 1 >= argc)
+		{
+			usage(argv[0]);
+			return 1;
+		}
+		const char *value = argv[++i];
+		switch (arg[1])
+		{
+			case 'c':
+				read_path = value;
+				break;
+			case 'w':
+				write_path = value;
+				break;
+			case 'd':
+				dictionary_path = value;
+				break;
+			case 'n':
+				count = strtoul(value, NULL, 10);
+				break;
+			case 'm':
+				mtu = strtoul(value, NULL, 10);
+				break;
+			case 's':
+				seed = (enet_uint32)strtoul(value, NULL, 10);
+				break;
+			case 'i':
+				iterations = atoi(value);
+				break;
+			default:
+				usage(argv[0]);
+				return 1;
+		}
+	}
+	if (count == 0 || iterations <= 0 ||
+		mtu < ENET_PROTOCOL_MINIMUM_MTU || mtu > ENET_PROTOCOL_MAXIMUM_MTU)
+	{
+		usage(argv[0]);
+		return 1;
+	}
+	for (int i = first_name; i < argc; i++)
+	{
+		size_t j = 0;
+		while (j < CODEC_COUNT && strcmp(argv[i], codecs[j].name) != 0)
+		{
+			j++;
+		}
+		if (j == CODEC_COUNT)
+		{
+			fprintf(stderr, "Unknown compressor %s, -l lists them\n", argv[i]);
+			return 1;
+		}
+	}
+
+	if (enet_initialize() != 0)
+	{
+		fprintf(stderr, "An error occurred while initializing ENet\n");
+		return 1;
+	}
+
+	if (dictionary_path != NULL && !dictionary_read(dictionary_path))
+	{
+		enet_deinitialize();
+		return 1;
+	}
+	Corpus corpus;
+	memset(&corpus, 0, sizeof corpus);
+	bool loaded = read_path != NULL ? corpus_read(&corpus, read_path) :
+		presence ? corpus_generate_presence(&corpus, count, seed) :
+		corpus_generate(&corpus, count, mtu, seed);
+	if (!loaded || corpus.count == 0)
+	{
+		fprintf(stderr, "No datagrams to replay\n");
+		corpus_destroy(&corpus);
+		free(dictionary_file);
+		enet_deinitialize();
+		return 1;
+	}
+	if (write_path != NULL && !corpus_write(&corpus, write_path))
+	{
+		corpus_destroy(&corpus);
+		free(dictionary_file);
+		enet_deinitialize();
+		return 1;
+	}
+	printf("%s: %lu datagrams, %lu bytes, %d passes\n",
+		read_path != NULL ? read_path : presence ? "generated presence updates" : "generated chat traffic",
+		(unsigned long)corpus.count, (unsigned long)corpus.total, iterations);
+
+	bool ok = true;
+	for (size_t j = 0; j < CODEC_COUNT; j++)
+	{
+		bool selected = first_name == argc;
+		for (int i = first_name; i < argc && !selected; i++)
+		{
+			selected = strcmp(argv[i], codecs[j].name) == 0;
+		}
+		if (selected && !benchmark(&codecs[j], &corpus, iterations))
+		{
+			ok = false;
+		}
+	}
+
+	corpus_destroy(&corpus);
+	free(dictionary_file);
+	enet_deinitialize();
+	return ok ? 0 : 1;
+}
+
+
+bool corpus_add(Corpus *corpus, const void *data, size_t length)
+{
+	if (corpus->count == corpus->capacity)
+	{
+		size_t capacity = corpus->capacity ? corpus->capacity * 2 : 1024;
+		ENetBuffer *datagrams = realloc(corpus->datagrams, capacity * sizeof *datagrams);
+		if (datagrams == NULL)
+		{
+			return false;
+		}
+		corpus->datagrams = datagrams;
+		corpus->capacity = capacity;
+	}
+	void *copy = malloc(length > 0 ? length : 1);
+	if (copy == NULL)
+	{
+		return false;
+	}
+	memcpy(copy, data, length);
+	corpus->datagrams[corpus->count].data = copy;
+	corpus->datagrams[corpus->count].dataLength = length;
+	corpus->count++;
+	corpus->total += length;
+	return true;
+}
+
+bool corpus_read(Corpus *corpus, const char *path)
+{
+	FILE *file = fopen(path, "rb");
+	if (file == NULL)
+	{
+		fprintf(stderr, "Failed to open %s\n", path);
+		return false;
+	}
+	bool ok = true;
+	enet_uint8 header[2];
+	enet_uint8 datagram[DATAGRAM_BUFFER_SIZE];
+	while (ok && fread(header, 1, sizeof header, file) == sizeof header)
+	{
+		size_t length = ((size_t)header[0] << 8) | header[1];
+		if (length > sizeof datagram || fread(datagram, 1, length, file) != length)
+		{
+			fprintf(stderr, "Corrupt record %lu in %s\n", (unsigned long)corpus->count, path);
+			ok = false;
+		}
+		else if (!corpus_add(corpus, datagram, length))
+		{
+			fprintf(stderr, "Out of memory\n");
+			ok = false;
+		}
+	}
+	fclose(file);
+	return ok;
+}
+
+bool corpus_write(const Corpus *corpus, const char *path)
+{
+	FILE *file = fopen(path, "wb");
+	if (file == NULL)
+	{
+		fprintf(stderr, "Failed to create %s\n", path);
+		return false;
+	}
+	bool ok = true;
+	for (size_t i = 0; i < corpus->count && ok; i++)
+	{
+		size_t length = corpus->datagrams[i].dataLength;
+		enet_uint8 header[2] = { (enet_uint8)(length >> 8), (enet_uint8)length };
+		ok = fwrite(header, 1, sizeof header, file) == sizeof header &&
+			fwrite(corpus->datagrams[i].data, 1, length, file) == length;
+	}
+	if (fclose(file) != 0 || !ok)
+	{
+		fprintf(stderr, "Failed to write %s\n", path);
+		return false;
+	}
+	return true;
+}
+
+void corpus_destroy(Corpus *corpus)
+{
+	for (size_t i = 0; i < corpus->count; i++)
+	{
+		free(corpus->datagrams[i].data);
+	}
+	free(corpus->datagrams);
+	memset(corpus, 0, sizeof *corpus);
+}
+
+bool dictionary_read(const char *path)
+{
+	FILE *file = fopen(path, "rb");
+	if (file == NULL)
+	{
+		fprintf(stderr, "Failed to open %s\n", path);
+		return false;
+	}
+	// Only the last 32 KiB of a dictionary are used, so a larger file is
+	// most likely not a dictionary
+	dictionary_file = malloc(32768 + 1);
+	dictionary_file_length = dictionary_file != NULL ? fread(dictionary_file, 1, 32768 + 1, file) : 0;
+	fclose(file);
+	if (dictionary_file_length == 0 || dictionary_file_length > 32768)
+	{
+		fprintf(stderr, "%s is not a dictionary\n", path);
+		free(dictionary_file);
+		dictionary_file = NULL;
+		return false;
+	}
+	return true;
+}
+
+
+static enet_uint32 next_random(enet_uint32 *state)
+{
+	// xorshift32, so a seed generates the same datagrams everywhere
+	enet_uint32 x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+	return x;
+}
+
+static size_t put_command(enet_uint8 *out, enet_uint8 command, enet_uint8 channel, enet_uint16 sequence)
+{
+	out[0] = command;
+	out[1] = channel;
+	out[2] = (enet_uint8)(sequence >> 8);
+	out[3] = (enet_uint8)sequence;
+	return 4;
+}
+
+static size_t put_uint16(enet_uint8 *out, enet_uint16 value)
+{
+	out[0] = (enet_uint8)(value >> 8);
+	out[1] = (enet_uint8)value;
+	return 2;
+}
+
+// Writes one line of chat as the server would broadcast it
+static size_t make_message(char *out, size_t limit, enet_uint32 *random)
+{
+	static const char *const words[] =
+	{
+		"hi", "hello", "anyone", "here", "lol", "ok", "yes", "no", "the",
+		"a", "is", "it", "that", "to", "and", "you", "I", "game", "map",
+		"round", "ready", "wait", "brb", "back", "gg", "nice", "shot",
+		"who", "wants", "to", "play", "again", "server", "lag", "ping",
+		"going", "now", "later", "thanks", "everyone", "what", "did",
+		"just", "happen", "?", "!", ":)", "haha", "really", "sure",
+	};
+	const size_t word_count = sizeof words / sizeof words[0];
+	int client = (int)(next_random(random) % 16);
+	enet_uint32 kind = next_random(random) % 100;
+	if (kind < 2)
+	{
+		return (size_t)snprintf(out, limit, "New client connected: id %d", client) + 1;
+	}
+	if (kind < 4)
+	{
+		return (size_t)snprintf(out, limit, "Client %d disconnected", client) + 1;
+	}
+
+	size_t length = (size_t)snprintf(out, limit, "Client %d says: ", client);
+	// Mostly short lines with the occasional paragraph
+	size_t word_limit = 1 + next_random(random) % (kind < 90 ? 8 : 40);
+	for (size_t i = 0; i < word_limit; i++)
+	{
+		const char *word = words[next_random(random) % word_count];
+		size_t word_length = strlen(word);
+		if (length + word_length + 2 > limit)
+		{
+			break;
+		}
+		if (i > 0)
+		{
+			out[length++] = ' ';
+		}
+		memcpy(out + length, word, word_length);
+		length += word_length;
+	}
+	out[length] = '\0';
+	return length + 1;
+}
+
+bool corpus_generate(Corpus *corpus, size_t count, size_t mtu, enet_uint32 seed)
+{
+	// The compressor sees each datagram after its 4 byte protocol header:
+	// acknowledgements for what clients sent, then the reliable broadcasts
+	// the server queued since the last flush
+	const size_t limit = mtu - 4;
+	enet_uint32 random = seed != 0 ? seed : 1;
+	enet_uint16 sequence = 0;
+	enet_uint16 acknowledged = 0;
+	enet_uint16 sent_time = 0;
+	enet_uint8 datagram[DATAGRAM_BUFFER_SIZE];
+	char message[512];
+	for (size_t i = 0; i < count; i++)
+	{
+		size_t length = 0;
+		sent_time += (enet_uint16)(1 + next_random(&random) % 50);
+		if (next_random(&random) % 20 == 0)
+		{
+			length += put_command(datagram, ENET_PROTOCOL_COMMAND_PING | ENET_PROTOCOL_COMMAND_FLAG_ACKNOWLEDGE, 0xFF, ++sequence);
+			if (!corpus_add(corpus, datagram, length))
+			{
+				return false;
+			}
+			continue;
+		}
+		int acknowledgements = (int)(next_random(&random) % 3);
+		for (int j = 0; j < acknowledgements; j++)
+		{
+			length += put_command(datagram + length, ENET_PROTOCOL_COMMAND_ACKNOWLEDGE, 0, acknowledged);
+			length += put_uint16(datagram + length, ++acknowledged);
+			length += put_uint16(datagram + length, (enet_uint16)(sent_time - next_random(&random) % 200));
+		}
+		// Usually one broadcast, but a busy server flushes several at once
+		enet_uint32 burst = next_random(&random) % 100;
+		int messages = burst < 60 ? 1 : burst < 85 ? 2 + (int)(next_random(&random) % 4) : 6 + (int)(next_random(&random) % 30);
+		for (int j = 0; j < messages; j++)
+		{
+			size_t message_length = make_message(message, sizeof message, &random);
+			if (length + 6 + message_length > limit)
+			{
+				break;
+			}
+			length += put_command(datagram + length, ENET_PROTOCOL_COMMAND_SEND_RELIABLE | ENET_PROTOCOL_COMMAND_FLAG_ACKNOWLEDGE, 0, ++sequence);
+			length += put_uint16(datagram + length, (enet_uint16)message_length);
+			memcpy(datagram + length, message, message_length);
+			length += message_length;
+		}
+		if (!corpus_add(corpus, datagram, length))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+
+bool corpus_generate_presence(Corpus *corpus, size_t count, enet_uint32 seed)
+{
+	// A server relays each change of a user's presence to everyone on one
+	// channel; a few busy users account for most of the updates
+	static const char *const statuses[] = { "online", "away", "busy", "in-game", "offline" };
+	static const char *const zones[] = { "lobby", "market", "harbor", "north-gate", "arena" };
+	typedef struct
+	{
+		int status;
+		int zone;
+		int x;
+		int y;
+		int health;
+	} Presence;
+	Presence users[64];
+	enet_uint32 random = seed != 0 ? seed : 1;
+	for (int i = 0; i < 64; i++)
+	{
+		users[i].status = 0;
+		users[i].zone = (int)(next_random(&random) % 5);
+		users[i].x = (int)(next_random(&random) % 2000);
+		users[i].y = (int)(next_random(&random) % 2000);
+		users[i].health = 100;
+	}
+	char packet[256];
+	for (size_t i = 0; i < count; i++)
+	{
+		int id = (int)(next_random(&random) % (next_random(&random) % 4 == 0 ? 64 : 8));
+		Presence *user = &users[id];
+		enet_uint32 change = next_random(&random) % 100;
+		if (change < 70)
+		{
+			user->x += (int)(next_random(&random) % 21) - 10;
+			user->y += (int)(next_random(&random) % 21) - 10;
+		}
+		else if (change < 85)
+		{
+			user->health = (int)(next_random(&random) % 101);
+		}
+		else if (change < 95)
+		{
+			user->status = (int)(next_random(&random) % 5);
+		}
+		else
+		{
+			user->zone = (int)(next_random(&random) % 5);
+		}
+		int length = snprintf(packet, sizeof packet,
+			"{\"user\":\"player%03d\",\"status\":\"%s\",\"zone\":\"%s\",\"x\":%d,\"y\":%d,\"hp\":%d}",
+			id, statuses[user->status], zones[user->zone], user->x, user->y, user->health);
+		if (!corpus_add(corpus, packet, (size_t)length + 1))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+static double now_ns(void)
+{
+#ifdef _WINDOWS
+	static LARGE_INTEGER frequency;
+	LARGE_INTEGER counter;
+	if (frequency.QuadPart == 0)
+	{
+		QueryPerformanceFrequency(&frequency);
+	}
+	QueryPerformanceCounter(&counter);
+	return (double)counter.QuadPart * 1e9 / (double)frequency.QuadPart;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+#endif
+}
+
+typedef struct
+{
+	size_t count;
+	// Datagrams the compressor made smaller, which ENet sends compressed
+	size_t shrunk;
+	// Datagrams the compressor produced output for, and their original size
+	size_t decompressed;
+	double decompressed_bytes;
+	double in_bytes;
+	double out_bytes;
+	double compress_ns;
+	double decompress_ns;
+} BucketStats;
+
+static const size_t bucket_limits[BUCKET_COUNT] = { 64, 128, 256, 512, 1024, DATAGRAM_BUFFER_SIZE + 1 };
+static const char *const bucket_names[BUCKET_COUNT] = { "0-63", "64-127", "128-255", "256-511", "512-1023", "1024+" };
+
+static void destroy_codec(Codec *codec)
+{
+	if (codec->destroy_stream != NULL)
+	{
+		if (codec->send != NULL)
+		{
+			codec->destroy_stream(codec->send);
+		}
+		if (codec->receive != NULL)
+		{
+			codec->destroy_stream(codec->receive);
+		}
+	}
+	if (codec->destroy != NULL && codec->context != NULL)
+	{
+		codec->destroy(codec->context);
+	}
+}
+
+bool benchmark(const CodecInfo *info, const Corpus *corpus, int iterations)
+{
+	Codec codec;
+	memset(&codec, 0, sizeof codec);
+	if (!info->create(&codec, corpus))
+	{
+		fprintf(stderr, "%s: failed to create compressor\n", info->name);
+		destroy_codec(&codec);
+		return false;
+	}
+	void *send = codec.reset != NULL ? codec.send : codec.context;
+	void *receive = codec.reset != NULL ? codec.receive : codec.context;
+
+	BucketStats buckets[BUCKET_COUNT];
+	memset(buckets, 0, sizeof buckets);
+	enet_uint8 compressed[DATAGRAM_BUFFER_SIZE];
+	enet_uint8 decompressed[DATAGRAM_BUFFER_SIZE];
+	bool ok = true;
+	// The first pass warms up caches and branch predictors and is not counted
+	for (int pass = 0; pass <= iterations && ok; pass++)
+	{
+		if (codec.reset != NULL)
+		{
+			codec.reset(codec.send);
+			codec.reset(codec.receive);
+		}
+		for (size_t i = 0; i < corpus->count && ok; i++)
+		{
+			const ENetBuffer *datagram = &corpus->datagrams[i];
+			size_t length = datagram->dataLength;
+			// Like ENet, only accept output smaller than the datagram
+			double start = now_ns();
+			size_t compressed_length = codec.compress(send, datagram, 1, length, compressed, length);
+			double compressed_at = now_ns();
+			double decompressed_at = compressed_at;
+			if (compressed_length > 0)
+			{
+				size_t decompressed_length = codec.decompress(receive, compressed, compressed_length, decompressed, sizeof decompressed);
+				decompressed_at = now_ns();
+				if (decompressed_length != length || memcmp(decompressed, datagram->data, length) != 0)
+				{
+					fprintf(stderr, "%s: datagram %lu did not decompress to its original contents\n",
+						info->name, (unsigned long)i);
+					ok = false;
+				}
+			}
+			else if (codec.uncompressed != NULL)
+			{
+				codec.uncompressed(receive, datagram);
+			}
+			if (pass == 0)
+			{
+				continue;
+			}
+
+			BucketStats *bucket = buckets;
+			while (length >= bucket_limits[bucket - buckets])
+			{
+				bucket++;
+			}
+			bucket->count++;
+			bucket->in_bytes += (double)length;
+			bucket->compress_ns += compressed_at - start;
+			if (compressed_length > 0 && compressed_length < length)
+			{
+				bucket->shrunk++;
+				bucket->out_bytes += (double)compressed_length;
+			}
+			else
+			{
+				bucket->out_bytes += (double)length;
+			}
+			if (compressed_length > 0)
+			{
+				bucket->decompressed++;
+				bucket->decompressed_bytes += (double)length;
+				bucket->decompress_ns += decompressed_at - compressed_at;
+			}
+		}
+	}
+	destroy_codec(&codec);
+	if (!ok)
+	{
+		return false;
+	}
+
+	// Throughput counts uncompressed bytes both ways; the ratio counts the
+	// bytes ENet would send, so it includes datagrams sent uncompressed.
+	// Decompression is only timed for datagrams the compressor accepted.
+	BucketStats total;
+	memset(&total, 0, sizeof total);
+	for (int b = 0; b < BUCKET_COUNT; b++)
+	{
+		total.count += buckets[b].count;
+		total.shrunk += buckets[b].shrunk;
+		total.decompressed += buckets[b].decompressed;
+		total.decompressed_bytes += buckets[b].decompressed_bytes;
+		total.in_bytes += buckets[b].in_bytes;
+		total.out_bytes += buckets[b].out_bytes;
+		total.compress_ns += buckets[b].compress_ns;
+		total.decompress_ns += buckets[b].decompress_ns;
+	}
+	printf("\n%s (%s)\n", info->name, info->description);
+	printf("  ratio %.3f, compress %.1f MB/s, decompress %.1f MB/s\n",
+		total.out_bytes / total.in_bytes,
+		total.in_bytes * 1e3 / total.compress_ns,
+		total.decompress_ns > 0 ? total.decompressed_bytes * 1e3 / total.decompress_ns : 0.0);
+	printf("  %-10s %10s %8s %8s %14s %16s\n",
+		"size", "datagrams", "ratio", "shrunk", "compress us", "decompress us");
+	for (int b = 0; b < BUCKET_COUNT; b++)
+	{
+		const BucketStats *bucket = &buckets[b];
+		if (bucket->count == 0)
+		{
+			continue;
+		}
+		printf("  %-10s %10lu %8.3f %7.1f%% %14.3f %16.3f\n",
+			bucket_names[b],
+			(unsigned long)(bucket->count / (size_t)iterations),
+			bucket->out_bytes / bucket->in_bytes,
+			100.0 * (double)bucket->shrunk / (double)bucket->count,
+			bucket->compress_ns / (double)bucket->count / 1e3,
+			bucket->decompressed > 0 ? bucket->decompress_ns / (double)bucket->decompressed / 1e3 : 0.0);
+	}
+	return true;
+}
@@ -0,0 +1,112 @@
+#include <cstdio>
+#include <cstdlib>
+#include <utility>
+
+#include <enet/coroutine.hpp>
+
+
+// Coroutine echo server
+// Sends every packet a client sends back to it on the same channel. The
+// per-client logic is written as straight-line coroutines over enet::Host,
+// as in the example of enet/coroutine.hpp, which this program also keeps
+// compiling. Serves until interrupted.
+
+
+namespace
+{
+
+struct Config
+{
+	int port;
+	int peers;
+};
+
+enet::Task echo(enet::Peer peer, enet_uint8 channelID)
+{
+	while (enet::Packet packet = co_await peer.receive(channelID))
+		peer.send(channelID, std::move(packet));
+}
+
+enet::Task serve(enet::Host &host)
+{
+	for (;;)
+	{
+		enet::Peer peer = co_await host.accept();
+		char ip[64];
+		if (enet_address_get_host_ip(&peer.get()->address, ip, sizeof ip) != 0)
+			snprintf(ip, sizeof ip, "unknown");
+		printf("Client connected from %s:%u\n", ip, (unsigned)peer.get()->address.port);
+		for (size_t channelID = 0; channelID < peer.get()->channelCount; channelID++)
+			echo(peer, (enet_uint8)channelID);
+	}
+}
+
+void usage(const char *program)
+{
+	fprintf(stderr,
+		"Usage: %s [options]\n"
+		"  -p PORT     port to listen on (default 7777)\n"
+		"  -n COUNT    peers to allow (default 64)\n",
+		program);
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+	Config config = { 7777, 64 };
+	for (int i = 1; i < argc; i++)
+	{
+		const char *arg = argv[i];
+		if (arg[0] != '-' || arg[1] == '\0' || arg[2] != '\0' || i + 1 >= argc)
+		{
+			usage(argv[0]);
+			return 1;
+		}
+		const char *value = argv[++i];
+		switch (arg[1])
+		{
+			case 'p':
+				config.port = atoi(value);
+				break;
+			case 'n':
+				config.peers = atoi(value);
+				break;
+			default:
+				usage(argv[0]);
+				return 1;
+		}
+	}
+	if (config.port <= 0 || config.port > 65535 || config.peers <= 0)
+	{
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (enet_initialize() != 0)
+	{
+		fprintf(stderr, "An error occurred while initializing ENet\n");
+		return 1;
+	}
+	ENetAddress address;
+	address.host = ENET_HOST_ANY;
+	address.port = (enet_uint16)config.port;
+	ENetHost *enetHost = enet_host_create(&address, config.peers, 0, 0, 0);
+	if (enetHost == NULL)
+	{
+		fprintf(stderr, "Failed to open ENet host\n");
+		enet_deinitialize();
+		return 1;
+	}
+	printf("Echoing on port %d\n", config.port);
+	{
+		enet::Host host(enetHost);
+		serve(host);
+		while (host.service(10) >= 0)
+			;
+		fprintf(stderr, "Error servicing host\n");
+	}
+	enet_host_destroy(enetHost);
+	enet_deinitialize();
+	return 1;
+}
@@ -0,0 +1,162 @@
+/**
+ @file  bus.c
+ @brief ENet broadcasts across hosts serviced on separate threads
+*/
+#define ENET_BUILDING_LIB 1
+#include "enet/enet.h"
+#include "enet/atomic.h"
+
+/** @defgroup host ENet host functions
+    @{
+*/
+
+/** Creates an empty broadcast bus.
+    @returns the bus on success, NULL on failure
+    @sa enet_broadcast_bus_attach()
+*/
+ENetBroadcastBus *
+enet_broadcast_bus_create (void)
+{
+    ENetBroadcastBus * bus = (ENetBroadcastBus *) enet_malloc (sizeof (ENetBroadcastBus));
+    if (bus == NULL)
+      return NULL;
+
+    if (enet_mutex_create (& bus -> mutex) < 0)
+    {
+        enet_free (bus);
+
+        return NULL;
+    }
+
+    bus -> hostCount = 0;
+
+    return bus;
+}
+
+/** Destroys a broadcast bus. The hosts attached to it are left alone, and broadcasts already
+    queued to them are still sent.
+    @param bus bus to destroy
+*/
+void
+enet_broadcast_bus_destroy (ENetBroadcastBus * bus)
+{
+    if (bus == NULL)
+      return;
+
+    enet_mutex_destroy (& bus -> mutex);
+
+    enet_free (bus);
+}
+
+/** Adds a host to a broadcast bus. May be called from any thread.
+    @param bus bus to add the host to
+    @param host host to add, such as one of the hosts of an ENetShardedHost
+    @retval 0 on success
+    @retval < 0 if the host is already attached or the bus holds ENET_BROADCAST_BUS_MAXIMUM_HOSTS hosts
+*/
+int
+enet_broadcast_bus_attach (ENetBroadcastBus * bus, ENetHost * host)
+{
+    size_t hostIndex;
+    int result = 0;
+
+    enet_mutex_lock (& bus -> mutex);
+
+    for (hostIndex = 0; hostIndex < bus -> hostCount; ++ hostIndex)
+      if (bus -> hosts [hostIndex] == host)
+        break;
+
+    if (hostIndex < bus -> hostCount || bus -> hostCount >= ENET_BROADCAST_BUS_MAXIMUM_HOSTS)
+      result = -1;
+    else
+      bus -> hosts [bus -> hostCount ++] = host;
+
+    enet_mutex_unlock (& bus -> mutex);
+
+    return result;
+}
+
+/** Removes a host from a broadcast bus. May be called from any thread, and once it returns no
+    further broadcasts reach the host, so it may then be destroyed.
+    @param bus bus to remove the host from
+    @param host host to remove
+*/
+void
+enet_broadcast_bus_detach (ENetBroadcastBus * bus, ENetHost * host)
+{
+    size_t hostIndex;
+
+    enet_mutex_lock (& bus -> mutex);
+
+    for (hostIndex = 0; hostIndex < bus -> hostCount; ++ hostIndex)
+    {
+        if (bus -> hosts [hostIndex] != host)
+          continue;
+
+        bus -> hosts [hostIndex] = bus -> hosts [-- bus -> hostCount];
+
+        break;
+    }
+
+    enet_mutex_unlock (& bus -> mutex);
+}
+
+/** Queues a packet to be broadcast to all peers of every host on a bus. May be called from any
+    thread. Each host carries out the broadcast at the start of its next call to
+    enet_host_service(), as with enet_host_broadcast_async(); a host that is the shard of an
+    ENetShardedHost is woken for it, while any other host waits out its service timeout.
+    @param bus bus to broadcast on
+    @param channelID channel on which to broadcast
+    @param packet packet to broadcast
+    @retval 0 on success
+    @retval < 0 on failure, in which case no host received the packet and the caller keeps it
+    @remarks The packet must not be changed once queued, as the hosts share it and may send it at
+    any time. It is destroyed once every host is done with it, or straight away if the bus is empty.
+*/
+int
+enet_broadcast_bus_broadcast (ENetBroadcastBus * bus, enet_uint8 channelID, ENetPacket * packet)
+{
+    ENetHostSubmission * submissions [ENET_BROADCAST_BUS_MAXIMUM_HOSTS];
+    size_t hostIndex;
+
+    enet_mutex_lock (& bus -> mutex);
+
+    for (hostIndex = 0; hostIndex < bus -> hostCount; ++ hostIndex)
+    {
+        ENetHostSubmission * submission = (ENetHostSubmission *) enet_malloc (sizeof (ENetHostSubmission));
+        if (submission == NULL)
+        {
+            while (hostIndex > 0)
+              enet_free (submissions [-- hostIndex]);
+
+            enet_mutex_unlock (& bus -> mutex);
+
+            return -1;
+        }
+
+        submission -> peerID = ENET_PROTOCOL_MAXIMUM_PEER_ID;
+        submission -> connectID = 0;
+        submission -> channelID = channelID;
+        submission -> packet = packet;
+        submission -> migration = NULL;
+
+        submissions [hostIndex] = submission;
+    }
+
+    /* Take every host's reference up front, so that a host which runs its submission straight
+       away cannot destroy the packet before the rest have theirs. */
+    if (bus -> hostCount > 0)
+      ENET_ATOMIC_ADD (& packet -> referenceCount, bus -> hostCount);
+
+    for (hostIndex = 0; hostIndex < bus -> hostCount; ++ hostIndex)
+      enet_host_push_submission (bus -> hosts [hostIndex], submissions [hostIndex]);
+
+    if (bus -> hostCount == 0 && ENET_ATOMIC_LOAD_SIZE_ACQUIRE (& packet -> referenceCount) == 0)
+      enet_packet_destroy (packet);
+
+    enet_mutex_unlock (& bus -> mutex);
+
+    return 0;
+}
+
+/** @} */
@@ -6,6 +6,10 @@
 #include <string.h>
 #include "enet/enet.h"
 
+#if defined (__SSE2__) || defined (_M_X64) || (defined (_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#endif
+
 typedef struct _ENetSymbol
 {
     /* binary indexed tree of symbols */
@@ -43,6 +47,16 @@ typedef struct _ENetRangeCoder
 {
     /* only allocate enough symbols for reasonable MTUs, would need to be larger for large file compression */
     ENetSymbol symbols[4096];
+#ifndef ENET_CONTEXT_EXCLUSION
+    /* The root context gives every byte value a weight of ENET_CONTEXT_SYMBOL_MINIMUM plus its count,
+       so rather than walking its tree of up to 256 nodes it is kept as a flat table: rootSymbols maps
+       a value to its symbol node (0 if none yet), rootWeights holds the weights and rootBlocks their
+       sums over each run of 16 values. Cumulative frequencies come out identical to the tree walk,
+       so the coded stream is unchanged. */
+    enet_uint16 rootSymbols [256];
+    enet_uint16 rootWeights [256];
+    enet_uint16 rootBlocks [16];
+#endif
 } ENetRangeCoder;
 
 void *
@@ -65,6 +79,15 @@ enet_range_coder_destroy (void * context)
     enet_free (rangeCoder);
 }
 
+/** Creates another range coder for a pipeline worker. The coder keeps no state between packets. */
+void *
+enet_range_coder_clone (void * context)
+{
+    (void) context;
+
+    return enet_range_coder_create ();
+}
+
 #define ENET_SYMBOL_CREATE(symbol, value_, count_) \
 { \
     symbol = & rangeCoder -> symbols [nextSymbol ++]; \
@@ -87,6 +110,161 @@ enet_range_coder_destroy (void * context)
     (context) -> symbols = 0; \
 }
 
+#ifndef ENET_CONTEXT_EXCLUSION
+static void
+enet_range_coder_root_reset (ENetRangeCoder * rangeCoder)
+{
+    int value;
+
+    memset (rangeCoder -> rootSymbols, 0, sizeof (rangeCoder -> rootSymbols));
+    for (value = 0; value < 256; ++ value)
+      rangeCoder -> rootWeights [value] = ENET_CONTEXT_SYMBOL_MINIMUM;
+    for (value = 0; value < 16; ++ value)
+      rangeCoder -> rootBlocks [value] = 16 * ENET_CONTEXT_SYMBOL_MINIMUM;
+}
+
+#if defined (__SSE2__) || defined (_M_X64) || (defined (_M_IX86_FP) && _M_IX86_FP >= 2)
+/* sum of the first count of 16 weights, from their running sums computed in two vectors by shifting and adding */
+static unsigned int
+enet_range_coder_root_sum (const enet_uint16 * weights, unsigned int count)
+{
+    enet_uint16 sums [17];
+    __m128i first = _mm_loadu_si128 ((const __m128i *) weights),
+            second = _mm_loadu_si128 ((const __m128i *) & weights [8]);
+
+    first = _mm_add_epi16 (first, _mm_slli_si128 (first, 2));
+    second = _mm_add_epi16 (second, _mm_slli_si128 (second, 2));
+    first = _mm_add_epi16 (first, _mm_slli_si128 (first, 4));
+    second = _mm_add_epi16 (second, _mm_slli_si128 (second, 4));
+    first = _mm_add_epi16 (first, _mm_slli_si128 (first, 8));
+    second = _mm_add_epi16 (second, _mm_slli_si128 (second, 8));
+
+    second = _mm_add_epi16 (second, _mm_unpackhi_epi64 (_mm_shufflehi_epi16 (first, 0xFF), _mm_shufflehi_epi16 (first, 0xFF)));
+
+    sums [0] = 0;
+    _mm_storeu_si128 ((__m128i *) & sums [1], first);
+    _mm_storeu_si128 ((__m128i *) & sums [9], second);
+
+    return sums [count];
+}
+#else
+static unsigned int
+enet_range_coder_root_sum (const enet_uint16 * weights, unsigned int count)
+{
+    unsigned int sum = 0, i;
+
+    for (i = 0; i < 16; ++ i)
+      sum += weights [i] & (0 - (unsigned int) (i < count));
+
+    return sum;
+}
+#endif
+
+/* sum of the weights of all values below value */
+static enet_uint16
+enet_range_coder_root_under (const ENetRangeCoder * rangeCoder, int value)
+{
+    return (enet_uint16) (enet_range_coder_root_sum (rangeCoder -> rootBlocks, (unsigned int) value >> 4) +
+                          enet_range_coder_root_sum (& rangeCoder -> rootWeights [value & ~15], (unsigned int) value & 15));
+}
+
+static void
+enet_range_coder_root_update (ENetRangeCoder * rangeCoder, int value, enet_uint16 update)
+{
+    rangeCoder -> rootWeights [value] += update;
+    rangeCoder -> rootBlocks [value >> 4] += update;
+}
+
+/* finds the value whose cumulative interval contains code, which must be below the sum of all weights;
+   plain loops that stop at the first block and weight past code beat vector scans here, as the scan
+   of the weights could only start once the scan of the blocks is done */
+static int
+enet_range_coder_root_find (const ENetRangeCoder * rangeCoder, enet_uint16 code, enet_uint16 * under)
+{
+    unsigned int cumulative = 0, block = 0;
+    const enet_uint16 * weight;
+
+    while (cumulative + rangeCoder -> rootBlocks [block] <= code)
+      cumulative += rangeCoder -> rootBlocks [block ++];
+    for (weight = & rangeCoder -> rootWeights [block << 4]; cumulative + * weight <= code; ++ weight)
+      cumulative += * weight;
+
+    * under = (enet_uint16) cumulative;
+    return (int) (weight - rangeCoder -> rootWeights);
+}
+
+#define ENET_ROOT_CREATE \
+{ \
+    ENET_CONTEXT_CREATE (root, ENET_CONTEXT_ESCAPE_MINIMUM, ENET_CONTEXT_SYMBOL_MINIMUM); \
+    enet_range_coder_root_reset (rangeCoder); \
+}
+
+#define ENET_ROOT_SYMBOL(symbol_, value_, count_, update) \
+{ \
+    enet_uint16 index = rangeCoder -> rootSymbols [value_]; \
+    if (index) \
+    { \
+        symbol_ = & rangeCoder -> symbols [index]; \
+        count_ = ENET_CONTEXT_SYMBOL_MINIMUM + symbol_ -> count; \
+        symbol_ -> count += update; \
+    } \
+    else \
+    { \
+        count_ = ENET_CONTEXT_SYMBOL_MINIMUM; \
+        ENET_SYMBOL_CREATE (symbol_, value_, update); \
+        rangeCoder -> rootSymbols [value_] = symbol_ - rangeCoder -> symbols; \
+    } \
+    enet_range_coder_root_update (rangeCoder, value_, update); \
+}
+
+#define ENET_ROOT_ENCODE(symbol_, value_, under_, count_, update) \
+{ \
+    under_ = enet_range_coder_root_under (rangeCoder, value_); \
+    ENET_ROOT_SYMBOL (symbol_, value_, count_, update); \
+}
+
+#define ENET_ROOT_DECODE(symbol_, code, value_, under_, count_, update) \
+{ \
+    if (code >= root -> total - root -> escapes) \
+      return 0; \
+    value_ = (enet_uint8) enet_range_coder_root_find (rangeCoder, code, & under_); \
+    ENET_ROOT_SYMBOL (symbol_, value_, count_, update); \
+}
+
+#define ENET_ROOT_RESCALE \
+{ \
+    int rescaleValue; \
+    root -> total = 0; \
+    for (rescaleValue = 0; rescaleValue < 256; ++ rescaleValue) \
+    { \
+        enet_uint16 index = rangeCoder -> rootSymbols [rescaleValue]; \
+        if (index) \
+        { \
+            ENetSymbol * rescaled = & rangeCoder -> symbols [index]; \
+            rescaled -> count -= rescaled -> count >> 1; \
+            root -> total += rescaled -> count; \
+            rangeCoder -> rootWeights [rescaleValue] = ENET_CONTEXT_SYMBOL_MINIMUM + rescaled -> count; \
+        } \
+        if ((rescaleValue & 15) == 15) \
+        { \
+            int rescaleBlock; \
+            rangeCoder -> rootBlocks [rescaleValue >> 4] = 0; \
+            for (rescaleBlock = rescaleValue - 15; rescaleBlock <= rescaleValue; ++ rescaleBlock) \
+              rangeCoder -> rootBlocks [rescaleValue >> 4] += rangeCoder -> rootWeights [rescaleBlock]; \
+        } \
+    } \
+    root -> escapes -= root -> escapes >> 1; \
+    root -> total += root -> escapes + 256*ENET_CONTEXT_SYMBOL_MINIMUM; \
+}
+#else
+#define ENET_ROOT_CREATE ENET_CONTEXT_CREATE (root, ENET_CONTEXT_ESCAPE_MINIMUM, ENET_CONTEXT_SYMBOL_MINIMUM)
+
+#define ENET_ROOT_ENCODE(symbol_, value_, under_, count_, update) \
+    ENET_CONTEXT_ENCODE (root, symbol_, value_, under_, count_, update, ENET_CONTEXT_SYMBOL_MINIMUM)
+
+#define ENET_ROOT_RESCALE ENET_CONTEXT_RESCALE (root, ENET_CONTEXT_SYMBOL_MINIMUM)
+#endif
+
 static enet_uint16
 enet_symbol_rescale (ENetSymbol * symbol)
 {
@@ -150,7 +328,7 @@ enet_symbol_rescale (ENetSymbol * symbol)
     if (nextSymbol >= sizeof (rangeCoder -> symbols) / sizeof (ENetSymbol) - ENET_SUBCONTEXT_ORDER ) \
     { \
         nextSymbol = 0; \
-        ENET_CONTEXT_CREATE (root, ENET_CONTEXT_ESCAPE_MINIMUM, ENET_CONTEXT_SYMBOL_MINIMUM); \
+        ENET_ROOT_CREATE; \
         predicted = 0; \
         order = 0; \
     } \
@@ -262,7 +440,7 @@ enet_range_coder_compress (void * context, const ENetBuffer * inBuffers, size_t
     inBuffers ++;
     inBufferCount --;
 
-    ENET_CONTEXT_CREATE (root, ENET_CONTEXT_ESCAPE_MINIMUM, ENET_CONTEXT_SYMBOL_MINIMUM);
+    ENET_ROOT_CREATE;
 
     for (;;)
     {
@@ -274,6 +452,12 @@ enet_range_coder_compress (void * context, const ENetBuffer * inBuffers, size_t
         enet_uint16 count, under, * parent = & predicted, total;
         if (inData >= inEnd)
         {
+            /* zero-length packets leave empty buffers among the commands */
+            while (inBufferCount > 0 && inBuffers -> dataLength <= 0)
+            {
+                inBuffers ++;
+                inBufferCount --;
+            }
             if (inBufferCount <= 0)
               break;
             inData = (const enet_uint8 *) inBuffers -> data;
@@ -315,7 +499,7 @@ enet_range_coder_compress (void * context, const ENetBuffer * inBuffers, size_t
             if (count > 0) goto nextInput;
         }
 
-        ENET_CONTEXT_ENCODE (root, symbol, value, under, count, ENET_CONTEXT_SYMBOL_DELTA, ENET_CONTEXT_SYMBOL_MINIMUM);
+        ENET_ROOT_ENCODE (symbol, value, under, count, ENET_CONTEXT_SYMBOL_DELTA);
         * parent = symbol - rangeCoder -> symbols;
         parent = & symbol -> parent;
         total = root -> total;
@@ -326,7 +510,7 @@ enet_range_coder_compress (void * context, const ENetBuffer * inBuffers, size_t
         ENET_RANGE_CODER_ENCODE (root -> escapes + under, count, total);
         root -> total += ENET_CONTEXT_SYMBOL_DELTA; 
         if (count > 0xFF - 2*ENET_CONTEXT_SYMBOL_DELTA + ENET_CONTEXT_SYMBOL_MINIMUM || root -> total > ENET_RANGE_CODER_BOTTOM - 0x100)
-          ENET_CONTEXT_RESCALE (root, ENET_CONTEXT_SYMBOL_MINIMUM);
+          ENET_ROOT_RESCALE;
 
     nextInput:
         if (order >= ENET_SUBCONTEXT_ORDER) 
@@ -343,7 +527,7 @@ enet_range_coder_compress (void * context, const ENetBuffer * inBuffers, size_t
 
 #define ENET_RANGE_CODER_SEED \
 { \
-    if (inData < inEnd) decodeCode |= * inData ++ << 24; \
+    if (inData < inEnd) decodeCode |= (enet_uint32) * inData ++ << 24; \
     if (inData < inEnd) decodeCode |= * inData ++ << 16; \
     if (inData < inEnd) decodeCode |= * inData ++ << 8; \
     if (inData < inEnd) decodeCode |= * inData ++; \
@@ -513,7 +697,7 @@ enet_range_coder_decompress (void * context, const enet_uint8 * inData, size_t i
     if (rangeCoder == NULL || inLimit <= 0)
       return 0;
 
-    ENET_CONTEXT_CREATE (root, ENET_CONTEXT_ESCAPE_MINIMUM, ENET_CONTEXT_SYMBOL_MINIMUM);
+    ENET_ROOT_CREATE;
 
     ENET_RANGE_CODER_SEED;
 
@@ -585,15 +769,17 @@ enet_range_coder_decompress (void * context, const enet_uint8 * inData, size_t i
             ENET_CONTEXT_ROOT_DECODE (root, symbol, code, value, under, count, ENET_CONTEXT_SYMBOL_DELTA, ENET_CONTEXT_SYMBOL_MINIMUM, ENET_CONTEXT_EXCLUDED); 
         }
         else
-#endif
         {
             ENET_CONTEXT_ROOT_DECODE (root, symbol, code, value, under, count, ENET_CONTEXT_SYMBOL_DELTA, ENET_CONTEXT_SYMBOL_MINIMUM, ENET_CONTEXT_NOT_EXCLUDED); 
         }
+#else
+        ENET_ROOT_DECODE (symbol, code, value, under, count, ENET_CONTEXT_SYMBOL_DELTA);
+#endif
         bottom = symbol - rangeCoder -> symbols;
         ENET_RANGE_CODER_DECODE (root -> escapes + under, count, total);
         root -> total += ENET_CONTEXT_SYMBOL_DELTA;
         if (count > 0xFF - 2*ENET_CONTEXT_SYMBOL_DELTA + ENET_CONTEXT_SYMBOL_MINIMUM || root -> total > ENET_RANGE_CODER_BOTTOM - 0x100)
-          ENET_CONTEXT_RESCALE (root, ENET_CONTEXT_SYMBOL_MINIMUM);
+          ENET_ROOT_RESCALE;
 
     patchContexts:
         for (patch = & rangeCoder -> symbols [predicted];
@@ -645,6 +831,7 @@ enet_host_compress_with_range_coder (ENetHost * host)
     compressor.compress = enet_range_coder_compress;
     compressor.decompress = enet_range_coder_decompress;
     compressor.destroy = enet_range_coder_destroy;
+    compressor.clone = enet_range_coder_clone;
     enet_host_compress (host, & compressor);
     return 0;
 }
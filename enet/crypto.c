@@ -0,0 +1,695 @@
+/**
+ @file  crypto.c
+ @brief ENet packet protection with ChaCha20-Poly1305 (RFC 8439)
+*/
+#include <string.h>
+#define ENET_BUILDING_LIB 1
+#include "enet/enet.h"
+
+#if (defined (__x86_64__) || defined (__i386__)) && (defined (__clang__) || (defined (__GNUC__) && __GNUC__ >= 5))
+#include <cpuid.h>
+#include <immintrin.h>
+#define ENET_CRYPTO_X86 1
+#define ENET_CRYPTO_TARGET(isa) __attribute__ ((target (isa)))
+#elif defined (_MSC_VER) && (defined (_M_X64) || defined (_M_IX86)) && _MSC_VER >= 1700
+#include <intrin.h>
+#include <immintrin.h>
+#define ENET_CRYPTO_X86 1
+#define ENET_CRYPTO_TARGET(isa)
+#endif
+
+/** @defgroup crypto ENet packet protection functions
+    @{
+*/
+
+/** XORs the ChaCha20 key stream for state into data, advancing the block counter in state[12].
+    Vectorized versions only handle whole groups of blocks and return how many bytes they did.
+*/
+typedef size_t (* ENetChaChaXor) (enet_uint32 * state, enet_uint8 * data, size_t dataLength);
+
+static ENetChaChaXor chachaXorWide = NULL;
+static ENetChaChaXor chachaXorNarrow = NULL;
+static int cryptoInitialized = 0;
+
+static enet_uint32
+enet_crypto_load_32 (const enet_uint8 * data)
+{
+    return (enet_uint32) data [0] | ((enet_uint32) data [1] << 8) | ((enet_uint32) data [2] << 16) | ((enet_uint32) data [3] << 24);
+}
+
+static void
+enet_crypto_store_32 (enet_uint8 * data, enet_uint32 value)
+{
+    data [0] = (enet_uint8) value;
+    data [1] = (enet_uint8) (value >> 8);
+    data [2] = (enet_uint8) (value >> 16);
+    data [3] = (enet_uint8) (value >> 24);
+}
+
+#define ENET_CHACHA_ROTATE(value, count) (((value) << (count)) | ((value) >> (32 - (count))))
+
+#define ENET_CHACHA_QUARTER_ROUND(a, b, c, d) \
+    do { \
+        a += b; d ^= a; d = ENET_CHACHA_ROTATE (d, 16); \
+        c += d; b ^= c; b = ENET_CHACHA_ROTATE (b, 12); \
+        a += b; d ^= a; d = ENET_CHACHA_ROTATE (d, 8); \
+        c += d; b ^= c; b = ENET_CHACHA_ROTATE (b, 7); \
+    } while (0)
+
+static void
+enet_chacha20_rounds (enet_uint32 * x)
+{
+    int round;
+
+    for (round = 0; round < 10; ++ round)
+    {
+        ENET_CHACHA_QUARTER_ROUND (x [0], x [4], x [8], x [12]);
+        ENET_CHACHA_QUARTER_ROUND (x [1], x [5], x [9], x [13]);
+        ENET_CHACHA_QUARTER_ROUND (x [2], x [6], x [10], x [14]);
+        ENET_CHACHA_QUARTER_ROUND (x [3], x [7], x [11], x [15]);
+        ENET_CHACHA_QUARTER_ROUND (x [0], x [5], x [10], x [15]);
+        ENET_CHACHA_QUARTER_ROUND (x [1], x [6], x [11], x [12]);
+        ENET_CHACHA_QUARTER_ROUND (x [2], x [7], x [8], x [13]);
+        ENET_CHACHA_QUARTER_ROUND (x [3], x [4], x [9], x [14]);
+    }
+}
+
+static void
+enet_chacha20_setup (enet_uint32 * state, const enet_uint8 * key, enet_uint32 counter, const enet_uint8 * nonce)
+{
+    int i;
+
+    state [0] = 0x61707865;
+    state [1] = 0x3320646e;
+    state [2] = 0x79622d32;
+    state [3] = 0x6b206574;
+    for (i = 0; i < 8; ++ i)
+      state [4 + i] = enet_crypto_load_32 (& key [i * 4]);
+    state [12] = counter;
+    state [13] = enet_crypto_load_32 (& nonce [0]);
+    state [14] = enet_crypto_load_32 (& nonce [4]);
+    state [15] = enet_crypto_load_32 (& nonce [8]);
+}
+
+static void
+enet_chacha20_block (enet_uint32 * state, enet_uint8 * block)
+{
+    enet_uint32 x [16];
+    int i;
+
+    memcpy (x, state, sizeof (x));
+
+    enet_chacha20_rounds (x);
+
+    for (i = 0; i < 16; ++ i)
+      enet_crypto_store_32 (& block [i * 4], x [i] + state [i]);
+
+    ++ state [12];
+}
+
+static size_t
+enet_chacha20_xor_scalar (enet_uint32 * state, enet_uint8 * data, size_t dataLength)
+{
+    enet_uint8 block [64];
+    size_t offset, i;
+
+    for (offset = 0; offset < dataLength; offset += 64)
+    {
+        size_t blockLength = dataLength - offset < 64 ? dataLength - offset : 64;
+
+        enet_chacha20_block (state, block);
+
+        for (i = 0; i < blockLength; ++ i)
+          data [offset + i] ^= block [i];
+    }
+
+    return dataLength;
+}
+
+#ifdef ENET_CRYPTO_X86
+
+#define ENET_CHACHA_ROTATE_SSE2(value, count) _mm_or_si128 (_mm_slli_epi32 (value, count), _mm_srli_epi32 (value, 32 - (count)))
+
+#define ENET_CHACHA_QUARTER_ROUND_SSE2(a, b, c, d) \
+    do { \
+        a = _mm_add_epi32 (a, b); d = _mm_xor_si128 (d, a); d = ENET_CHACHA_ROTATE_SSE2 (d, 16); \
+        c = _mm_add_epi32 (c, d); b = _mm_xor_si128 (b, c); b = ENET_CHACHA_ROTATE_SSE2 (b, 12); \
+        a = _mm_add_epi32 (a, b); d = _mm_xor_si128 (d, a); d = ENET_CHACHA_ROTATE_SSE2 (d, 8); \
+        c = _mm_add_epi32 (c, d); b = _mm_xor_si128 (b, c); b = ENET_CHACHA_ROTATE_SSE2 (b, 7); \
+    } while (0)
+
+/** Four blocks at a time, one block per 32-bit lane, transposed back into byte order for the XOR. */
+ENET_CRYPTO_TARGET ("sse2") static size_t
+enet_chacha20_xor_sse2 (enet_uint32 * state, enet_uint8 * data, size_t dataLength)
+{
+    size_t offset;
+
+    for (offset = 0; dataLength - offset >= 256; offset += 256)
+    {
+        __m128i s [16], x [16];
+        int i, round;
+
+        for (i = 0; i < 16; ++ i)
+          s [i] = _mm_set1_epi32 ((int) state [i]);
+        s [12] = _mm_add_epi32 (s [12], _mm_set_epi32 (3, 2, 1, 0));
+
+        for (i = 0; i < 16; ++ i)
+          x [i] = s [i];
+
+        for (round = 0; round < 10; ++ round)
+        {
+            ENET_CHACHA_QUARTER_ROUND_SSE2 (x [0], x [4], x [8], x [12]);
+            ENET_CHACHA_QUARTER_ROUND_SSE2 (x [1], x [5], x [9], x [13]);
+            ENET_CHACHA_QUARTER_ROUND_SSE2 (x [2], x [6], x [10], x [14]);
+            ENET_CHACHA_QUARTER_ROUND_SSE2 (x [3], x [7], x [11], x [15]);
+            ENET_CHACHA_QUARTER_ROUND_SSE2 (x [0], x [5], x [10], x [15]);
+            ENET_CHACHA_QUARTER_ROUND_SSE2 (x [1], x [6], x [11], x [12]);
+            ENET_CHACHA_QUARTER_ROUND_SSE2 (x [2], x [7], x [8], x [13]);
+            ENET_CHACHA_QUARTER_ROUND_SSE2 (x [3], x [4], x [9], x [14]);
+        }
+
+        for (i = 0; i < 16; ++ i)
+          x [i] = _mm_add_epi32 (x [i], s [i]);
+
+        for (i = 0; i < 16; i += 4)
+        {
+            __m128i t0 = _mm_unpacklo_epi32 (x [i], x [i + 1]),
+                    t1 = _mm_unpackhi_epi32 (x [i], x [i + 1]),
+                    t2 = _mm_unpacklo_epi32 (x [i + 2], x [i + 3]),
+                    t3 = _mm_unpackhi_epi32 (x [i + 2], x [i + 3]),
+                    u [4];
+            int block;
+
+            u [0] = _mm_unpacklo_epi64 (t0, t2);
+            u [1] = _mm_unpackhi_epi64 (t0, t2);
+            u [2] = _mm_unpacklo_epi64 (t1, t3);
+            u [3] = _mm_unpackhi_epi64 (t1, t3);
+
+            for (block = 0; block < 4; ++ block)
+            {
+                __m128i * p = (__m128i *) & data [offset + block * 64 + i * 4];
+
+                _mm_storeu_si128 (p, _mm_xor_si128 (_mm_loadu_si128 (p), u [block]));
+            }
+        }
+
+        state [12] += 4;
+    }
+
+    return offset;
+}
+
+#define ENET_CHACHA_ROTATE_AVX2(value, count) _mm256_or_si256 (_mm256_slli_epi32 (value, count), _mm256_srli_epi32 (value, 32 - (count)))
+
+#define ENET_CHACHA_QUARTER_ROUND_AVX2(a, b, c, d) \
+    do { \
+        a = _mm256_add_epi32 (a, b); d = _mm256_xor_si256 (d, a); d = _mm256_shuffle_epi8 (d, rotate16); \
+        c = _mm256_add_epi32 (c, d); b = _mm256_xor_si256 (b, c); b = ENET_CHACHA_ROTATE_AVX2 (b, 12); \
+        a = _mm256_add_epi32 (a, b); d = _mm256_xor_si256 (d, a); d = _mm256_shuffle_epi8 (d, rotate8); \
+        c = _mm256_add_epi32 (c, d); b = _mm256_xor_si256 (b, c); b = ENET_CHACHA_ROTATE_AVX2 (b, 7); \
+    } while (0)
+
+/** Eight blocks at a time. After the in-lane transpose each register holds 16 bytes of block k in
+    its low half and of block k + 4 in its high half, which the final permutes pair up.
+*/
+ENET_CRYPTO_TARGET ("avx2") static size_t
+enet_chacha20_xor_avx2 (enet_uint32 * state, enet_uint8 * data, size_t dataLength)
+{
+    const __m256i rotate16 = _mm256_set_epi8 (13, 12, 15, 14, 9, 8, 11, 10, 5, 4, 7, 6, 1, 0, 3, 2,
+                                              13, 12, 15, 14, 9, 8, 11, 10, 5, 4, 7, 6, 1, 0, 3, 2),
+                  rotate8 = _mm256_set_epi8 (14, 13, 12, 15, 10, 9, 8, 11, 6, 5, 4, 7, 2, 1, 0, 3,
+                                             14, 13, 12, 15, 10, 9, 8, 11, 6, 5, 4, 7, 2, 1, 0, 3);
+    size_t offset;
+
+    for (offset = 0; dataLength - offset >= 512; offset += 512)
+    {
+        __m256i s [16], x [16], u [4] [4];
+        int i, round, block;
+
+        for (i = 0; i < 16; ++ i)
+          s [i] = _mm256_set1_epi32 ((int) state [i]);
+        s [12] = _mm256_add_epi32 (s [12], _mm256_set_epi32 (7, 6, 5, 4, 3, 2, 1, 0));
+
+        for (i = 0; i < 16; ++ i)
+          x [i] = s [i];
+
+        for (round = 0; round < 10; ++ round)
+        {
+            ENET_CHACHA_QUARTER_ROUND_AVX2 (x [0], x [4], x [8], x [12]);
+            ENET_CHACHA_QUARTER_ROUND_AVX2 (x [1], x [5], x [9], x [13]);
+            ENET_CHACHA_QUARTER_ROUND_AVX2 (x [2], x [6], x [10], x [14]);
+            ENET_CHACHA_QUARTER_ROUND_AVX2 (x [3], x [7], x [11], x [15]);
+            ENET_CHACHA_QUARTER_ROUND_AVX2 (x [0], x [5], x [10], x [15]);
+            ENET_CHACHA_QUARTER_ROUND_AVX2 (x [1], x [6], x [11], x [12]);
+            ENET_CHACHA_QUARTER_ROUND_AVX2 (x [2], x [7], x [8], x [13]);
+            ENET_CHACHA_QUARTER_ROUND_AVX2 (x [3], x [4], x [9], x [14]);
+        }
+
+        for (i = 0; i < 16; ++ i)
+          x [i] = _mm256_add_epi32 (x [i], s [i]);
+
+        for (i = 0; i < 4; ++ i)
+        {
+            __m256i t0 = _mm256_unpacklo_epi32 (x [i * 4], x [i * 4 + 1]),
+                    t1 = _mm256_unpackhi_epi32 (x [i * 4], x [i * 4 + 1]),
+                    t2 = _mm256_unpacklo_epi32 (x [i * 4 + 2], x [i * 4 + 3]),
+                    t3 = _mm256_unpackhi_epi32 (x [i * 4 + 2], x [i * 4 + 3]);
+
+            u [i] [0] = _mm256_unpacklo_epi64 (t0, t2);
+            u [i] [1] = _mm256_unpackhi_epi64 (t0, t2);
+            u [i] [2] = _mm256_unpacklo_epi64 (t1, t3);
+            u [i] [3] = _mm256_unpackhi_epi64 (t1, t3);
+        }
+
+        for (block = 0; block < 4; ++ block)
+        {
+            __m256i * low = (__m256i *) & data [offset + block * 64],
+                    * high = (__m256i *) & data [offset + (block + 4) * 64];
+
+            _mm256_storeu_si256 (low, _mm256_xor_si256 (_mm256_loadu_si256 (low), _mm256_permute2x128_si256 (u [0] [block], u [1] [block], 0x20)));
+            _mm256_storeu_si256 (low + 1, _mm256_xor_si256 (_mm256_loadu_si256 (low + 1), _mm256_permute2x128_si256 (u [2] [block], u [3] [block], 0x20)));
+            _mm256_storeu_si256 (high, _mm256_xor_si256 (_mm256_loadu_si256 (high), _mm256_permute2x128_si256 (u [0] [block], u [1] [block], 0x31)));
+            _mm256_storeu_si256 (high + 1, _mm256_xor_si256 (_mm256_loadu_si256 (high + 1), _mm256_permute2x128_si256 (u [2] [block], u [3] [block], 0x31)));
+        }
+
+        state [12] += 8;
+    }
+
+    return offset;
+}
+
+static void
+enet_crypto_cpuid (unsigned int leaf, unsigned int * ebx, unsigned int * ecx, unsigned int * edx)
+{
+#ifdef _MSC_VER
+    int info [4];
+
+    __cpuid (info, 0);
+    if ((unsigned int) info [0] < leaf)
+    {
+        * ebx = * ecx = * edx = 0;
+        return;
+    }
+
+    __cpuidex (info, (int) leaf, 0);
+    * ebx = (unsigned int) info [1];
+    * ecx = (unsigned int) info [2];
+    * edx = (unsigned int) info [3];
+#else
+    unsigned int eax;
+
+    if (__get_cpuid_max (0, NULL) < leaf)
+    {
+        * ebx = * ecx = * edx = 0;
+        return;
+    }
+
+    __cpuid_count (leaf, 0, eax, * ebx, * ecx, * edx);
+#endif
+}
+
+/** AVX2 also needs the OS to save the YMM registers, which XGETBV reports once OSXSAVE is set. */
+static int
+enet_crypto_has_avx2 (void)
+{
+    unsigned int ebx, ecx, edx, xcr0;
+
+    enet_crypto_cpuid (1, & ebx, & ecx, & edx);
+    if (! (ecx & (1 << 27)) || ! (ecx & (1 << 28)))
+      return 0;
+
+#ifdef _MSC_VER
+    xcr0 = (unsigned int) _xgetbv (0);
+#else
+    __asm__ ("xgetbv" : "=a" (xcr0) : "c" (0) : "%edx");
+#endif
+    if ((xcr0 & 6) != 6)
+      return 0;
+
+    enet_crypto_cpuid (7, & ebx, & ecx, & edx);
+
+    return (ebx & (1 << 5)) != 0;
+}
+
+#endif /* ENET_CRYPTO_X86 */
+
+/** Selects the fastest ChaCha20 implementations supported by the running CPU.
+    Called by enet_initialize(); safe to call again.
+*/
+void
+enet_crypto_initialize (void)
+{
+    if (cryptoInitialized)
+      return;
+
+#ifdef ENET_CRYPTO_X86
+    {
+        unsigned int ebx, ecx, edx;
+
+        enet_crypto_cpuid (1, & ebx, & ecx, & edx);
+
+        /* EDX bit 26: SSE2 */
+        if (edx & (1 << 26))
+          chachaXorNarrow = enet_chacha20_xor_sse2;
+        if (chachaXorNarrow != NULL && enet_crypto_has_avx2 ())
+          chachaXorWide = enet_chacha20_xor_avx2;
+    }
+#endif
+
+    cryptoInitialized = 1;
+}
+
+static void
+enet_chacha20_xor (enet_uint32 * state, enet_uint8 * data, size_t dataLength)
+{
+    size_t offset = 0;
+
+    if (! cryptoInitialized)
+      enet_crypto_initialize ();
+
+    if (chachaXorWide != NULL)
+      offset += chachaXorWide (state, data, dataLength);
+    if (chachaXorNarrow != NULL)
+      offset += chachaXorNarrow (state, data + offset, dataLength - offset);
+
+    enet_chacha20_xor_scalar (state, data + offset, dataLength - offset);
+}
+
+#if defined (__SIZEOF_INT128__)
+
+/* Poly1305 in three 44/44/42 bit limbs with 128 bit products */
+typedef unsigned long long ENetPolyLimb;
+typedef unsigned __int128 ENetPolyProduct;
+
+typedef struct _ENetPoly1305
+{
+    ENetPolyLimb r [3], h [3];
+    enet_uint8 pad [16];
+} ENetPoly1305;
+
+static ENetPolyLimb
+enet_poly1305_load_64 (const enet_uint8 * data)
+{
+    return (ENetPolyLimb) enet_crypto_load_32 (data) | ((ENetPolyLimb) enet_crypto_load_32 (data + 4) << 32);
+}
+
+static void
+enet_poly1305_setup (ENetPoly1305 * poly, const enet_uint8 * key)
+{
+    ENetPolyLimb t0 = enet_poly1305_load_64 (key),
+                 t1 = enet_poly1305_load_64 (key + 8);
+
+    poly -> r [0] = t0 & 0xffc0fffffffULL;
+    poly -> r [1] = ((t0 >> 44) | (t1 << 20)) & 0xfffffc0ffffULL;
+    poly -> r [2] = (t1 >> 24) & 0x00ffffffc0fULL;
+    poly -> h [0] = poly -> h [1] = poly -> h [2] = 0;
+    memcpy (poly -> pad, key + 16, 16);
+}
+
+static void
+enet_poly1305_blocks (ENetPoly1305 * poly, const enet_uint8 * data, size_t dataLength)
+{
+    const ENetPolyLimb mask44 = 0xfffffffffffULL, mask42 = 0x3ffffffffffULL;
+    ENetPolyLimb r0 = poly -> r [0], r1 = poly -> r [1], r2 = poly -> r [2],
+                 s1 = r1 * (5 << 2), s2 = r2 * (5 << 2),
+                 h0 = poly -> h [0], h1 = poly -> h [1], h2 = poly -> h [2],
+                 c;
+
+    for (; dataLength >= 16; data += 16, dataLength -= 16)
+    {
+        ENetPolyLimb t0 = enet_poly1305_load_64 (data),
+                     t1 = enet_poly1305_load_64 (data + 8);
+        ENetPolyProduct d0, d1, d2;
+
+        h0 += t0 & mask44;
+        h1 += ((t0 >> 44) | (t1 << 20)) & mask44;
+        h2 += ((t1 >> 24) & mask42) | ((ENetPolyLimb) 1 << 40);
+
+        d0 = (ENetPolyProduct) h0 * r0 + (ENetPolyProduct) h1 * s2 + (ENetPolyProduct) h2 * s1;
+        d1 = (ENetPolyProduct) h0 * r1 + (ENetPolyProduct) h1 * r0 + (ENetPolyProduct) h2 * s2;
+        d2 = (ENetPolyProduct) h0 * r2 + (ENetPolyProduct) h1 * r1 + (ENetPolyProduct) h2 * r0;
+
+        c = (ENetPolyLimb) (d0 >> 44); h0 = (ENetPolyLimb) d0 & mask44;
+        d1 += c; c = (ENetPolyLimb) (d1 >> 44); h1 = (ENetPolyLimb) d1 & mask44;
+        d2 += c; c = (ENetPolyLimb) (d2 >> 42); h2 = (ENetPolyLimb) d2 & mask42;
+        h0 += c * 5; c = h0 >> 44; h0 &= mask44;
+        h1 += c;
+    }
+
+    poly -> h [0] = h0;
+    poly -> h [1] = h1;
+    poly -> h [2] = h2;
+}
+
+static void
+enet_poly1305_finish (ENetPoly1305 * poly, enet_uint8 * tag)
+{
+    const ENetPolyLimb mask44 = 0xfffffffffffULL, mask42 = 0x3ffffffffffULL;
+    ENetPolyLimb h0 = poly -> h [0], h1 = poly -> h [1], h2 = poly -> h [2],
+                 g0, g1, g2, c, t0, t1;
+
+    c = h1 >> 44; h1 &= mask44;
+    h2 += c; c = h2 >> 42; h2 &= mask42;
+    h0 += c * 5; c = h0 >> 44; h0 &= mask44;
+    h1 += c; c = h1 >> 44; h1 &= mask44;
+    h2 += c; c = h2 >> 42; h2 &= mask42;
+    h0 += c * 5; c = h0 >> 44; h0 &= mask44;
+    h1 += c;
+
+    /* select h - p if it does not go negative */
+    g0 = h0 + 5; c = g0 >> 44; g0 &= mask44;
+    g1 = h1 + c; c = g1 >> 44; g1 &= mask44;
+    g2 = h2 + c - ((ENetPolyLimb) 1 << 42);
+
+    c = (g2 >> 63) - 1;
+    h0 = (h0 & ~ c) | (g0 & c);
+    h1 = (h1 & ~ c) | (g1 & c);
+    h2 = (h2 & ~ c) | (g2 & c);
+
+    t0 = enet_poly1305_load_64 (poly -> pad);
+    t1 = enet_poly1305_load_64 (poly -> pad + 8);
+
+    h0 += t0 & mask44; c = h0 >> 44; h0 &= mask44;
+    h1 += (((t0 >> 44) | (t1 << 20)) & mask44) + c; c = h1 >> 44; h1 &= mask44;
+    h2 += ((t1 >> 24) & mask42) + c; h2 &= mask42;
+
+    h0 = h0 | (h1 << 44);
+    h1 = (h1 >> 20) | (h2 << 24);
+
+    enet_crypto_store_32 (tag, (enet_uint32) h0);
+    enet_crypto_store_32 (tag + 4, (enet_uint32) (h0 >> 32));
+    enet_crypto_store_32 (tag + 8, (enet_uint32) h1);
+    enet_crypto_store_32 (tag + 12, (enet_uint32) (h1 >> 32));
+}
+
+#else
+
+/* Poly1305 in five 26 bit limbs with 64 bit products */
+typedef struct _ENetPoly1305
+{
+    enet_uint32 r [5], h [5];
+    enet_uint8 pad [16];
+} ENetPoly1305;
+
+#if defined (_MSC_VER) && _MSC_VER < 1300
+typedef unsigned __int64 ENetPolyProduct;
+#else
+typedef unsigned long long ENetPolyProduct;
+#endif
+
+static void
+enet_poly1305_setup (ENetPoly1305 * poly, const enet_uint8 * key)
+{
+    poly -> r [0] = enet_crypto_load_32 (& key [0]) & 0x3ffffff;
+    poly -> r [1] = (enet_crypto_load_32 (& key [3]) >> 2) & 0x3ffff03;
+    poly -> r [2] = (enet_crypto_load_32 (& key [6]) >> 4) & 0x3ffc0ff;
+    poly -> r [3] = (enet_crypto_load_32 (& key [9]) >> 6) & 0x3f03fff;
+    poly -> r [4] = (enet_crypto_load_32 (& key [12]) >> 8) & 0x00fffff;
+    memset (poly -> h, 0, sizeof (poly -> h));
+    memcpy (poly -> pad, key + 16, 16);
+}
+
+static void
+enet_poly1305_blocks (ENetPoly1305 * poly, const enet_uint8 * data, size_t dataLength)
+{
+    enet_uint32 r0 = poly -> r [0], r1 = poly -> r [1], r2 = poly -> r [2], r3 = poly -> r [3], r4 = poly -> r [4],
+                s1 = r1 * 5, s2 = r2 * 5, s3 = r3 * 5, s4 = r4 * 5,
+                h0 = poly -> h [0], h1 = poly -> h [1], h2 = poly -> h [2], h3 = poly -> h [3], h4 = poly -> h [4],
+                c;
+
+    for (; dataLength >= 16; data += 16, dataLength -= 16)
+    {
+        ENetPolyProduct d0, d1, d2, d3, d4;
+
+        h0 += enet_crypto_load_32 (& data [0]) & 0x3ffffff;
+        h1 += (enet_crypto_load_32 (& data [3]) >> 2) & 0x3ffffff;
+        h2 += (enet_crypto_load_32 (& data [6]) >> 4) & 0x3ffffff;
+        h3 += (enet_crypto_load_32 (& data [9]) >> 6) & 0x3ffffff;
+        h4 += (enet_crypto_load_32 (& data [12]) >> 8) | (1 << 24);
+
+        d0 = (ENetPolyProduct) h0 * r0 + (ENetPolyProduct) h1 * s4 + (ENetPolyProduct) h2 * s3 + (ENetPolyProduct) h3 * s2 + (ENetPolyProduct) h4 * s1;
+        d1 = (ENetPolyProduct) h0 * r1 + (ENetPolyProduct) h1 * r0 + (ENetPolyProduct) h2 * s4 + (ENetPolyProduct) h3 * s3 + (ENetPolyProduct) h4 * s2;
+        d2 = (ENetPolyProduct) h0 * r2 + (ENetPolyProduct) h1 * r1 + (ENetPolyProduct) h2 * r0 + (ENetPolyProduct) h3 * s4 + (ENetPolyProduct) h4 * s3;
+        d3 = (ENetPolyProduct) h0 * r3 + (ENetPolyProduct) h1 * r2 + (ENetPolyProduct) h2 * r1 + (ENetPolyProduct) h3 * r0 + (ENetPolyProduct) h4 * s4;
+        d4 = (ENetPolyProduct) h0 * r4 + (ENetPolyProduct) h1 * r3 + (ENetPolyProduct) h2 * r2 + (ENetPolyProduct) h3 * r1 + (ENetPolyProduct) h4 * r0;
+
+        c = (enet_uint32) (d0 >> 26); h0 = (enet_uint32) d0 & 0x3ffffff;
+        d1 += c; c = (enet_uint32) (d1 >> 26); h1 = (enet_uint32) d1 & 0x3ffffff;
+        d2 += c; c = (enet_uint32) (d2 >> 26); h2 = (enet_uint32) d2 & 0x3ffffff;
+        d3 += c; c = (enet_uint32) (d3 >> 26); h3 = (enet_uint32) d3 & 0x3ffffff;
+        d4 += c; c = (enet_uint32) (d4 >> 26); h4 = (enet_uint32) d4 & 0x3ffffff;
+        h0 += c * 5; c = h0 >> 26; h0 &= 0x3ffffff;
+        h1 += c;
+    }
+
+    poly -> h [0] = h0;
+    poly -> h [1] = h1;
+    poly -> h [2] = h2;
+    poly -> h [3] = h3;
+    poly -> h [4] = h4;
+}
+
+static void
+enet_poly1305_finish (ENetPoly1305 * poly, enet_uint8 * tag)
+{
+    enet_uint32 h0 = poly -> h [0], h1 = poly -> h [1], h2 = poly -> h [2], h3 = poly -> h [3], h4 = poly -> h [4],
+                g0, g1, g2, g3, g4, c, mask;
+    ENetPolyProduct f;
+
+    c = h1 >> 26; h1 &= 0x3ffffff;
+    h2 += c; c = h2 >> 26; h2 &= 0x3ffffff;
+    h3 += c; c = h3 >> 26; h3 &= 0x3ffffff;
+    h4 += c; c = h4 >> 26; h4 &= 0x3ffffff;
+    h0 += c * 5; c = h0 >> 26; h0 &= 0x3ffffff;
+    h1 += c;
+
+    /* select h - p if it does not go negative */
+    g0 = h0 + 5; c = g0 >> 26; g0 &= 0x3ffffff;
+    g1 = h1 + c; c = g1 >> 26; g1 &= 0x3ffffff;
+    g2 = h2 + c; c = g2 >> 26; g2 &= 0x3ffffff;
+    g3 = h3 + c; c = g3 >> 26; g3 &= 0x3ffffff;
+    g4 = h4 + c - (1 << 26);
+
+    mask = (g4 >> 31) - 1;
+    h0 = (h0 & ~ mask) | (g0 & mask);
+    h1 = (h1 & ~ mask) | (g1 & mask);
+    h2 = (h2 & ~ mask) | (g2 & mask);
+    h3 = (h3 & ~ mask) | (g3 & mask);
+    h4 = (h4 & ~ mask) | (g4 & mask);
+
+    h0 = (h0 | (h1 << 26)) & 0xffffffff;
+    h1 = ((h1 >> 6) | (h2 << 20)) & 0xffffffff;
+    h2 = ((h2 >> 12) | (h3 << 14)) & 0xffffffff;
+    h3 = ((h3 >> 18) | (h4 << 8)) & 0xffffffff;
+
+    f = (ENetPolyProduct) h0 + enet_crypto_load_32 (& poly -> pad [0]); enet_crypto_store_32 (& tag [0], (enet_uint32) f);
+    f = (ENetPolyProduct) h1 + enet_crypto_load_32 (& poly -> pad [4]) + (f >> 32); enet_crypto_store_32 (& tag [4], (enet_uint32) f);
+    f = (ENetPolyProduct) h2 + enet_crypto_load_32 (& poly -> pad [8]) + (f >> 32); enet_crypto_store_32 (& tag [8], (enet_uint32) f);
+    f = (ENetPolyProduct) h3 + enet_crypto_load_32 (& poly -> pad [12]) + (f >> 32); enet_crypto_store_32 (& tag [12], (enet_uint32) f);
+}
+
+#endif
+
+/** Feeds data into the MAC, zero padded to a whole number of blocks as the AEAD construction requires */
+static void
+enet_poly1305_padded (ENetPoly1305 * poly, const enet_uint8 * data, size_t dataLength)
+{
+    size_t wholeLength = dataLength & ~ (size_t) 15;
+
+    enet_poly1305_blocks (poly, data, wholeLength);
+
+    if (wholeLength < dataLength)
+    {
+        enet_uint8 block [16];
+
+        memset (block, 0, sizeof (block));
+        memcpy (block, data + wholeLength, dataLength - wholeLength);
+
+        enet_poly1305_blocks (poly, block, sizeof (block));
+    }
+}
+
+static void
+enet_chacha20_poly1305_tag (const enet_uint32 * state, const enet_uint8 * additionalData, size_t additionalDataLength, const enet_uint8 * data, size_t dataLength, enet_uint8 * tag)
+{
+    enet_uint32 keyState [16];
+    enet_uint8 polyKey [64], lengths [16];
+    ENetPoly1305 poly;
+
+    memcpy (keyState, state, sizeof (keyState));
+    keyState [12] = 0;
+    enet_chacha20_block (keyState, polyKey);
+
+    enet_poly1305_setup (& poly, polyKey);
+    enet_poly1305_padded (& poly, additionalData, additionalDataLength);
+    enet_poly1305_padded (& poly, data, dataLength);
+
+    enet_crypto_store_32 (& lengths [0], (enet_uint32) additionalDataLength);
+    enet_crypto_store_32 (& lengths [4], 0);
+    enet_crypto_store_32 (& lengths [8], (enet_uint32) dataLength);
+    enet_crypto_store_32 (& lengths [12], 0);
+    enet_poly1305_blocks (& poly, lengths, sizeof (lengths));
+
+    enet_poly1305_finish (& poly, tag);
+}
+
+/** Encrypts data in place with ChaCha20-Poly1305 and computes its authentication tag.
+    @param key 32 byte key
+    @param nonce 12 byte nonce, which must never repeat for the same key
+    @param additionalData data that is authenticated but not encrypted, may be NULL if additionalDataLength is 0
+    @param data plaintext on entry, ciphertext on return
+    @param tag receives the 16 byte tag
+*/
+void
+enet_chacha20_poly1305_encrypt (const enet_uint8 * key, const enet_uint8 * nonce, const enet_uint8 * additionalData, size_t additionalDataLength, enet_uint8 * data, size_t dataLength, enet_uint8 * tag)
+{
+    enet_uint32 state [16];
+
+    enet_chacha20_setup (state, key, 1, nonce);
+    enet_chacha20_xor (state, data, dataLength);
+
+    enet_chacha20_poly1305_tag (state, additionalData, additionalDataLength, data, dataLength, tag);
+}
+
+/** Checks the authentication tag of data and decrypts it in place with ChaCha20-Poly1305.
+    Data that fails to authenticate is left as it is.
+    @returns 0 on success, < 0 if the tag does not match
+*/
+int
+enet_chacha20_poly1305_decrypt (const enet_uint8 * key, const enet_uint8 * nonce, const enet_uint8 * additionalData, size_t additionalDataLength, enet_uint8 * data, size_t dataLength, const enet_uint8 * tag)
+{
+    enet_uint32 state [16];
+    enet_uint8 expectedTag [16], difference = 0;
+    int i;
+
+    enet_chacha20_setup (state, key, 1, nonce);
+    enet_chacha20_poly1305_tag (state, additionalData, additionalDataLength, data, dataLength, expectedTag);
+
+    for (i = 0; i < 16; ++ i)
+      difference |= expectedTag [i] ^ tag [i];
+    if (difference != 0)
+      return -1;
+
+    enet_chacha20_xor (state, data, dataLength);
+
+    return 0;
+}
+
+/** Derives a 32 byte session key from a 32 byte key and a 16 byte salt with HChaCha20. */
+void
+enet_crypto_derive_key (const enet_uint8 * key, const enet_uint8 * salt, enet_uint8 * sessionKey)
+{
+    enet_uint32 x [16];
+    int i;
+
+    enet_chacha20_setup (x, key, enet_crypto_load_32 (salt), salt + 4);
+    enet_chacha20_rounds (x);
+
+    for (i = 0; i < 4; ++ i)
+    {
+        enet_crypto_store_32 (& sessionKey [i * 4], x [i]);
+        enet_crypto_store_32 (& sessionKey [16 + i * 4], x [12 + i]);
+    }
+}
+
+/** @} */
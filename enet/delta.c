@@ -0,0 +1,213 @@
+/**
+ @file delta.c
+ @brief Delta encoding of packets against the previous packet on a channel
+*/
+#define ENET_BUILDING_LIB 1
+#include <string.h>
+#include "enet/utility.h"
+#include "enet/enet.h"
+
+/* A delta starts with a count that is 0 when the packet follows unchanged, and otherwise is one more
+   than the number of bytes at the end of the packet that repeat the end of the base. An encoded
+   packet then gives its length and a series of runs, each a count of bytes that repeat the base at
+   the same offset, a count of literal bytes and the literals themselves, until the runs reach the
+   repeated end. Counts are stored 7 bits per byte, least significant first, with the top bit set on
+   every byte but the last.
+
+   Runs are positional, so edits that keep the layout of a message, such as a changed counter or
+   status word, cost only the changed bytes; an insertion or deletion costs the bytes between it
+   and the repeated end.
+*/
+enum
+{
+    ENET_DELTA_MINIMUM_MATCH = 4
+};
+
+static enet_uint8 *
+enet_delta_write_count (enet_uint8 * outData, const enet_uint8 * outEnd, size_t count)
+{
+    do
+    {
+        if (outData >= outEnd)
+          return NULL;
+
+        * outData ++ = (enet_uint8) ((count & 0x7F) | (count > 0x7F ? 0x80 : 0));
+
+        count >>= 7;
+    } while (count > 0);
+
+    return outData;
+}
+
+static const enet_uint8 *
+enet_delta_read_count (const enet_uint8 * inData, const enet_uint8 * inEnd, size_t * count)
+{
+    size_t shift = 0;
+
+    * count = 0;
+
+    do
+    {
+        if (inData >= inEnd || shift > 14)
+          return NULL;
+
+        * count |= (size_t) (* inData & 0x7F) << shift;
+
+        shift += 7;
+    } while (* inData ++ & 0x80);
+
+    return inData;
+}
+
+static size_t
+enet_delta_match_length (const enet_uint8 * base, size_t baseLength, const enet_uint8 * data, size_t position, size_t limit)
+{
+    size_t matchLength = 0;
+
+    if (limit > baseLength)
+      limit = baseLength;
+
+    while (position + matchLength < limit && data [position + matchLength] == base [position + matchLength])
+      ++ matchLength;
+
+    return matchLength;
+}
+
+/** Encodes a packet against the previous delta encoded packet on its channel.
+    Falls back to sending the packet unchanged behind a one byte marker whenever the delta would not
+    be smaller, so outLimit must be at least dataLength + 1 for encoding to always succeed.
+    @param base        previous packet, or NULL
+    @param baseLength  length of the previous packet, 0 if there is none
+    @param data        packet to encode
+    @param dataLength  length of the packet
+    @param outData     receives the encoded packet
+    @param outLimit    size of outData
+    @returns the length of the encoded packet, 0 if it does not fit
+*/
+size_t
+enet_delta_encode (const enet_uint8 * base, size_t baseLength, const enet_uint8 * data, size_t dataLength, enet_uint8 * outData, size_t outLimit)
+{
+    enet_uint8 * outStart = outData;
+    const enet_uint8 * outEnd = outData + ENET_MIN (outLimit, dataLength + 1);
+    size_t suffixLength = 0, headLength, position = 0, limit = ENET_MIN (baseLength, dataLength);
+
+    if (baseLength > 0 && dataLength > 0)
+    {
+        while (suffixLength < limit && base [baseLength - suffixLength - 1] == data [dataLength - suffixLength - 1])
+          ++ suffixLength;
+
+        headLength = dataLength - suffixLength;
+
+        outData = enet_delta_write_count (outData, outEnd, suffixLength + 1);
+        if (outData != NULL)
+          outData = enet_delta_write_count (outData, outEnd, dataLength);
+
+        while (outData != NULL && position < headLength)
+        {
+            size_t matchLength = enet_delta_match_length (base, baseLength, data, position, headLength),
+                   literalEnd = position + matchLength;
+
+            while (literalEnd < headLength)
+            {
+                size_t runLength = enet_delta_match_length (base, baseLength, data, literalEnd, headLength);
+
+                if (runLength >= ENET_DELTA_MINIMUM_MATCH || (runLength > 0 && literalEnd + runLength >= headLength))
+                  break;
+
+                literalEnd += runLength > 0 ? runLength : 1;
+            }
+
+            outData = enet_delta_write_count (outData, outEnd, matchLength);
+            if (outData != NULL)
+              outData = enet_delta_write_count (outData, outEnd, literalEnd - position - matchLength);
+            if (outData == NULL || (size_t) (outEnd - outData) < literalEnd - position - matchLength)
+            {
+                outData = NULL;
+                break;
+            }
+
+            memcpy (outData, data + position + matchLength, literalEnd - position - matchLength);
+            outData += literalEnd - position - matchLength;
+
+            position = literalEnd;
+        }
+
+        if (outData != NULL && (size_t) (outData - outStart) <= dataLength)
+          return (size_t) (outData - outStart);
+    }
+
+    if (dataLength + 1 > outLimit)
+      return 0;
+
+    outStart [0] = 0;
+    memcpy (outStart + 1, data, dataLength);
+
+    return dataLength + 1;
+}
+
+/** Decodes a packet encoded by enet_delta_encode() against the same base.
+    @returns the length of the decoded packet, 0 if the encoded packet is malformed or does not fit
+*/
+size_t
+enet_delta_decode (const enet_uint8 * base, size_t baseLength, const enet_uint8 * inData, size_t inLimit, enet_uint8 * outData, size_t outLimit)
+{
+    const enet_uint8 * inEnd = inData + inLimit;
+    size_t suffixLength, dataLength, headLength, position = 0;
+
+    inData = enet_delta_read_count (inData, inEnd, & suffixLength);
+    if (inData == NULL)
+      return 0;
+
+    if (suffixLength == 0)
+    {
+        dataLength = inEnd - inData;
+        if (dataLength > outLimit)
+          return 0;
+
+        memcpy (outData, inData, dataLength);
+
+        return dataLength;
+    }
+
+    -- suffixLength;
+
+    inData = enet_delta_read_count (inData, inEnd, & dataLength);
+    if (inData == NULL ||
+        dataLength > outLimit ||
+        suffixLength > dataLength ||
+        suffixLength > baseLength)
+      return 0;
+
+    headLength = dataLength - suffixLength;
+
+    while (position < headLength)
+    {
+        size_t matchLength, literalLength;
+
+        inData = enet_delta_read_count (inData, inEnd, & matchLength);
+        if (inData == NULL)
+          return 0;
+        inData = enet_delta_read_count (inData, inEnd, & literalLength);
+        if (inData == NULL ||
+            matchLength + literalLength == 0 ||
+            matchLength > headLength - position ||
+            matchLength > baseLength - ENET_MIN (position, baseLength) ||
+            literalLength > headLength - position - matchLength ||
+            literalLength > (size_t) (inEnd - inData))
+          return 0;
+
+        memcpy (outData + position, base + position, matchLength);
+        position += matchLength;
+
+        memcpy (outData + position, inData, literalLength);
+        inData += literalLength;
+        position += literalLength;
+    }
+
+    if (inData != inEnd)
+      return 0;
+
+    memcpy (outData + headLength, base + baseLength - suffixLength, suffixLength);
+
+    return dataLength;
+}
@@ -97,14 +97,38 @@ SOURCE=.\list.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\lz.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\migrate.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\bus.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\callbacks.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\checksum.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\compress.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\crypto.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\delta.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\packet.c
 # End Source File
 # Begin Source File
@@ -113,10 +137,26 @@ SOURCE=.\peer.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\pipeline.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\protocol.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\shard.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\statistics.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\thread.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\unix.c
 # End Source File
 # Begin Source File
@@ -163,6 +203,14 @@ SOURCE=.\include\enet\utility.h
 
 SOURCE=.\include\enet\win32.h
 # End Source File
+# Begin Source File
+
+SOURCE=.\include\enet\atomic.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\include\enet\coroutine.hpp
+# End Source File
 # End Group
 # End Target
 # End Project
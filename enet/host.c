@@ -4,7 +4,10 @@
 */
 #define ENET_BUILDING_LIB 1
 #include <string.h>
+#include "enet/utility.h"
+#include "enet/time.h"
 #include "enet/enet.h"
+#include "enet/atomic.h"
 
 /** @defgroup host ENet host functions
     @{
@@ -13,7 +16,11 @@
 /** Creates a host for communicating to peers.  
 
     @param address   the address at which other peers may connect to this host.  If NULL, then no peers may connect to the host.
-    @param peerCount the maximum number of peers that should be allocated for the host.
+    @param peerCount the maximum number of peers that may be allocated for the host.  Peers are allocated
+    in chunks of ENET_HOST_PEER_CHUNK_SIZE as connections arrive, and stay allocated, so that pointers
+    to them remain valid, unless enet_host_release_peer_chunks() is enabled.  Peers with IDs
+    from ENET_PROTOCOL_EXTENDED_PEER_ID upwards are only handed out to remote hosts that negotiate
+    ENET_PROTOCOL_CAPABILITY_EXTENDED_PEER_ID, up to a total of ENET_PROTOCOL_MAXIMUM_EXTENDED_PEER_ID.
     @param channelLimit the maximum number of channels allowed; if 0, then this is equivalent to ENET_PROTOCOL_MAXIMUM_CHANNEL_COUNT
     @param incomingBandwidth downstream bandwidth of the host in bytes/second; if 0, ENet will assume unlimited bandwidth.
     @param outgoingBandwidth upstream bandwidth of the host in bytes/second; if 0, ENet will assume unlimited bandwidth.
@@ -29,24 +36,46 @@ ENetHost *
 enet_host_create (const ENetAddress * address, size_t peerCount, size_t channelLimit, enet_uint32 incomingBandwidth, enet_uint32 outgoingBandwidth)
 {
     ENetHost * host;
-    ENetPeer * currentPeer;
+    ENetList * bucket;
 
-    if (peerCount > ENET_PROTOCOL_MAXIMUM_PEER_ID)
+    if (peerCount > ENET_PROTOCOL_MAXIMUM_EXTENDED_PEER_ID)
       return NULL;
 
+    /* the extended peer ID marker and the legacy "no peer" ID are never handed out, so a peer table
+       that reaches them is made that much larger to still hold peerCount peers */
+    if (peerCount > ENET_PROTOCOL_EXTENDED_PEER_ID)
+      peerCount = ENET_MIN (peerCount + ENET_PROTOCOL_MAXIMUM_PEER_ID + 1 - ENET_PROTOCOL_EXTENDED_PEER_ID,
+                            ENET_PROTOCOL_MAXIMUM_EXTENDED_PEER_ID);
+
     host = (ENetHost *) enet_malloc (sizeof (ENetHost));
     if (host == NULL)
       return NULL;
     memset (host, 0, sizeof (ENetHost));
 
-    host -> peers = (ENetPeer *) enet_malloc (peerCount * sizeof (ENetPeer));
-    if (host -> peers == NULL)
+    host -> peerChunkCount = (peerCount + ENET_HOST_PEER_CHUNK_SIZE - 1) / ENET_HOST_PEER_CHUNK_SIZE;
+    host -> peerChunks = (ENetPeerChunk *) enet_malloc (host -> peerChunkCount * sizeof (ENetPeerChunk));
+    if (host -> peerChunks == NULL)
     {
        enet_free (host);
 
        return NULL;
     }
-    memset (host -> peers, 0, peerCount * sizeof (ENetPeer));
+    memset (host -> peerChunks, 0, host -> peerChunkCount * sizeof (ENetPeerChunk));
+
+    host -> peerBuckets = (ENetList *) enet_malloc (ENET_HOST_MINIMUM_PEER_BUCKETS * sizeof (ENetList));
+    if (host -> peerBuckets == NULL)
+    {
+       enet_free (host -> peerChunks);
+       enet_free (host);
+
+       return NULL;
+    }
+    host -> peerBucketMask = ENET_HOST_MINIMUM_PEER_BUCKETS - 1;
+
+    for (bucket = host -> peerBuckets;
+         bucket < & host -> peerBuckets [ENET_HOST_MINIMUM_PEER_BUCKETS];
+         ++ bucket)
+      enet_list_clear (bucket);
 
     host -> socket = enet_socket_create (ENET_SOCKET_TYPE_DATAGRAM);
     if (host -> socket == ENET_SOCKET_NULL || (address != NULL && enet_socket_bind (host -> socket, address) < 0))
@@ -54,7 +83,8 @@ enet_host_create (const ENetAddress * address, size_t peerCount, size_t channelL
        if (host -> socket != ENET_SOCKET_NULL)
          enet_socket_destroy (host -> socket);
 
-       enet_free (host -> peers);
+       enet_free (host -> peerBuckets);
+       enet_free (host -> peerChunks);
        enet_free (host);
 
        return NULL;
@@ -81,11 +111,20 @@ enet_host_create (const ENetAddress * address, size_t peerCount, size_t channelL
     host -> incomingBandwidth = incomingBandwidth;
     host -> outgoingBandwidth = outgoingBandwidth;
     host -> bandwidthThrottleEpoch = 0;
+    host -> outgoingDataTotal = 0;
+    host -> packetThrottleLimit = ENET_PEER_PACKET_THROTTLE_SCALE;
+    host -> incomingBandwidthLimit = 0;
+    host -> bandwidthLimitEpoch = 0;
     host -> recalculateBandwidthLimits = 0;
     host -> mtu = ENET_HOST_DEFAULT_MTU;
     host -> peerCount = peerCount;
-    host -> commandCount = 0;
-    host -> bufferCount = 0;
+    host -> peerChunkStride = 1;
+    host -> peerChunkOffset = 0;
+    host -> releasePeerChunks = 0;
+    host -> keepPeerChunks = 0;
+    host -> sendScratch.deferred = 0;
+    host -> sendScratch.commandCount = 0;
+    host -> sendScratch.bufferCount = 0;
     host -> checksum = NULL;
     host -> receivedAddress.host = ENET_HOST_ANY;
     host -> receivedAddress.port = 0;
@@ -96,10 +135,17 @@ enet_host_create (const ENetAddress * address, size_t peerCount, size_t channelL
     host -> totalSentPackets = 0;
     host -> totalReceivedData = 0;
     host -> totalReceivedPackets = 0;
+    host -> totalCompressionAttempts = 0;
+    host -> totalCompressionBypasses = 0;
+    host -> totalCompressionInput = 0;
+    host -> totalCompressionSaved = 0;
 
     host -> connectedPeers = 0;
     host -> bandwidthLimitedPeers = 0;
-    host -> duplicatePeers = ENET_PROTOCOL_MAXIMUM_PEER_ID;
+    host -> outgoingBandwidthLimitedPeers = 0;
+    host -> duplicatePeers = ENET_PROTOCOL_MAXIMUM_EXTENDED_PEER_ID;
+    host -> capabilities = ENET_PROTOCOL_CAPABILITY_EXTENDED_PEER_ID | ENET_PROTOCOL_CAPABILITY_ADAPTIVE_WINDOW | ENET_PROTOCOL_CAPABILITY_DELTA_ENCODING;
+    host -> maximumWindowSize = ENET_HOST_RECEIVE_BUFFER_SIZE;
     host -> maximumPacketSize = ENET_HOST_DEFAULT_MAXIMUM_PACKET_SIZE;
     host -> maximumWaitingData = ENET_HOST_DEFAULT_MAXIMUM_WAITING_DATA;
 
@@ -107,17 +153,198 @@ enet_host_create (const ENetAddress * address, size_t peerCount, size_t channelL
     host -> compressor.compress = NULL;
     host -> compressor.decompress = NULL;
     host -> compressor.destroy = NULL;
+    host -> compressor.clone = NULL;
+
+    memset (host -> encryptionKey, 0, sizeof (host -> encryptionKey));
+
+    memset (& host -> streamCompressor, 0, sizeof (host -> streamCompressor));
+
+    host -> pipeline = NULL;
+
+    host -> shard = NULL;
+    host -> submissions = NULL;
 
     host -> intercept = NULL;
 
+    host -> statisticsInterval = ENET_HOST_DEFAULT_STATISTICS_INTERVAL;
+    host -> statisticsEpoch = 0;
+    host -> statisticsSequence = 0;
+
     enet_list_clear (& host -> dispatchQueue);
+    enet_list_clear (& host -> limitedPeers);
+    enet_list_clear (& host -> outgoingLimitedPeers);
+    enet_list_clear (& host -> freePeers);
+    enet_list_clear (& host -> freeExtendedPeers);
+
+    return host;
+}
+
+/** Destroys the host and all resources associated with it.
+    @param host pointer to the host to destroy
+*/
+void
+enet_host_destroy (ENetHost * host)
+{
+    ENetPeerChunk * chunk;
+    ENetPeer * currentPeer;
+
+    if (host == NULL)
+      return;
+
+    if (host -> pipeline != NULL)
+      enet_pipeline_destroy (host -> pipeline);
+
+    enet_host_discard_submissions (host);
+
+    if (host -> shard == NULL)
+      enet_socket_destroy (host -> socket);
+
+    for (chunk = host -> peerChunks;
+         chunk < & host -> peerChunks [host -> peerChunkCount];
+         ++ chunk)
+    {
+       for (currentPeer = chunk -> peers;
+            currentPeer < & chunk -> peers [chunk -> peerCount];
+            ++ currentPeer)
+       {
+          enet_peer_reset (currentPeer);
+       }
+    }
+
+    /* resetting a peer links it into the free lists, so no chunk may go before all are reset */
+    for (chunk = host -> peerChunks;
+         chunk < & host -> peerChunks [host -> peerChunkCount];
+         ++ chunk)
+    {
+#ifdef ENET_PEER_COLD_SPLIT
+       enet_free (chunk -> cold);
+#endif
+       enet_free (chunk -> peers);
+    }
+
+    if (host -> compressor.context != NULL && host -> compressor.destroy)
+      (* host -> compressor.destroy) (host -> compressor.context);
+
+    if (host -> streamCompressor.context != NULL && host -> streamCompressor.destroy)
+      (* host -> streamCompressor.destroy) (host -> streamCompressor.context);
+
+    enet_free (host -> peerBuckets);
+    enet_free (host -> peerChunks);
+    enet_free (host);
+}
+
+/** Returns the peer with the given incoming peer ID.
+    @param host host the peer belongs to
+    @param peerID incoming peer ID of the peer
+    @returns the peer, or NULL if peerID is out of range or its chunk is not currently allocated
+*/
+ENetPeer *
+enet_host_get_peer (ENetHost * host, size_t peerID)
+{
+    ENetPeerChunk * chunk;
+
+    if (peerID >= host -> peerCount)
+      return NULL;
+
+    chunk = & host -> peerChunks [peerID / ENET_HOST_PEER_CHUNK_SIZE];
+    if (chunk -> peers == NULL)
+      return NULL;
+
+    return & chunk -> peers [peerID % ENET_HOST_PEER_CHUNK_SIZE];
+}
+
+static void
+enet_host_rehash_peers (ENetHost * host, size_t bucketCount)
+{
+    ENetList * buckets, * bucket;
+    ENetPeerChunk * chunk;
+    ENetPeer * currentPeer;
+
+    buckets = (ENetList *) enet_malloc (bucketCount * sizeof (ENetList));
+    if (buckets == NULL)
+      return;
+
+    for (bucket = buckets;
+         bucket < & buckets [bucketCount];
+         ++ bucket)
+      enet_list_clear (bucket);
 
-    for (currentPeer = host -> peers;
-         currentPeer < & host -> peers [host -> peerCount];
+    enet_free (host -> peerBuckets);
+
+    host -> peerBuckets = buckets;
+    host -> peerBucketMask = bucketCount - 1;
+
+    for (chunk = host -> peerChunks;
+         chunk < & host -> peerChunks [host -> peerChunkCount];
+         ++ chunk)
+    for (currentPeer = chunk -> peers;
+         currentPeer < & chunk -> peers [chunk -> peerCount];
+         ++ currentPeer)
+    {
+       if (currentPeer -> state != ENET_PEER_STATE_DISCONNECTED)
+         enet_list_insert (enet_list_end (enet_host_peer_bucket (host, currentPeer -> address.host)), & currentPeer -> lookupList);
+    }
+}
+
+/** Whether new connections to the host may use a peer ID. The hosts of an ENetShardedHost only
+    use the IDs their shard owns, which change hands as peers migrate between them.
+*/
+int
+enet_host_owns_peer (ENetHost * host, size_t peerID)
+{
+    return host -> shard == NULL ||
+           ENET_ATOMIC_LOAD_ACQUIRE (& host -> shard -> sharded -> peerShards [peerID]) == host -> shard -> index;
+}
+
+/** Allocates a chunk of peers and places those whose IDs the host owns on the matching free list.
+    The others are left off every list, for a peer migrating to the host to take over.
+    @retval 0 on success
+    @retval < 0 if allocation failed
+*/
+int
+enet_host_allocate_peer_chunk (ENetHost * host, size_t chunkIndex)
+{
+    ENetPeerChunk * chunk = & host -> peerChunks [chunkIndex];
+    ENetPeer * currentPeer;
+    size_t peerCount,
+           bucketCount;
+
+    peerCount = host -> peerCount - chunkIndex * ENET_HOST_PEER_CHUNK_SIZE;
+    if (peerCount > ENET_HOST_PEER_CHUNK_SIZE)
+      peerCount = ENET_HOST_PEER_CHUNK_SIZE;
+
+    chunk -> peers = (ENetPeer *) enet_malloc (peerCount * sizeof (ENetPeer));
+    if (chunk -> peers == NULL)
+      return -1;
+    memset (chunk -> peers, 0, peerCount * sizeof (ENetPeer));
+
+#ifdef ENET_PEER_COLD_SPLIT
+    chunk -> cold = (ENetPeerCold *) enet_malloc (peerCount * sizeof (ENetPeerCold));
+    if (chunk -> cold == NULL)
+    {
+       enet_free (chunk -> peers);
+       chunk -> peers = NULL;
+
+       return -1;
+    }
+    memset (chunk -> cold, 0, peerCount * sizeof (ENetPeerCold));
+#endif
+
+    chunk -> peerCount = peerCount;
+    chunk -> usedPeers = 0;
+    chunk -> idleTime = enet_time_get ();
+
+    host -> allocatedPeers += peerCount;
+
+    for (currentPeer = chunk -> peers;
+         currentPeer < & chunk -> peers [chunk -> peerCount];
          ++ currentPeer)
     {
        currentPeer -> host = host;
-       currentPeer -> incomingPeerID = currentPeer - host -> peers;
+       currentPeer -> incomingPeerID = chunkIndex * ENET_HOST_PEER_CHUNK_SIZE + (currentPeer - chunk -> peers);
+#ifdef ENET_PEER_COLD_SPLIT
+       currentPeer -> cold = & chunk -> cold [currentPeer - chunk -> peers];
+#endif
        currentPeer -> outgoingSessionID = currentPeer -> incomingSessionID = 0xFF;
        currentPeer -> data = NULL;
 
@@ -128,36 +355,228 @@ enet_host_create (const ENetAddress * address, size_t peerCount, size_t channelL
        enet_list_clear (& currentPeer -> dispatchedCommands);
 
        enet_peer_reset (currentPeer);
+
+       /* a peer whose ID the host does not own is linked to itself, so that it may be removed
+          from the free list it is not on */
+       if (! enet_host_owns_peer (host, currentPeer -> incomingPeerID))
+         currentPeer -> lookupList.next = currentPeer -> lookupList.previous = & currentPeer -> lookupList;
+       else
+       if (currentPeer -> incomingPeerID < ENET_PROTOCOL_EXTENDED_PEER_ID)
+         enet_list_insert (enet_list_end (& host -> freePeers), & currentPeer -> lookupList);
+       else
+       if (currentPeer -> incomingPeerID > ENET_PROTOCOL_MAXIMUM_PEER_ID)
+         enet_list_insert (enet_list_end (& host -> freeExtendedPeers), & currentPeer -> lookupList);
     }
 
-    return host;
+    if (host -> allocatedPeers > host -> peerBucketMask + 1)
+    {
+       for (bucketCount = host -> peerBucketMask + 1; bucketCount < host -> allocatedPeers; bucketCount <<= 1);
+
+       enet_host_rehash_peers (host, bucketCount);
+    }
+
+    return 0;
 }
 
-/** Destroys the host and all resources associated with it.
-    @param host pointer to the host to destroy
+/** Allocates the next unused chunk of peers owned by the host in either the legacy or the extended peer ID range
+    and places its peers on the matching free list.
+    @retval 0 on success
+    @retval < 0 if the range is exhausted or allocation failed
+*/
+static int
+enet_host_grow_peers (ENetHost * host, int extended)
+{
+    size_t chunkIndex = extended ? (ENET_PROTOCOL_MAXIMUM_PEER_ID + 1) / ENET_HOST_PEER_CHUNK_SIZE : 0;
+
+    chunkIndex += (host -> peerChunkOffset + host -> peerChunkStride - chunkIndex % host -> peerChunkStride) % host -> peerChunkStride;
+
+    for (; chunkIndex < host -> peerChunkCount; chunkIndex += host -> peerChunkStride)
+    {
+       if (host -> peerChunks [chunkIndex].peers == NULL)
+         break;
+    }
+
+    if (chunkIndex >= host -> peerChunkCount ||
+        (! extended && chunkIndex * ENET_HOST_PEER_CHUNK_SIZE >= ENET_PROTOCOL_EXTENDED_PEER_ID))
+      return -1;
+
+    return enet_host_allocate_peer_chunk (host, chunkIndex);
+}
+
+/** Releases peer chunks, other than the first, that have had no peers in use for
+    ENET_HOST_PEER_CHUNK_IDLE_TIMEOUT milliseconds, if the host releases idle peer chunks.
 */
 void
-enet_host_destroy (ENetHost * host)
+enet_host_shrink_peers (ENetHost * host)
 {
+    ENetPeerChunk * chunk;
     ENetPeer * currentPeer;
 
-    if (host == NULL)
+    if (host -> peerChunkCount <= 1 || ! host -> releasePeerChunks || host -> keepPeerChunks)
       return;
 
-    enet_socket_destroy (host -> socket);
+    for (chunk = & host -> peerChunks [1];
+         chunk < & host -> peerChunks [host -> peerChunkCount];
+         ++ chunk)
+    {
+       size_t chunkIndex = (size_t) (chunk - host -> peerChunks),
+              returnedPeers = 0;
+       ENetHostSubmission * submission = NULL;
 
-    for (currentPeer = host -> peers;
-         currentPeer < & host -> peers [host -> peerCount];
-         ++ currentPeer)
+       if (chunk -> peers == NULL ||
+           chunk -> usedPeers > 0 ||
+           ENET_TIME_DIFFERENCE (host -> serviceTime, chunk -> idleTime) < ENET_HOST_PEER_CHUNK_IDLE_TIMEOUT)
+         continue;
+
+       /* IDs taken over from a chunk of another shard go back to it, rather than being lost
+          until a peer migrates here again, and the shard puts them on its free lists */
+       if (chunkIndex % host -> peerChunkStride != host -> peerChunkOffset)
+       {
+           submission = (ENetHostSubmission *) enet_malloc (sizeof (ENetHostSubmission));
+           if (submission == NULL)
+             continue;
+       }
+
+       for (currentPeer = chunk -> peers;
+            currentPeer < & chunk -> peers [chunk -> peerCount];
+            ++ currentPeer)
+       {
+          if (currentPeer -> incomingPeerID < ENET_PROTOCOL_EXTENDED_PEER_ID ||
+              currentPeer -> incomingPeerID > ENET_PROTOCOL_MAXIMUM_PEER_ID)
+            enet_list_remove (& currentPeer -> lookupList);
+
+          if (submission != NULL && enet_host_owns_peer (host, currentPeer -> incomingPeerID))
+          {
+              ENET_ATOMIC_STORE_RELEASE (& host -> shard -> sharded -> peerShards [currentPeer -> incomingPeerID],
+                                         (enet_uint32) (chunkIndex % host -> peerChunkStride) | ENET_SHARD_PEER_RETURNING);
+
+              ++ returnedPeers;
+          }
+       }
+
+       if (returnedPeers > 0)
+       {
+           submission -> peerID = (enet_uint16) (chunkIndex * ENET_HOST_PEER_CHUNK_SIZE);
+           submission -> connectID = 0;
+           submission -> channelID = 0;
+           submission -> packet = NULL;
+           submission -> migration = NULL;
+
+           enet_host_push_submission (host -> shard -> sharded -> hosts [chunkIndex % host -> peerChunkStride], submission);
+       }
+       else
+         enet_free (submission);
+
+       host -> allocatedPeers -= chunk -> peerCount;
+
+#ifdef ENET_PEER_COLD_SPLIT
+       enet_free (chunk -> cold);
+       chunk -> cold = NULL;
+#endif
+       enet_free (chunk -> peers);
+       chunk -> peers = NULL;
+       chunk -> peerCount = 0;
+    }
+}
+
+/** Takes back the IDs of one of the chunks of the host that another host of its ENetShardedHost
+    released, placing their peers on the free lists if the host has the chunk allocated. Called by
+    the service thread only, from the submission the other host sent after marking the IDs.
+*/
+void
+enet_host_reclaim_peers (ENetHost * host, size_t chunkIndex)
+{
+    ENetPeerChunk * chunk = & host -> peerChunks [chunkIndex];
+    enet_uint32 returned = host -> shard -> index | ENET_SHARD_PEER_RETURNING;
+    size_t peerID = chunkIndex * ENET_HOST_PEER_CHUNK_SIZE,
+           lastPeerID = peerID + ENET_HOST_PEER_CHUNK_SIZE;
+
+    if (lastPeerID > host -> peerCount)
+      lastPeerID = host -> peerCount;
+
+    for (; peerID < lastPeerID; ++ peerID)
     {
-       enet_peer_reset (currentPeer);
+       ENetPeer * currentPeer;
+
+       if (ENET_ATOMIC_LOAD_ACQUIRE (& host -> shard -> sharded -> peerShards [peerID]) != returned)
+         continue;
+
+       ENET_ATOMIC_STORE_RELEASE (& host -> shard -> sharded -> peerShards [peerID], host -> shard -> index);
+
+       /* the peers of an allocated chunk were linked to themselves while another shard owned their IDs */
+       if (chunk -> peers == NULL)
+         continue;
+
+       currentPeer = & chunk -> peers [peerID % ENET_HOST_PEER_CHUNK_SIZE];
+
+       if (peerID < ENET_PROTOCOL_EXTENDED_PEER_ID)
+         enet_list_insert (enet_list_end (& host -> freePeers), & currentPeer -> lookupList);
+       else
+       if (peerID > ENET_PROTOCOL_MAXIMUM_PEER_ID)
+         enet_list_insert (enet_list_end (& host -> freeExtendedPeers), & currentPeer -> lookupList);
     }
+}
 
-    if (host -> compressor.context != NULL && host -> compressor.destroy)
-      (* host -> compressor.destroy) (host -> compressor.context);
+/** Finds a disconnected peer for a new connection, growing the peer table if needed.
+    The peer stays on its free list until enet_host_use_peer() is called on it.
+    @param host host to find the peer on
+    @param extended whether peer IDs outside the legacy 12-bit range may be used
+    @returns a disconnected peer, or NULL if none is available
+*/
+ENetPeer *
+enet_host_find_free_peer (ENetHost * host, int extended)
+{
+    if (! enet_list_empty (& host -> freePeers) || enet_host_grow_peers (host, 0) == 0)
+      return ENET_PEER_FROM_LOOKUP_LIST (enet_list_front (& host -> freePeers));
 
-    enet_free (host -> peers);
-    enet_free (host);
+    if (extended && (! enet_list_empty (& host -> freeExtendedPeers) || enet_host_grow_peers (host, 1) == 0))
+      return ENET_PEER_FROM_LOOKUP_LIST (enet_list_front (& host -> freeExtendedPeers));
+
+    return NULL;
+}
+
+/** Moves a peer returned by enet_host_find_free_peer() from its free list into the
+    address bucket matching its current address.
+*/
+void
+enet_host_use_peer (ENetHost * host, ENetPeer * peer)
+{
+    enet_list_remove (& peer -> lookupList);
+    enet_list_insert (enet_list_end (enet_host_peer_bucket (host, peer -> address.host)), & peer -> lookupList);
+
+    ++ host -> peerChunks [peer -> incomingPeerID / ENET_HOST_PEER_CHUNK_SIZE].usedPeers;
+}
+
+/** Returns a peer that is being reset from its address bucket to its free list.
+*/
+void
+enet_host_release_peer (ENetHost * host, ENetPeer * peer)
+{
+    ENetPeerChunk * chunk = & host -> peerChunks [peer -> incomingPeerID / ENET_HOST_PEER_CHUNK_SIZE];
+
+    enet_list_remove (& peer -> lookupList);
+
+    if (peer -> incomingPeerID < ENET_PROTOCOL_EXTENDED_PEER_ID)
+      enet_list_insert (enet_list_end (& host -> freePeers), & peer -> lookupList);
+    else
+      enet_list_insert (enet_list_end (& host -> freeExtendedPeers), & peer -> lookupList);
+
+    if (-- chunk -> usedPeers == 0)
+      chunk -> idleTime = enet_time_get ();
+}
+
+/** Returns the bucket of peers in use whose address host hashes like the given one.
+*/
+ENetList *
+enet_host_peer_bucket (ENetHost * host, enet_uint32 addressHost)
+{
+    enet_uint32 hash = addressHost;
+
+    hash ^= hash >> 16;
+    hash *= 0x45D9F3B;
+    hash ^= hash >> 16;
+
+    return & host -> peerBuckets [hash & host -> peerBucketMask];
 }
 
 enet_uint32
@@ -185,6 +604,7 @@ enet_host_connect (ENetHost * host, const ENetAddress * address, size_t channelC
     ENetPeer * currentPeer;
     ENetChannel * channel;
     ENetProtocol command;
+    enet_uint8 salt [16];
 
     if (channelCount < ENET_PROTOCOL_MINIMUM_CHANNEL_COUNT)
       channelCount = ENET_PROTOCOL_MINIMUM_CHANNEL_COUNT;
@@ -192,23 +612,29 @@ enet_host_connect (ENetHost * host, const ENetAddress * address, size_t channelC
     if (channelCount > ENET_PROTOCOL_MAXIMUM_CHANNEL_COUNT)
       channelCount = ENET_PROTOCOL_MAXIMUM_CHANNEL_COUNT;
 
-    for (currentPeer = host -> peers;
-         currentPeer < & host -> peers [host -> peerCount];
-         ++ currentPeer)
-    {
-       if (currentPeer -> state == ENET_PEER_STATE_DISCONNECTED)
-         break;
-    }
-
-    if (currentPeer >= & host -> peers [host -> peerCount])
+    currentPeer = enet_host_find_free_peer (host, 0);
+    if (currentPeer == NULL)
       return NULL;
 
     currentPeer -> channels = (ENetChannel *) enet_malloc (channelCount * sizeof (ENetChannel));
     if (currentPeer -> channels == NULL)
       return NULL;
+
+    memset (salt, 0, sizeof (salt));
+    if ((host -> capabilities & ENET_PROTOCOL_CAPABILITY_ENCRYPTION) &&
+        (enet_random_bytes (salt, sizeof (salt)) < 0 || enet_peer_encrypt (currentPeer, salt, NULL) < 0))
+    {
+        enet_free (currentPeer -> channels);
+        currentPeer -> channels = NULL;
+
+        return NULL;
+    }
+
     currentPeer -> channelCount = channelCount;
     currentPeer -> state = ENET_PEER_STATE_CONNECTING;
     currentPeer -> address = * address;
+
+    enet_host_use_peer (host, currentPeer);
     currentPeer -> connectID = enet_host_random (host);
 
     if (host -> outgoingBandwidth == 0)
@@ -223,6 +649,10 @@ enet_host_connect (ENetHost * host, const ENetAddress * address, size_t channelC
     else
     if (currentPeer -> windowSize > ENET_PROTOCOL_MAXIMUM_WINDOW_SIZE)
       currentPeer -> windowSize = ENET_PROTOCOL_MAXIMUM_WINDOW_SIZE;
+
+    ENET_PEER_COLD (currentPeer) -> advertisedIncomingBandwidth = host -> incomingBandwidth;
+    ENET_PEER_COLD (currentPeer) -> advertisedOutgoingBandwidth = host -> outgoingBandwidth;
+    currentPeer -> bandwidthLimitEpoch = host -> bandwidthLimitEpoch;
          
     for (channel = currentPeer -> channels;
          channel < & currentPeer -> channels [channelCount];
@@ -236,6 +666,11 @@ enet_host_connect (ENetHost * host, const ENetAddress * address, size_t channelC
         enet_list_clear (& channel -> incomingReliableCommands);
         enet_list_clear (& channel -> incomingUnreliableCommands);
 
+        channel -> outgoingDeltaBase = NULL;
+        channel -> incomingDeltaBase = NULL;
+        channel -> outgoingDeltaLength = 0;
+        channel -> incomingDeltaLength = 0;
+
         channel -> usedReliableWindows = 0;
         memset (channel -> reliableWindows, 0, sizeof (channel -> reliableWindows));
     }
@@ -250,11 +685,21 @@ enet_host_connect (ENetHost * host, const ENetAddress * address, size_t channelC
     command.connect.channelCount = ENET_HOST_TO_NET_32 (channelCount);
     command.connect.incomingBandwidth = ENET_HOST_TO_NET_32 (host -> incomingBandwidth);
     command.connect.outgoingBandwidth = ENET_HOST_TO_NET_32 (host -> outgoingBandwidth);
-    command.connect.packetThrottleInterval = ENET_HOST_TO_NET_32 (currentPeer -> packetThrottleInterval);
-    command.connect.packetThrottleAcceleration = ENET_HOST_TO_NET_32 (currentPeer -> packetThrottleAcceleration);
-    command.connect.packetThrottleDeceleration = ENET_HOST_TO_NET_32 (currentPeer -> packetThrottleDeceleration);
+    command.connect.packetThrottleInterval = ENET_HOST_TO_NET_32 (ENET_PEER_COLD (currentPeer) -> packetThrottleInterval);
+    command.connect.packetThrottleAcceleration = ENET_HOST_TO_NET_32 (ENET_PEER_COLD (currentPeer) -> packetThrottleAcceleration);
+    command.connect.packetThrottleDeceleration = ENET_HOST_TO_NET_32 (ENET_PEER_COLD (currentPeer) -> packetThrottleDeceleration);
     command.connect.connectID = currentPeer -> connectID;
     command.connect.data = ENET_HOST_TO_NET_32 (data);
+
+    if (host -> capabilities != 0)
+    {
+        command.header.command |= ENET_PROTOCOL_COMMAND_FLAG_CAPABILITIES;
+        command.connect.capabilities.command = ENET_PROTOCOL_COMMAND_NONE;
+        command.connect.capabilities.length = sizeof (ENetProtocolCapabilities);
+        command.connect.capabilities.capabilities = ENET_HOST_TO_NET_16 (host -> capabilities);
+        command.connect.capabilities.maximumWindowSize = ENET_HOST_TO_NET_32 (host -> maximumWindowSize);
+        memcpy (command.connect.capabilities.encryptionSalt, salt, sizeof (salt));
+    }
  
     enet_peer_queue_outgoing_command (currentPeer, & command, NULL, 0, 0);
 
@@ -269,10 +714,14 @@ enet_host_connect (ENetHost * host, const ENetAddress * address, size_t channelC
 void
 enet_host_broadcast (ENetHost * host, enet_uint8 channelID, ENetPacket * packet)
 {
+    ENetPeerChunk * chunk;
     ENetPeer * currentPeer;
 
-    for (currentPeer = host -> peers;
-         currentPeer < & host -> peers [host -> peerCount];
+    for (chunk = host -> peerChunks;
+         chunk < & host -> peerChunks [host -> peerChunkCount];
+         ++ chunk)
+    for (currentPeer = chunk -> peers;
+         currentPeer < & chunk -> peers [chunk -> peerCount];
          ++ currentPeer)
     {
        if (currentPeer -> state != ENET_PEER_STATE_CONNECTED)
@@ -281,10 +730,191 @@ enet_host_broadcast (ENetHost * host, enet_uint8 channelID, ENetPacket * packet)
        enet_peer_send (currentPeer, channelID, packet);
     }
 
-    if (packet -> referenceCount == 0)
+    /* hosts on other threads may hold references to a packet broadcast through a bus */
+    if (ENET_ATOMIC_LOAD_SIZE_ACQUIRE (& packet -> referenceCount) == 0)
       enet_packet_destroy (packet);
 }
 
+/** Queues a packet to be broadcast from any thread. The broadcast is carried out by the thread
+    servicing the host, at the start of its next call to enet_host_service().
+    @param host host on which to broadcast the packet
+    @param channelID channel on which to broadcast
+    @param packet packet to broadcast
+    @retval 0 on success
+    @retval < 0 on failure, in which case the caller keeps the packet
+    @remarks The packet must not be changed once queued, as it may be sent at any time.
+*/
+int
+enet_host_broadcast_async (ENetHost * host, enet_uint8 channelID, ENetPacket * packet)
+{
+    return enet_host_submit (host, NULL, channelID, packet);
+}
+
+/** Pushes a send onto the host's submission queue, which any number of threads may do at once.
+    The submission holds a reference on the packet until it is run or discarded. It names the peer
+    by its ID and connect ID rather than by pointer, as the peer may be gone by the time it is run.
+*/
+int
+enet_host_submit (ENetHost * host, ENetPeer * peer, enet_uint8 channelID, ENetPacket * packet)
+{
+    ENetHostSubmission * submission;
+
+    submission = (ENetHostSubmission *) enet_malloc (sizeof (ENetHostSubmission));
+    if (submission == NULL)
+      return -1;
+
+    if (peer != NULL)
+    {
+        submission -> peerID = peer -> incomingPeerID;
+        submission -> connectID = peer -> connectID;
+    }
+    else
+    {
+        submission -> peerID = ENET_PROTOCOL_MAXIMUM_PEER_ID;
+        submission -> connectID = 0;
+    }
+    submission -> channelID = channelID;
+    submission -> packet = packet;
+    submission -> migration = NULL;
+
+    ENET_ATOMIC_INCREMENT (& packet -> referenceCount);
+
+    enet_host_push_submission (host, submission);
+
+    return 0;
+}
+
+/** Pushes a submission holding a reference on its packet onto the host's submission queue, and
+    wakes the host if it is a shard waiting for datagrams.
+*/
+void
+enet_host_push_submission (ENetHost * host, ENetHostSubmission * submission)
+{
+    ENetHostSubmission * head;
+
+    /* Only the service thread removes submissions, and it always takes the whole queue, so a
+       submission at the head cannot be freed and reused while a push compares against it. */
+    do
+    {
+        head = (ENetHostSubmission *) ENET_ATOMIC_LOAD_POINTER_ACQUIRE (& host -> submissions);
+
+        submission -> next = head;
+    } while (! ENET_ATOMIC_COMPARE_EXCHANGE_POINTER (& host -> submissions, head, submission));
+
+    if (host -> shard != NULL)
+      enet_shard_wake (host -> shard);
+}
+
+static ENetHostSubmission *
+enet_host_take_submissions (ENetHost * host)
+{
+    ENetHostSubmission * submission, * next, * submissions = NULL;
+
+    if (ENET_ATOMIC_LOAD_POINTER_ACQUIRE (& host -> submissions) == NULL)
+      return NULL;
+
+    submission = (ENetHostSubmission *) ENET_ATOMIC_EXCHANGE_POINTER (& host -> submissions, NULL);
+
+    /* The queue is pushed newest first, so reverse it to run each thread's sends in order. */
+    for (; submission != NULL; submission = next)
+    {
+        next = submission -> next;
+
+        submission -> next = submissions;
+        submissions = submission;
+    }
+
+    return submissions;
+}
+
+/* Hands a send on to the shard a peer has migrated to, behind the submission that migrated it. */
+static int
+enet_host_forward_submission (ENetHost * host, ENetHostSubmission * submission)
+{
+    enet_uint32 shardIndex;
+
+    if (host -> shard == NULL || submission -> peerID >= host -> peerCount)
+      return 0;
+
+    shardIndex = ENET_ATOMIC_LOAD_ACQUIRE (& host -> shard -> sharded -> peerShards [submission -> peerID]) & ~ (ENET_SHARD_PEER_MIGRATING | ENET_SHARD_PEER_RETURNING);
+    if (shardIndex == host -> shard -> index)
+      return 0;
+
+    enet_host_push_submission (host -> shard -> sharded -> hosts [shardIndex], submission);
+
+    return 1;
+}
+
+/** Runs the sends queued by other threads. Called by the service thread only. */
+void
+enet_host_run_submissions (ENetHost * host)
+{
+    ENetHostSubmission * submission, * next;
+
+    for (submission = enet_host_take_submissions (host);
+         submission != NULL;
+         submission = next)
+    {
+        next = submission -> next;
+
+        if (submission -> migration != NULL || submission -> packet == NULL)
+        {
+            if (submission -> migration != NULL)
+              enet_host_adopt_peer (host, submission -> migration);
+            else
+              enet_host_reclaim_peers (host, submission -> peerID / ENET_HOST_PEER_CHUNK_SIZE);
+
+            enet_free (submission);
+
+            continue;
+        }
+
+        if (submission -> peerID == ENET_PROTOCOL_MAXIMUM_PEER_ID)
+          enet_host_broadcast (host, submission -> channelID, submission -> packet);
+        else
+        if (enet_host_forward_submission (host, submission))
+          continue;
+        else
+        {
+            ENetPeer * peer = enet_host_get_peer (host, submission -> peerID);
+
+            /* the peer may have disconnected, and its ID gone to a new connection, since the send was queued */
+            if (peer != NULL && peer -> connectID == submission -> connectID)
+              enet_peer_send (peer, submission -> channelID, submission -> packet);
+        }
+
+        if (ENET_ATOMIC_DECREMENT (& submission -> packet -> referenceCount) == 0)
+          enet_packet_destroy (submission -> packet);
+
+        enet_free (submission);
+    }
+}
+
+/** Drops the sends queued by other threads, and the peers migrating to the host. */
+void
+enet_host_discard_submissions (ENetHost * host)
+{
+    ENetHostSubmission * submission, * next;
+
+    for (submission = enet_host_take_submissions (host);
+         submission != NULL;
+         submission = next)
+    {
+        next = submission -> next;
+
+        if (submission -> migration != NULL)
+          enet_peer_migration_destroy (host, submission -> migration);
+        else
+        if (submission -> packet == NULL)
+          enet_host_reclaim_peers (host, submission -> peerID / ENET_HOST_PEER_CHUNK_SIZE);
+        else
+        if (ENET_ATOMIC_DECREMENT (& submission -> packet -> referenceCount) == 0)
+          enet_packet_destroy (submission -> packet);
+
+        enet_free (submission);
+    }
+}
+
 /** Sets the packet compressor the host should use to compress and decompress packets.
     @param host host to enable or disable compression for
     @param compressor callbacks for for the packet compressor; if NULL, then compression is disabled
@@ -299,6 +929,75 @@ enet_host_compress (ENetHost * host, const ENetCompressor * compressor)
       host -> compressor = * compressor;
     else
       host -> compressor.context = NULL;
+
+    if (host -> pipeline != NULL)
+      enet_pipeline_set_compressor (host -> pipeline, & host -> compressor);
+}
+
+/** Sets the stream compressor the host should use with peers that support stream compression.
+    Peers that do not support it keep using the packet compressor set with enet_host_compress().
+    @param host host to enable or disable stream compression for
+    @param streamCompressor callbacks for the stream compressor; if NULL, then stream compression is disabled
+    @remarks Should be set before connecting; peers already connected stop compressing with it.
+*/
+void
+enet_host_compress_stream (ENetHost * host, const ENetStreamCompressor * streamCompressor)
+{
+    ENetPeerChunk * chunk;
+    ENetPeer * currentPeer;
+
+    for (chunk = host -> peerChunks;
+         chunk < & host -> peerChunks [host -> peerChunkCount];
+         ++ chunk)
+    {
+       for (currentPeer = chunk -> peers;
+            currentPeer < & chunk -> peers [chunk -> peerCount];
+            ++ currentPeer)
+       {
+          enet_peer_destroy_streams (currentPeer);
+       }
+    }
+
+    if (host -> streamCompressor.context != NULL && host -> streamCompressor.destroy)
+      (* host -> streamCompressor.destroy) (host -> streamCompressor.context);
+
+    if (streamCompressor)
+    {
+        host -> streamCompressor = * streamCompressor;
+        host -> capabilities |= ENET_PROTOCOL_CAPABILITY_STREAM_COMPRESSION;
+    }
+    else
+    {
+        memset (& host -> streamCompressor, 0, sizeof (host -> streamCompressor));
+        host -> capabilities &= ~ ENET_PROTOCOL_CAPABILITY_STREAM_COMPRESSION;
+    }
+}
+
+/** Protects the datagrams exchanged with peers of the host with ChaCha20-Poly1305.
+    Each connection encrypts with its own keys, one per direction, derived from the pre-shared key
+    and random salts that the connecting host sends along with its CONNECT command and the server
+    returns with VERIFY_CONNECT; every later datagram in either direction is encrypted and
+    authenticated, and replayed datagrams are dropped, including those of an earlier connection.
+    @param host host to enable or disable encryption for
+    @param key 32 byte pre-shared key; if NULL, then encryption is disabled
+    @remarks Both ends must use the same key. A host with a key refuses connections from hosts
+    without encryption, and a connection between hosts with different keys times out.
+    Should be set before connecting; peers already connected keep their keys. The intercept callback
+    sees datagrams still encrypted, unless the host runs a pipeline, whose workers decrypt them first.
+*/
+void
+enet_host_encrypt (ENetHost * host, const void * key)
+{
+    if (key != NULL)
+    {
+        memcpy (host -> encryptionKey, key, sizeof (host -> encryptionKey));
+        host -> capabilities |= ENET_PROTOCOL_CAPABILITY_ENCRYPTION;
+    }
+    else
+    {
+        memset (host -> encryptionKey, 0, sizeof (host -> encryptionKey));
+        host -> capabilities &= ~ ENET_PROTOCOL_CAPABILITY_ENCRYPTION;
+    }
 }
 
 /** Limits the maximum allowed channels of future incoming connections.
@@ -317,6 +1016,20 @@ enet_host_channel_limit (ENetHost * host, size_t channelLimit)
     host -> channelLimit = channelLimit;
 }
 
+/** Sets whether a host releases the memory of peers it no longer needs.  Peers are allocated in
+    chunks of ENET_HOST_PEER_CHUNK_SIZE as connections arrive; when enabled, a chunk other than the
+    first is released once none of its peers has been in use for ENET_HOST_PEER_CHUNK_IDLE_TIMEOUT.
+    @param host host to configure
+    @param release nonzero to release idle peer chunks, 0 to keep them, which is the default
+    @remarks Releasing a chunk frees its peers, so a pointer to a peer, such as the one of a
+    ENET_EVENT_TYPE_DISCONNECT event, must not be used once the peer has been disconnected for that
+    long.  A host serviced by enet_host_thread_create() keeps its chunks while the thread runs.
+*/
+void
+enet_host_release_peer_chunks (ENetHost * host, int release)
+{
+    host -> releasePeerChunks = release;
+}
 
 /** Adjusts the bandwidth limits of a host.
     @param host host to adjust
@@ -333,6 +1046,14 @@ enet_host_bandwidth_limit (ENetHost * host, enet_uint32 incomingBandwidth, enet_
     host -> recalculateBandwidthLimits = 1;
 }
 
+/** Recomputes the packet throttle limits of the host's peers and redistributes
+    its incoming bandwidth among them, once every ENET_HOST_BANDWIDTH_THROTTLE_INTERVAL.
+
+    Only the peers with a bandwidth limit of their own are visited. The outgoing data of all peers
+    is tracked as a running total on the host, and the other peers catch up with the packet
+    throttle limit and bandwidth limits computed for them when they are next serviced, see
+    enet_peer_update_throttle() and enet_peer_update_bandwidth_limit().
+*/
 void
 enet_host_bandwidth_throttle (ENetHost * host)
 {
@@ -344,32 +1065,24 @@ enet_host_bandwidth_throttle (ENetHost * host)
            throttle = 0,
            bandwidthLimit = 0;
     int needsAdjustment = host -> bandwidthLimitedPeers > 0 ? 1 : 0;
+    ENetListIterator currentPeer;
     ENetPeer * peer;
-    ENetProtocol command;
 
     if (elapsedTime < ENET_HOST_BANDWIDTH_THROTTLE_INTERVAL)
       return;
 
     host -> bandwidthThrottleEpoch = timeCurrent;
 
-    if (peersRemaining == 0)
-      return;
-
     if (host -> outgoingBandwidth != 0)
     {
-        dataTotal = 0;
+        dataTotal = host -> outgoingDataTotal;
         bandwidth = (host -> outgoingBandwidth * elapsedTime) / 1000;
+    }
 
-        for (peer = host -> peers;
-             peer < & host -> peers [host -> peerCount];
-            ++ peer)
-        {
-            if (peer -> state != ENET_PEER_STATE_CONNECTED && peer -> state != ENET_PEER_STATE_DISCONNECT_LATER)
-              continue;
+    host -> outgoingDataTotal = 0;
 
-            dataTotal += peer -> outgoingDataTotal;
-        }
-    }
+    if (peersRemaining == 0)
+      return;
 
     while (peersRemaining > 0 && needsAdjustment != 0)
     {
@@ -380,15 +1093,15 @@ enet_host_bandwidth_throttle (ENetHost * host)
         else
           throttle = (bandwidth * ENET_PEER_PACKET_THROTTLE_SCALE) / dataTotal;
 
-        for (peer = host -> peers;
-             peer < & host -> peers [host -> peerCount];
-             ++ peer)
+        for (currentPeer = enet_list_begin (& host -> limitedPeers);
+             currentPeer != enet_list_end (& host -> limitedPeers);
+             currentPeer = enet_list_next (currentPeer))
         {
             enet_uint32 peerBandwidth;
-            
-            if ((peer -> state != ENET_PEER_STATE_CONNECTED && peer -> state != ENET_PEER_STATE_DISCONNECT_LATER) ||
-                peer -> incomingBandwidth == 0 ||
-                peer -> outgoingBandwidthThrottleEpoch == timeCurrent)
+
+            peer = ENET_PEER_FROM_LIMITED_LIST (currentPeer);
+
+            if (ENET_PEER_COLD (peer) -> outgoingBandwidthThrottleEpoch == timeCurrent)
               continue;
 
             peerBandwidth = (peer -> incomingBandwidth * elapsedTime) / 1000;
@@ -404,10 +1117,11 @@ enet_host_bandwidth_throttle (ENetHost * host)
             if (peer -> packetThrottle > peer -> packetThrottleLimit)
               peer -> packetThrottle = peer -> packetThrottleLimit;
 
-            peer -> outgoingBandwidthThrottleEpoch = timeCurrent;
+            ENET_PEER_COLD (peer) -> outgoingBandwidthThrottleEpoch = timeCurrent;
 
             peer -> incomingDataTotal = 0;
             peer -> outgoingDataTotal = 0;
+            peer -> bandwidthThrottleEpoch = timeCurrent;
 
             needsAdjustment = 1;
             -- peersRemaining;
@@ -423,12 +1137,16 @@ enet_host_bandwidth_throttle (ENetHost * host)
         else
           throttle = (bandwidth * ENET_PEER_PACKET_THROTTLE_SCALE) / dataTotal;
 
-        for (peer = host -> peers;
-             peer < & host -> peers [host -> peerCount];
-             ++ peer)
+        /* the peers without a limit take this up in enet_peer_update_throttle () */
+        host -> packetThrottleLimit = throttle;
+
+        for (currentPeer = enet_list_begin (& host -> limitedPeers);
+             currentPeer != enet_list_end (& host -> limitedPeers);
+             currentPeer = enet_list_next (currentPeer))
         {
-            if ((peer -> state != ENET_PEER_STATE_CONNECTED && peer -> state != ENET_PEER_STATE_DISCONNECT_LATER) ||
-                peer -> outgoingBandwidthThrottleEpoch == timeCurrent)
+            peer = ENET_PEER_FROM_LIMITED_LIST (currentPeer);
+
+            if (ENET_PEER_COLD (peer) -> outgoingBandwidthThrottleEpoch == timeCurrent)
               continue;
 
             peer -> packetThrottleLimit = throttle;
@@ -438,6 +1156,7 @@ enet_host_bandwidth_throttle (ENetHost * host)
 
             peer -> incomingDataTotal = 0;
             peer -> outgoingDataTotal = 0;
+            peer -> bandwidthThrottleEpoch = timeCurrent;
         }
     }
 
@@ -445,7 +1164,9 @@ enet_host_bandwidth_throttle (ENetHost * host)
     {
        host -> recalculateBandwidthLimits = 0;
 
-       peersRemaining = (enet_uint32) host -> connectedPeers;
+       /* peers without an upstream limit are given all of theirs, that is none, so only those with one
+          take part, and the others take up the result in enet_peer_update_bandwidth_limit () */
+       peersRemaining = (enet_uint32) host -> outgoingBandwidthLimitedPeers;
        bandwidth = host -> incomingBandwidth;
        needsAdjustment = 1;
 
@@ -457,19 +1178,19 @@ enet_host_bandwidth_throttle (ENetHost * host)
            needsAdjustment = 0;
            bandwidthLimit = bandwidth / peersRemaining;
 
-           for (peer = host -> peers;
-                peer < & host -> peers [host -> peerCount];
-                ++ peer)
+           for (currentPeer = enet_list_begin (& host -> outgoingLimitedPeers);
+                currentPeer != enet_list_end (& host -> outgoingLimitedPeers);
+                currentPeer = enet_list_next (currentPeer))
            {
-               if ((peer -> state != ENET_PEER_STATE_CONNECTED && peer -> state != ENET_PEER_STATE_DISCONNECT_LATER) ||
-                   peer -> incomingBandwidthThrottleEpoch == timeCurrent)
+               peer = ENET_PEER_FROM_OUTGOING_LIMITED_LIST (currentPeer);
+
+               if (ENET_PEER_COLD (peer) -> incomingBandwidthThrottleEpoch == timeCurrent)
                  continue;
 
-               if (peer -> outgoingBandwidth > 0 &&
-                   peer -> outgoingBandwidth >= bandwidthLimit)
+               if (peer -> outgoingBandwidth >= bandwidthLimit)
                  continue;
 
-               peer -> incomingBandwidthThrottleEpoch = timeCurrent;
+               ENET_PEER_COLD (peer) -> incomingBandwidthThrottleEpoch = timeCurrent;
  
                needsAdjustment = 1;
                -- peersRemaining;
@@ -477,24 +1198,8 @@ enet_host_bandwidth_throttle (ENetHost * host)
            }
        }
 
-       for (peer = host -> peers;
-            peer < & host -> peers [host -> peerCount];
-            ++ peer)
-       {
-           if (peer -> state != ENET_PEER_STATE_CONNECTED && peer -> state != ENET_PEER_STATE_DISCONNECT_LATER)
-             continue;
-
-           command.header.command = ENET_PROTOCOL_COMMAND_BANDWIDTH_LIMIT | ENET_PROTOCOL_COMMAND_FLAG_ACKNOWLEDGE;
-           command.header.channelID = 0xFF;
-           command.bandwidthLimit.outgoingBandwidth = ENET_HOST_TO_NET_32 (host -> outgoingBandwidth);
-
-           if (peer -> incomingBandwidthThrottleEpoch == timeCurrent)
-             command.bandwidthLimit.incomingBandwidth = ENET_HOST_TO_NET_32 (peer -> outgoingBandwidth);
-           else
-             command.bandwidthLimit.incomingBandwidth = ENET_HOST_TO_NET_32 (bandwidthLimit);
-
-           enet_peer_queue_outgoing_command (peer, & command, NULL, 0, 0);
-       } 
+       host -> incomingBandwidthLimit = bandwidthLimit;
+       ++ host -> bandwidthLimitEpoch;
     }
 }
     
@@ -0,0 +1,58 @@
+/** 
+ @file  atomic.h
+ @brief ENet atomic operations header
+
+ The loads and stores work on enet_uint32 values, the additions on size_t values such as packet
+ reference counts, which return the new value, and ENET_ATOMIC_LOAD_SIZE_ACQUIRE reads the latter.
+*/
+#ifndef __ENET_ATOMIC_H__
+#define __ENET_ATOMIC_H__
+
+#ifdef _MSC_VER
+
+#include <intrin.h>
+
+#pragma intrinsic (_InterlockedOr, _InterlockedExchange, _InterlockedExchangePointer, _InterlockedCompareExchangePointer)
+
+#define ENET_ATOMIC_LOAD_ACQUIRE(p) ((enet_uint32) _InterlockedOr ((volatile long *) (p), 0))
+#define ENET_ATOMIC_STORE_RELEASE(p, v) ((void) _InterlockedExchange ((volatile long *) (p), (long) (v)))
+
+#define ENET_ATOMIC_LOAD_POINTER_ACQUIRE(p) _InterlockedCompareExchangePointer ((void * volatile *) (p), NULL, NULL)
+#define ENET_ATOMIC_EXCHANGE_POINTER(p, v) _InterlockedExchangePointer ((void * volatile *) (p), (v))
+#define ENET_ATOMIC_COMPARE_EXCHANGE_POINTER(p, expected, desired) \
+    (_InterlockedCompareExchangePointer ((void * volatile *) (p), (desired), (expected)) == (void *) (expected))
+
+#define ENET_ATOMIC_FENCE() MemoryBarrier ()
+
+#ifdef _WIN64
+#pragma intrinsic (_InterlockedExchangeAdd64)
+#define ENET_ATOMIC_ADD(p, v) ((size_t) _InterlockedExchangeAdd64 ((volatile __int64 *) (p), (__int64) (v)) + (size_t) (v))
+#else
+#pragma intrinsic (_InterlockedExchangeAdd)
+#define ENET_ATOMIC_ADD(p, v) ((size_t) _InterlockedExchangeAdd ((volatile long *) (p), (long) (v)) + (size_t) (v))
+#endif
+
+#define ENET_ATOMIC_LOAD_SIZE_ACQUIRE(p) ENET_ATOMIC_ADD (p, 0)
+
+#else
+
+#define ENET_ATOMIC_LOAD_ACQUIRE(p) __atomic_load_n ((p), __ATOMIC_ACQUIRE)
+#define ENET_ATOMIC_STORE_RELEASE(p, v) __atomic_store_n ((p), (v), __ATOMIC_RELEASE)
+
+#define ENET_ATOMIC_LOAD_POINTER_ACQUIRE(p) __atomic_load_n ((p), __ATOMIC_ACQUIRE)
+#define ENET_ATOMIC_EXCHANGE_POINTER(p, v) __atomic_exchange_n ((p), (v), __ATOMIC_ACQ_REL)
+#define ENET_ATOMIC_COMPARE_EXCHANGE_POINTER(p, expected, desired) __sync_bool_compare_and_swap ((p), (expected), (desired))
+
+#define ENET_ATOMIC_FENCE() __atomic_thread_fence (__ATOMIC_SEQ_CST)
+
+#define ENET_ATOMIC_ADD(p, v) __atomic_add_fetch ((p), (v), __ATOMIC_ACQ_REL)
+
+#define ENET_ATOMIC_LOAD_SIZE_ACQUIRE(p) __atomic_load_n ((p), __ATOMIC_ACQUIRE)
+
+#endif
+
+#define ENET_ATOMIC_INCREMENT(p) ENET_ATOMIC_ADD (p, 1)
+#define ENET_ATOMIC_DECREMENT(p) ENET_ATOMIC_ADD (p, (size_t) -1)
+
+#endif /* __ENET_ATOMIC_H__ */
+
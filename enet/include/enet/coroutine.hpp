@@ -0,0 +1,623 @@
+/**
+ @file  coroutine.hpp
+ @brief ENet C++20 coroutine interface
+
+ enet::Host wraps an ENetHost and resumes the coroutines awaiting it from its own dispatch loop,
+ so that per-client logic can be written as straight-line code instead of a state machine:
+
+     enet::Task talk (enet::Peer peer)
+     {
+         while (enet::Packet packet = co_await peer.receive (0))
+           peer.send (0, std::move (packet));
+     }
+
+     enet::Task serve (enet::Host & host)
+     {
+         for (;;)
+           talk (co_await host.accept ());
+     }
+
+     serve (host);
+     while (host.service (10) >= 0);
+
+ Everything runs on the thread calling Host::service (). Awaiting does not allocate: each
+ awaiter lives in the frame of the coroutine awaiting it and is linked into the host until its
+ event arrives, and packets received before anyone awaits them are queued through their userData.
+*/
+#ifndef __ENET_COROUTINE_HPP__
+#define __ENET_COROUTINE_HPP__
+
+#include <coroutine>
+#include <exception>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "enet/enet.h"
+
+namespace enet
+{
+
+/** Destroys a packet that was not handed back to ENet. */
+struct PacketDeleter
+{
+    void operator () (ENetPacket * packet) const noexcept
+    {
+        enet_packet_destroy (packet);
+    }
+};
+
+/** A received packet, or one about to be sent. */
+typedef std::unique_ptr <ENetPacket, PacketDeleter> Packet;
+
+/** A coroutine that starts as soon as it is called and frees itself when it returns. Nothing
+    awaits it, and an exception escaping it terminates the program.
+*/
+struct Task
+{
+    struct promise_type
+    {
+        Task get_return_object () noexcept { return Task (); }
+        std::suspend_never initial_suspend () noexcept { return {}; }
+        std::suspend_never final_suspend () noexcept { return {}; }
+        void return_void () noexcept {}
+        void unhandled_exception () noexcept { std::terminate (); }
+    };
+};
+
+namespace detail
+{
+
+/** A suspended coroutine, linked into the host until the event it awaits arrives. */
+struct Waiter
+{
+    Waiter *                 next = nullptr;
+    std::coroutine_handle <> handle;
+};
+
+/** Waiters in the order they started waiting. */
+struct WaiterQueue
+{
+    Waiter * head = nullptr;
+    Waiter * tail = nullptr;
+
+    bool empty () const noexcept { return head == nullptr; }
+
+    void push (Waiter * waiter) noexcept
+    {
+        waiter -> next = nullptr;
+        if (tail != nullptr)
+          tail -> next = waiter;
+        else
+          head = waiter;
+        tail = waiter;
+    }
+
+    Waiter * pop () noexcept
+    {
+        Waiter * waiter = head;
+        if (waiter != nullptr && (head = waiter -> next) == nullptr)
+          tail = nullptr;
+        return waiter;
+    }
+
+    /** Removes and returns the first waiter for which match is true. */
+    template <typename Match>
+    Waiter * take (Match match) noexcept
+    {
+        Waiter * previous = nullptr;
+
+        for (Waiter * waiter = head; waiter != nullptr; previous = waiter, waiter = waiter -> next)
+        {
+            if (! match (waiter))
+              continue;
+
+            if (previous != nullptr)
+              previous -> next = waiter -> next;
+            else
+              head = waiter -> next;
+            if (tail == waiter)
+              tail = previous;
+            return waiter;
+        }
+
+        return nullptr;
+    }
+};
+
+/** Packets received on a channel that nobody awaited yet, linked through their userData. */
+struct PacketQueue
+{
+    ENetPacket * head = nullptr;
+    ENetPacket * tail = nullptr;
+
+    void push (ENetPacket * packet) noexcept
+    {
+        packet -> userData = nullptr;
+        if (tail != nullptr)
+          tail -> userData = packet;
+        else
+          head = packet;
+        tail = packet;
+    }
+
+    ENetPacket * pop () noexcept
+    {
+        ENetPacket * packet = head;
+        if (packet == nullptr)
+          return nullptr;
+        if ((head = (ENetPacket *) packet -> userData) == nullptr)
+          tail = nullptr;
+        packet -> userData = nullptr;
+        return packet;
+    }
+
+    void clear () noexcept
+    {
+        while (ENetPacket * packet = pop ())
+          enet_packet_destroy (packet);
+    }
+};
+
+/** What the host tracks for each peer ID, reused by every connection made through it. */
+struct PeerState
+{
+    ENetPeer *                peer = nullptr;
+    enet_uint32               connectID = 0;       /**< identifies the connection, so that a Peer of an earlier one sees it ended */
+    bool                      connected = false;
+    bool                      claimed = false;     /**< handed out by Host::accept () or Host::connect () */
+    bool                      pending = false;     /**< in the queue of connections waiting for Host::accept () */
+    bool                      flushing = false;    /**< in the list of peers awaited by Peer::flush () */
+    PeerState *               nextPending = nullptr;
+    PeerState *               nextFlushing = nullptr;
+    Waiter *                  connector = nullptr; /**< the Host::connect () that created the connection */
+    WaiterQueue               receivers;
+    WaiterQueue               flushers;
+    std::vector <PacketQueue> channels;
+
+    bool flushed () const noexcept
+    {
+        return enet_list_empty (& peer -> outgoingCommands) &&
+               enet_list_empty (& peer -> sentReliableCommands);
+    }
+};
+
+struct PeerWaiter : Waiter
+{
+    PeerState * state = nullptr;
+};
+
+struct ReceiveWaiter : Waiter
+{
+    enet_uint8   channelID = 0;
+    ENetPacket * packet = nullptr;
+};
+
+struct FlushWaiter : Waiter
+{
+    bool flushed = false;
+};
+
+} /* namespace detail */
+
+class Host;
+
+/** A connection to a remote peer, from Host::accept () or Host::connect (). Copies refer to the
+    same connection. Once it ends, receive () and flush () complete straight away.
+*/
+class Peer
+{
+public:
+    class ReceiveAwaiter;
+    class FlushAwaiter;
+
+    Peer () noexcept = default;
+
+    /** Whether this refers to a connection at all. */
+    explicit operator bool () const noexcept { return state_ != nullptr; }
+
+    ENetPeer * get () const noexcept { return state_ != nullptr ? state_ -> peer : nullptr; }
+
+    /** Whether the connection is still up. */
+    bool connected () const noexcept
+    {
+        return state_ != nullptr && state_ -> connected && state_ -> connectID == connectID_;
+    }
+
+    /** Queues a packet to be sent to the peer, as enet_peer_send ().
+        @returns 0 on success, when ENet takes the packet over, < 0 on failure
+    */
+    int send (enet_uint8 channelID, Packet packet) noexcept
+    {
+        if (! connected () || enet_peer_send (state_ -> peer, channelID, packet.get ()) < 0)
+          return -1;
+
+        packet.release ();
+        return 0;
+    }
+
+    /** Requests a disconnection from the peer, as enet_peer_disconnect (). */
+    void disconnect (enet_uint32 data = 0) noexcept
+    {
+        if (connected ())
+          enet_peer_disconnect (state_ -> peer, data);
+    }
+
+    /** Awaits the next packet received on a channel.
+        @returns the packet, or an empty Packet once the connection ends
+    */
+    ReceiveAwaiter receive (enet_uint8 channelID) noexcept;
+
+    /** Awaits the acknowledgement of everything queued to the peer so far.
+        @returns true once it is, false if the connection ends first
+    */
+    FlushAwaiter flush () noexcept;
+
+private:
+    friend class Host;
+
+    Peer (Host * host, detail::PeerState * state) noexcept
+      : host_ (host), state_ (state), connectID_ (state -> connectID) {}
+
+    Host *              host_ = nullptr;
+    detail::PeerState * state_ = nullptr;
+    enet_uint32         connectID_ = 0;
+};
+
+/** Dispatches the events of an ENetHost to the coroutines awaiting them. The ENetHost is not
+    owned, and must only be serviced through this wrapper from the moment it is wrapped.
+    Coroutines still suspended when the wrapper is destroyed are never resumed.
+*/
+class Host
+{
+public:
+    class AcceptAwaiter;
+    class ConnectAwaiter;
+
+    explicit Host (ENetHost * host) : host_ (host) {}
+
+    Host (const Host &) = delete;
+    Host & operator = (const Host &) = delete;
+
+    ~Host ()
+    {
+        for (std::unique_ptr <detail::PeerState> & state : states_)
+          if (state != nullptr)
+            for (detail::PacketQueue & queue : state -> channels)
+              queue.clear ();
+    }
+
+    ENetHost * get () const noexcept { return host_; }
+
+    /** Awaits the next incoming connection.
+        @returns the connected peer
+    */
+    AcceptAwaiter accept () noexcept;
+
+    /** Initiates a connection, as enet_host_connect (), and awaits its outcome.
+        @returns the connected peer, or an empty Peer if the connection failed
+    */
+    ConnectAwaiter connect (const ENetAddress & address, size_t channelCount, enet_uint32 data = 0) noexcept;
+
+    /** Services the host once, as enet_host_service (), then dispatches every event ready,
+        resuming the coroutines awaiting them before returning.
+        @param timeout milliseconds to wait for the first event
+        @returns the number of events dispatched, or < 0 on failure
+    */
+    int service (enet_uint32 timeout = 0)
+    {
+        ENetEvent event;
+        int events = 0,
+            result = enet_host_service (host_, & event, timeout);
+
+        while (result > 0)
+        {
+            dispatch (event);
+            ++ events;
+            result = enet_host_check_events (host_, & event);
+        }
+
+        resumeFlushed ();
+
+        return result < 0 ? result : events;
+    }
+
+private:
+    friend class Peer;
+
+    detail::PeerState * stateOf (ENetPeer * peer)
+    {
+        if (peer -> incomingPeerID >= states_.size ())
+          states_.resize (peer -> incomingPeerID + 1);
+
+        std::unique_ptr <detail::PeerState> & state = states_ [peer -> incomingPeerID];
+        if (state == nullptr)
+          state.reset (new detail::PeerState ());
+
+        state -> peer = peer;
+        return state.get ();
+    }
+
+    void dispatch (const ENetEvent & event)
+    {
+        detail::PeerState * state = stateOf (event.peer);
+
+        switch (event.type)
+        {
+        case ENET_EVENT_TYPE_CONNECT:
+            state -> connectID = event.peer -> connectID;
+            state -> connected = true;
+            state -> claimed = false;
+            state -> channels.resize (event.peer -> channelCount);
+
+            if (detail::Waiter * connector = state -> connector)
+            {
+                state -> connector = nullptr;
+                state -> claimed = true;
+                static_cast <detail::PeerWaiter *> (connector) -> state = state;
+                connector -> handle.resume ();
+            }
+            else
+            if (detail::Waiter * acceptor = acceptors_.pop ())
+            {
+                state -> claimed = true;
+                static_cast <detail::PeerWaiter *> (acceptor) -> state = state;
+                acceptor -> handle.resume ();
+            }
+            else
+            if (! state -> pending)
+            {
+                state -> pending = true;
+                state -> nextPending = nullptr;
+                if (pendingTail_ != nullptr)
+                  pendingTail_ -> nextPending = state;
+                else
+                  pendingHead_ = state;
+                pendingTail_ = state;
+            }
+            break;
+
+        case ENET_EVENT_TYPE_RECEIVE:
+        {
+            const enet_uint8 channelID = event.channelID;
+            detail::Waiter * receiver = state -> receivers.take ([channelID] (detail::Waiter * waiter)
+            {
+                return static_cast <detail::ReceiveWaiter *> (waiter) -> channelID == channelID;
+            });
+
+            if (receiver != nullptr)
+            {
+                static_cast <detail::ReceiveWaiter *> (receiver) -> packet = event.packet;
+                receiver -> handle.resume ();
+            }
+            else
+            if (state -> connected && channelID < state -> channels.size ())
+              state -> channels [channelID].push (event.packet);
+            else
+              enet_packet_destroy (event.packet);
+            break;
+        }
+
+        case ENET_EVENT_TYPE_DISCONNECT:
+            state -> connected = false;
+
+            for (detail::PacketQueue & queue : state -> channels)
+              queue.clear ();
+
+            if (detail::Waiter * connector = state -> connector)
+            {
+                state -> connector = nullptr;
+                connector -> handle.resume ();
+            }
+
+            /* a resumed coroutine finds the connection ended and does not wait again */
+            while (detail::Waiter * receiver = state -> receivers.pop ())
+              receiver -> handle.resume ();
+
+            while (detail::Waiter * flusher = state -> flushers.pop ())
+              flusher -> handle.resume ();
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    void resumeFlushed ()
+    {
+        detail::PeerState ** link = & flushingHead_;
+
+        while (detail::PeerState * state = * link)
+        {
+            if (state -> connected && ! state -> flushers.empty () && ! state -> flushed ())
+            {
+                link = & state -> nextFlushing;
+                continue;
+            }
+
+            * link = state -> nextFlushing;
+            state -> flushing = false;
+
+            while (detail::Waiter * flusher = state -> flushers.pop ())
+            {
+                static_cast <detail::FlushWaiter *> (flusher) -> flushed = state -> connected;
+                flusher -> handle.resume ();
+            }
+        }
+    }
+
+    detail::PeerState * takePending () noexcept
+    {
+        while (detail::PeerState * state = pendingHead_)
+        {
+            if ((pendingHead_ = state -> nextPending) == nullptr)
+              pendingTail_ = nullptr;
+            state -> pending = false;
+
+            /* skip connections that ended before anyone accepted them */
+            if (state -> connected && ! state -> claimed)
+            {
+                state -> claimed = true;
+                return state;
+            }
+        }
+
+        return nullptr;
+    }
+
+    ENetHost *                                        host_;
+    std::vector <std::unique_ptr <detail::PeerState>> states_;
+    detail::WaiterQueue                               acceptors_;
+    detail::PeerState *                               pendingHead_ = nullptr;
+    detail::PeerState *                               pendingTail_ = nullptr;
+    detail::PeerState *                               flushingHead_ = nullptr;
+};
+
+class Host::AcceptAwaiter : detail::PeerWaiter
+{
+public:
+    bool await_ready () noexcept
+    {
+        state = host_.takePending ();
+        return state != nullptr;
+    }
+
+    void await_suspend (std::coroutine_handle <> awaiting) noexcept
+    {
+        handle = awaiting;
+        host_.acceptors_.push (this);
+    }
+
+    Peer await_resume () noexcept { return Peer (& host_, state); }
+
+private:
+    friend class Host;
+
+    explicit AcceptAwaiter (Host & host) noexcept : host_ (host) {}
+
+    Host & host_;
+};
+
+class Host::ConnectAwaiter : detail::PeerWaiter
+{
+public:
+    bool await_ready () noexcept { return false; }
+
+    bool await_suspend (std::coroutine_handle <> awaiting) noexcept
+    {
+        ENetPeer * peer = enet_host_connect (host_.host_, & address_, channelCount_, data_);
+        if (peer == nullptr)
+          return false;
+
+        detail::PeerState * pending = host_.stateOf (peer);
+        pending -> connected = false;
+        pending -> connector = this;
+
+        handle = awaiting;
+        return true;
+    }
+
+    Peer await_resume () noexcept { return state != nullptr ? Peer (& host_, state) : Peer (); }
+
+private:
+    friend class Host;
+
+    ConnectAwaiter (Host & host, const ENetAddress & address, size_t channelCount, enet_uint32 data) noexcept
+      : host_ (host), address_ (address), channelCount_ (channelCount), data_ (data) {}
+
+    Host &      host_;
+    ENetAddress address_;
+    size_t      channelCount_;
+    enet_uint32 data_;
+};
+
+class Peer::ReceiveAwaiter : detail::ReceiveWaiter
+{
+public:
+    bool await_ready () noexcept
+    {
+        if (! peer_.connected ())
+          return true;
+
+        if (channelID < peer_.state_ -> channels.size ())
+          packet = peer_.state_ -> channels [channelID].pop ();
+        return packet != nullptr;
+    }
+
+    void await_suspend (std::coroutine_handle <> awaiting) noexcept
+    {
+        handle = awaiting;
+        peer_.state_ -> receivers.push (this);
+    }
+
+    Packet await_resume () noexcept { return Packet (packet); }
+
+private:
+    friend class Peer;
+
+    ReceiveAwaiter (const Peer & peer, enet_uint8 channel) noexcept : peer_ (peer) { channelID = channel; }
+
+    Peer peer_;
+};
+
+class Peer::FlushAwaiter : detail::FlushWaiter
+{
+public:
+    bool await_ready () noexcept
+    {
+        flushed = peer_.connected () && peer_.state_ -> flushed ();
+        return flushed || ! peer_.connected ();
+    }
+
+    void await_suspend (std::coroutine_handle <> awaiting) noexcept
+    {
+        detail::PeerState * state = peer_.state_;
+
+        handle = awaiting;
+        state -> flushers.push (this);
+
+        if (! state -> flushing)
+        {
+            state -> flushing = true;
+            state -> nextFlushing = peer_.host_ -> flushingHead_;
+            peer_.host_ -> flushingHead_ = state;
+        }
+    }
+
+    bool await_resume () noexcept { return flushed; }
+
+private:
+    friend class Peer;
+
+    explicit FlushAwaiter (const Peer & peer) noexcept : peer_ (peer) {}
+
+    Peer peer_;
+};
+
+inline Host::AcceptAwaiter
+Host::accept () noexcept
+{
+    return AcceptAwaiter (* this);
+}
+
+inline Host::ConnectAwaiter
+Host::connect (const ENetAddress & address, size_t channelCount, enet_uint32 data) noexcept
+{
+    return ConnectAwaiter (* this, address, channelCount, data);
+}
+
+inline Peer::ReceiveAwaiter
+Peer::receive (enet_uint8 channelID) noexcept
+{
+    return ReceiveAwaiter (* this, channelID);
+}
+
+inline Peer::FlushAwaiter
+Peer::flush () noexcept
+{
+    return FlushAwaiter (* this);
+}
+
+} /* namespace enet */
+
+#endif /* __ENET_COROUTINE_HPP__ */
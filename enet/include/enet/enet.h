@@ -215,6 +215,10 @@ enum
    ENET_HOST_DEFAULT_MTU                  = 1400,
    ENET_HOST_DEFAULT_MAXIMUM_PACKET_SIZE  = 32 * 1024 * 1024,
    ENET_HOST_DEFAULT_MAXIMUM_WAITING_DATA = 32 * 1024 * 1024,
+   ENET_HOST_PEER_CHUNK_SIZE              = 256,
+   ENET_HOST_PEER_CHUNK_IDLE_TIMEOUT      = 30000,
+   ENET_HOST_MINIMUM_PEER_BUCKETS         = 64,
+   ENET_HOST_DEFAULT_STATISTICS_INTERVAL  = 100,
 
    ENET_PEER_DEFAULT_ROUND_TRIP_TIME      = 500,
    ENET_PEER_DEFAULT_PACKET_THROTTLE      = 32,
@@ -235,7 +239,11 @@ enum
    ENET_PEER_FREE_UNSEQUENCED_WINDOWS     = 32,
    ENET_PEER_RELIABLE_WINDOWS             = 16,
    ENET_PEER_RELIABLE_WINDOW_SIZE         = 0x1000,
-   ENET_PEER_FREE_RELIABLE_WINDOWS        = 8
+   ENET_PEER_FREE_RELIABLE_WINDOWS        = 8,
+   ENET_PEER_WINDOW_ADAPT_INTERVAL        = 50,
+   ENET_PEER_COMPRESSION_CLASSES          = 8,
+   ENET_PEER_COMPRESSION_MAXIMUM_BACKOFF  = 64,
+   ENET_PEER_COMPRESSION_MINIMUM_YIELD    = 16
 };
 
 typedef struct _ENetChannel
@@ -248,13 +256,92 @@ typedef struct _ENetChannel
    enet_uint16  incomingUnreliableSequenceNumber;
    ENetList     incomingReliableCommands;
    ENetList     incomingUnreliableCommands;
+   enet_uint8 * outgoingDeltaBase;   /**< last delta encoded packet sent on the channel, NULL while delta encoding is disabled */
+   enet_uint8 * incomingDeltaBase;   /**< last delta encoded packet delivered on the channel, NULL until the first arrives */
+   enet_uint16  outgoingDeltaLength;
+   enet_uint16  incomingDeltaLength;
 } ENetChannel;
 
 typedef enum _ENetPeerFlag
 {
-   ENET_PEER_FLAG_NEEDS_DISPATCH = (1 << 0)
+   ENET_PEER_FLAG_NEEDS_DISPATCH     = (1 << 0),
+   ENET_PEER_FLAG_EXTENDED_PEER_ID   = (1 << 1),
+   ENET_PEER_FLAG_STREAM_RESET       = (1 << 2), /**< the next stream compressed datagram must restart the outgoing stream */
+   ENET_PEER_FLAG_STREAM_LOST        = (1 << 3), /**< the incoming stream lost a datagram and waits for the remote end to restart it */
+   ENET_PEER_FLAG_ENCRYPTED          = (1 << 4), /**< datagrams exchanged with the peer are protected with its connection key */
+   ENET_PEER_FLAG_PENDING_ZOMBIE     = (1 << 5), /**< a pipeline worker acknowledged a disconnect, the service thread makes the peer a zombie */
+   ENET_PEER_FLAG_PENDING_DISCONNECT = (1 << 6), /**< a pipeline worker found a delayed disconnect due, the service thread starts it */
+   ENET_PEER_FLAG_PENDING_PING       = (1 << 7)  /**< a pipeline worker found a ping due, the service thread queues it */
 } ENetPeerFlag;
 
+/**
+ * Statistics of a peer as last published by the thread servicing its host, read with
+ * enet_peer_get_statistics().  Only holds enet_uint32 fields, which are published one by one.
+ */
+typedef struct _ENetPeerStatistics
+{
+   enet_uint32   time;                     /**< service time of the host when the statistics were published */
+   enet_uint32   state;                    /**< the ENetPeerState of the peer */
+   enet_uint32   roundTripTime;
+   enet_uint32   roundTripTimeVariance;
+   enet_uint32   lowestRoundTripTime;
+   enet_uint32   packetLoss;               /**< as a ratio with respect to ENET_PEER_PACKET_LOSS_SCALE */
+   enet_uint32   packetLossVariance;
+   enet_uint32   packetThrottle;
+   enet_uint32   reliableDataInTransit;
+   enet_uint32   windowSize;
+   enet_uint32   mtu;
+   enet_uint32   incomingBandwidth;
+   enet_uint32   outgoingBandwidth;
+} ENetPeerStatistics;
+
+/**
+ * Rarely touched per-peer state: throttle tuning, bandwidth recalculation epochs, adaptive
+ * window measurements, compression and encryption state, the unsequenced packet window and the published statistics.
+ * These are ordinary fields of ENetPeer, at its end, unless ENET_PEER_COLD_SPLIT is defined.  Then they live in an
+ * ENetPeerCold side table allocated with each peer chunk so that peer sweeps only walk the hot ENetPeer fields.
+ * Code that must build either way accesses them through ENET_PEER_COLD(), which is the peer itself by default.
+ */
+#define ENET_PEER_COLD_FIELDS \
+   enet_uint32   incomingBandwidthThrottleEpoch;                                                                                                   \
+   enet_uint32   outgoingBandwidthThrottleEpoch;                                                                                                   \
+   enet_uint32   advertisedIncomingBandwidth;                                                                                                      \
+   enet_uint32   advertisedOutgoingBandwidth;                                                                                                      \
+   enet_uint32   packetThrottleAcceleration;                                                                                                       \
+   enet_uint32   packetThrottleDeceleration;                                                                                                       \
+   enet_uint32   packetThrottleInterval;                                                                                                           \
+   enet_uint32   maximumWindowSize;                                                                                                                \
+   enet_uint32   windowEpoch;                                                                                                                      \
+   enet_uint32   windowDataAcknowledged;                                                                                                           \
+   enet_uint8    compressionBackoff [ENET_PEER_COMPRESSION_CLASSES]; /**< per datagram size class, datagrams to skip after the next poor result */ \
+   enet_uint8    compressionSkip [ENET_PEER_COMPRESSION_CLASSES];    /**< per datagram size class, datagrams left to send without compressing */   \
+   enet_uint8    outgoingStreamSequence;                                                                                                           \
+   enet_uint8    incomingStreamSequence;                                                                                                           \
+   void *        outgoingStream;     /**< stream compressor state for datagrams sent to the peer */                                                \
+   void *        incomingStream;     /**< stream compressor state for datagrams received from the peer */                                          \
+   enet_uint8    outgoingKey [32];            /**< key protecting the datagrams sent to the peer */                                                \
+   enet_uint8    incomingKey [32];            /**< key protecting the datagrams received from the peer */                                          \
+   enet_uint8    encryptionSalt [16];         /**< salt of the CONNECT command, which the client needs again for VERIFY_CONNECT */                 \
+   enet_uint8    outgoingNoncePrefix [8];     /**< random first part of the nonces sent to the peer */                                             \
+   enet_uint32   outgoingNonce;               /**< counter completing the next nonce sent to the peer */                                           \
+   enet_uint8    incomingNoncePrefix [8];                                                                                                          \
+   enet_uint32   incomingNonce;               /**< highest nonce counter received from the peer */                                                 \
+   enet_uint32   incomingNonceWindow;         /**< bit n set if incomingNonce - n was received, 0 before the first datagram */                     \
+   enet_uint16   incomingUnsequencedGroup;                                                                                                         \
+   enet_uint16   outgoingUnsequencedGroup;                                                                                                         \
+   enet_uint32   unsequencedWindow [ENET_PEER_UNSEQUENCED_WINDOW_SIZE / 32];                                                                       \
+   volatile enet_uint32 statisticsSequence;   /**< odd while the statistics are being published */                                                 \
+   ENetPeerStatistics   statistics;
+
+#ifdef ENET_PEER_COLD_SPLIT
+typedef struct _ENetPeerCold
+{
+   ENET_PEER_COLD_FIELDS
+} ENetPeerCold;
+#else
+typedef struct _ENetPeer ENetPeerCold;
+#endif
+
 /**
  * An ENet peer which data packets may be sent or received from. 
  *
@@ -262,68 +349,98 @@ typedef enum _ENetPeerFlag
  */
 typedef struct _ENetPeer
 { 
-   ENetListNode  dispatchList;
-   struct _ENetHost * host;
+   ENetListNode  dispatchList;       /**< must stay first, the dispatch queue casts nodes back to peers */
+   ENetPeerState state;
+   enet_uint16   flags;
    enet_uint16   outgoingPeerID;
-   enet_uint16   incomingPeerID;
+   enet_uint32   nextTimeout;
+   enet_uint32   earliestTimeout;
+   enet_uint32   lastSendTime;
+   enet_uint32   lastReceiveTime;
+   enet_uint32   pingInterval;
+   enet_uint32   reliableDataInTransit;
+   enet_uint32   bandwidthThrottleEpoch; /**< the bandwidth throttle of the host that the data totals and packet throttle limit are up to date with */
+   enet_uint32   bandwidthLimitEpoch;    /**< the bandwidth recalculation of the host that the advertised bandwidth is up to date with */
+   ENetList      acknowledgements;
+   ENetList      sentReliableCommands;
+   ENetList      sentUnreliableCommands;
+   ENetList      outgoingCommands;
+   struct _ENetHost * host;
    enet_uint32   connectID;
+   enet_uint16   incomingPeerID;
    enet_uint8    outgoingSessionID;
    enet_uint8    incomingSessionID;
+   enet_uint16   capabilities;       /**< ENET_PROTOCOL_CAPABILITY_* flags negotiated with the peer */
    ENetAddress   address;            /**< Internet address of the peer */
-   void *        data;               /**< Application private data, may be freely modified */
-   ENetPeerState state;
+   ENetListNode  lookupList;         /**< free list entry while disconnected, address bucket entry otherwise */
+   enet_uint32   mtu;
+   enet_uint32   windowSize;
+   enet_uint32   packetThrottle;
+   enet_uint32   packetThrottleLimit;
+   enet_uint32   packetThrottleCounter;
+   enet_uint32   packetThrottleEpoch;
+   enet_uint32   roundTripTime;            /**< mean round trip time (RTT), in milliseconds, between sending a reliable packet and receiving its acknowledgement */
+   enet_uint32   roundTripTimeVariance;
+   enet_uint32   timeoutLimit;
+   enet_uint32   timeoutMinimum;
+   enet_uint32   timeoutMaximum;
+   enet_uint32   incomingDataTotal;
+   enet_uint32   outgoingDataTotal;
+   enet_uint16   outgoingReliableSequenceNumber;
+   enet_uint16   reserved;
    ENetChannel * channels;
    size_t        channelCount;       /**< Number of channels allocated for communication with peer */
+   void *        data;               /**< Application private data, may be freely modified */
+   ENetList      dispatchedCommands;
+   size_t        totalWaitingData;
+   enet_uint32   eventData;
    enet_uint32   incomingBandwidth;  /**< Downstream bandwidth of the client in bytes/second */
    enet_uint32   outgoingBandwidth;  /**< Upstream bandwidth of the client in bytes/second */
-   enet_uint32   incomingBandwidthThrottleEpoch;
-   enet_uint32   outgoingBandwidthThrottleEpoch;
-   enet_uint32   incomingDataTotal;
-   enet_uint32   outgoingDataTotal;
-   enet_uint32   lastSendTime;
-   enet_uint32   lastReceiveTime;
-   enet_uint32   nextTimeout;
-   enet_uint32   earliestTimeout;
    enet_uint32   packetLossEpoch;
    enet_uint32   packetsSent;
    enet_uint32   packetsLost;
    enet_uint32   packetLoss;          /**< mean packet loss of reliable packets as a ratio with respect to the constant ENET_PEER_PACKET_LOSS_SCALE */
    enet_uint32   packetLossVariance;
-   enet_uint32   packetThrottle;
-   enet_uint32   packetThrottleLimit;
-   enet_uint32   packetThrottleCounter;
-   enet_uint32   packetThrottleEpoch;
-   enet_uint32   packetThrottleAcceleration;
-   enet_uint32   packetThrottleDeceleration;
-   enet_uint32   packetThrottleInterval;
-   enet_uint32   pingInterval;
-   enet_uint32   timeoutLimit;
-   enet_uint32   timeoutMinimum;
-   enet_uint32   timeoutMaximum;
    enet_uint32   lastRoundTripTime;
    enet_uint32   lowestRoundTripTime;
    enet_uint32   lastRoundTripTimeVariance;
    enet_uint32   highestRoundTripTimeVariance;
-   enet_uint32   roundTripTime;            /**< mean round trip time (RTT), in milliseconds, between sending a reliable packet and receiving its acknowledgement */
-   enet_uint32   roundTripTimeVariance;
-   enet_uint32   mtu;
-   enet_uint32   windowSize;
-   enet_uint32   reliableDataInTransit;
-   enet_uint16   outgoingReliableSequenceNumber;
-   ENetList      acknowledgements;
-   ENetList      sentReliableCommands;
-   ENetList      sentUnreliableCommands;
-   ENetList      outgoingCommands;
-   ENetList      dispatchedCommands;
-   enet_uint16   flags;
-   enet_uint16   reserved;
-   enet_uint16   incomingUnsequencedGroup;
-   enet_uint16   outgoingUnsequencedGroup;
-   enet_uint32   unsequencedWindow [ENET_PEER_UNSEQUENCED_WINDOW_SIZE / 32]; 
-   enet_uint32   eventData;
-   size_t        totalWaitingData;
+   ENetListNode  limitedList;
+   ENetListNode  outgoingLimitedList;
+#ifdef ENET_PEER_COLD_SPLIT
+   ENetPeerCold * cold;
+#else
+   ENET_PEER_COLD_FIELDS
+#endif
 } ENetPeer;
 
+#ifdef ENET_PEER_COLD_SPLIT
+#define ENET_PEER_COLD(peer) ((peer) -> cold)
+#else
+#define ENET_PEER_COLD(peer) (peer)
+#endif
+
+#define ENET_PEER_FROM_LIST_NODE(node, field) ((ENetPeer *) ((enet_uint8 *) (node) - (size_t) & ((ENetPeer *) 0) -> field))
+#define ENET_PEER_FROM_LIMITED_LIST(node) ENET_PEER_FROM_LIST_NODE (node, limitedList)
+#define ENET_PEER_FROM_OUTGOING_LIMITED_LIST(node) ENET_PEER_FROM_LIST_NODE (node, outgoingLimitedList)
+#define ENET_PEER_FROM_LOOKUP_LIST(node) ENET_PEER_FROM_LIST_NODE (node, lookupList)
+
+/**
+ * A fixed-size block of peers.  Chunks are allocated as connections arrive and never
+ * move, so peer pointers and IDs stay stable.  They are only freed again by a host that
+ * releases idle peer chunks, which invalidates pointers to the disconnected peers in them.
+ */
+typedef struct _ENetPeerChunk
+{
+   ENetPeer *     peers;
+#ifdef ENET_PEER_COLD_SPLIT
+   ENetPeerCold * cold;
+#endif
+   size_t         peerCount;
+   size_t         usedPeers;
+   enet_uint32    idleTime;
+} ENetPeerChunk;
+
 /** An ENet packet compressor for compressing UDP packets before socket sends or receives.
  */
 typedef struct _ENetCompressor
@@ -336,14 +453,234 @@ typedef struct _ENetCompressor
    size_t (ENET_CALLBACK * decompress) (void * context, const enet_uint8 * inData, size_t inLimit, enet_uint8 * outData, size_t outLimit);
    /** Destroys the context when compression is disabled or the host is destroyed. May be NULL. */
    void (ENET_CALLBACK * destroy) (void * context);
+   /** Creates another context that compresses and decompresses exactly like context, for use by a pipeline worker thread. Should return NULL on failure. May be NULL, in which case the host compresses on its service thread only. */
+   void * (ENET_CALLBACK * clone) (void * context);
 } ENetCompressor;
 
+/** An ENet stream compressor, which keeps history for each direction of each connection so that a
+    datagram may refer back to data sent earlier in the stream rather than only to itself.
+    Compression is only used with peers that negotiate ENET_PROTOCOL_CAPABILITY_STREAM_COMPRESSION,
+    and both ends must use the same stream compressor.
+ */
+typedef struct _ENetStreamCompressor
+{
+   /** Context data shared by all streams, e.g. a dictionary. Must be non-NULL. */
+   void * context;
+   /** Creates the state for one direction of one connection. Should return NULL on failure. */
+   void * (ENET_CALLBACK * create) (void * context);
+   /** Compresses like ENetCompressor::compress, but may refer back to earlier datagrams of the stream. The input only becomes part of the history when this returns non-zero. */
+   size_t (ENET_CALLBACK * compress) (void * stream, const ENetBuffer * inBuffers, size_t inBufferCount, size_t inLimit, enet_uint8 * outData, size_t outLimit);
+   /** Decompresses like ENetCompressor::decompress. The output only becomes part of the history when this returns non-zero. */
+   size_t (ENET_CALLBACK * decompress) (void * stream, const enet_uint8 * inData, size_t inLimit, enet_uint8 * outData, size_t outLimit);
+   /** Discards the history of a stream, returning it to the state it was created in. */
+   void (ENET_CALLBACK * reset) (void * stream);
+   /** Destroys the state of one stream. */
+   void (ENET_CALLBACK * destroyStream) (void * stream);
+   /** Destroys the context when stream compression is disabled or the host is destroyed. May be NULL. */
+   void (ENET_CALLBACK * destroy) (void * context);
+} ENetStreamCompressor;
+
 /** Callback that computes the checksum of the data held in buffers[0:bufferCount-1] */
 typedef enet_uint32 (ENET_CALLBACK * ENetChecksumCallback) (const ENetBuffer * buffers, size_t bufferCount);
 
 /** Callback for intercepting received raw UDP packets. Should return 1 to intercept, 0 to ignore, or -1 to propagate an error. */
 typedef int (ENET_CALLBACK * ENetInterceptCallback) (struct _ENetHost * host, struct _ENetEvent * event);
+
+/** Entry point of a thread started with enet_thread_create() */
+typedef void (ENET_CALLBACK * ENetThreadFunction) (void * data);
+
+enum
+{
+   ENET_PIPELINE_MAXIMUM_WORKERS        = 16,
+   ENET_PIPELINE_MAXIMUM_DATAGRAMS      = 32,
+   ENET_PIPELINE_MAXIMUM_SEND_DATAGRAMS = 256
+};
+
+typedef enum _ENetPipelineStatus
+{
+   ENET_PIPELINE_STATUS_PENDING   = 0,  /**< the service thread still has to decompress and verify the datagram */
+   ENET_PIPELINE_STATUS_VERIFIED  = 1,
+   ENET_PIPELINE_STATUS_REJECTED  = 2,
+   ENET_PIPELINE_STATUS_DECRYPTED = 3   /**< decrypted, but the service thread still has to decompress and verify it */
+} ENetPipelineStatus;
+
+/** A datagram handed to the pipeline workers. Outgoing datagrams are queued uncompressed with their
+    checksum field holding the connect ID; the workers compress, checksum and encrypt them. Incoming datagrams
+    are decrypted, decompressed and verified against the peer they were addressed to when they were received.
+ */
+typedef struct _ENetPipelineDatagram
+{
+   ENetPeer *         peer;
+   ENetAddress        address;
+   enet_uint32        connectID;        /**< connect ID the datagram was verified with */
+   ENetPipelineStatus status;
+   size_t             headerSize;
+   size_t             checksumOffset;   /**< offset of the checksum field, 0 if the host uses no checksum */
+   int                compress;         /**< whether a worker should try the packet compressor on an outgoing datagram */
+   int                encrypt;          /**< whether a worker should encrypt an outgoing datagram, which is then sent with its tag, or decrypted an incoming one */
+   size_t             dataLength;
+   size_t             outputLength;     /**< length of the compressed or decompressed copy in output, 0 if there is none */
+   enet_uint8         data [ENET_PROTOCOL_MAXIMUM_MTU + sizeof (enet_uint32)];   /**< the checksum is not counted against the MTU */
+   enet_uint8         output [ENET_PROTOCOL_MAXIMUM_MTU + sizeof (enet_uint32)];
+} ENetPipelineDatagram;
+
+/** Scratch space for assembling the datagram for one peer, as the commands and the buffers that gather
+    them and their packet data behind a header. The host assembles in its own, and the service thread
+    and every pipeline worker in another, so that datagrams for different peers can be assembled at once.
+ */
+typedef struct _ENetSendScratch
+{
+   int          deferred;          /**< whether changes reaching beyond the peer are left to the service thread with ENET_PEER_FLAG_PENDING_* */
+   int          continueSending;   /**< set when a peer had more to send than fit into its datagram */
+   size_t       packetSize;
+   enet_uint16  headerFlags;
+   ENetProtocol commands [ENET_PROTOCOL_MAXIMUM_PACKET_COMMANDS];
+   size_t       commandCount;
+   ENetBuffer   buffers [ENET_BUFFER_MAXIMUM];
+   size_t       bufferCount;
+   enet_uint8   headerData [sizeof (ENetProtocolHeader) + sizeof (enet_uint16) + ENET_PROTOCOL_ENCRYPTION_NONCE_SIZE + sizeof (enet_uint32)];
+} ENetSendScratch;
+
+typedef void (ENET_CALLBACK * ENetPipelineCallback) (struct _ENetHost * host, void * compressorContext, ENetSendScratch * scratch, ENetPipelineDatagram * datagram);
+
+typedef struct _ENetPipelineWorker
+{
+   struct _ENetPipeline * pipeline;
+   ENetThread             thread;
+   void *                 compressorContext;
+   ENetSendScratch        scratch;
+} ENetPipelineWorker;
+
+/** A small pool of threads that assemble, compress and checksum datagrams in batches for the service
+    thread, which works on the batch as well and then sends or handles the datagrams in their original order.
+    @sa enet_host_pipeline()
+ */
+typedef struct _ENetPipeline
+{
+   struct _ENetHost *     host;
+   ENetMutex              mutex;
+   ENetCondition          workAvailable;
+   ENetCondition          workDone;
+   ENetPipelineWorker     workers [ENET_PIPELINE_MAXIMUM_WORKERS];
+   size_t                 workerCount;
+   ENetCompressor         compressor;       /**< compressor the worker contexts were cloned from, context is NULL if they could not be */
+   ENetPipelineCallback   callback;
+   ENetPipelineDatagram * batch;
+   size_t                 batchLength;
+   size_t                 nextDatagram;
+   size_t                 finishedDatagrams;
+   enet_uint32            generation;
+   int                    shutdown;
+   ENetSendScratch        scratch;          /**< scratch space of the service thread while it works on a batch */
+   ENetPipelineDatagram   sendDatagrams [ENET_PIPELINE_MAXIMUM_SEND_DATAGRAMS];
+   size_t                 sendCount;
+   ENetPipelineDatagram   receiveDatagrams [ENET_PIPELINE_MAXIMUM_DATAGRAMS];
+   size_t                 receiveCount;
+   size_t                 receiveIndex;     /**< next received datagram to handle; the rest wait for the next call */
+} ENetPipeline;
  
+enum
+{
+   ENET_RING_CACHE_LINE_SIZE = 64
+};
+
+/** A bounded queue of fixed size entries passed from exactly one producer thread to exactly one
+    consumer thread. Each side only advances its own index and keeps a cached copy of the other,
+    so neither side ever waits for the other and the shared cache lines are rarely touched.
+    @sa enet_host_thread_create()
+    @sa enet_sharded_host_create()
+ */
+typedef struct _ENetRing
+{
+   enet_uint8 *         entries;
+   size_t               entrySize;
+   enet_uint32          mask;                                 /**< capacity - 1, the capacity is a power of two */
+   enet_uint8           padding0 [ENET_RING_CACHE_LINE_SIZE];
+   volatile enet_uint32 head;                                 /**< next entry to write, only advanced by the producer */
+   enet_uint32          tailCache;                            /**< the producer's last reading of tail */
+   enet_uint8           padding1 [ENET_RING_CACHE_LINE_SIZE];
+   volatile enet_uint32 tail;                                 /**< next entry to read, only advanced by the consumer */
+   enet_uint32          headCache;                            /**< the consumer's last reading of head */
+   enet_uint8           padding2 [ENET_RING_CACHE_LINE_SIZE];
+} ENetRing;
+
+enum
+{
+   ENET_SHARD_MAXIMUM_SHARDS      = 16,
+   ENET_SHARD_DATAGRAMS           = 256,
+   ENET_SHARD_RECEIVE_TIMEOUT     = 100,
+   ENET_SHARD_PEER_MIGRATING      = 0x80, /**< set in peerShards while a peer moves to the shard named by the rest of the entry */
+   ENET_SHARD_PEER_RETURNING      = 0x40, /**< set in peerShards while an ID that a shard took over goes back to the shard named by the rest of the entry, whose chunk it is in */
+   ENET_SHARD_REBALANCE_THRESHOLD = 4,    /**< peers a shard must serve beyond the least loaded one before it hands any over */
+   ENET_SHARD_REBALANCE_PEERS     = 32    /**< most peers a shard hands over per rebalancing */
+};
+
+/** A datagram read by the receive thread of a sharded host, waiting for its shard. */
+typedef struct _ENetShardDatagram
+{
+   ENetAddress address;
+   size_t      dataLength;
+   enet_uint8  data [ENET_PROTOCOL_MAXIMUM_MTU];
+} ENetShardDatagram;
+
+/** The receiving side of one host of an ENetShardedHost, which reads its datagrams from a ring
+    filled by the receive thread instead of from the socket it shares with the other shards.
+ */
+typedef struct _ENetHostShard
+{
+   ENetRing             datagrams;
+   ENetMutex            mutex;
+   ENetCondition        datagramsAvailable;
+   volatile enet_uint32 waiting;              /**< nonzero while the shard sleeps on datagramsAvailable */
+   enet_uint32          droppedDatagrams;     /**< datagrams dropped because the shard fell behind, user should reset to 0 as needed to prevent overflow */
+   struct _ENetShardedHost * sharded;
+   enet_uint32          index;
+   volatile enet_uint32 load;                 /**< peers the host of the shard serves, published by its service thread */
+   volatile size_t      arrivingPeers;        /**< peers migrating to the shard that it has not taken over yet */
+   enet_uint32          rebalanceEpoch;
+} ENetHostShard;
+
+/**
+ * Counters of a host as last published by the thread servicing it, read with
+ * enet_host_get_statistics().  Only holds enet_uint32 fields, which are published one by one.
+ */
+typedef struct _ENetHostStatistics
+{
+   enet_uint32 time;                       /**< service time of the host when the counters were published */
+   enet_uint32 connectedPeers;
+   enet_uint32 bandwidthLimitedPeers;
+   enet_uint32 totalSentData;
+   enet_uint32 totalSentPackets;
+   enet_uint32 totalReceivedData;
+   enet_uint32 totalReceivedPackets;
+   enet_uint32 totalCompressionAttempts;
+   enet_uint32 totalCompressionBypasses;
+   enet_uint32 totalCompressionInput;
+   enet_uint32 totalCompressionSaved;
+} ENetHostStatistics;
+
+/** A peer detached from its host by enet_peer_migrate(), owning its queued commands, channels and
+    stream compressor state until the host it moves to takes it over. */
+typedef struct _ENetPeerMigration
+{
+   ENetPeer                     peer;
+#ifdef ENET_PEER_COLD_SPLIT
+   ENetPeerCold                 cold;
+#endif
+} ENetPeerMigration;
+
+/** A send queued by another thread with enet_peer_send_async(), enet_host_broadcast_async() or
+    enet_broadcast_bus_broadcast(), or a peer migrating to the host. */
+typedef struct _ENetHostSubmission
+{
+   struct _ENetHostSubmission * next;
+   enet_uint16                  peerID;      /**< incoming peer ID of the destination, ENET_PROTOCOL_MAXIMUM_PEER_ID to broadcast */
+   enet_uint32                  connectID;   /**< connect ID of the destination when queued, so that a send is dropped once the peer with that ID is a different one */
+   enet_uint8                   channelID;
+   ENetPacket *                 packet;      /**< if NULL, with no migration, the IDs returning to the host in the chunk of peerID instead of a send */
+   ENetPeerMigration *          migration;   /**< if not NULL, a peer to take over instead of a send */
+} ENetHostSubmission;
+
 /** An ENet host for communicating with peers.
   *
   * No fields should be modified unless otherwise stated.
@@ -356,6 +693,7 @@ typedef int (ENET_CALLBACK * ENetInterceptCallback) (struct _ENetHost * host, st
     @sa enet_host_broadcast()
     @sa enet_host_compress()
     @sa enet_host_compress_with_range_coder()
+    @sa enet_host_compress_stream()
     @sa enet_host_channel_limit()
     @sa enet_host_bandwidth_limit()
     @sa enet_host_bandwidth_throttle()
@@ -367,23 +705,39 @@ typedef struct _ENetHost
    enet_uint32          incomingBandwidth;           /**< downstream bandwidth of the host */
    enet_uint32          outgoingBandwidth;           /**< upstream bandwidth of the host */
    enet_uint32          bandwidthThrottleEpoch;
+   enet_uint32          outgoingDataTotal;
+   enet_uint32          packetThrottleLimit;         /**< packet throttle limit shared by the peers without an incoming bandwidth limit */
+   enet_uint32          incomingBandwidthLimit;      /**< share of the incoming bandwidth advertised to the peers whose upstream exceeds it */
+   enet_uint32          bandwidthLimitEpoch;
    enet_uint32          mtu;
    enet_uint32          randomSeed;
    int                  recalculateBandwidthLimits;
-   ENetPeer *           peers;                       /**< array of peers allocated for this host */
-   size_t               peerCount;                   /**< number of peers allocated for this host */
+   ENetPeerChunk *      peerChunks;                  /**< peer storage, use enet_host_get_peer() to look up peers by ID */
+   size_t               peerChunkCount;
+   size_t               peerCount;                   /**< maximum number of peers that may be allocated for this host */
+   size_t               allocatedPeers;              /**< number of peers currently allocated for this host */
+   ENetList             freePeers;                   /**< disconnected peers addressable by legacy 12-bit peer IDs */
+   ENetList             freeExtendedPeers;           /**< disconnected peers only addressable through extended headers */
+   ENetList *           peerBuckets;                 /**< peers in use, hashed by address host */
+   size_t               peerBucketMask;
+   size_t               peerChunkStride;             /**< only chunks whose index is peerChunkOffset modulo peerChunkStride are grown for new connections, so that sharded hosts start out owning disjoint peer IDs */
+   size_t               peerChunkOffset;
+   int                  releasePeerChunks;           /**< nonzero if peer chunks that stay unused are released, which invalidates pointers to their peers, see enet_host_release_peer_chunks() */
+   int                  keepPeerChunks;              /**< nonzero while another thread may hold peer pointers, which keeps idle peer chunks allocated even if releasePeerChunks is set */
+   enet_uint16          capabilities;                /**< ENET_PROTOCOL_CAPABILITY_* flags offered to remote hosts, defaults to all supported; stream compression is offered while a stream compressor is set */
+   enet_uint32          maximumWindowSize;           /**< largest reliable window an adaptive peer may grow to, up to ENET_PROTOCOL_MAXIMUM_ADAPTIVE_WINDOW_SIZE; defaults to ENET_HOST_RECEIVE_BUFFER_SIZE as a whole window can arrive in one burst, so raise it only along with the socket receive buffer */
    size_t               channelLimit;                /**< maximum number of channels allowed for connected peers */
    enet_uint32          serviceTime;
    ENetList             dispatchQueue;
    int                  continueSending;
-   size_t               packetSize;
-   enet_uint16          headerFlags;
-   ENetProtocol         commands [ENET_PROTOCOL_MAXIMUM_PACKET_COMMANDS];
-   size_t               commandCount;
-   ENetBuffer           buffers [ENET_BUFFER_MAXIMUM];
-   size_t               bufferCount;
+   ENetSendScratch      sendScratch;                 /**< where the service thread assembles datagrams unless the pipeline does */
    ENetChecksumCallback checksum;                    /**< callback the user can set to enable packet checksums for this host */
    ENetCompressor       compressor;
+   ENetStreamCompressor streamCompressor;
+   ENetPipeline *       pipeline;                    /**< worker threads for datagram assembly, compression and checksums, NULL unless enabled with enet_host_pipeline() */
+   ENetHostShard *      shard;                       /**< set on the hosts of an ENetShardedHost, which receive through it rather than from the socket */
+   ENetHostSubmission * submissions;                 /**< sends queued by other threads, newest first, run at the start of enet_host_service() */
+   enet_uint8           encryptionKey [32];          /**< pre-shared key set with enet_host_encrypt() */
    enet_uint8           packetData [2][ENET_PROTOCOL_MAXIMUM_MTU];
    ENetAddress          receivedAddress;
    enet_uint8 *         receivedData;
@@ -392,10 +746,21 @@ typedef struct _ENetHost
    enet_uint32          totalSentPackets;            /**< total UDP packets sent, user should reset to 0 as needed to prevent overflow */
    enet_uint32          totalReceivedData;           /**< total data received, user should reset to 0 as needed to prevent overflow */
    enet_uint32          totalReceivedPackets;        /**< total UDP packets received, user should reset to 0 as needed to prevent overflow */
+   enet_uint32          totalCompressionAttempts;    /**< total UDP packets the compressor was run on, user should reset to 0 as needed to prevent overflow */
+   enet_uint32          totalCompressionBypasses;    /**< total UDP packets sent without running the compressor because it was not expected to pay off */
+   enet_uint32          totalCompressionInput;       /**< total bytes fed to the compressor, proportional to the CPU spent compressing */
+   enet_uint32          totalCompressionSaved;       /**< total bytes saved by compression */
    ENetInterceptCallback intercept;                  /**< callback the user can set to intercept received raw UDP packets */
+   enet_uint32          statisticsInterval;          /**< milliseconds between statistics snapshots for enet_host_get_statistics() and enet_peer_get_statistics(), defaults to ENET_HOST_DEFAULT_STATISTICS_INTERVAL */
+   enet_uint32          statisticsEpoch;
+   volatile enet_uint32 statisticsSequence;          /**< odd while the statistics are being published */
+   ENetHostStatistics   statistics;
    size_t               connectedPeers;
    size_t               bandwidthLimitedPeers;
-   size_t               duplicatePeers;              /**< optional number of allowed peers from duplicate IPs, defaults to ENET_PROTOCOL_MAXIMUM_PEER_ID */
+   ENetList             limitedPeers;
+   size_t               outgoingBandwidthLimitedPeers;
+   ENetList             outgoingLimitedPeers;
+   size_t               duplicatePeers;              /**< optional number of allowed peers from duplicate IPs, defaults to ENET_PROTOCOL_MAXIMUM_EXTENDED_PEER_ID */
    size_t               maximumPacketSize;           /**< the maximum allowable packet size that may be sent or received on a peer */
    size_t               maximumWaitingData;          /**< the maximum aggregate amount of buffer space a peer may use waiting for packets to be delivered */
 } ENetHost;
@@ -445,6 +810,83 @@ typedef struct _ENetEvent
    ENetPacket *         packet;    /**< packet associated with the event, if appropriate */
 } ENetEvent;
 
+typedef enum _ENetHostCommandType
+{
+   ENET_HOST_COMMAND_SEND             = 0,
+   ENET_HOST_COMMAND_BROADCAST        = 1,
+   ENET_HOST_COMMAND_DISCONNECT       = 2,
+   ENET_HOST_COMMAND_DISCONNECT_NOW   = 3,
+   ENET_HOST_COMMAND_DISCONNECT_LATER = 4
+} ENetHostCommandType;
+
+/** A request from the application to the thread servicing a host. */
+typedef struct _ENetHostCommand
+{
+   ENetHostCommandType type;
+   ENetPeer *          peer;
+   enet_uint32         eventCount;   /**< number of events the application had received when it made the request */
+   enet_uint8          channelID;
+   enet_uint32         data;
+   ENetPacket *        packet;
+} ENetHostCommand;
+
+/** A thread that owns an ENet host and services it continuously, so that acknowledgements, resends
+    and pings never wait on the application. Events reach the application and its requests reach the
+    host through a pair of ENetRing queues.
+    @sa enet_host_thread_create()
+ */
+typedef struct _ENetHostThread
+{
+   ENetHost *           host;
+   ENetThread           thread;
+   enet_uint32          serviceTimeout;
+   ENetRing             events;             /**< events from the service thread to the application */
+   ENetRing             commands;           /**< requests from the application to the service thread */
+   enet_uint32          eventsQueued;       /**< events queued so far, only used by the service thread */
+   enet_uint32          eventsReceived;     /**< events received so far, only used by the application */
+   enet_uint32 *        connectEvents;      /**< for each incoming peer ID, eventsQueued just after its latest connect event */
+   enet_uint32          eventsDeferred;     /**< times the service thread found the event queue full, user should reset to 0 as needed to prevent overflow */
+   volatile enet_uint32 stop;
+   volatile enet_uint32 error;
+} ENetHostThread;
+
+/** A set of hosts sharing one socket, each owning a disjoint set of peer IDs. A receive thread
+    reads every datagram and hands it to the shard owning the peer ID in its header, or for a
+    connection request to the shard its address hashes to, so that each shard may be serviced
+    on its own thread.
+    @sa enet_sharded_host_create()
+ */
+typedef struct _ENetShardedHost
+{
+   ENetSocket           socket;
+   ENetAddress          address;
+   ENetThread           receiver;
+   volatile enet_uint32 stop;
+   size_t               shardCount;
+   ENetHost *           hosts [ENET_SHARD_MAXIMUM_SHARDS];
+   ENetHostShard        shards [ENET_SHARD_MAXIMUM_SHARDS];
+   volatile enet_uint32 * peerShards;        /**< for each peer ID, the shard owning it, which alone may use it */
+   enet_uint32          rebalanceInterval;   /**< milliseconds between the checks each shard makes for peers to hand over to a less loaded one, 0 to never rebalance */
+} ENetShardedHost;
+
+enum
+{
+   ENET_BROADCAST_BUS_MAXIMUM_HOSTS = 64
+};
+
+/** A set of hosts, each serviced by its own thread, that packets may be broadcast to as one.
+    A broadcast hands one reference to the same packet to each host's submission queue, so it
+    costs one cross-thread message per host however many peers there are, and each host then
+    queues the packet for its own peers when it is next serviced.
+    @sa enet_broadcast_bus_create()
+ */
+typedef struct _ENetBroadcastBus
+{
+   ENetMutex            mutex;                                    /**< held while hosts are attached, detached or broadcast to */
+   size_t               hostCount;
+   ENetHost *           hosts [ENET_BROADCAST_BUS_MAXIMUM_HOSTS];
+} ENetBroadcastBus;
+
 /** @defgroup global ENet global functions
     @{ 
 */
@@ -501,6 +943,7 @@ ENET_API int        enet_socket_listen (ENetSocket, int);
 ENET_API ENetSocket enet_socket_accept (ENetSocket, ENetAddress *);
 ENET_API int        enet_socket_connect (ENetSocket, const ENetAddress *);
 ENET_API int        enet_socket_send (ENetSocket, const ENetAddress *, const ENetBuffer *, size_t);
+ENET_API int        enet_socket_send_batch (ENetSocket, const ENetAddress *, const ENetBuffer *, size_t);
 ENET_API int        enet_socket_receive (ENetSocket, ENetAddress *, ENetBuffer *, size_t);
 ENET_API int        enet_socket_wait (ENetSocket, enet_uint32 *, enet_uint32);
 ENET_API int        enet_socket_set_option (ENetSocket, ENetSocketOption, int);
@@ -511,6 +954,25 @@ ENET_API int        enet_socketset_select (ENetSocket, ENetSocketSet *, ENetSock
 
 /** @} */
 
+/** @defgroup thread ENet thread functions
+    Minimal wrappers over the platform threads, used by the host pipeline, the host thread and sharded hosts.
+    @{
+*/
+ENET_API int  enet_thread_create (ENetThread *, ENetThreadFunction, void *);
+ENET_API void enet_thread_join (ENetThread);
+ENET_API int  enet_mutex_create (ENetMutex *);
+ENET_API void enet_mutex_destroy (ENetMutex *);
+ENET_API void enet_mutex_lock (ENetMutex *);
+ENET_API void enet_mutex_unlock (ENetMutex *);
+ENET_API int  enet_condition_create (ENetCondition *);
+ENET_API void enet_condition_destroy (ENetCondition *);
+ENET_API void enet_condition_wait (ENetCondition *, ENetMutex *);
+ENET_API void enet_condition_wait_timeout (ENetCondition *, ENetMutex *, enet_uint32);
+ENET_API void enet_condition_signal (ENetCondition *);
+ENET_API void enet_condition_broadcast (ENetCondition *);
+
+/** @} */
+
 /** @defgroup Address ENet address functions
     @{
 */
@@ -561,33 +1023,107 @@ ENET_API ENetPacket * enet_packet_create (const void *, size_t, enet_uint32);
 ENET_API void         enet_packet_destroy (ENetPacket *);
 ENET_API int          enet_packet_resize  (ENetPacket *, size_t);
 ENET_API enet_uint32  enet_crc32 (const ENetBuffer *, size_t);
+ENET_API enet_uint32  enet_crc32c (const ENetBuffer *, size_t);
+extern   void         enet_checksum_initialize (void);
+ENET_API void         enet_chacha20_poly1305_encrypt (const enet_uint8 *, const enet_uint8 *, const enet_uint8 *, size_t, enet_uint8 *, size_t, enet_uint8 *);
+ENET_API int          enet_chacha20_poly1305_decrypt (const enet_uint8 *, const enet_uint8 *, const enet_uint8 *, size_t, enet_uint8 *, size_t, const enet_uint8 *);
+extern   void         enet_crypto_derive_key (const enet_uint8 *, const enet_uint8 *, enet_uint8 *);
+extern   void         enet_crypto_initialize (void);
+extern   int          enet_random_bytes (void *, size_t);
                 
 ENET_API ENetHost * enet_host_create (const ENetAddress *, size_t, size_t, enet_uint32, enet_uint32);
 ENET_API void       enet_host_destroy (ENetHost *);
+ENET_API ENetPeer * enet_host_get_peer (ENetHost *, size_t);
+ENET_API void       enet_host_get_statistics (const ENetHost *, ENetHostStatistics *);
 ENET_API ENetPeer * enet_host_connect (ENetHost *, const ENetAddress *, size_t, enet_uint32);
 ENET_API int        enet_host_check_events (ENetHost *, ENetEvent *);
 ENET_API int        enet_host_service (ENetHost *, ENetEvent *, enet_uint32);
 ENET_API void       enet_host_flush (ENetHost *);
 ENET_API void       enet_host_broadcast (ENetHost *, enet_uint8, ENetPacket *);
+ENET_API int        enet_host_broadcast_async (ENetHost *, enet_uint8, ENetPacket *);
 ENET_API void       enet_host_compress (ENetHost *, const ENetCompressor *);
 ENET_API int        enet_host_compress_with_range_coder (ENetHost * host);
+ENET_API int        enet_host_compress_with_lz (ENetHost * host);
+ENET_API int        enet_host_compress_with_lz_dictionary (ENetHost * host, const void *, size_t);
+ENET_API void       enet_host_compress_stream (ENetHost *, const ENetStreamCompressor *);
+ENET_API int        enet_host_compress_stream_with_lz (ENetHost * host, const void *, size_t);
+ENET_API int        enet_host_pipeline (ENetHost *, size_t);
+ENET_API ENetHostThread * enet_host_thread_create (ENetHost *, size_t, size_t, enet_uint32);
+ENET_API void       enet_host_thread_destroy (ENetHostThread *);
+ENET_API int        enet_host_thread_receive (ENetHostThread *, ENetEvent *);
+ENET_API int        enet_host_thread_send (ENetHostThread *, ENetPeer *, enet_uint8, ENetPacket *);
+ENET_API int        enet_host_thread_broadcast (ENetHostThread *, enet_uint8, ENetPacket *);
+ENET_API int        enet_host_thread_disconnect (ENetHostThread *, ENetPeer *, enet_uint32);
+ENET_API int        enet_host_thread_disconnect_now (ENetHostThread *, ENetPeer *, enet_uint32);
+ENET_API int        enet_host_thread_disconnect_later (ENetHostThread *, ENetPeer *, enet_uint32);
+
+ENET_API ENetShardedHost * enet_sharded_host_create (const ENetAddress *, size_t, size_t, size_t, enet_uint32, enet_uint32);
+ENET_API void       enet_sharded_host_destroy (ENetShardedHost *);
+ENET_API ENetBroadcastBus * enet_broadcast_bus_create (void);
+ENET_API void       enet_broadcast_bus_destroy (ENetBroadcastBus *);
+ENET_API int        enet_broadcast_bus_attach (ENetBroadcastBus *, ENetHost *);
+ENET_API void       enet_broadcast_bus_detach (ENetBroadcastBus *, ENetHost *);
+ENET_API int        enet_broadcast_bus_broadcast (ENetBroadcastBus *, enet_uint8, ENetPacket *);
+ENET_API void       enet_host_encrypt (ENetHost *, const void *);
 ENET_API void       enet_host_channel_limit (ENetHost *, size_t);
+ENET_API void       enet_host_release_peer_chunks (ENetHost *, int);
 ENET_API void       enet_host_bandwidth_limit (ENetHost *, enet_uint32, enet_uint32);
 extern   void       enet_host_bandwidth_throttle (ENetHost *);
 extern  enet_uint32 enet_host_random_seed (void);
 extern  enet_uint32 enet_host_random (ENetHost *);
+extern  ENetList *  enet_host_peer_bucket (ENetHost *, enet_uint32);
+extern  ENetPeer *  enet_host_find_free_peer (ENetHost *, int);
+extern  void        enet_host_use_peer (ENetHost *, ENetPeer *);
+extern  void        enet_host_release_peer (ENetHost *, ENetPeer *);
+extern  void        enet_host_shrink_peers (ENetHost *);
+extern  void        enet_host_reclaim_peers (ENetHost *, size_t);
+extern  int         enet_host_submit (ENetHost *, ENetPeer *, enet_uint8, ENetPacket *);
+extern  void        enet_host_push_submission (ENetHost *, ENetHostSubmission *);
+extern  void        enet_host_run_submissions (ENetHost *);
+extern  void        enet_host_discard_submissions (ENetHost *);
+extern  void        enet_host_publish_statistics (ENetHost *);
+extern  int         enet_host_owns_peer (ENetHost *, size_t);
+extern  int         enet_host_allocate_peer_chunk (ENetHost *, size_t);
+extern  void        enet_host_adopt_peer (ENetHost *, ENetPeerMigration *);
+extern  void        enet_peer_migration_destroy (ENetHost *, ENetPeerMigration *);
+
+extern void enet_pipeline_destroy (ENetPipeline *);
+extern void enet_pipeline_set_compressor (ENetPipeline *, const ENetCompressor *);
+extern void enet_pipeline_run (ENetPipeline *, ENetPipelineCallback, ENetPipelineDatagram *, size_t);
+
+extern int    enet_ring_create (ENetRing *, size_t, size_t);
+extern void   enet_ring_destroy (ENetRing *);
+extern int    enet_ring_full (ENetRing *);
+extern void * enet_ring_reserve (ENetRing *);
+extern void   enet_ring_commit (ENetRing *);
+extern int    enet_ring_push (ENetRing *, const void *);
+extern void * enet_ring_peek (ENetRing *);
+extern void   enet_ring_release (ENetRing *);
+extern int    enet_ring_pop (ENetRing *, void *);
+
+extern int  enet_shard_receive (ENetHostShard *, ENetAddress *, ENetBuffer *);
+extern int  enet_shard_wait (ENetHost *, enet_uint32 *, enet_uint32);
+extern void enet_shard_wake (ENetHostShard *);
+extern void enet_shard_rebalance (ENetHost *);
 
 ENET_API int                 enet_peer_send (ENetPeer *, enet_uint8, ENetPacket *);
+ENET_API int                 enet_peer_send_async (ENetPeer *, enet_uint8, ENetPacket *);
+ENET_API int                 enet_peer_migrate (ENetPeer *, ENetHost *);
 ENET_API ENetPacket *        enet_peer_receive (ENetPeer *, enet_uint8 * channelID);
 ENET_API void                enet_peer_ping (ENetPeer *);
 ENET_API void                enet_peer_ping_interval (ENetPeer *, enet_uint32);
+ENET_API void                enet_peer_get_statistics (const ENetPeer *, ENetPeerStatistics *);
 ENET_API void                enet_peer_timeout (ENetPeer *, enet_uint32, enet_uint32, enet_uint32);
 ENET_API void                enet_peer_reset (ENetPeer *);
 ENET_API void                enet_peer_disconnect (ENetPeer *, enet_uint32);
 ENET_API void                enet_peer_disconnect_now (ENetPeer *, enet_uint32);
 ENET_API void                enet_peer_disconnect_later (ENetPeer *, enet_uint32);
 ENET_API void                enet_peer_throttle_configure (ENetPeer *, enet_uint32, enet_uint32, enet_uint32);
+ENET_API int                 enet_peer_delta_encode (ENetPeer *, enet_uint8, int);
 extern int                   enet_peer_throttle (ENetPeer *, enet_uint32);
+extern void                  enet_peer_update_throttle (ENetPeer *);
+extern void                  enet_peer_update_bandwidth_limit (ENetPeer *);
+extern void                  enet_peer_adapt_window (ENetPeer *);
 extern void                  enet_peer_reset_queues (ENetPeer *);
 extern void                  enet_peer_setup_outgoing_command (ENetPeer *, ENetOutgoingCommand *);
 extern ENetOutgoingCommand * enet_peer_queue_outgoing_command (ENetPeer *, const ENetProtocol *, ENetPacket *, enet_uint32, enet_uint16);
@@ -597,13 +1133,35 @@ extern void                  enet_peer_dispatch_incoming_unreliable_commands (EN
 extern void                  enet_peer_dispatch_incoming_reliable_commands (ENetPeer *, ENetChannel *, ENetIncomingCommand *);
 extern void                  enet_peer_on_connect (ENetPeer *);
 extern void                  enet_peer_on_disconnect (ENetPeer *);
+extern int                   enet_peer_create_streams (ENetPeer *);
+extern void                  enet_peer_destroy_streams (ENetPeer *);
+extern int                   enet_peer_encrypt (ENetPeer *, const enet_uint8 *, const enet_uint8 *);
+extern void                  enet_peer_encrypt_verified (ENetPeer *, const enet_uint8 *);
 
 ENET_API void * enet_range_coder_create (void);
 ENET_API void   enet_range_coder_destroy (void *);
+ENET_API void * enet_range_coder_clone (void *);
 ENET_API size_t enet_range_coder_compress (void *, const ENetBuffer *, size_t, size_t, enet_uint8 *, size_t);
 ENET_API size_t enet_range_coder_decompress (void *, const enet_uint8 *, size_t, enet_uint8 *, size_t);
+
+ENET_API void * enet_lz_create (void);
+ENET_API void * enet_lz_create_with_dictionary (const void *, size_t);
+ENET_API void   enet_lz_destroy (void *);
+ENET_API void * enet_lz_clone (void *);
+ENET_API size_t enet_lz_compress (void *, const ENetBuffer *, size_t, size_t, enet_uint8 *, size_t);
+ENET_API size_t enet_lz_decompress (void *, const enet_uint8 *, size_t, enet_uint8 *, size_t);
+ENET_API size_t enet_lz_train_dictionary (const ENetBuffer *, size_t, enet_uint8 *, size_t);
+ENET_API void * enet_lz_stream_create (void *);
+ENET_API void   enet_lz_stream_destroy (void *);
+ENET_API void   enet_lz_stream_reset (void *);
+ENET_API size_t enet_lz_stream_compress (void *, const ENetBuffer *, size_t, size_t, enet_uint8 *, size_t);
+ENET_API size_t enet_lz_stream_decompress (void *, const enet_uint8 *, size_t, enet_uint8 *, size_t);
+
+ENET_API size_t enet_delta_encode (const enet_uint8 *, size_t, const enet_uint8 *, size_t, enet_uint8 *, size_t);
+ENET_API size_t enet_delta_decode (const enet_uint8 *, size_t, const enet_uint8 *, size_t, enet_uint8 *, size_t);
    
 extern size_t enet_protocol_command_size (enet_uint8);
+extern void   enet_protocol_dispatch_state (ENetHost *, ENetPeer *, ENetPeerState);
 
 #ifdef __cplusplus
 }
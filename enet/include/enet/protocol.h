@@ -14,9 +14,16 @@ enum
    ENET_PROTOCOL_MAXIMUM_PACKET_COMMANDS = 32,
    ENET_PROTOCOL_MINIMUM_WINDOW_SIZE     = 4096,
    ENET_PROTOCOL_MAXIMUM_WINDOW_SIZE     = 65536,
+   ENET_PROTOCOL_MAXIMUM_ADAPTIVE_WINDOW_SIZE = 16 * 1024 * 1024,
    ENET_PROTOCOL_MINIMUM_CHANNEL_COUNT   = 1,
    ENET_PROTOCOL_MAXIMUM_CHANNEL_COUNT   = 255,
    ENET_PROTOCOL_MAXIMUM_PEER_ID         = 0xFFF,
+   ENET_PROTOCOL_EXTENDED_PEER_ID        = 0xFFE,
+   ENET_PROTOCOL_MAXIMUM_EXTENDED_PEER_ID = 0xFFFF,
+   ENET_PROTOCOL_MINIMUM_CAPABILITIES_LENGTH = 4,
+   ENET_PROTOCOL_ENCRYPTION_NONCE_SIZE   = 12,
+   ENET_PROTOCOL_ENCRYPTION_TAG_SIZE     = 16,
+   ENET_PROTOCOL_ENCRYPTION_OVERHEAD     = ENET_PROTOCOL_ENCRYPTION_NONCE_SIZE + ENET_PROTOCOL_ENCRYPTION_TAG_SIZE,
    ENET_PROTOCOL_MAXIMUM_FRAGMENT_COUNT  = 1024 * 1024
 };
 
@@ -44,15 +51,55 @@ typedef enum _ENetProtocolFlag
 {
    ENET_PROTOCOL_COMMAND_FLAG_ACKNOWLEDGE = (1 << 7),
    ENET_PROTOCOL_COMMAND_FLAG_UNSEQUENCED = (1 << 6),
+   ENET_PROTOCOL_COMMAND_FLAG_CAPABILITIES = (1 << 5),
+   ENET_PROTOCOL_COMMAND_FLAG_DELTA       = (1 << 4),
 
    ENET_PROTOCOL_HEADER_FLAG_COMPRESSED = (1 << 14),
    ENET_PROTOCOL_HEADER_FLAG_SENT_TIME  = (1 << 15),
    ENET_PROTOCOL_HEADER_FLAG_MASK       = ENET_PROTOCOL_HEADER_FLAG_COMPRESSED | ENET_PROTOCOL_HEADER_FLAG_SENT_TIME,
 
    ENET_PROTOCOL_HEADER_SESSION_MASK    = (3 << 12),
-   ENET_PROTOCOL_HEADER_SESSION_SHIFT   = 12
+   ENET_PROTOCOL_HEADER_SESSION_SHIFT   = 12,
+
+   ENET_PROTOCOL_STREAM_FLAG_RESET      = (1 << 7),
+   ENET_PROTOCOL_STREAM_FLAG_REQUEST    = (1 << 6),
+   ENET_PROTOCOL_STREAM_SEQUENCE_MASK   = 0x3F
 } ENetProtocolFlag;
 
+typedef enum _ENetProtocolCapability
+{
+   ENET_PROTOCOL_CAPABILITY_EXTENDED_PEER_ID = (1 << 0),
+   ENET_PROTOCOL_CAPABILITY_ADAPTIVE_WINDOW  = (1 << 1),
+   ENET_PROTOCOL_CAPABILITY_STREAM_COMPRESSION = (1 << 2),
+   ENET_PROTOCOL_CAPABILITY_ENCRYPTION       = (1 << 3),
+   ENET_PROTOCOL_CAPABILITY_DELTA_ENCODING   = (1 << 4)
+} ENetProtocolCapability;
+
+/** With ENET_PROTOCOL_CAPABILITY_STREAM_COMPRESSION negotiated, a compressed datagram's payload
+    starts with one stream byte ahead of the stream compressor's output: a 6 bit sequence number,
+    ENET_PROTOCOL_STREAM_FLAG_RESET when the sender restarted its stream history for this datagram,
+    and ENET_PROTOCOL_STREAM_FLAG_REQUEST when the sender missed part of the opposite stream.
+    A receiver that misses a sequence number ignores compressed datagrams until the next reset,
+    which the sender issues whenever it retransmits or is asked to.
+*/
+
+/** With ENET_PROTOCOL_CAPABILITY_ENCRYPTION negotiated, every datagram after the CONNECT command
+    carries a 12 byte nonce after the peer ID, sent time and extended peer ID, and before the
+    checksum: an 8 byte prefix the sender picks at random for the connection followed by a 32 bit
+    counter in network byte order.  The payload is encrypted with ChaCha20-Poly1305, the whole
+    header is authenticated as additional data, and the 16 byte tag follows the payload.  Each
+    direction has its own key: the server's datagrams use one derived from the pre-shared key and
+    the CONNECT trailer's encryptionSalt, and the client's datagrams one that also takes the
+    VERIFY_CONNECT trailer's encryptionSalt, which the server picks at random for the connection.
+*/
+
+/** With ENET_PROTOCOL_CAPABILITY_DELTA_ENCODING negotiated, a SEND_RELIABLE command carrying
+    ENET_PROTOCOL_COMMAND_FLAG_DELTA holds its packet encoded against the previous such packet on
+    the same channel (see enet_delta_encode()); the receiver decodes it when it is dispatched in
+    order and keeps the result as the next base.  Fragmented packets are never delta encoded and
+    leave the base unchanged.
+*/
+
 #ifdef _MSC_VER
 #pragma pack(push, 1)
 #define ENET_PACKED
@@ -82,6 +129,20 @@ typedef struct _ENetProtocolAcknowledge
    enet_uint16 receivedSentTime;
 } ENET_PACKED ENetProtocolAcknowledge;
 
+/** Trailer appended to CONNECT and VERIFY_CONNECT commands carrying
+    ENET_PROTOCOL_COMMAND_FLAG_CAPABILITIES.  Its first byte is always
+    ENET_PROTOCOL_COMMAND_NONE so receivers that predate it stop parsing there.
+    Fields beyond the received length are treated as zero.
+*/
+typedef struct _ENetProtocolCapabilities
+{
+   enet_uint8  command;
+   enet_uint8  length;
+   enet_uint16 capabilities;
+   enet_uint32 maximumWindowSize;
+   enet_uint8  encryptionSalt [16];
+} ENET_PACKED ENetProtocolCapabilities;
+
 typedef struct _ENetProtocolConnect
 {
    ENetProtocolCommandHeader header;
@@ -98,6 +159,7 @@ typedef struct _ENetProtocolConnect
    enet_uint32 packetThrottleDeceleration;
    enet_uint32 connectID;
    enet_uint32 data;
+   ENetProtocolCapabilities capabilities;
 } ENET_PACKED ENetProtocolConnect;
 
 typedef struct _ENetProtocolVerifyConnect
@@ -115,6 +177,7 @@ typedef struct _ENetProtocolVerifyConnect
    enet_uint32 packetThrottleAcceleration;
    enet_uint32 packetThrottleDeceleration;
    enet_uint32 connectID;
+   ENetProtocolCapabilities capabilities;
 } ENET_PACKED ENetProtocolVerifyConnect;
 
 typedef struct _ENetProtocolBandwidthLimit
@@ -54,6 +54,10 @@ typedef fd_set ENetSocketSet;
 #define ENET_SOCKETSET_REMOVE(sockset, socket) FD_CLR (socket, & (sockset))
 #define ENET_SOCKETSET_CHECK(sockset, socket)  FD_ISSET (socket, & (sockset))
 
+typedef HANDLE ENetThread;
+typedef CRITICAL_SECTION ENetMutex;
+typedef CONDITION_VARIABLE ENetCondition;
+
 #endif /* __ENET_WIN32_H__ */
 
 
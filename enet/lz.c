@@ -0,0 +1,917 @@
+/**
+ @file lz.c
+ @brief A fast LZ77 packet compressor in the style of LZ4
+*/
+#define ENET_BUILDING_LIB 1
+#include <string.h>
+#include "enet/enet.h"
+
+/* The block format follows LZ4: each sequence is a token byte holding the literal length in its high
+   nibble and the match length minus ENET_LZ_MINIMUM_MATCH in its low nibble, then any length extension
+   bytes for the literals, the literals themselves, a little-endian 16 bit match offset and any length
+   extension bytes for the match. A nibble of 15 is extended by bytes that are added on until one is
+   less than 255. The final sequence carries literals only and ends the block.
+
+   A context may be primed with a dictionary shared by both ends. Offsets reaching back past the start
+   of the packet continue into the end of the dictionary, so short packets can still match.
+
+   A stream keeps the last ENET_LZ_STREAM_WINDOW bytes of earlier packets in the same direction of a
+   connection, starting out with the end of the dictionary, and offsets may reach back into them.
+*/
+enum
+{
+    ENET_LZ_MINIMUM_MATCH = 4,
+    ENET_LZ_MINIMUM_INPUT = 12,
+    ENET_LZ_HASH_BITS     = 12,
+    ENET_LZ_HASH_SIZE     = 1 << ENET_LZ_HASH_BITS,
+    ENET_LZ_CHAIN_DEPTH   = 16,
+    ENET_LZ_COPY_SIZE     = 16,
+    ENET_LZ_BASE_LIMIT    = 0x70000000,
+
+    ENET_LZ_MAXIMUM_DICTIONARY = 32768,
+    ENET_LZ_TRAIN_GRAM         = 6,
+    ENET_LZ_TRAIN_SEGMENT      = 32,
+    ENET_LZ_TRAIN_HASH_BITS    = 16,
+
+    ENET_LZ_STREAM_WINDOW      = 8192,
+    ENET_LZ_STREAM_BUFFER      = 2 * ENET_LZ_STREAM_WINDOW + ENET_PROTOCOL_MAXIMUM_MTU,
+    ENET_LZ_STREAM_CHAIN_SIZE  = 16384
+};
+
+typedef struct _ENetLZ
+{
+    /* positions are stored relative to base, so entries from previous packets compare below it
+       and the tables never need to be cleared between packets */
+    enet_uint32 base;
+    enet_uint32 hashTable [ENET_LZ_HASH_SIZE];
+    enet_uint32 chainTable [ENET_PROTOCOL_MAXIMUM_MTU];
+    enet_uint8 input [ENET_PROTOCOL_MAXIMUM_MTU];
+
+    /* the dictionary is indexed once at creation; its entries hold position + 1 so 0 marks an empty slot */
+    size_t dictionaryLength;
+    const enet_uint8 * dictionary;
+    enet_uint32 * dictionaryHashTable;
+    enet_uint32 * dictionaryChainTable;
+} ENetLZ;
+
+typedef struct _ENetLZStream
+{
+    const ENetLZ * lz;
+
+    /* positions count bytes since the stream was reset, starting at 1 so that 0 marks an empty hash slot;
+       matches may reach ENET_LZ_STREAM_WINDOW bytes back from the start of a packet, and the chain holds
+       distances so that it covers that span plus one packet without ever being cleared */
+    enet_uint32 windowPosition;
+    size_t windowLength;
+    size_t indexedLength;
+
+    /* only streams that compress need the tables, so they are allocated on the first compression */
+    enet_uint32 * hashTable;
+    enet_uint16 * chainTable;
+    enet_uint8 window [ENET_LZ_STREAM_BUFFER];
+} ENetLZStream;
+
+static enet_uint32 enet_lz_hash (const enet_uint8 * data);
+
+void *
+enet_lz_create (void)
+{
+    return enet_lz_create_with_dictionary (NULL, 0);
+}
+
+/** Creates an LZ compressor context primed with a dictionary.
+    Only the last 32 KiB of the dictionary are used. Both ends must use identical dictionaries.
+*/
+void *
+enet_lz_create_with_dictionary (const void * dictionary, size_t dictionaryLength)
+{
+    ENetLZ * lz;
+    size_t position;
+
+    if (dictionary == NULL)
+      dictionaryLength = 0;
+    else
+    if (dictionaryLength > ENET_LZ_MAXIMUM_DICTIONARY)
+    {
+        dictionary = (const enet_uint8 *) dictionary + dictionaryLength - ENET_LZ_MAXIMUM_DICTIONARY;
+        dictionaryLength = ENET_LZ_MAXIMUM_DICTIONARY;
+    }
+
+    lz = (ENetLZ *) enet_malloc (sizeof (ENetLZ) + (dictionaryLength > 0 ? (ENET_LZ_HASH_SIZE + dictionaryLength) * sizeof (enet_uint32) + dictionaryLength : 0));
+    if (lz == NULL)
+      return NULL;
+
+    memset (lz -> hashTable, 0, sizeof (lz -> hashTable));
+    lz -> base = 1;
+
+    lz -> dictionaryLength = dictionaryLength;
+    lz -> dictionary = NULL;
+    lz -> dictionaryHashTable = NULL;
+    lz -> dictionaryChainTable = NULL;
+
+    if (dictionaryLength > 0)
+    {
+        enet_uint8 * dictionaryCopy;
+
+        lz -> dictionaryHashTable = (enet_uint32 *) & lz [1];
+        lz -> dictionaryChainTable = & lz -> dictionaryHashTable [ENET_LZ_HASH_SIZE];
+        dictionaryCopy = (enet_uint8 *) & lz -> dictionaryChainTable [dictionaryLength];
+        memcpy (dictionaryCopy, dictionary, dictionaryLength);
+        lz -> dictionary = dictionaryCopy;
+
+        memset (lz -> dictionaryHashTable, 0, ENET_LZ_HASH_SIZE * sizeof (enet_uint32));
+        for (position = 0; position + ENET_LZ_MINIMUM_MATCH <= dictionaryLength; ++ position)
+        {
+            enet_uint32 hash = enet_lz_hash (& dictionaryCopy [position]);
+
+            lz -> dictionaryChainTable [position] = lz -> dictionaryHashTable [hash];
+            lz -> dictionaryHashTable [hash] = (enet_uint32) position + 1;
+        }
+    }
+
+    return lz;
+}
+
+void
+enet_lz_destroy (void * context)
+{
+    ENetLZ * lz = (ENetLZ *) context;
+    if (lz == NULL)
+      return;
+
+    enet_free (lz);
+}
+
+/** Creates another LZ compressor context with the same dictionary, for a pipeline worker. */
+void *
+enet_lz_clone (void * context)
+{
+    const ENetLZ * lz = (const ENetLZ *) context;
+
+    return enet_lz_create_with_dictionary (lz -> dictionary, lz -> dictionaryLength);
+}
+
+static enet_uint32
+enet_lz_read_32 (const enet_uint8 * data)
+{
+    enet_uint32 value;
+    memcpy (& value, data, sizeof (value));
+    return value;
+}
+
+static enet_uint32
+enet_lz_hash (const enet_uint8 * data)
+{
+    return (enet_lz_read_32 (data) * 2654435761U) >> (32 - ENET_LZ_HASH_BITS);
+}
+
+/* copies in fixed size chunks the compiler turns into single vector moves; may write up to
+   ENET_LZ_COPY_SIZE - 1 bytes past dataEnd, so callers must guarantee the slack */
+static void
+enet_lz_wild_copy (enet_uint8 * outData, const enet_uint8 * inData, const enet_uint8 * outEnd)
+{
+    do
+    {
+        memcpy (outData, inData, ENET_LZ_COPY_SIZE);
+        outData += ENET_LZ_COPY_SIZE;
+        inData += ENET_LZ_COPY_SIZE;
+    } while (outData < outEnd);
+}
+
+static enet_uint8 *
+enet_lz_write_length (enet_uint8 * outData, size_t length)
+{
+    while (length >= 255)
+    {
+        * outData ++ = 255;
+        length -= 255;
+    }
+    * outData ++ = (enet_uint8) length;
+    return outData;
+}
+
+static enet_uint8 *
+enet_lz_write_sequence (enet_uint8 * outData, const enet_uint8 * outEnd, const enet_uint8 * literals, size_t literalLength, size_t matchOffset, size_t matchLength)
+{
+    enet_uint8 * token;
+
+    if ((size_t) (outEnd - outData) < 1 + literalLength + literalLength / 255 + 1 + 2 + matchLength / 255 + 1)
+      return NULL;
+
+    token = outData ++;
+    if (literalLength >= 15)
+    {
+        * token = 15 << 4;
+        outData = enet_lz_write_length (outData, literalLength - 15);
+    }
+    else
+      * token = (enet_uint8) (literalLength << 4);
+
+    memcpy (outData, literals, literalLength);
+    outData += literalLength;
+
+    if (matchLength == 0)
+      return outData;
+
+    * outData ++ = (enet_uint8) (matchOffset & 0xFF);
+    * outData ++ = (enet_uint8) (matchOffset >> 8);
+
+    matchLength -= ENET_LZ_MINIMUM_MATCH;
+    if (matchLength >= 15)
+    {
+        * token |= 15;
+        outData = enet_lz_write_length (outData, matchLength - 15);
+    }
+    else
+      * token |= (enet_uint8) matchLength;
+
+    return outData;
+}
+
+size_t
+enet_lz_compress (void * context, const ENetBuffer * inBuffers, size_t inBufferCount, size_t inLimit, enet_uint8 * outData, size_t outLimit)
+{
+    ENetLZ * lz = (ENetLZ *) context;
+    enet_uint8 * outStart = outData, * outEnd = & outData [outLimit];
+    const enet_uint8 * input, * inEnd;
+    size_t inLength = 0, position, anchor, matchLimit;
+    enet_uint32 base;
+
+    if (lz == NULL || inBufferCount <= 0 || inLimit < ENET_LZ_MINIMUM_INPUT || inLimit > sizeof (lz -> input))
+      return 0;
+
+    while (inBufferCount -- > 0)
+    {
+        if (inBuffers -> dataLength > inLimit - inLength)
+          return 0;
+        memcpy (& lz -> input [inLength], inBuffers -> data, inBuffers -> dataLength);
+        inLength += inBuffers -> dataLength;
+        ++ inBuffers;
+    }
+
+    if (lz -> base >= ENET_LZ_BASE_LIMIT)
+    {
+        memset (lz -> hashTable, 0, sizeof (lz -> hashTable));
+        lz -> base = 1;
+    }
+    base = lz -> base;
+    lz -> base += (enet_uint32) inLength;
+
+    input = lz -> input;
+    inEnd = & input [inLength];
+    matchLimit = inLength >= ENET_LZ_MINIMUM_MATCH ? inLength - ENET_LZ_MINIMUM_MATCH : 0;
+    position = 0;
+    anchor = 0;
+
+    while (position < matchLimit)
+    {
+        enet_uint32 hash = enet_lz_hash (& input [position]),
+                    candidate = lz -> hashTable [hash],
+                    word = enet_lz_read_32 (& input [position]);
+        size_t bestLength = 0, bestOffset = 0, depth = ENET_LZ_CHAIN_DEPTH;
+
+        lz -> chainTable [position] = candidate;
+        lz -> hashTable [hash] = base + (enet_uint32) position;
+
+        for (; candidate >= base && depth > 0; -- depth)
+        {
+            size_t candidatePosition = candidate - base;
+
+            if (enet_lz_read_32 (& input [candidatePosition]) == word)
+            {
+                const enet_uint8 * match = & input [candidatePosition + ENET_LZ_MINIMUM_MATCH],
+                                 * current = & input [position + ENET_LZ_MINIMUM_MATCH];
+
+                while (current < inEnd && * current == * match)
+                {
+                    ++ current;
+                    ++ match;
+                }
+
+                if ((size_t) (current - input) - position > bestLength)
+                {
+                    bestLength = (size_t) (current - input) - position;
+                    bestOffset = position - candidatePosition;
+                    if (current >= inEnd)
+                      break;
+                }
+            }
+
+            candidate = lz -> chainTable [candidatePosition];
+        }
+
+        if (lz -> dictionaryLength > 0 && bestLength < (size_t) (inEnd - & input [position]))
+        {
+            const enet_uint8 * dictionaryEnd = & lz -> dictionary [lz -> dictionaryLength];
+
+            candidate = lz -> dictionaryHashTable [hash];
+            for (depth = ENET_LZ_CHAIN_DEPTH; candidate > 0 && depth > 0; -- depth)
+            {
+                size_t candidatePosition = candidate - 1;
+
+                if (enet_lz_read_32 (& lz -> dictionary [candidatePosition]) == word)
+                {
+                    const enet_uint8 * match = & lz -> dictionary [candidatePosition + ENET_LZ_MINIMUM_MATCH],
+                                     * current = & input [position + ENET_LZ_MINIMUM_MATCH];
+
+                    while (current < inEnd && match < dictionaryEnd && * current == * match)
+                    {
+                        ++ current;
+                        ++ match;
+                    }
+
+                    if ((size_t) (current - input) - position > bestLength)
+                    {
+                        bestLength = (size_t) (current - input) - position;
+                        bestOffset = position + lz -> dictionaryLength - candidatePosition;
+                        if (current >= inEnd)
+                          break;
+                    }
+                }
+
+                candidate = lz -> dictionaryChainTable [candidatePosition];
+            }
+        }
+
+        if (bestLength < ENET_LZ_MINIMUM_MATCH)
+        {
+            ++ position;
+            continue;
+        }
+
+        outData = enet_lz_write_sequence (outData, outEnd, & input [anchor], position - anchor, bestOffset, bestLength);
+        if (outData == NULL)
+          return 0;
+
+        /* index the positions covered by the match so later repeats can still find them */
+        anchor = position + bestLength;
+        for (++ position; position < anchor && position < matchLimit; ++ position)
+        {
+            hash = enet_lz_hash (& input [position]);
+            lz -> chainTable [position] = lz -> hashTable [hash];
+            lz -> hashTable [hash] = base + (enet_uint32) position;
+        }
+        position = anchor;
+    }
+
+    outData = enet_lz_write_sequence (outData, outEnd, & input [anchor], inLength - anchor, 0, 0);
+    if (outData == NULL)
+      return 0;
+
+    return (size_t) (outData - outStart);
+}
+
+/* historyLength bytes directly before outData may be matched as well, and offsets reaching back past
+   those continue into the end of the dictionary */
+static size_t
+enet_lz_decode (const enet_uint8 * inData, size_t inLimit, enet_uint8 * outData, size_t outLimit, size_t historyLength, const enet_uint8 * dictionary, size_t dictionaryLength)
+{
+    enet_uint8 * outStart = outData - historyLength, * outEnd = & outData [outLimit];
+    const enet_uint8 * inEnd = & inData [inLimit];
+
+    if (inLimit <= 0)
+      return 0;
+
+    while (inData < inEnd)
+    {
+        enet_uint8 token = * inData ++;
+        size_t length = token >> 4, offset;
+        const enet_uint8 * match;
+
+        if (length == 15)
+        {
+            enet_uint8 extension;
+            do
+            {
+                if (inData >= inEnd)
+                  return 0;
+                extension = * inData ++;
+                length += extension;
+            } while (extension == 255);
+        }
+
+        if (length > (size_t) (inEnd - inData) || length > (size_t) (outEnd - outData))
+          return 0;
+
+        if ((size_t) (inEnd - inData) >= length + ENET_LZ_COPY_SIZE && (size_t) (outEnd - outData) >= length + ENET_LZ_COPY_SIZE)
+          enet_lz_wild_copy (outData, inData, outData + length);
+        else
+          memcpy (outData, inData, length);
+        inData += length;
+        outData += length;
+
+        if (inData >= inEnd)
+          break;
+
+        if (inEnd - inData < 2)
+          return 0;
+        offset = inData [0] | (inData [1] << 8);
+        inData += 2;
+        if (offset == 0 || offset > (size_t) (outData - outStart) + dictionaryLength)
+          return 0;
+
+        length = token & 15;
+        if (length == 15)
+        {
+            enet_uint8 extension;
+            do
+            {
+                if (inData >= inEnd)
+                  return 0;
+                extension = * inData ++;
+                length += extension;
+            } while (extension == 255);
+        }
+        length += ENET_LZ_MINIMUM_MATCH;
+
+        if (length > (size_t) (outEnd - outData))
+          return 0;
+
+        if (offset > (size_t) (outData - outStart))
+        {
+            /* the match starts in the dictionary and may run on into the start of the packet */
+            size_t dictionaryOffset = offset - (size_t) (outData - outStart),
+                   dictionaryCopy = length < dictionaryOffset ? length : dictionaryOffset;
+
+            memcpy (outData, & dictionary [dictionaryLength - dictionaryOffset], dictionaryCopy);
+            outData += dictionaryCopy;
+            length -= dictionaryCopy;
+            offset = (size_t) (outData - outStart);
+            if (length == 0)
+              continue;
+        }
+
+        match = outData - offset;
+        if (offset >= ENET_LZ_COPY_SIZE && (size_t) (outEnd - outData) >= length + ENET_LZ_COPY_SIZE)
+          enet_lz_wild_copy (outData, match, outData + length);
+        else
+        if (offset >= length)
+          memcpy (outData, match, length);
+        else
+        {
+            /* overlapping match repeats the last offset bytes, so copy forward one byte at a time */
+            enet_uint8 * copyEnd = outData + length, * copy = outData;
+            while (copy < copyEnd)
+              * copy ++ = * match ++;
+        }
+        outData += length;
+    }
+
+    return (size_t) (outData - outStart) - historyLength;
+}
+
+size_t
+enet_lz_decompress (void * context, const enet_uint8 * inData, size_t inLimit, enet_uint8 * outData, size_t outLimit)
+{
+    ENetLZ * lz = (ENetLZ *) context;
+
+    if (lz == NULL)
+      return 0;
+
+    return enet_lz_decode (inData, inLimit, outData, outLimit, 0, lz -> dictionary, lz -> dictionaryLength);
+}
+
+/** Builds a dictionary for enet_lz_create_with_dictionary() from sample packets.
+    The samples are split into one epoch per dictionary segment. From each epoch the segment whose
+    short substrings occur most often across all samples is kept, and its substrings are then
+    discounted so later epochs pick different content.
+    @param samples          representative packets, e.g. one chat line per buffer
+    @param sampleCount      number of samples
+    @param dictionary       receives the trained dictionary
+    @param dictionaryLimit  size of dictionary in bytes; at most 32 KiB is useful
+    @returns the length of the trained dictionary, 0 on failure
+*/
+size_t
+enet_lz_train_dictionary (const ENetBuffer * samples, size_t sampleCount, enet_uint8 * dictionary, size_t dictionaryLimit)
+{
+    enet_uint8 * corpus;
+    enet_uint32 * counts, * grams;
+    size_t corpusLength = 0, sampleIndex, position, epochCount, epochLength, epoch, dictionaryLength = 0;
+
+    if (dictionaryLimit > ENET_LZ_MAXIMUM_DICTIONARY)
+      dictionaryLimit = ENET_LZ_MAXIMUM_DICTIONARY;
+
+    for (sampleIndex = 0; sampleIndex < sampleCount; ++ sampleIndex)
+      corpusLength += samples [sampleIndex].dataLength;
+
+    if (corpusLength < ENET_LZ_TRAIN_SEGMENT || dictionaryLimit < ENET_LZ_TRAIN_SEGMENT)
+      return 0;
+
+    corpus = (enet_uint8 *) enet_malloc (corpusLength);
+    grams = (enet_uint32 *) enet_malloc (corpusLength * sizeof (enet_uint32));
+    counts = (enet_uint32 *) enet_malloc ((1 << ENET_LZ_TRAIN_HASH_BITS) * sizeof (enet_uint32));
+    if (corpus == NULL || grams == NULL || counts == NULL)
+    {
+        if (corpus != NULL)
+          enet_free (corpus);
+        if (grams != NULL)
+          enet_free (grams);
+        if (counts != NULL)
+          enet_free (counts);
+        return 0;
+    }
+
+    memset (counts, 0, (1 << ENET_LZ_TRAIN_HASH_BITS) * sizeof (enet_uint32));
+
+    /* hash every gram that lies within a single sample; grams spanning two samples never repeat in practice */
+    position = 0;
+    for (sampleIndex = 0; sampleIndex < sampleCount; ++ sampleIndex)
+    {
+        const ENetBuffer * sample = & samples [sampleIndex];
+        size_t sampleEnd = position + sample -> dataLength;
+
+        memcpy (& corpus [position], sample -> data, sample -> dataLength);
+        for (; position < sampleEnd; ++ position)
+        {
+            if (position + ENET_LZ_TRAIN_GRAM > sampleEnd)
+            {
+                grams [position] = ~0U;
+                continue;
+            }
+
+            grams [position] = ((enet_lz_read_32 (& corpus [position]) ^ (enet_uint32) corpus [position + 4] << 8 ^ (enet_uint32) corpus [position + 5] << 16) * 2654435761U) >> (32 - ENET_LZ_TRAIN_HASH_BITS);
+            ++ counts [grams [position]];
+        }
+    }
+
+    epochCount = dictionaryLimit / ENET_LZ_TRAIN_SEGMENT;
+    epochLength = corpusLength / epochCount;
+    if (epochLength < ENET_LZ_TRAIN_SEGMENT)
+    {
+        epochLength = ENET_LZ_TRAIN_SEGMENT;
+        epochCount = corpusLength / epochLength;
+    }
+
+    for (epoch = 0; epoch < epochCount && dictionaryLength + ENET_LZ_TRAIN_SEGMENT <= dictionaryLimit; ++ epoch)
+    {
+        size_t epochStart = epoch * epochLength,
+               epochEnd = epoch + 1 < epochCount ? epochStart + epochLength : corpusLength,
+               bestStart = 0,
+               window = ENET_LZ_TRAIN_SEGMENT - ENET_LZ_TRAIN_GRAM + 1;
+        enet_uint32 score = 0, bestScore = 0;
+
+        if (epochEnd - epochStart < ENET_LZ_TRAIN_SEGMENT)
+          continue;
+
+        /* slide a segment sized window over the epoch, summing the counts of the grams it covers */
+        for (position = epochStart; position < epochEnd - ENET_LZ_TRAIN_GRAM + 1; ++ position)
+        {
+            if (grams [position] != ~0U)
+              score += counts [grams [position]];
+            if (position >= epochStart + window)
+            {
+                size_t leaving = position - window;
+                if (grams [leaving] != ~0U)
+                  score -= counts [grams [leaving]];
+            }
+            if (position + 1 >= epochStart + window && score > bestScore)
+            {
+                bestScore = score;
+                bestStart = position + 1 - window;
+            }
+        }
+
+        if (bestScore <= window)
+          continue;
+
+        memcpy (& dictionary [dictionaryLength], & corpus [bestStart], ENET_LZ_TRAIN_SEGMENT);
+        dictionaryLength += ENET_LZ_TRAIN_SEGMENT;
+
+        for (position = bestStart; position < bestStart + window; ++ position)
+        {
+            if (grams [position] != ~0U)
+              counts [grams [position]] = 0;
+        }
+    }
+
+    enet_free (counts);
+    enet_free (grams);
+    enet_free (corpus);
+
+    return dictionaryLength;
+}
+
+/** Creates the state for one direction of a connection compressed with enet_lz_stream_compress().
+    @param context LZ context whose dictionary, if any, the stream starts out with; must outlive the stream
+*/
+void *
+enet_lz_stream_create (void * context)
+{
+    ENetLZStream * stream;
+
+    if (context == NULL)
+      return NULL;
+
+    stream = (ENetLZStream *) enet_malloc (sizeof (ENetLZStream));
+    if (stream == NULL)
+      return NULL;
+
+    stream -> lz = (const ENetLZ *) context;
+    stream -> hashTable = NULL;
+    stream -> chainTable = NULL;
+
+    enet_lz_stream_reset (stream);
+
+    return stream;
+}
+
+void
+enet_lz_stream_destroy (void * context)
+{
+    ENetLZStream * stream = (ENetLZStream *) context;
+    if (stream == NULL)
+      return;
+
+    if (stream -> hashTable != NULL)
+      enet_free (stream -> hashTable);
+    if (stream -> chainTable != NULL)
+      enet_free (stream -> chainTable);
+
+    enet_free (stream);
+}
+
+void
+enet_lz_stream_reset (void * context)
+{
+    ENetLZStream * stream = (ENetLZStream *) context;
+    size_t dictionaryLength;
+
+    if (stream == NULL)
+      return;
+
+    dictionaryLength = stream -> lz -> dictionaryLength < ENET_LZ_STREAM_WINDOW ? stream -> lz -> dictionaryLength : ENET_LZ_STREAM_WINDOW;
+    if (dictionaryLength > 0)
+      memcpy (stream -> window, & stream -> lz -> dictionary [stream -> lz -> dictionaryLength - dictionaryLength], dictionaryLength);
+
+    stream -> windowPosition = 1;
+    stream -> windowLength = dictionaryLength;
+    stream -> indexedLength = 0;
+
+    if (stream -> hashTable != NULL)
+      memset (stream -> hashTable, 0, ENET_LZ_HASH_SIZE * sizeof (enet_uint32));
+}
+
+/* makes room for one more packet, keeping the window's worth of history that matches may still reach */
+static void
+enet_lz_stream_slide (ENetLZStream * stream)
+{
+    size_t shift;
+
+    if (stream -> windowLength + ENET_PROTOCOL_MAXIMUM_MTU <= ENET_LZ_STREAM_BUFFER)
+      return;
+
+    shift = stream -> windowLength - ENET_LZ_STREAM_WINDOW;
+    memmove (stream -> window, & stream -> window [shift], ENET_LZ_STREAM_WINDOW);
+    stream -> windowPosition += (enet_uint32) shift;
+    stream -> windowLength = ENET_LZ_STREAM_WINDOW;
+    stream -> indexedLength = stream -> indexedLength > shift ? stream -> indexedLength - shift : 0;
+}
+
+/* links the window position into its hash chain and returns the previous position with the same hash */
+static enet_uint32
+enet_lz_stream_insert (ENetLZStream * stream, size_t position, enet_uint32 hash)
+{
+    enet_uint32 current = stream -> windowPosition + (enet_uint32) position,
+                candidate = stream -> hashTable [hash];
+
+    stream -> chainTable [current & (ENET_LZ_STREAM_CHAIN_SIZE - 1)] =
+        (enet_uint16) (candidate < current && current - candidate < ENET_LZ_STREAM_CHAIN_SIZE ? current - candidate : 0);
+    stream -> hashTable [hash] = current;
+
+    return candidate;
+}
+
+size_t
+enet_lz_stream_compress (void * context, const ENetBuffer * inBuffers, size_t inBufferCount, size_t inLimit, enet_uint8 * outData, size_t outLimit)
+{
+    ENetLZStream * stream = (ENetLZStream *) context;
+    enet_uint8 * outStart = outData, * outEnd = & outData [outLimit];
+    const enet_uint8 * window, * inEnd;
+    size_t start, end, position, anchor, matchLimit;
+    enet_uint32 limit;
+
+    if (stream == NULL || inBufferCount <= 0 || inLimit <= 0 || inLimit > ENET_PROTOCOL_MAXIMUM_MTU)
+      return 0;
+
+    if (stream -> hashTable == NULL)
+    {
+        stream -> hashTable = (enet_uint32 *) enet_malloc (ENET_LZ_HASH_SIZE * sizeof (enet_uint32));
+        if (stream -> hashTable == NULL)
+          return 0;
+
+        memset (stream -> hashTable, 0, ENET_LZ_HASH_SIZE * sizeof (enet_uint32));
+        stream -> indexedLength = 0;
+    }
+    if (stream -> chainTable == NULL)
+    {
+        stream -> chainTable = (enet_uint16 *) enet_malloc (ENET_LZ_STREAM_CHAIN_SIZE * sizeof (enet_uint16));
+        if (stream -> chainTable == NULL)
+          return 0;
+    }
+
+    enet_lz_stream_slide (stream);
+
+    /* positions only matter to this end, so renumbering them just forgets the indexed history */
+    if (stream -> windowPosition >= ENET_LZ_BASE_LIMIT)
+    {
+        memset (stream -> hashTable, 0, ENET_LZ_HASH_SIZE * sizeof (enet_uint32));
+        stream -> windowPosition = 1;
+        stream -> indexedLength = 0;
+    }
+
+    start = stream -> windowLength;
+    end = start;
+    while (inBufferCount -- > 0)
+    {
+        if (inBuffers -> dataLength > inLimit - (end - start))
+          return 0;
+        memcpy (& stream -> window [end], inBuffers -> data, inBuffers -> dataLength);
+        end += inBuffers -> dataLength;
+        ++ inBuffers;
+    }
+    if (end == start)
+      return 0;
+
+    window = stream -> window;
+    inEnd = & window [end];
+
+    /* catch up on the dictionary and the tail of the last packet, which needed this one to hash */
+    for (position = stream -> indexedLength; position < start && position + ENET_LZ_MINIMUM_MATCH <= end; ++ position)
+      enet_lz_stream_insert (stream, position, enet_lz_hash (& window [position]));
+
+    limit = stream -> windowPosition + (enet_uint32) (start > ENET_LZ_STREAM_WINDOW ? start - ENET_LZ_STREAM_WINDOW : 0);
+    matchLimit = end - start > ENET_LZ_MINIMUM_MATCH ? end - ENET_LZ_MINIMUM_MATCH : start;
+    position = start;
+    anchor = start;
+
+    while (position < matchLimit)
+    {
+        enet_uint32 hash = enet_lz_hash (& window [position]),
+                    current = stream -> windowPosition + (enet_uint32) position,
+                    candidate = enet_lz_stream_insert (stream, position, hash),
+                    word = enet_lz_read_32 (& window [position]);
+        size_t bestLength = 0, bestOffset = 0, depth = ENET_LZ_CHAIN_DEPTH;
+
+        /* entries left by a packet that failed to compress may point past the current position */
+        while (candidate >= limit && candidate < current && depth > 0)
+        {
+            size_t candidatePosition = candidate - stream -> windowPosition;
+            enet_uint16 distance;
+
+            if (enet_lz_read_32 (& window [candidatePosition]) == word)
+            {
+                const enet_uint8 * match = & window [candidatePosition + ENET_LZ_MINIMUM_MATCH],
+                                 * next = & window [position + ENET_LZ_MINIMUM_MATCH];
+
+                while (next < inEnd && * next == * match)
+                {
+                    ++ next;
+                    ++ match;
+                }
+
+                if ((size_t) (next - window) - position > bestLength)
+                {
+                    bestLength = (size_t) (next - window) - position;
+                    bestOffset = position - candidatePosition;
+                    if (next >= inEnd)
+                      break;
+                }
+            }
+
+            distance = stream -> chainTable [candidate & (ENET_LZ_STREAM_CHAIN_SIZE - 1)];
+            if (distance == 0)
+              break;
+            candidate -= distance;
+            -- depth;
+        }
+
+        if (bestLength < ENET_LZ_MINIMUM_MATCH)
+        {
+            ++ position;
+            continue;
+        }
+
+        outData = enet_lz_write_sequence (outData, outEnd, & window [anchor], position - anchor, bestOffset, bestLength);
+        if (outData == NULL)
+          return 0;
+
+        anchor = position + bestLength;
+        for (++ position; position < anchor && position < matchLimit; ++ position)
+          enet_lz_stream_insert (stream, position, enet_lz_hash (& window [position]));
+        position = anchor;
+    }
+
+    outData = enet_lz_write_sequence (outData, outEnd, & window [anchor], end - anchor, 0, 0);
+    if (outData == NULL)
+      return 0;
+
+    stream -> windowLength = end;
+    stream -> indexedLength = matchLimit;
+
+    return (size_t) (outData - outStart);
+}
+
+size_t
+enet_lz_stream_decompress (void * context, const enet_uint8 * inData, size_t inLimit, enet_uint8 * outData, size_t outLimit)
+{
+    ENetLZStream * stream = (ENetLZStream *) context;
+    enet_uint8 * packet;
+    size_t length;
+
+    if (stream == NULL)
+      return 0;
+
+    enet_lz_stream_slide (stream);
+
+    if (outLimit > ENET_PROTOCOL_MAXIMUM_MTU)
+      outLimit = ENET_PROTOCOL_MAXIMUM_MTU;
+
+    packet = & stream -> window [stream -> windowLength];
+    length = enet_lz_decode (inData, inLimit, packet, outLimit, stream -> windowLength, NULL, 0);
+    if (length == 0)
+      return 0;
+
+    memcpy (outData, packet, length);
+    stream -> windowLength += length;
+
+    return length;
+}
+
+/** @defgroup host ENet host functions
+    @{
+*/
+
+/** Sets the packet compressor the host should use to the LZ compressor.
+    Trades some compression ratio for far less CPU per byte than the range coder, which suits fast links.
+    Both ends of a connection must use the same compressor.
+    @param host host to enable the LZ compressor for
+    @returns 0 on success, < 0 on failure
+*/
+int
+enet_host_compress_with_lz (ENetHost * host)
+{
+    ENetCompressor compressor;
+    memset (& compressor, 0, sizeof (compressor));
+    compressor.context = enet_lz_create();
+    if (compressor.context == NULL)
+      return -1;
+    compressor.compress = enet_lz_compress;
+    compressor.decompress = enet_lz_decompress;
+    compressor.destroy = enet_lz_destroy;
+    compressor.clone = enet_lz_clone;
+    enet_host_compress (host, & compressor);
+    return 0;
+}
+
+/** Sets the packet compressor the host should use to the LZ compressor primed with a dictionary.
+    The dictionary, e.g. one built by enet_lz_train_dictionary(), lets short packets compress well
+    without any per-peer state. Both ends of a connection must use the same dictionary.
+    @param host host to enable the LZ compressor for
+    @param dictionary dictionary data, copied by the compressor
+    @param dictionaryLength length of the dictionary in bytes
+    @returns 0 on success, < 0 on failure
+*/
+int
+enet_host_compress_with_lz_dictionary (ENetHost * host, const void * dictionary, size_t dictionaryLength)
+{
+    ENetCompressor compressor;
+    memset (& compressor, 0, sizeof (compressor));
+    compressor.context = enet_lz_create_with_dictionary (dictionary, dictionaryLength);
+    if (compressor.context == NULL)
+      return -1;
+    compressor.compress = enet_lz_compress;
+    compressor.decompress = enet_lz_decompress;
+    compressor.destroy = enet_lz_destroy;
+    compressor.clone = enet_lz_clone;
+    enet_host_compress (host, & compressor);
+    return 0;
+}
+
+/** Sets the stream compressor the host should use to the LZ compressor.
+    Each direction of a connection keeps its last 8 KiB of data as history, so repeated names and
+    phrases compress even when they last appeared several packets ago. This costs about 70 KiB of
+    memory per connected peer. Both ends of a connection must use the same dictionary.
+    @param host host to enable LZ stream compression for
+    @param dictionary optional dictionary data each stream starts out with, copied by the compressor
+    @param dictionaryLength length of the dictionary in bytes
+    @returns 0 on success, < 0 on failure
+*/
+int
+enet_host_compress_stream_with_lz (ENetHost * host, const void * dictionary, size_t dictionaryLength)
+{
+    ENetStreamCompressor streamCompressor;
+    memset (& streamCompressor, 0, sizeof (streamCompressor));
+    streamCompressor.context = enet_lz_create_with_dictionary (dictionary, dictionaryLength);
+    if (streamCompressor.context == NULL)
+      return -1;
+    streamCompressor.create = enet_lz_stream_create;
+    streamCompressor.compress = enet_lz_stream_compress;
+    streamCompressor.decompress = enet_lz_stream_decompress;
+    streamCompressor.reset = enet_lz_stream_reset;
+    streamCompressor.destroyStream = enet_lz_stream_destroy;
+    streamCompressor.destroy = enet_lz_destroy;
+    enet_host_compress_stream (host, & streamCompressor);
+    return 0;
+}
+
+/** @} */
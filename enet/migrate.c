@@ -0,0 +1,222 @@
+/**
+ @file  migrate.c
+ @brief ENet peer migration between the hosts of a sharded host
+*/
+#include <string.h>
+#define ENET_BUILDING_LIB 1
+#include "enet/enet.h"
+#include "enet/atomic.h"
+
+/* A migrating peer keeps its incoming peer ID, which the remote end puts in the header of every
+   datagram, so the host it moves to takes it over in the same slot of its own peer table, and
+   the receive thread routes by the owner of each ID in peerShards rather than by chunk. The old
+   host hands the peer over through the submissions of the new one, and while it is on its way
+   its ID belongs to neither, so that both keep it off their free lists. Datagrams that arrive in
+   the meantime find no connected peer and are dropped, which the remote end handles as it would
+   any other loss. */
+
+static void
+enet_peer_move_list (ENetList * to, ENetList * from)
+{
+    enet_list_clear (to);
+
+    if (! enet_list_empty (from))
+      enet_list_move (enet_list_end (to), enet_list_front (from), enet_list_back (from));
+}
+
+/** Moves the protocol state of a peer into another, leaving the queues of the first empty. The
+    links of the second to its host and to the lists of the host, and its published statistics,
+    are kept.
+*/
+static void
+enet_peer_move (ENetPeer * to, ENetPeer * from)
+{
+    ENetHost * host = to -> host;
+    ENetListNode dispatchList = to -> dispatchList,
+                 lookupList = to -> lookupList,
+                 limitedList = to -> limitedList,
+                 outgoingLimitedList = to -> outgoingLimitedList;
+
+#ifdef ENET_PEER_COLD_SPLIT
+    memcpy (to, from, (size_t) & ((ENetPeer *) 0) -> cold);
+    memcpy (to -> cold, from -> cold, (size_t) & ((ENetPeerCold *) 0) -> statisticsSequence);
+#else
+    memcpy (to, from, (size_t) & ((ENetPeer *) 0) -> statisticsSequence);
+#endif
+
+    to -> host = host;
+    to -> dispatchList = dispatchList;
+    to -> lookupList = lookupList;
+    to -> limitedList = limitedList;
+    to -> outgoingLimitedList = outgoingLimitedList;
+
+    enet_peer_move_list (& to -> acknowledgements, & from -> acknowledgements);
+    enet_peer_move_list (& to -> sentReliableCommands, & from -> sentReliableCommands);
+    enet_peer_move_list (& to -> sentUnreliableCommands, & from -> sentUnreliableCommands);
+    enet_peer_move_list (& to -> outgoingCommands, & from -> outgoingCommands);
+    enet_peer_move_list (& to -> dispatchedCommands, & from -> dispatchedCommands);
+
+    from -> channels = NULL;
+    from -> channelCount = 0;
+    ENET_PEER_COLD (from) -> outgoingStream = NULL;
+    ENET_PEER_COLD (from) -> incomingStream = NULL;
+}
+
+/** Takes over a peer migrating to the host, at the start of enet_host_service(). */
+void
+enet_host_adopt_peer (ENetHost * host, ENetPeerMigration * migration)
+{
+    size_t peerID = migration -> peer.incomingPeerID;
+    ENetPeerChunk * chunk = & host -> peerChunks [peerID / ENET_HOST_PEER_CHUNK_SIZE];
+    ENetPeer * peer;
+
+    if (chunk -> peers == NULL && enet_host_allocate_peer_chunk (host, peerID / ENET_HOST_PEER_CHUNK_SIZE) < 0)
+    {
+        enet_peer_migration_destroy (host, migration);
+
+        return;
+    }
+
+    peer = & chunk -> peers [peerID % ENET_HOST_PEER_CHUNK_SIZE];
+
+    enet_peer_move (peer, & migration -> peer);
+
+    /* count the peer as it would be counted on connecting to the host */
+    peer -> state = ENET_PEER_STATE_DISCONNECTED;
+    enet_peer_on_connect (peer);
+    peer -> state = migration -> peer.state;
+
+    /* the epochs count the throttles of the old host, and the bandwidth it advertised is checked
+       against the share of this one on the next send */
+    peer -> bandwidthThrottleEpoch = host -> bandwidthThrottleEpoch;
+    peer -> bandwidthLimitEpoch = host -> bandwidthLimitEpoch - 1;
+
+    enet_host_use_peer (host, peer);
+
+    if (! enet_list_empty (& peer -> dispatchedCommands))
+    {
+        enet_list_insert (enet_list_end (& host -> dispatchQueue), & peer -> dispatchList);
+
+        peer -> flags |= ENET_PEER_FLAG_NEEDS_DISPATCH;
+    }
+
+    ENET_ATOMIC_STORE_RELEASE (& host -> shard -> sharded -> peerShards [peerID], host -> shard -> index);
+    ENET_ATOMIC_STORE_RELEASE (& host -> shard -> load, (enet_uint32) host -> connectedPeers);
+    ENET_ATOMIC_DECREMENT (& host -> shard -> arrivingPeers);
+
+    enet_free (migration);
+}
+
+/** Drops a peer migrating to the host, when it cannot take the peer over or is being destroyed.
+    The peer is lost, and the remote end times out.
+*/
+void
+enet_peer_migration_destroy (ENetHost * host, ENetPeerMigration * migration)
+{
+    ENetPeer * peer = & migration -> peer;
+
+    peer -> host = host;
+
+    enet_peer_destroy_streams (peer);
+    enet_peer_reset_queues (peer);
+
+    /* the host was to own the ID, and may now use it for new connections */
+    ENET_ATOMIC_STORE_RELEASE (& host -> shard -> sharded -> peerShards [peer -> incomingPeerID], host -> shard -> index);
+    ENET_ATOMIC_DECREMENT (& host -> shard -> arrivingPeers);
+
+    enet_free (migration);
+}
+
+/** @defgroup peer ENet peer functions
+    @{
+*/
+
+/** Moves a connected peer to another host of the same ENetShardedHost together with all of its
+    protocol state, its sequence numbers, channels, queued commands and round trip time, so that
+    the remote end carries on without noticing. Must be called from the thread servicing the
+    current host of the peer, between calls to enet_host_service().
+    @param peer peer to move
+    @param host host to move the peer to
+    @retval 0 on success, after which the peer is gone from its old host and the new host takes it over at the start of its next call to enet_host_service()
+    @retval < 0 if the peer is not connected, the hosts are not shards of the same sharded host, or allocation failed
+    @remarks The peer keeps its incoming peer ID and its data, and the events of its new host
+    report it at enet_host_get_peer() of that host with that ID. The old pointer must no longer be
+    used, while sends queued to it with enet_peer_send_async() follow it to the new host. Events
+    for the peer that the old host had not returned yet are returned by the new one.
+    @sa ENetShardedHost::rebalanceInterval
+*/
+int
+enet_peer_migrate (ENetPeer * peer, ENetHost * host)
+{
+    ENetHost * source = peer -> host;
+    ENetShardedHost * sharded;
+    ENetPeerChunk * chunk;
+    ENetPeerMigration * migration;
+    ENetHostSubmission * submission;
+
+    if (source -> shard == NULL ||
+        host -> shard == NULL ||
+        host == source ||
+        host -> shard -> sharded != source -> shard -> sharded ||
+        peer -> state != ENET_PEER_STATE_CONNECTED ||
+        (peer -> flags & (ENET_PEER_FLAG_PENDING_ZOMBIE | ENET_PEER_FLAG_PENDING_DISCONNECT | ENET_PEER_FLAG_PENDING_PING)))
+      return -1;
+
+    sharded = source -> shard -> sharded;
+
+    submission = (ENetHostSubmission *) enet_malloc (sizeof (ENetHostSubmission));
+    if (submission == NULL)
+      return -1;
+
+    migration = (ENetPeerMigration *) enet_malloc (sizeof (ENetPeerMigration));
+    if (migration == NULL)
+    {
+        enet_free (submission);
+
+        return -1;
+    }
+
+    memset (migration, 0, sizeof (ENetPeerMigration));
+#ifdef ENET_PEER_COLD_SPLIT
+    migration -> peer.cold = & migration -> cold;
+#endif
+
+    enet_peer_on_disconnect (peer);
+
+    if (peer -> flags & ENET_PEER_FLAG_NEEDS_DISPATCH)
+    {
+        enet_list_remove (& peer -> dispatchList);
+
+        peer -> flags &= ~ ENET_PEER_FLAG_NEEDS_DISPATCH;
+    }
+
+    enet_peer_move (& migration -> peer, peer);
+
+    /* the ID now belongs to the other shard, so it stays off the free lists of this one */
+    enet_list_remove (& peer -> lookupList);
+    peer -> lookupList.next = peer -> lookupList.previous = & peer -> lookupList;
+
+    chunk = & source -> peerChunks [peer -> incomingPeerID / ENET_HOST_PEER_CHUNK_SIZE];
+    if (-- chunk -> usedPeers == 0)
+      chunk -> idleTime = enet_time_get ();
+
+    peer -> state = ENET_PEER_STATE_DISCONNECTED;
+    peer -> data = NULL;
+    enet_peer_reset (peer);
+
+    ENET_ATOMIC_STORE_RELEASE (& sharded -> peerShards [peer -> incomingPeerID], host -> shard -> index | ENET_SHARD_PEER_MIGRATING);
+    ENET_ATOMIC_STORE_RELEASE (& source -> shard -> load, (enet_uint32) source -> connectedPeers);
+    ENET_ATOMIC_INCREMENT (& host -> shard -> arrivingPeers);
+
+    submission -> peerID = ENET_PROTOCOL_MAXIMUM_PEER_ID;
+    submission -> connectID = 0;
+    submission -> channelID = 0;
+    submission -> packet = NULL;
+    submission -> migration = migration;
+
+    enet_host_push_submission (host, submission);
+
+    return 0;
+}
+
+/** @} */
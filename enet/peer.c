@@ -4,7 +4,10 @@
 */
 #include <string.h>
 #define ENET_BUILDING_LIB 1
+#include "enet/utility.h"
+#include "enet/time.h"
 #include "enet/enet.h"
+#include "enet/atomic.h"
 
 /** @defgroup peer ENet peer functions 
     @{
@@ -44,9 +47,9 @@ enet_peer_throttle_configure (ENetPeer * peer, enet_uint32 interval, enet_uint32
 {
     ENetProtocol command;
 
-    peer -> packetThrottleInterval = interval;
-    peer -> packetThrottleAcceleration = acceleration;
-    peer -> packetThrottleDeceleration = deceleration;
+    ENET_PEER_COLD (peer) -> packetThrottleInterval = interval;
+    ENET_PEER_COLD (peer) -> packetThrottleAcceleration = acceleration;
+    ENET_PEER_COLD (peer) -> packetThrottleDeceleration = deceleration;
 
     command.header.command = ENET_PROTOCOL_COMMAND_THROTTLE_CONFIGURE | ENET_PROTOCOL_COMMAND_FLAG_ACKNOWLEDGE;
     command.header.channelID = 0xFF;
@@ -61,6 +64,8 @@ enet_peer_throttle_configure (ENetPeer * peer, enet_uint32 interval, enet_uint32
 int
 enet_peer_throttle (ENetPeer * peer, enet_uint32 rtt)
 {
+    enet_peer_update_throttle (peer);
+
     if (peer -> lastRoundTripTime <= peer -> lastRoundTripTimeVariance)
     {
         peer -> packetThrottle = peer -> packetThrottleLimit;
@@ -68,7 +73,7 @@ enet_peer_throttle (ENetPeer * peer, enet_uint32 rtt)
     else
     if (rtt <= peer -> lastRoundTripTime)
     {
-        peer -> packetThrottle += peer -> packetThrottleAcceleration;
+        peer -> packetThrottle += ENET_PEER_COLD (peer) -> packetThrottleAcceleration;
 
         if (peer -> packetThrottle > peer -> packetThrottleLimit)
           peer -> packetThrottle = peer -> packetThrottleLimit;
@@ -78,8 +83,8 @@ enet_peer_throttle (ENetPeer * peer, enet_uint32 rtt)
     else
     if (rtt > peer -> lastRoundTripTime + 2 * peer -> lastRoundTripTimeVariance)
     {
-        if (peer -> packetThrottle > peer -> packetThrottleDeceleration)
-          peer -> packetThrottle -= peer -> packetThrottleDeceleration;
+        if (peer -> packetThrottle > ENET_PEER_COLD (peer) -> packetThrottleDeceleration)
+          peer -> packetThrottle -= ENET_PEER_COLD (peer) -> packetThrottleDeceleration;
         else
           peer -> packetThrottle = 0;
 
@@ -89,6 +94,142 @@ enet_peer_throttle (ENetPeer * peer, enet_uint32 rtt)
     return 0;
 }
 
+/** Catches a peer up with the last bandwidth throttle of its host, which only visits the peers
+    with an incoming bandwidth limit of their own. Their data totals start over, and the peer takes
+    on the packet throttle limit the host computed for the others.
+*/
+void
+enet_peer_update_throttle (ENetPeer * peer)
+{
+    ENetHost * host = peer -> host;
+
+    if (peer -> bandwidthThrottleEpoch == host -> bandwidthThrottleEpoch)
+      return;
+
+    peer -> bandwidthThrottleEpoch = host -> bandwidthThrottleEpoch;
+
+    peer -> incomingDataTotal = 0;
+    peer -> outgoingDataTotal = 0;
+
+    peer -> packetThrottleLimit = host -> packetThrottleLimit;
+
+    if (peer -> packetThrottle > peer -> packetThrottleLimit)
+      peer -> packetThrottle = peer -> packetThrottleLimit;
+}
+
+/** Catches a connected peer up with the last recalculation of the bandwidth limits of its host,
+    and sends it a bandwidth limit command if its share of the incoming bandwidth changed. Peers
+    whose upstream is below the share of the others keep their whole upstream.
+*/
+void
+enet_peer_update_bandwidth_limit (ENetPeer * peer)
+{
+    ENetHost * host = peer -> host;
+    enet_uint32 incomingBandwidth;
+    ENetProtocol command;
+
+    if (peer -> bandwidthLimitEpoch == host -> bandwidthLimitEpoch)
+      return;
+
+    peer -> bandwidthLimitEpoch = host -> bandwidthLimitEpoch;
+
+    if (peer -> state != ENET_PEER_STATE_CONNECTED && peer -> state != ENET_PEER_STATE_DISCONNECT_LATER)
+      return;
+
+    if (peer -> outgoingBandwidth != 0 && peer -> outgoingBandwidth >= host -> incomingBandwidthLimit)
+      incomingBandwidth = host -> incomingBandwidthLimit;
+    else
+      incomingBandwidth = peer -> outgoingBandwidth;
+
+    if (ENET_PEER_COLD (peer) -> advertisedIncomingBandwidth == incomingBandwidth &&
+        ENET_PEER_COLD (peer) -> advertisedOutgoingBandwidth == host -> outgoingBandwidth)
+      return;
+
+    ENET_PEER_COLD (peer) -> advertisedIncomingBandwidth = incomingBandwidth;
+    ENET_PEER_COLD (peer) -> advertisedOutgoingBandwidth = host -> outgoingBandwidth;
+
+    command.header.command = ENET_PROTOCOL_COMMAND_BANDWIDTH_LIMIT | ENET_PROTOCOL_COMMAND_FLAG_ACKNOWLEDGE;
+    command.header.channelID = 0xFF;
+    command.bandwidthLimit.outgoingBandwidth = ENET_HOST_TO_NET_32 (host -> outgoingBandwidth);
+    command.bandwidthLimit.incomingBandwidth = ENET_HOST_TO_NET_32 (incomingBandwidth);
+
+    enet_peer_queue_outgoing_command (peer, & command, NULL, 0, 0);
+}
+
+/** Resizes the reliable window of a peer that negotiated ENET_PROTOCOL_CAPABILITY_ADAPTIVE_WINDOW.
+
+    Once per round trip, but no more often than ENET_PEER_WINDOW_ADAPT_INTERVAL, the window is set to
+    twice the bandwidth-delay product measured from the reliable data acknowledged since the last
+    adjustment.  A window-bound sender therefore doubles its window each round until it reaches the
+    negotiated maximum, while an idle one falls back towards ENET_PROTOCOL_MAXIMUM_WINDOW_SIZE.
+    Peers with a bandwidth limit on either side keep the window derived from that limit.
+*/
+void
+enet_peer_adapt_window (ENetPeer * peer)
+{
+    ENetPeerCold * cold = ENET_PEER_COLD (peer);
+    enet_uint32 serviceTime = peer -> host -> serviceTime,
+                roundTripTime = ENET_MAX (peer -> roundTripTime, 1),
+                elapsedTime,
+                deliveryRate;
+
+    if (cold -> maximumWindowSize <= ENET_PROTOCOL_MAXIMUM_WINDOW_SIZE ||
+        peer -> incomingBandwidth != 0 ||
+        peer -> host -> outgoingBandwidth != 0)
+      return;
+
+    if (cold -> windowEpoch == 0)
+    {
+        cold -> windowEpoch = ENET_MAX (serviceTime, 1);
+        cold -> windowDataAcknowledged = 0;
+        return;
+    }
+
+    elapsedTime = ENET_TIME_DIFFERENCE (serviceTime, cold -> windowEpoch);
+    if (elapsedTime < ENET_MAX (roundTripTime, ENET_PEER_WINDOW_ADAPT_INTERVAL))
+      return;
+
+    deliveryRate = cold -> windowDataAcknowledged / elapsedTime;
+
+    if (deliveryRate >= cold -> maximumWindowSize / (2 * roundTripTime))
+      peer -> windowSize = cold -> maximumWindowSize;
+    else
+      peer -> windowSize = ENET_MAX (2 * deliveryRate * roundTripTime, ENET_PROTOCOL_MAXIMUM_WINDOW_SIZE);
+
+    cold -> windowEpoch = ENET_MAX (serviceTime, 1);
+    cold -> windowDataAcknowledged = 0;
+}
+
+static void ENET_CALLBACK
+enet_peer_delta_free (ENetPacket * deltaPacket)
+{
+    ENetPacket * packet = (ENetPacket *) deltaPacket -> userData;
+
+    packet -> flags |= deltaPacket -> flags & ENET_PACKET_FLAG_SENT;
+
+    if (ENET_ATOMIC_DECREMENT (& packet -> referenceCount) == 0)
+      enet_packet_destroy (packet);
+}
+
+/** Encodes a packet against the last one sent on a delta encoded channel. The encoded packet holds
+    a reference to the original until it is destroyed, so the sender sees the original queued as usual.
+*/
+static ENetPacket *
+enet_peer_delta_encode_packet (ENetChannel * channel, ENetPacket * packet)
+{
+    ENetPacket * deltaPacket = enet_packet_create (NULL, packet -> dataLength + 1, ENET_PACKET_FLAG_RELIABLE);
+    if (deltaPacket == NULL)
+      return NULL;
+
+    deltaPacket -> dataLength = enet_delta_encode (channel -> outgoingDeltaBase, channel -> outgoingDeltaLength, packet -> data, packet -> dataLength, deltaPacket -> data, deltaPacket -> dataLength);
+    deltaPacket -> freeCallback = enet_peer_delta_free;
+    deltaPacket -> userData = packet;
+
+    ENET_ATOMIC_INCREMENT (& packet -> referenceCount);
+
+    return deltaPacket;
+}
+
 /** Queues a packet to be sent.
 
     On success, ENet will assume ownership of the packet, and so enet_packet_destroy
@@ -108,6 +249,7 @@ enet_peer_send (ENetPeer * peer, enet_uint8 channelID, ENetPacket * packet)
 {
    ENetChannel * channel;
    ENetProtocol command;
+   ENetPacket * deltaPacket = NULL;
    size_t fragmentLength;
 
    if (peer -> state != ENET_PEER_STATE_CONNECTED ||
@@ -119,6 +261,10 @@ enet_peer_send (ENetPeer * peer, enet_uint8 channelID, ENetPacket * packet)
    fragmentLength = peer -> mtu - sizeof (ENetProtocolHeader) - sizeof (ENetProtocolSendFragment);
    if (peer -> host -> checksum != NULL)
      fragmentLength -= sizeof(enet_uint32);
+   if (peer -> flags & ENET_PEER_FLAG_EXTENDED_PEER_ID)
+     fragmentLength -= sizeof (enet_uint16);
+   if (peer -> flags & ENET_PEER_FLAG_ENCRYPTED)
+     fragmentLength -= ENET_PROTOCOL_ENCRYPTION_OVERHEAD;
 
    if (packet -> dataLength > fragmentLength)
    {
@@ -184,7 +330,7 @@ enet_peer_send (ENetPeer * peer, enet_uint8 channelID, ENetPacket * packet)
          enet_list_insert (enet_list_end (& fragments), fragment);
       }
 
-      packet -> referenceCount += fragmentNumber;
+      ENET_ATOMIC_ADD (& packet -> referenceCount, fragmentNumber);
 
       while (! enet_list_empty (& fragments))
       {
@@ -207,6 +353,32 @@ enet_peer_send (ENetPeer * peer, enet_uint8 channelID, ENetPacket * packet)
    if (packet -> flags & ENET_PACKET_FLAG_RELIABLE || channel -> outgoingUnreliableSequenceNumber >= 0xFFFF)
    {
       command.header.command = ENET_PROTOCOL_COMMAND_SEND_RELIABLE | ENET_PROTOCOL_COMMAND_FLAG_ACKNOWLEDGE;
+
+      if (channel -> outgoingDeltaBase != NULL && packet -> dataLength > 0 && packet -> dataLength < fragmentLength)
+      {
+         deltaPacket = enet_peer_delta_encode_packet (channel, packet);
+         if (deltaPacket == NULL)
+           return -1;
+
+         command.header.command |= ENET_PROTOCOL_COMMAND_FLAG_DELTA;
+         command.sendReliable.dataLength = ENET_HOST_TO_NET_16 (deltaPacket -> dataLength);
+
+         if (enet_peer_queue_outgoing_command (peer, & command, deltaPacket, 0, deltaPacket -> dataLength) == NULL)
+         {
+            deltaPacket -> freeCallback = NULL;
+            enet_packet_destroy (deltaPacket);
+
+            ENET_ATOMIC_DECREMENT (& packet -> referenceCount);
+
+            return -1;
+         }
+
+         memcpy (channel -> outgoingDeltaBase, packet -> data, packet -> dataLength);
+         channel -> outgoingDeltaLength = (enet_uint16) packet -> dataLength;
+
+         return 0;
+      }
+
       command.sendReliable.dataLength = ENET_HOST_TO_NET_16 (packet -> dataLength);
    }
    else
@@ -221,6 +393,77 @@ enet_peer_send (ENetPeer * peer, enet_uint8 channelID, ENetPacket * packet)
    return 0;
 }
 
+/** Enables or disables delta encoding of reliable packets sent to a peer on a channel.
+
+    While enabled, each reliable packet small enough to be sent unfragmented is encoded against the
+    previous such packet on the channel, so only the bytes that changed go out; the peer rebuilds it
+    before delivery. This suits channels that repeat near-identical messages, such as status lines or
+    presence updates, and costs a copy of the last packet on both ends.
+    @param peer peer to configure, which must be connected and have negotiated ENET_PROTOCOL_CAPABILITY_DELTA_ENCODING
+    @param channelID channel to configure
+    @param enable nonzero to enable delta encoding, zero to disable it
+    @retval 0 on success
+    @retval < 0 on failure
+*/
+int
+enet_peer_delta_encode (ENetPeer * peer, enet_uint8 channelID, int enable)
+{
+    ENetChannel * channel;
+
+    if (peer -> state != ENET_PEER_STATE_CONNECTED ||
+        channelID >= peer -> channelCount ||
+        ! (peer -> capabilities & ENET_PROTOCOL_CAPABILITY_DELTA_ENCODING))
+      return -1;
+
+    channel = & peer -> channels [channelID];
+
+    if (! enable)
+    {
+        if (channel -> outgoingDeltaBase != NULL)
+        {
+            enet_free (channel -> outgoingDeltaBase);
+
+            channel -> outgoingDeltaBase = NULL;
+        }
+
+        return 0;
+    }
+
+    if (channel -> outgoingDeltaBase == NULL)
+    {
+        channel -> outgoingDeltaBase = (enet_uint8 *) enet_malloc (ENET_PROTOCOL_MAXIMUM_MTU);
+        if (channel -> outgoingDeltaBase == NULL)
+          return -1;
+
+        /* with no base the first packet goes out unchanged, which also resynchronizes a peer
+           that still holds the base from before delta encoding was last disabled */
+        channel -> outgoingDeltaLength = 0;
+    }
+
+    return 0;
+}
+
+/** Queues a packet to be sent to a peer from any thread. The send is carried out by the thread
+    servicing the host, at the start of its next call to enet_host_service(), and is dropped there
+    if the peer has disconnected by then, even if a new connection has taken over its ID.
+    @param peer destination for the packet
+    @param channelID channel on which to send
+    @param packet packet to send
+    @retval 0 on success
+    @retval < 0 on failure, in which case the caller keeps the packet
+    @remarks The packet must not be changed once queued, and the host may destroy it at any time after,
+    so a packet for several peers is best queued with enet_host_broadcast_async() or created once per peer.
+    The peer is only read here, to note its ID and connect ID, so it need only be valid for the call.
+*/
+int
+enet_peer_send_async (ENetPeer * peer, enet_uint8 channelID, ENetPacket * packet)
+{
+    if (peer == NULL)
+      return -1;
+
+    return enet_host_submit (peer -> host, peer, channelID, packet);
+}
+
 /** Attempts to dequeue any incoming queued packet.
     @param peer peer to dequeue packets from
     @param channelID holds the channel ID of the channel the packet was received on success
@@ -242,7 +485,7 @@ enet_peer_receive (ENetPeer * peer, enet_uint8 * channelID)
 
    packet = incomingCommand -> packet;
 
-   -- packet -> referenceCount;
+   ENET_ATOMIC_DECREMENT (& packet -> referenceCount);
 
    if (incomingCommand -> fragments != NULL)
      enet_free (incomingCommand -> fragments);
@@ -265,9 +508,7 @@ enet_peer_reset_outgoing_commands (ENetList * queue)
 
        if (outgoingCommand -> packet != NULL)
        {
-          -- outgoingCommand -> packet -> referenceCount;
-
-          if (outgoingCommand -> packet -> referenceCount == 0)
+          if (ENET_ATOMIC_DECREMENT (& outgoingCommand -> packet -> referenceCount) == 0)
             enet_packet_destroy (outgoingCommand -> packet);
        }
 
@@ -293,9 +534,7 @@ enet_peer_remove_incoming_commands (ENetList * queue, ENetListIterator startComm
  
        if (incomingCommand -> packet != NULL)
        {
-          -- incomingCommand -> packet -> referenceCount;
-
-          if (incomingCommand -> packet -> referenceCount == 0)
+          if (ENET_ATOMIC_DECREMENT (& incomingCommand -> packet -> referenceCount) == 0)
             enet_packet_destroy (incomingCommand -> packet);
        }
 
@@ -340,6 +579,11 @@ enet_peer_reset_queues (ENetPeer * peer)
         {
             enet_peer_reset_incoming_commands (& channel -> incomingReliableCommands);
             enet_peer_reset_incoming_commands (& channel -> incomingUnreliableCommands);
+
+            if (channel -> outgoingDeltaBase != NULL)
+              enet_free (channel -> outgoingDeltaBase);
+            if (channel -> incomingDeltaBase != NULL)
+              enet_free (channel -> incomingDeltaBase);
         }
 
         enet_free (peer -> channels);
@@ -355,7 +599,25 @@ enet_peer_on_connect (ENetPeer * peer)
     if (peer -> state != ENET_PEER_STATE_CONNECTED && peer -> state != ENET_PEER_STATE_DISCONNECT_LATER)
     {
         if (peer -> incomingBandwidth != 0)
-          ++ peer -> host -> bandwidthLimitedPeers;
+        {
+            ++ peer -> host -> bandwidthLimitedPeers;
+
+            peer -> incomingDataTotal = 0;
+            peer -> outgoingDataTotal = 0;
+
+            enet_list_insert (enet_list_end (& peer -> host -> limitedPeers), & peer -> limitedList);
+        }
+
+        if (peer -> outgoingBandwidth != 0)
+        {
+            ++ peer -> host -> outgoingBandwidthLimitedPeers;
+
+            enet_list_insert (enet_list_end (& peer -> host -> outgoingLimitedPeers), & peer -> outgoingLimitedList);
+        }
+
+        peer -> packetThrottleLimit = peer -> host -> packetThrottleLimit;
+        if (peer -> packetThrottle > peer -> packetThrottleLimit)
+          peer -> packetThrottle = peer -> packetThrottleLimit;
 
         ++ peer -> host -> connectedPeers;
     }
@@ -367,12 +629,145 @@ enet_peer_on_disconnect (ENetPeer * peer)
     if (peer -> state == ENET_PEER_STATE_CONNECTED || peer -> state == ENET_PEER_STATE_DISCONNECT_LATER)
     {
         if (peer -> incomingBandwidth != 0)
-          -- peer -> host -> bandwidthLimitedPeers;
+        {
+            -- peer -> host -> bandwidthLimitedPeers;
+
+            enet_list_remove (& peer -> limitedList);
+        }
+
+        if (peer -> outgoingBandwidth != 0)
+        {
+            -- peer -> host -> outgoingBandwidthLimitedPeers;
+
+            enet_list_remove (& peer -> outgoingLimitedList);
+        }
 
         -- peer -> host -> connectedPeers;
     }
 }
 
+/** Creates the stream compressor state for both directions of the connection once
+    ENET_PROTOCOL_CAPABILITY_STREAM_COMPRESSION has been negotiated. The first stream compressed
+    datagram sent either way carries a reset, so both ends start from the same history.
+    @returns 0 on success, < 0 on failure
+*/
+int
+enet_peer_create_streams (ENetPeer * peer)
+{
+    ENetStreamCompressor * streamCompressor = & peer -> host -> streamCompressor;
+    ENetPeerCold * cold = ENET_PEER_COLD (peer);
+
+    enet_peer_destroy_streams (peer);
+
+    if (streamCompressor -> context == NULL || streamCompressor -> create == NULL)
+      return -1;
+
+    cold -> outgoingStream = streamCompressor -> create (streamCompressor -> context);
+    cold -> incomingStream = streamCompressor -> create (streamCompressor -> context);
+    if (cold -> outgoingStream == NULL || cold -> incomingStream == NULL)
+    {
+        enet_peer_destroy_streams (peer);
+
+        return -1;
+    }
+
+    cold -> outgoingStreamSequence = 0;
+    cold -> incomingStreamSequence = 0;
+    peer -> flags |= ENET_PEER_FLAG_STREAM_RESET;
+
+    return 0;
+}
+
+void
+enet_peer_destroy_streams (ENetPeer * peer)
+{
+    ENetStreamCompressor * streamCompressor = & peer -> host -> streamCompressor;
+    ENetPeerCold * cold = ENET_PEER_COLD (peer);
+
+    if (cold -> outgoingStream != NULL)
+    {
+        streamCompressor -> destroyStream (cold -> outgoingStream);
+        cold -> outgoingStream = NULL;
+    }
+
+    if (cold -> incomingStream != NULL)
+    {
+        streamCompressor -> destroyStream (cold -> incomingStream);
+        cold -> incomingStream = NULL;
+    }
+
+    peer -> flags &= ~ (ENET_PEER_FLAG_STREAM_RESET | ENET_PEER_FLAG_STREAM_LOST);
+}
+
+/** Derives the key protecting one direction of an encrypted connection.  Both directions start from
+    the host's pre-shared key and the salt of the CONNECT command.  Datagrams from the server need
+    nothing more, as the client's salt is fresh for every connection.  The client's salt travels in
+    clear, though, so datagrams from the client also depend on the salt the server sends back in
+    VERIFY_CONNECT, which keeps a recorded connection from being replayed to the server.
+    @param verifySalt salt of the VERIFY_CONNECT command for datagrams from the client, NULL for datagrams from the server
+*/
+static void
+enet_peer_derive_key (ENetPeer * peer, const enet_uint8 * verifySalt, enet_uint8 * key)
+{
+    static const enet_uint8 serverLabel [16] = { 's', 'e', 'r', 'v', 'e', 'r', ' ', 't', 'o', ' ', 'c', 'l', 'i', 'e', 'n', 't' },
+                            clientLabel [16] = { 'c', 'l', 'i', 'e', 'n', 't', ' ', 't', 'o', ' ', 's', 'e', 'r', 'v', 'e', 'r' };
+    enet_uint8 connectKey [32];
+
+    enet_crypto_derive_key (peer -> host -> encryptionKey, ENET_PEER_COLD (peer) -> encryptionSalt, connectKey);
+
+    if (verifySalt == NULL)
+      enet_crypto_derive_key (connectKey, serverLabel, key);
+    else
+    {
+        enet_crypto_derive_key (connectKey, clientLabel, connectKey);
+        enet_crypto_derive_key (connectKey, verifySalt, key);
+    }
+
+    memset (connectKey, 0, sizeof (connectKey));
+}
+
+/** Starts encrypting the datagrams exchanged with peer.  The server passes both salts and has its
+    keys at once, while the client passes only the salt of its CONNECT command, which sets the key
+    for the server's datagrams, and completes the other with enet_peer_encrypt_verified().
+    @returns 0 on success, < 0 if no random nonce prefix could be chosen
+*/
+int
+enet_peer_encrypt (ENetPeer * peer, const enet_uint8 * connectSalt, const enet_uint8 * verifySalt)
+{
+    ENetPeerCold * cold = ENET_PEER_COLD (peer);
+
+    if (enet_random_bytes (cold -> outgoingNoncePrefix, sizeof (cold -> outgoingNoncePrefix)) < 0)
+      return -1;
+
+    memcpy (cold -> encryptionSalt, connectSalt, sizeof (cold -> encryptionSalt));
+
+    if (verifySalt != NULL)
+    {
+        enet_peer_derive_key (peer, NULL, cold -> outgoingKey);
+        enet_peer_derive_key (peer, verifySalt, cold -> incomingKey);
+    }
+    else
+    {
+        enet_peer_derive_key (peer, NULL, cold -> incomingKey);
+        memset (cold -> outgoingKey, 0, sizeof (cold -> outgoingKey));
+    }
+
+    cold -> outgoingNonce = 0;
+    cold -> incomingNonce = 0;
+    cold -> incomingNonceWindow = 0;
+    peer -> flags |= ENET_PEER_FLAG_ENCRYPTED;
+
+    return 0;
+}
+
+/** Sets the key for the datagrams a client sends from the salt of the server's VERIFY_CONNECT command.
+*/
+void
+enet_peer_encrypt_verified (ENetPeer * peer, const enet_uint8 * verifySalt)
+{
+    enet_peer_derive_key (peer, verifySalt, ENET_PEER_COLD (peer) -> outgoingKey);
+}
+
 /** Forcefully disconnects a peer.
     @param peer peer to forcefully disconnect
     @remarks The foreign host represented by the peer is not notified of the disconnection and will timeout
@@ -382,18 +777,26 @@ void
 enet_peer_reset (ENetPeer * peer)
 {
     enet_peer_on_disconnect (peer);
+
+    if (peer -> state != ENET_PEER_STATE_DISCONNECTED)
+      enet_host_release_peer (peer -> host, peer);
         
     peer -> outgoingPeerID = ENET_PROTOCOL_MAXIMUM_PEER_ID;
     peer -> connectID = 0;
+    peer -> capabilities = 0;
 
     peer -> state = ENET_PEER_STATE_DISCONNECTED;
 
     peer -> incomingBandwidth = 0;
     peer -> outgoingBandwidth = 0;
-    peer -> incomingBandwidthThrottleEpoch = 0;
-    peer -> outgoingBandwidthThrottleEpoch = 0;
+    ENET_PEER_COLD (peer) -> advertisedIncomingBandwidth = 0;
+    ENET_PEER_COLD (peer) -> advertisedOutgoingBandwidth = 0;
+    ENET_PEER_COLD (peer) -> incomingBandwidthThrottleEpoch = 0;
+    ENET_PEER_COLD (peer) -> outgoingBandwidthThrottleEpoch = 0;
     peer -> incomingDataTotal = 0;
     peer -> outgoingDataTotal = 0;
+    peer -> bandwidthThrottleEpoch = peer -> host -> bandwidthThrottleEpoch;
+    peer -> bandwidthLimitEpoch = peer -> host -> bandwidthLimitEpoch;
     peer -> lastSendTime = 0;
     peer -> lastReceiveTime = 0;
     peer -> nextTimeout = 0;
@@ -407,9 +810,19 @@ enet_peer_reset (ENetPeer * peer)
     peer -> packetThrottleLimit = ENET_PEER_PACKET_THROTTLE_SCALE;
     peer -> packetThrottleCounter = 0;
     peer -> packetThrottleEpoch = 0;
-    peer -> packetThrottleAcceleration = ENET_PEER_PACKET_THROTTLE_ACCELERATION;
-    peer -> packetThrottleDeceleration = ENET_PEER_PACKET_THROTTLE_DECELERATION;
-    peer -> packetThrottleInterval = ENET_PEER_PACKET_THROTTLE_INTERVAL;
+    ENET_PEER_COLD (peer) -> packetThrottleAcceleration = ENET_PEER_PACKET_THROTTLE_ACCELERATION;
+    ENET_PEER_COLD (peer) -> packetThrottleDeceleration = ENET_PEER_PACKET_THROTTLE_DECELERATION;
+    ENET_PEER_COLD (peer) -> packetThrottleInterval = ENET_PEER_PACKET_THROTTLE_INTERVAL;
+    ENET_PEER_COLD (peer) -> maximumWindowSize = ENET_PROTOCOL_MAXIMUM_WINDOW_SIZE;
+    ENET_PEER_COLD (peer) -> windowEpoch = 0;
+    ENET_PEER_COLD (peer) -> windowDataAcknowledged = 0;
+    memset (ENET_PEER_COLD (peer) -> compressionBackoff, 0, sizeof (ENET_PEER_COLD (peer) -> compressionBackoff));
+    memset (ENET_PEER_COLD (peer) -> compressionSkip, 0, sizeof (ENET_PEER_COLD (peer) -> compressionSkip));
+    enet_peer_destroy_streams (peer);
+    memset (ENET_PEER_COLD (peer) -> outgoingKey, 0, sizeof (ENET_PEER_COLD (peer) -> outgoingKey));
+    memset (ENET_PEER_COLD (peer) -> incomingKey, 0, sizeof (ENET_PEER_COLD (peer) -> incomingKey));
+    memset (ENET_PEER_COLD (peer) -> encryptionSalt, 0, sizeof (ENET_PEER_COLD (peer) -> encryptionSalt));
+    ENET_PEER_COLD (peer) -> incomingNonceWindow = 0;
     peer -> pingInterval = ENET_PEER_PING_INTERVAL;
     peer -> timeoutLimit = ENET_PEER_TIMEOUT_LIMIT;
     peer -> timeoutMinimum = ENET_PEER_TIMEOUT_MINIMUM;
@@ -424,13 +837,13 @@ enet_peer_reset (ENetPeer * peer)
     peer -> reliableDataInTransit = 0;
     peer -> outgoingReliableSequenceNumber = 0;
     peer -> windowSize = ENET_PROTOCOL_MAXIMUM_WINDOW_SIZE;
-    peer -> incomingUnsequencedGroup = 0;
-    peer -> outgoingUnsequencedGroup = 0;
+    ENET_PEER_COLD (peer) -> incomingUnsequencedGroup = 0;
+    ENET_PEER_COLD (peer) -> outgoingUnsequencedGroup = 0;
     peer -> eventData = 0;
     peer -> totalWaitingData = 0;
     peer -> flags = 0;
 
-    memset (peer -> unsequencedWindow, 0, sizeof (peer -> unsequencedWindow));
+    memset (ENET_PEER_COLD (peer) -> unsequencedWindow, 0, sizeof (ENET_PEER_COLD (peer) -> unsequencedWindow));
     
     enet_peer_reset_queues (peer);
 }
@@ -613,7 +1026,10 @@ enet_peer_queue_acknowledgement (ENetPeer * peer, const ENetProtocol * command,
     if (acknowledgement == NULL)
       return NULL;
 
+    enet_peer_update_throttle (peer);
+
     peer -> outgoingDataTotal += sizeof (ENetProtocolAcknowledge);
+    peer -> host -> outgoingDataTotal += sizeof (ENetProtocolAcknowledge);
 
     acknowledgement -> sentTime = sentTime;
     acknowledgement -> command = * command;
@@ -626,7 +1042,12 @@ enet_peer_queue_acknowledgement (ENetPeer * peer, const ENetProtocol * command,
 void
 enet_peer_setup_outgoing_command (ENetPeer * peer, ENetOutgoingCommand * outgoingCommand)
 {
-    peer -> outgoingDataTotal += enet_protocol_command_size (outgoingCommand -> command.header.command) + outgoingCommand -> fragmentLength;
+    size_t commandSize = enet_protocol_command_size (outgoingCommand -> command.header.command) + outgoingCommand -> fragmentLength;
+
+    enet_peer_update_throttle (peer);
+
+    peer -> outgoingDataTotal += commandSize;
+    peer -> host -> outgoingDataTotal += commandSize;
 
     if (outgoingCommand -> command.header.channelID == 0xFF)
     {
@@ -650,7 +1071,7 @@ enet_peer_setup_outgoing_command (ENetPeer * peer, ENetOutgoingCommand * outgoin
         else
         if (outgoingCommand -> command.header.command & ENET_PROTOCOL_COMMAND_FLAG_UNSEQUENCED)
         {
-           ++ peer -> outgoingUnsequencedGroup;
+           ++ ENET_PEER_COLD (peer) -> outgoingUnsequencedGroup;
 
            outgoingCommand -> reliableSequenceNumber = 0;
            outgoingCommand -> unreliableSequenceNumber = 0;
@@ -678,7 +1099,7 @@ enet_peer_setup_outgoing_command (ENetPeer * peer, ENetOutgoingCommand * outgoin
         break;
 
     case ENET_PROTOCOL_COMMAND_SEND_UNSEQUENCED:
-        outgoingCommand -> command.sendUnsequenced.unsequencedGroup = ENET_HOST_TO_NET_16 (peer -> outgoingUnsequencedGroup);
+        outgoingCommand -> command.sendUnsequenced.unsequencedGroup = ENET_HOST_TO_NET_16 (ENET_PEER_COLD (peer) -> outgoingUnsequencedGroup);
         break;
     
     default:
@@ -700,7 +1121,7 @@ enet_peer_queue_outgoing_command (ENetPeer * peer, const ENetProtocol * command,
     outgoingCommand -> fragmentLength = length;
     outgoingCommand -> packet = packet;
     if (packet != NULL)
-      ++ packet -> referenceCount;
+      ENET_ATOMIC_INCREMENT (& packet -> referenceCount);
 
     enet_peer_setup_outgoing_command (peer, outgoingCommand);
 
@@ -790,6 +1211,46 @@ enet_peer_dispatch_incoming_unreliable_commands (ENetPeer * peer, ENetChannel *
     enet_peer_remove_incoming_commands (& channel -> incomingUnreliableCommands, enet_list_begin (& channel -> incomingUnreliableCommands), droppedCommand, queuedCommand);
 }
 
+/** Replaces the packet of a delta encoded command, dispatched in order, with the packet it encodes.
+*/
+static int
+enet_peer_delta_decode_packet (ENetPeer * peer, ENetChannel * channel, ENetIncomingCommand * incomingCommand)
+{
+    enet_uint8 data [ENET_PROTOCOL_MAXIMUM_MTU];
+    ENetPacket * deltaPacket = incomingCommand -> packet, * packet;
+    size_t dataLength;
+
+    if (channel -> incomingDeltaBase == NULL)
+    {
+        channel -> incomingDeltaBase = (enet_uint8 *) enet_malloc (ENET_PROTOCOL_MAXIMUM_MTU);
+        if (channel -> incomingDeltaBase == NULL)
+          return -1;
+
+        channel -> incomingDeltaLength = 0;
+    }
+
+    dataLength = enet_delta_decode (channel -> incomingDeltaBase, channel -> incomingDeltaLength, deltaPacket -> data, deltaPacket -> dataLength, data, sizeof (data));
+    if (dataLength == 0)
+      return -1;
+
+    packet = enet_packet_create (data, dataLength, deltaPacket -> flags);
+    if (packet == NULL)
+      return -1;
+
+    memcpy (channel -> incomingDeltaBase, data, dataLength);
+    channel -> incomingDeltaLength = (enet_uint16) dataLength;
+
+    peer -> totalWaitingData += dataLength;
+    peer -> totalWaitingData -= deltaPacket -> dataLength;
+
+    packet -> referenceCount = deltaPacket -> referenceCount;
+    incomingCommand -> packet = packet;
+
+    enet_packet_destroy (deltaPacket);
+
+    return 0;
+}
+
 void
 enet_peer_dispatch_incoming_reliable_commands (ENetPeer * peer, ENetChannel * channel, ENetIncomingCommand * queuedCommand)
 {
@@ -805,6 +1266,18 @@ enet_peer_dispatch_incoming_reliable_commands (ENetPeer * peer, ENetChannel * ch
            incomingCommand -> reliableSequenceNumber != (enet_uint16) (channel -> incomingReliableSequenceNumber + 1))
          break;
 
+       /* every later delta on the channel builds on this one, so a packet that cannot be decoded
+          leaves the channel unusable and is treated as a protocol violation */
+       if ((incomingCommand -> command.header.command & ENET_PROTOCOL_COMMAND_FLAG_DELTA) &&
+           enet_peer_delta_decode_packet (peer, channel, incomingCommand) < 0)
+       {
+          peer -> eventData = 0;
+
+          enet_protocol_dispatch_state (peer -> host, peer, ENET_PEER_STATE_ZOMBIE);
+
+          break;
+       }
+
        channel -> incomingReliableSequenceNumber = incomingCommand -> reliableSequenceNumber;
 
        if (incomingCommand -> fragmentCount > 0)
@@ -973,7 +1446,7 @@ enet_peer_queue_incoming_command (ENetPeer * peer, const ENetProtocol * command,
 
     if (packet != NULL)
     {
-       ++ packet -> referenceCount;
+       ENET_ATOMIC_INCREMENT (& packet -> referenceCount);
       
        peer -> totalWaitingData += packet -> dataLength;
     }
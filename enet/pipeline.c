@@ -0,0 +1,260 @@
+/**
+ @file  pipeline.c
+ @brief ENet worker threads for datagram assembly, compression and checksums
+*/
+#include <string.h>
+#define ENET_BUILDING_LIB 1
+#include "enet/enet.h"
+
+/* Runs datagrams of the current batch until none are left. Called and returns with the mutex held. */
+static void
+enet_pipeline_work (ENetPipeline * pipeline, void * compressorContext, ENetSendScratch * scratch)
+{
+    while (pipeline -> nextDatagram < pipeline -> batchLength)
+    {
+        ENetPipelineDatagram * datagram = & pipeline -> batch [pipeline -> nextDatagram ++];
+
+        enet_mutex_unlock (& pipeline -> mutex);
+
+        pipeline -> callback (pipeline -> host, compressorContext, scratch, datagram);
+
+        enet_mutex_lock (& pipeline -> mutex);
+
+        if (++ pipeline -> finishedDatagrams >= pipeline -> batchLength)
+          enet_condition_signal (& pipeline -> workDone);
+    }
+}
+
+static void ENET_CALLBACK
+enet_pipeline_worker (void * data)
+{
+    ENetPipelineWorker * worker = (ENetPipelineWorker *) data;
+    ENetPipeline * pipeline = worker -> pipeline;
+    enet_uint32 generation = 0;
+
+    enet_mutex_lock (& pipeline -> mutex);
+
+    for (;;)
+    {
+        while (! pipeline -> shutdown && pipeline -> generation == generation)
+          enet_condition_wait (& pipeline -> workAvailable, & pipeline -> mutex);
+
+        if (pipeline -> shutdown)
+          break;
+
+        generation = pipeline -> generation;
+
+        enet_pipeline_work (pipeline, worker -> compressorContext, & worker -> scratch);
+    }
+
+    enet_mutex_unlock (& pipeline -> mutex);
+}
+
+/** Runs callback on each datagram of batch, spread over the workers and the calling service thread,
+    and returns once all of them are done. A single datagram is not worth waking the workers for.
+*/
+void
+enet_pipeline_run (ENetPipeline * pipeline, ENetPipelineCallback callback, ENetPipelineDatagram * batch, size_t batchLength)
+{
+    void * compressorContext = pipeline -> compressor.context != NULL ? pipeline -> host -> compressor.context : NULL;
+
+    if (batchLength <= 1 || pipeline -> workerCount == 0)
+    {
+        size_t i;
+
+        for (i = 0; i < batchLength; ++ i)
+          callback (pipeline -> host, compressorContext, & pipeline -> scratch, & batch [i]);
+
+        return;
+    }
+
+    enet_mutex_lock (& pipeline -> mutex);
+
+    pipeline -> callback = callback;
+    pipeline -> batch = batch;
+    pipeline -> batchLength = batchLength;
+    pipeline -> nextDatagram = 0;
+    pipeline -> finishedDatagrams = 0;
+    ++ pipeline -> generation;
+
+    enet_condition_broadcast (& pipeline -> workAvailable);
+
+    enet_pipeline_work (pipeline, compressorContext, & pipeline -> scratch);
+
+    while (pipeline -> finishedDatagrams < batchLength)
+      enet_condition_wait (& pipeline -> workDone, & pipeline -> mutex);
+
+    enet_mutex_unlock (& pipeline -> mutex);
+}
+
+/** Replaces the compressor contexts of the workers with clones of compressor. If the compressor
+    cannot be cloned, the workers only checksum and the service thread keeps compressing.
+*/
+void
+enet_pipeline_set_compressor (ENetPipeline * pipeline, const ENetCompressor * compressor)
+{
+    ENetPipelineWorker * worker;
+
+    enet_mutex_lock (& pipeline -> mutex);
+
+    for (worker = pipeline -> workers;
+         worker < & pipeline -> workers [ENET_PIPELINE_MAXIMUM_WORKERS];
+         ++ worker)
+    {
+        if (worker -> compressorContext != NULL && pipeline -> compressor.destroy != NULL)
+          pipeline -> compressor.destroy (worker -> compressorContext);
+
+        worker -> compressorContext = NULL;
+    }
+
+    memset (& pipeline -> compressor, 0, sizeof (ENetCompressor));
+
+    if (compressor != NULL && compressor -> context != NULL && compressor -> clone != NULL)
+    {
+        pipeline -> compressor = * compressor;
+
+        for (worker = pipeline -> workers;
+             worker < & pipeline -> workers [pipeline -> workerCount];
+             ++ worker)
+        {
+            worker -> compressorContext = compressor -> clone (compressor -> context);
+            if (worker -> compressorContext == NULL)
+              break;
+        }
+
+        if (worker < & pipeline -> workers [pipeline -> workerCount])
+        {
+            while (worker > pipeline -> workers)
+            {
+                -- worker;
+
+                if (compressor -> destroy != NULL)
+                  compressor -> destroy (worker -> compressorContext);
+
+                worker -> compressorContext = NULL;
+            }
+
+            memset (& pipeline -> compressor, 0, sizeof (ENetCompressor));
+        }
+    }
+
+    enet_mutex_unlock (& pipeline -> mutex);
+}
+
+/** Stops the workers and frees the pipeline. Received datagrams that were not handled yet are dropped. */
+void
+enet_pipeline_destroy (ENetPipeline * pipeline)
+{
+    ENetPipelineWorker * worker;
+
+    enet_mutex_lock (& pipeline -> mutex);
+    pipeline -> shutdown = 1;
+    enet_condition_broadcast (& pipeline -> workAvailable);
+    enet_mutex_unlock (& pipeline -> mutex);
+
+    for (worker = pipeline -> workers;
+         worker < & pipeline -> workers [pipeline -> workerCount];
+         ++ worker)
+      enet_thread_join (worker -> thread);
+
+    enet_pipeline_set_compressor (pipeline, NULL);
+
+    enet_condition_destroy (& pipeline -> workDone);
+    enet_condition_destroy (& pipeline -> workAvailable);
+    enet_mutex_destroy (& pipeline -> mutex);
+
+    enet_free (pipeline);
+}
+
+/** @defgroup host ENet host functions
+    @{
+*/
+
+/** Moves datagram assembly, packet compression and checksums off the service thread. The peers with
+    something to send are handed out in batches, whose datagrams the workers assemble, compress and
+    checksum together with the service thread, each in its own scratch space, before the batch is sent
+    at once; received datagrams are read in batches, decompressed and verified the same way, and then
+    handled in the order they arrived.
+    @param host host to enable or disable the pipeline for
+    @param workerCount number of worker threads, at most ENET_PIPELINE_MAXIMUM_WORKERS; 0 disables the pipeline
+    @returns 0 on success, < 0 on failure
+    @remarks Only pays off with an expensive packet compressor or many peers per service call.
+    The compressor must provide a clone callback to be run by the workers, and the checksum callback
+    must be safe to call from several threads at once. Stream compression keeps per-connection state,
+    so it stays on the service thread, and only the checksums of those datagrams are offloaded.
+    As the workers assemble datagrams, packet free callbacks may run on them.
+*/
+int
+enet_host_pipeline (ENetHost * host, size_t workerCount)
+{
+    ENetPipeline * pipeline;
+
+    if (host -> pipeline != NULL)
+    {
+        enet_pipeline_destroy (host -> pipeline);
+
+        host -> pipeline = NULL;
+    }
+
+    if (workerCount == 0)
+      return 0;
+
+    if (workerCount > ENET_PIPELINE_MAXIMUM_WORKERS)
+      workerCount = ENET_PIPELINE_MAXIMUM_WORKERS;
+
+    pipeline = (ENetPipeline *) enet_malloc (sizeof (ENetPipeline));
+    if (pipeline == NULL)
+      return -1;
+
+    memset (pipeline, 0, sizeof (ENetPipeline));
+
+    pipeline -> host = host;
+    pipeline -> scratch.deferred = 1;
+
+    if (enet_mutex_create (& pipeline -> mutex) < 0)
+    {
+        enet_free (pipeline);
+
+        return -1;
+    }
+
+    if (enet_condition_create (& pipeline -> workAvailable) < 0)
+    {
+        enet_mutex_destroy (& pipeline -> mutex);
+        enet_free (pipeline);
+
+        return -1;
+    }
+
+    if (enet_condition_create (& pipeline -> workDone) < 0)
+    {
+        enet_condition_destroy (& pipeline -> workAvailable);
+        enet_mutex_destroy (& pipeline -> mutex);
+        enet_free (pipeline);
+
+        return -1;
+    }
+
+    for (; pipeline -> workerCount < workerCount; ++ pipeline -> workerCount)
+    {
+        ENetPipelineWorker * worker = & pipeline -> workers [pipeline -> workerCount];
+
+        worker -> pipeline = pipeline;
+        worker -> scratch.deferred = 1;
+
+        if (enet_thread_create (& worker -> thread, enet_pipeline_worker, worker) < 0)
+        {
+            enet_pipeline_destroy (pipeline);
+
+            return -1;
+        }
+    }
+
+    enet_pipeline_set_compressor (pipeline, & host -> compressor);
+
+    host -> pipeline = pipeline;
+
+    return 0;
+}
+
+/** @} */
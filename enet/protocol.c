@@ -8,13 +8,14 @@
 #include "enet/utility.h"
 #include "enet/time.h"
 #include "enet/enet.h"
+#include "enet/atomic.h"
 
 static const size_t commandSizes [ENET_PROTOCOL_COMMAND_COUNT] =
 {
     0,
     sizeof (ENetProtocolAcknowledge),
-    sizeof (ENetProtocolConnect),
-    sizeof (ENetProtocolVerifyConnect),
+    (size_t) & ((ENetProtocolConnect *) 0) -> capabilities,
+    (size_t) & ((ENetProtocolVerifyConnect *) 0) -> capabilities,
     sizeof (ENetProtocolDisconnect),
     sizeof (ENetProtocolPing),
     sizeof (ENetProtocolSendReliable),
@@ -26,10 +27,28 @@ static const size_t commandSizes [ENET_PROTOCOL_COMMAND_COUNT] =
     sizeof (ENetProtocolSendFragment)
 };
 
+/** Returns the size of an outgoing command, including any trailer implied by its flags.
+*/
 size_t
 enet_protocol_command_size (enet_uint8 commandNumber)
 {
-    return commandSizes [commandNumber & ENET_PROTOCOL_COMMAND_MASK];
+    size_t commandSize = commandSizes [commandNumber & ENET_PROTOCOL_COMMAND_MASK];
+
+    if (commandNumber & ENET_PROTOCOL_COMMAND_FLAG_CAPABILITIES)
+    {
+        switch (commandNumber & ENET_PROTOCOL_COMMAND_MASK)
+        {
+        case ENET_PROTOCOL_COMMAND_CONNECT:
+        case ENET_PROTOCOL_COMMAND_VERIFY_CONNECT:
+           commandSize += sizeof (ENetProtocolCapabilities);
+           break;
+
+        default:
+           break;
+        }
+    }
+
+    return commandSize;
 }
 
 static void
@@ -43,7 +62,7 @@ enet_protocol_change_state (ENetHost * host, ENetPeer * peer, ENetPeerState stat
     peer -> state = state;
 }
 
-static void
+void
 enet_protocol_dispatch_state (ENetHost * host, ENetPeer * peer, ENetPeerState state)
 {
     enet_protocol_change_state (host, peer, state);
@@ -174,9 +193,7 @@ enet_protocol_remove_sent_unreliable_commands (ENetPeer * peer)
 
         if (outgoingCommand -> packet != NULL)
         {
-           -- outgoingCommand -> packet -> referenceCount;
-
-           if (outgoingCommand -> packet -> referenceCount == 0)
+           if (ENET_ATOMIC_DECREMENT (& outgoingCommand -> packet -> referenceCount) == 0)
            {
               outgoingCommand -> packet -> flags |= ENET_PACKET_FLAG_SENT;
  
@@ -258,11 +275,13 @@ enet_protocol_remove_sent_reliable_command (ENetPeer * peer, enet_uint16 reliabl
     if (outgoingCommand -> packet != NULL)
     {
        if (wasSent)
-         peer -> reliableDataInTransit -= outgoingCommand -> fragmentLength;
+       {
+           peer -> reliableDataInTransit -= outgoingCommand -> fragmentLength;
 
-       -- outgoingCommand -> packet -> referenceCount;
+           ENET_PEER_COLD (peer) -> windowDataAcknowledged += outgoingCommand -> fragmentLength;
+       }
 
-       if (outgoingCommand -> packet -> referenceCount == 0)
+       if (ENET_ATOMIC_DECREMENT (& outgoingCommand -> packet -> referenceCount) == 0)
        {
           outgoingCommand -> packet -> flags |= ENET_PACKET_FLAG_SENT;
 
@@ -282,6 +301,34 @@ enet_protocol_remove_sent_reliable_command (ENetPeer * peer, enet_uint16 reliabl
     return commandNumber;
 } 
 
+/** Copies the capabilities trailer of a CONNECT or VERIFY_CONNECT command into host byte order,
+    zeroing any fields the remote host did not send.
+*/
+static void
+enet_protocol_read_capabilities (const ENetProtocol * command, const ENetProtocolCapabilities * trailer, ENetProtocolCapabilities * capabilities)
+{
+    memset (capabilities, 0, sizeof (ENetProtocolCapabilities));
+
+    if (! (command -> header.command & ENET_PROTOCOL_COMMAND_FLAG_CAPABILITIES))
+      return;
+
+    memcpy (capabilities, trailer, ENET_MIN (trailer -> length, sizeof (ENetProtocolCapabilities)));
+
+    capabilities -> capabilities = ENET_NET_TO_HOST_16 (capabilities -> capabilities);
+    capabilities -> maximumWindowSize = ENET_NET_TO_HOST_32 (capabilities -> maximumWindowSize);
+}
+
+static enet_uint32
+enet_protocol_negotiate_window (ENetHost * host, enet_uint16 capabilities, enet_uint32 maximumWindowSize)
+{
+    if (! (capabilities & ENET_PROTOCOL_CAPABILITY_ADAPTIVE_WINDOW))
+      return ENET_PROTOCOL_MAXIMUM_WINDOW_SIZE;
+
+    maximumWindowSize = ENET_MIN (maximumWindowSize, host -> maximumWindowSize);
+
+    return ENET_MAX (maximumWindowSize, ENET_PROTOCOL_MAXIMUM_WINDOW_SIZE);
+}
+
 static ENetPeer *
 enet_protocol_handle_connect (ENetHost * host, ENetProtocolHeader * header, ENetProtocol * command)
 {
@@ -289,8 +336,13 @@ enet_protocol_handle_connect (ENetHost * host, ENetProtocolHeader * header, ENet
     enet_uint32 mtu, windowSize;
     ENetChannel * channel;
     size_t channelCount, duplicatePeers = 0;
-    ENetPeer * currentPeer, * peer = NULL;
+    ENetPeer * peer = NULL;
     ENetProtocol verifyCommand;
+    ENetList * bucket;
+    ENetListIterator currentPeer;
+    ENetProtocolCapabilities remoteCapabilities;
+    enet_uint16 capabilities;
+    enet_uint8 verifySalt [16];
 
     channelCount = ENET_NET_TO_HOST_32 (command -> connect.channelCount);
 
@@ -298,28 +350,36 @@ enet_protocol_handle_connect (ENetHost * host, ENetProtocolHeader * header, ENet
         channelCount > ENET_PROTOCOL_MAXIMUM_CHANNEL_COUNT)
       return NULL;
 
-    for (currentPeer = host -> peers;
-         currentPeer < & host -> peers [host -> peerCount];
-         ++ currentPeer)
+    enet_protocol_read_capabilities (command, & command -> connect.capabilities, & remoteCapabilities);
+    capabilities = remoteCapabilities.capabilities & host -> capabilities;
+
+    if ((host -> capabilities & ENET_PROTOCOL_CAPABILITY_ENCRYPTION) && ! (capabilities & ENET_PROTOCOL_CAPABILITY_ENCRYPTION))
+      return NULL;
+
+    bucket = enet_host_peer_bucket (host, host -> receivedAddress.host);
+
+    for (currentPeer = enet_list_begin (bucket);
+         currentPeer != enet_list_end (bucket);
+         currentPeer = enet_list_next (currentPeer))
     {
-        if (currentPeer -> state == ENET_PEER_STATE_DISCONNECTED)
-        {
-            if (peer == NULL)
-              peer = currentPeer;
-        }
-        else 
-        if (currentPeer -> state != ENET_PEER_STATE_CONNECTING &&
-            currentPeer -> address.host == host -> receivedAddress.host)
+        ENetPeer * duplicatePeer = ENET_PEER_FROM_LOOKUP_LIST (currentPeer);
+
+        if (duplicatePeer -> state != ENET_PEER_STATE_CONNECTING &&
+            duplicatePeer -> address.host == host -> receivedAddress.host)
         {
-            if (currentPeer -> address.port == host -> receivedAddress.port &&
-                currentPeer -> connectID == command -> connect.connectID)
+            if (duplicatePeer -> address.port == host -> receivedAddress.port &&
+                duplicatePeer -> connectID == command -> connect.connectID)
               return NULL;
 
             ++ duplicatePeers;
         }
     }
 
-    if (peer == NULL || duplicatePeers >= host -> duplicatePeers)
+    if (duplicatePeers >= host -> duplicatePeers)
+      return NULL;
+
+    peer = enet_host_find_free_peer (host, capabilities & ENET_PROTOCOL_CAPABILITY_EXTENDED_PEER_ID);
+    if (peer == NULL)
       return NULL;
 
     if (channelCount > host -> channelLimit)
@@ -327,16 +387,31 @@ enet_protocol_handle_connect (ENetHost * host, ENetProtocolHeader * header, ENet
     peer -> channels = (ENetChannel *) enet_malloc (channelCount * sizeof (ENetChannel));
     if (peer -> channels == NULL)
       return NULL;
+    memset (verifySalt, 0, sizeof (verifySalt));
+    if ((capabilities & ENET_PROTOCOL_CAPABILITY_ENCRYPTION) &&
+        (enet_random_bytes (verifySalt, sizeof (verifySalt)) < 0 || enet_peer_encrypt (peer, remoteCapabilities.encryptionSalt, verifySalt) < 0))
+    {
+        enet_free (peer -> channels);
+        peer -> channels = NULL;
+
+        return NULL;
+    }
     peer -> channelCount = channelCount;
     peer -> state = ENET_PEER_STATE_ACKNOWLEDGING_CONNECT;
     peer -> connectID = command -> connect.connectID;
+    if ((capabilities & ENET_PROTOCOL_CAPABILITY_STREAM_COMPRESSION) && enet_peer_create_streams (peer) < 0)
+      capabilities &= ~ ENET_PROTOCOL_CAPABILITY_STREAM_COMPRESSION;
+    peer -> capabilities = capabilities;
     peer -> address = host -> receivedAddress;
+    ENET_PEER_COLD (peer) -> maximumWindowSize = enet_protocol_negotiate_window (host, capabilities, remoteCapabilities.maximumWindowSize);
+
+    enet_host_use_peer (host, peer);
     peer -> outgoingPeerID = ENET_NET_TO_HOST_16 (command -> connect.outgoingPeerID);
     peer -> incomingBandwidth = ENET_NET_TO_HOST_32 (command -> connect.incomingBandwidth);
     peer -> outgoingBandwidth = ENET_NET_TO_HOST_32 (command -> connect.outgoingBandwidth);
-    peer -> packetThrottleInterval = ENET_NET_TO_HOST_32 (command -> connect.packetThrottleInterval);
-    peer -> packetThrottleAcceleration = ENET_NET_TO_HOST_32 (command -> connect.packetThrottleAcceleration);
-    peer -> packetThrottleDeceleration = ENET_NET_TO_HOST_32 (command -> connect.packetThrottleDeceleration);
+    ENET_PEER_COLD (peer) -> packetThrottleInterval = ENET_NET_TO_HOST_32 (command -> connect.packetThrottleInterval);
+    ENET_PEER_COLD (peer) -> packetThrottleAcceleration = ENET_NET_TO_HOST_32 (command -> connect.packetThrottleAcceleration);
+    ENET_PEER_COLD (peer) -> packetThrottleDeceleration = ENET_NET_TO_HOST_32 (command -> connect.packetThrottleDeceleration);
     peer -> eventData = ENET_NET_TO_HOST_32 (command -> connect.data);
 
     incomingSessionID = command -> connect.incomingSessionID == 0xFF ? peer -> outgoingSessionID : command -> connect.incomingSessionID;
@@ -363,6 +438,11 @@ enet_protocol_handle_connect (ENetHost * host, ENetProtocolHeader * header, ENet
         enet_list_clear (& channel -> incomingReliableCommands);
         enet_list_clear (& channel -> incomingUnreliableCommands);
 
+        channel -> outgoingDeltaBase = NULL;
+        channel -> incomingDeltaBase = NULL;
+        channel -> outgoingDeltaLength = 0;
+        channel -> incomingDeltaLength = 0;
+
         channel -> usedReliableWindows = 0;
         memset (channel -> reliableWindows, 0, sizeof (channel -> reliableWindows));
     }
@@ -422,11 +502,25 @@ enet_protocol_handle_connect (ENetHost * host, ENetProtocolHeader * header, ENet
     verifyCommand.verifyConnect.channelCount = ENET_HOST_TO_NET_32 (channelCount);
     verifyCommand.verifyConnect.incomingBandwidth = ENET_HOST_TO_NET_32 (host -> incomingBandwidth);
     verifyCommand.verifyConnect.outgoingBandwidth = ENET_HOST_TO_NET_32 (host -> outgoingBandwidth);
-    verifyCommand.verifyConnect.packetThrottleInterval = ENET_HOST_TO_NET_32 (peer -> packetThrottleInterval);
-    verifyCommand.verifyConnect.packetThrottleAcceleration = ENET_HOST_TO_NET_32 (peer -> packetThrottleAcceleration);
-    verifyCommand.verifyConnect.packetThrottleDeceleration = ENET_HOST_TO_NET_32 (peer -> packetThrottleDeceleration);
+    verifyCommand.verifyConnect.packetThrottleInterval = ENET_HOST_TO_NET_32 (ENET_PEER_COLD (peer) -> packetThrottleInterval);
+    verifyCommand.verifyConnect.packetThrottleAcceleration = ENET_HOST_TO_NET_32 (ENET_PEER_COLD (peer) -> packetThrottleAcceleration);
+    verifyCommand.verifyConnect.packetThrottleDeceleration = ENET_HOST_TO_NET_32 (ENET_PEER_COLD (peer) -> packetThrottleDeceleration);
     verifyCommand.verifyConnect.connectID = peer -> connectID;
 
+    if (command -> header.command & ENET_PROTOCOL_COMMAND_FLAG_CAPABILITIES)
+    {
+        verifyCommand.header.command |= ENET_PROTOCOL_COMMAND_FLAG_CAPABILITIES;
+        verifyCommand.verifyConnect.capabilities.command = ENET_PROTOCOL_COMMAND_NONE;
+        verifyCommand.verifyConnect.capabilities.length = sizeof (ENetProtocolCapabilities);
+        verifyCommand.verifyConnect.capabilities.capabilities = ENET_HOST_TO_NET_16 (capabilities);
+        verifyCommand.verifyConnect.capabilities.maximumWindowSize = ENET_HOST_TO_NET_32 (ENET_PEER_COLD (peer) -> maximumWindowSize);
+        memcpy (verifyCommand.verifyConnect.capabilities.encryptionSalt, verifySalt, sizeof (verifySalt));
+    }
+
+    ENET_PEER_COLD (peer) -> advertisedIncomingBandwidth = host -> incomingBandwidth;
+    ENET_PEER_COLD (peer) -> advertisedOutgoingBandwidth = host -> outgoingBandwidth;
+    peer -> bandwidthLimitEpoch = host -> bandwidthLimitEpoch;
+
     enet_peer_queue_outgoing_command (peer, & verifyCommand, NULL, 0, 0);
 
     return peer;
@@ -474,28 +568,28 @@ enet_protocol_handle_send_unsequenced (ENetHost * host, ENetPeer * peer, const E
     unsequencedGroup = ENET_NET_TO_HOST_16 (command -> sendUnsequenced.unsequencedGroup);
     index = unsequencedGroup % ENET_PEER_UNSEQUENCED_WINDOW_SIZE;
    
-    if (unsequencedGroup < peer -> incomingUnsequencedGroup)
+    if (unsequencedGroup < ENET_PEER_COLD (peer) -> incomingUnsequencedGroup)
       unsequencedGroup += 0x10000;
 
-    if (unsequencedGroup >= (enet_uint32) peer -> incomingUnsequencedGroup + ENET_PEER_FREE_UNSEQUENCED_WINDOWS * ENET_PEER_UNSEQUENCED_WINDOW_SIZE)
+    if (unsequencedGroup >= (enet_uint32) ENET_PEER_COLD (peer) -> incomingUnsequencedGroup + ENET_PEER_FREE_UNSEQUENCED_WINDOWS * ENET_PEER_UNSEQUENCED_WINDOW_SIZE)
       return 0;
 
     unsequencedGroup &= 0xFFFF;
 
-    if (unsequencedGroup - index != peer -> incomingUnsequencedGroup)
+    if (unsequencedGroup - index != ENET_PEER_COLD (peer) -> incomingUnsequencedGroup)
     {
-        peer -> incomingUnsequencedGroup = unsequencedGroup - index;
+        ENET_PEER_COLD (peer) -> incomingUnsequencedGroup = unsequencedGroup - index;
 
-        memset (peer -> unsequencedWindow, 0, sizeof (peer -> unsequencedWindow));
+        memset (ENET_PEER_COLD (peer) -> unsequencedWindow, 0, sizeof (ENET_PEER_COLD (peer) -> unsequencedWindow));
     }
     else
-    if (peer -> unsequencedWindow [index / 32] & (1 << (index % 32)))
+    if (ENET_PEER_COLD (peer) -> unsequencedWindow [index / 32] & (1 << (index % 32)))
       return 0;
       
     if (enet_peer_queue_incoming_command (peer, command, (const enet_uint8 *) command + sizeof (ENetProtocolSendUnsequenced), dataLength, ENET_PACKET_FLAG_UNSEQUENCED, 0) == NULL)
       return -1;
    
-    peer -> unsequencedWindow [index / 32] |= 1 << (index % 32);
+    ENET_PEER_COLD (peer) -> unsequencedWindow [index / 32] |= 1 << (index % 32);
  
     return 0;
 }
@@ -765,13 +859,38 @@ enet_protocol_handle_bandwidth_limit (ENetHost * host, ENetPeer * peer, const EN
       return -1;
 
     if (peer -> incomingBandwidth != 0)
-      -- host -> bandwidthLimitedPeers;
+    {
+        -- host -> bandwidthLimitedPeers;
+
+        enet_list_remove (& peer -> limitedList);
+    }
+
+    if (peer -> outgoingBandwidth != 0)
+    {
+        -- host -> outgoingBandwidthLimitedPeers;
+
+        enet_list_remove (& peer -> outgoingLimitedList);
+    }
 
     peer -> incomingBandwidth = ENET_NET_TO_HOST_32 (command -> bandwidthLimit.incomingBandwidth);
     peer -> outgoingBandwidth = ENET_NET_TO_HOST_32 (command -> bandwidthLimit.outgoingBandwidth);
 
     if (peer -> incomingBandwidth != 0)
-      ++ host -> bandwidthLimitedPeers;
+    {
+        ++ host -> bandwidthLimitedPeers;
+
+        peer -> incomingDataTotal = 0;
+        peer -> outgoingDataTotal = 0;
+
+        enet_list_insert (enet_list_end (& host -> limitedPeers), & peer -> limitedList);
+    }
+
+    if (peer -> outgoingBandwidth != 0)
+    {
+        ++ host -> outgoingBandwidthLimitedPeers;
+
+        enet_list_insert (enet_list_end (& host -> outgoingLimitedPeers), & peer -> outgoingLimitedList);
+    }
 
     if (peer -> incomingBandwidth == 0 && host -> outgoingBandwidth == 0)
       peer -> windowSize = ENET_PROTOCOL_MAXIMUM_WINDOW_SIZE;
@@ -798,9 +917,9 @@ enet_protocol_handle_throttle_configure (ENetHost * host, ENetPeer * peer, const
     if (peer -> state != ENET_PEER_STATE_CONNECTED && peer -> state != ENET_PEER_STATE_DISCONNECT_LATER)
       return -1;
 
-    peer -> packetThrottleInterval = ENET_NET_TO_HOST_32 (command -> throttleConfigure.packetThrottleInterval);
-    peer -> packetThrottleAcceleration = ENET_NET_TO_HOST_32 (command -> throttleConfigure.packetThrottleAcceleration);
-    peer -> packetThrottleDeceleration = ENET_NET_TO_HOST_32 (command -> throttleConfigure.packetThrottleDeceleration);
+    ENET_PEER_COLD (peer) -> packetThrottleInterval = ENET_NET_TO_HOST_32 (command -> throttleConfigure.packetThrottleInterval);
+    ENET_PEER_COLD (peer) -> packetThrottleAcceleration = ENET_NET_TO_HOST_32 (command -> throttleConfigure.packetThrottleAcceleration);
+    ENET_PEER_COLD (peer) -> packetThrottleDeceleration = ENET_NET_TO_HOST_32 (command -> throttleConfigure.packetThrottleDeceleration);
 
     return 0;
 }
@@ -888,7 +1007,7 @@ enet_protocol_handle_acknowledge (ENetHost * host, ENetEvent * event, ENetPeer *
       peer -> highestRoundTripTimeVariance = peer -> roundTripTimeVariance;
 
     if (peer -> packetThrottleEpoch == 0 ||
-        ENET_TIME_DIFFERENCE (host -> serviceTime, peer -> packetThrottleEpoch) >= peer -> packetThrottleInterval)
+        ENET_TIME_DIFFERENCE (host -> serviceTime, peer -> packetThrottleEpoch) >= ENET_PEER_COLD (peer) -> packetThrottleInterval)
     {
         peer -> lastRoundTripTime = peer -> lowestRoundTripTime;
         peer -> lastRoundTripTimeVariance = ENET_MAX (peer -> highestRoundTripTimeVariance, 1);
@@ -904,6 +1023,9 @@ enet_protocol_handle_acknowledge (ENetHost * host, ENetEvent * event, ENetPeer *
 
     commandNumber = enet_protocol_remove_sent_reliable_command (peer, receivedReliableSequenceNumber, command -> header.channelID);
 
+    if (peer -> capabilities & ENET_PROTOCOL_CAPABILITY_ADAPTIVE_WINDOW)
+      enet_peer_adapt_window (peer);
+
     switch (peer -> state)
     {
     case ENET_PEER_STATE_ACKNOWLEDGING_CONNECT:
@@ -938,6 +1060,7 @@ enet_protocol_handle_verify_connect (ENetHost * host, ENetEvent * event, ENetPee
 {
     enet_uint32 mtu, windowSize;
     size_t channelCount;
+    ENetProtocolCapabilities remoteCapabilities;
 
     if (peer -> state != ENET_PEER_STATE_CONNECTING)
       return 0;
@@ -945,9 +1068,9 @@ enet_protocol_handle_verify_connect (ENetHost * host, ENetEvent * event, ENetPee
     channelCount = ENET_NET_TO_HOST_32 (command -> verifyConnect.channelCount);
 
     if (channelCount < ENET_PROTOCOL_MINIMUM_CHANNEL_COUNT || channelCount > ENET_PROTOCOL_MAXIMUM_CHANNEL_COUNT ||
-        ENET_NET_TO_HOST_32 (command -> verifyConnect.packetThrottleInterval) != peer -> packetThrottleInterval ||
-        ENET_NET_TO_HOST_32 (command -> verifyConnect.packetThrottleAcceleration) != peer -> packetThrottleAcceleration ||
-        ENET_NET_TO_HOST_32 (command -> verifyConnect.packetThrottleDeceleration) != peer -> packetThrottleDeceleration ||
+        ENET_NET_TO_HOST_32 (command -> verifyConnect.packetThrottleInterval) != ENET_PEER_COLD (peer) -> packetThrottleInterval ||
+        ENET_NET_TO_HOST_32 (command -> verifyConnect.packetThrottleAcceleration) != ENET_PEER_COLD (peer) -> packetThrottleAcceleration ||
+        ENET_NET_TO_HOST_32 (command -> verifyConnect.packetThrottleDeceleration) != ENET_PEER_COLD (peer) -> packetThrottleDeceleration ||
         command -> verifyConnect.connectID != peer -> connectID)
     {
         peer -> eventData = 0;
@@ -962,7 +1085,42 @@ enet_protocol_handle_verify_connect (ENetHost * host, ENetEvent * event, ENetPee
     if (channelCount < peer -> channelCount)
       peer -> channelCount = channelCount;
 
+    enet_protocol_read_capabilities (command, & command -> verifyConnect.capabilities, & remoteCapabilities);
+
+    peer -> capabilities = remoteCapabilities.capabilities & host -> capabilities;
+    ENET_PEER_COLD (peer) -> maximumWindowSize = enet_protocol_negotiate_window (host, peer -> capabilities, remoteCapabilities.maximumWindowSize);
+
+    if (peer -> flags & ENET_PEER_FLAG_ENCRYPTED)
+      enet_peer_encrypt_verified (peer, remoteCapabilities.encryptionSalt);
+
+    if ((peer -> capabilities & ENET_PROTOCOL_CAPABILITY_STREAM_COMPRESSION) && enet_peer_create_streams (peer) < 0)
+    {
+        peer -> eventData = 0;
+
+        enet_protocol_dispatch_state (host, peer, ENET_PEER_STATE_ZOMBIE);
+
+        return -1;
+    }
+
+    /* 0xFFE marks an extended peer ID in the header, so a server that negotiated extended IDs never hands it out,
+       while for any other server it is the last legacy peer ID */
     peer -> outgoingPeerID = ENET_NET_TO_HOST_16 (command -> verifyConnect.outgoingPeerID);
+    if (peer -> outgoingPeerID >= ENET_PROTOCOL_EXTENDED_PEER_ID)
+    {
+        if (peer -> capabilities & ENET_PROTOCOL_CAPABILITY_EXTENDED_PEER_ID ?
+              peer -> outgoingPeerID <= ENET_PROTOCOL_MAXIMUM_PEER_ID :
+              peer -> outgoingPeerID != ENET_PROTOCOL_EXTENDED_PEER_ID)
+        {
+            peer -> eventData = 0;
+
+            enet_protocol_dispatch_state (host, peer, ENET_PEER_STATE_ZOMBIE);
+
+            return -1;
+        }
+
+        if (peer -> outgoingPeerID > ENET_PROTOCOL_MAXIMUM_PEER_ID)
+          peer -> flags |= ENET_PEER_FLAG_EXTENDED_PEER_ID;
+    }
     peer -> incomingSessionID = command -> verifyConnect.incomingSessionID;
     peer -> outgoingSessionID = command -> verifyConnect.outgoingSessionID;
 
@@ -995,61 +1153,267 @@ enet_protocol_handle_verify_connect (ENetHost * host, ENetEvent * event, ENetPee
     return 0;
 }
 
+/** Decompresses a datagram from a peer that negotiated stream compression into host -> packetData [1].
+    A datagram ahead of the expected sequence number means one went missing, so the incoming stream
+    is marked lost and compressed datagrams are dropped until the sender restarts the stream; the
+    reliable commands among them are retransmitted after the reset. Stale datagrams are just dropped.
+    A reset request from the peer restarts the outgoing stream with the next datagram sent to it.
+    @returns the decompressed size, 0 if the datagram cannot be decompressed
+*/
+static size_t
+enet_protocol_decompress_stream (ENetHost * host, ENetPeer * peer, size_t headerSize)
+{
+    ENetPeerCold * cold = ENET_PEER_COLD (peer);
+    enet_uint8 stream, distance;
+    size_t originalSize;
+
+    if (cold -> incomingStream == NULL || host -> receivedDataLength <= headerSize + 1)
+      return 0;
+
+    stream = host -> receivedData [headerSize];
+    if ((stream & ENET_PROTOCOL_STREAM_FLAG_REQUEST) && cold -> outgoingStream != NULL)
+      peer -> flags |= ENET_PEER_FLAG_STREAM_RESET;
+
+    if (stream & ENET_PROTOCOL_STREAM_FLAG_RESET)
+    {
+        host -> streamCompressor.reset (cold -> incomingStream);
+        peer -> flags &= ~ ENET_PEER_FLAG_STREAM_LOST;
+    }
+    else
+    if (! (peer -> flags & ENET_PEER_FLAG_STREAM_LOST))
+    {
+        distance = (stream - cold -> incomingStreamSequence) & ENET_PROTOCOL_STREAM_SEQUENCE_MASK;
+        if (distance >= (ENET_PROTOCOL_STREAM_SEQUENCE_MASK + 1) / 2)
+          return 0;
+        if (distance > 0)
+          peer -> flags |= ENET_PEER_FLAG_STREAM_LOST;
+    }
+
+    if (peer -> flags & ENET_PEER_FLAG_STREAM_LOST)
+      return 0;
+
+    originalSize = host -> streamCompressor.decompress (cold -> incomingStream,
+                                host -> receivedData + headerSize + 1,
+                                host -> receivedDataLength - headerSize - 1,
+                                host -> packetData [1] + headerSize,
+                                sizeof (host -> packetData [1]) - headerSize);
+    if (originalSize <= 0)
+    {
+        peer -> flags |= ENET_PEER_FLAG_STREAM_LOST;
+
+        return 0;
+    }
+
+    cold -> incomingStreamSequence = (stream + 1) & ENET_PROTOCOL_STREAM_SEQUENCE_MASK;
+
+    return originalSize;
+}
+
+/** Returns the nonce in the header of a datagram exchanged with an encrypting peer. */
+static enet_uint8 *
+enet_protocol_nonce (ENetHost * host, enet_uint8 * data, size_t headerSize)
+{
+    return & data [headerSize - ENET_PROTOCOL_ENCRYPTION_NONCE_SIZE - (host -> checksum != NULL ? sizeof (enet_uint32) : 0)];
+}
+
+/** Checks the nonce of a datagram received from peer against the nonces received before, which
+    the first datagram of the connection pins to its prefix. With accept set, records it as received.
+    @returns 1 if the nonce is new, 0 if the datagram is replayed or too old to tell
+*/
 static int
-enet_protocol_handle_incoming_commands (ENetHost * host, ENetEvent * event)
+enet_protocol_check_nonce (ENetPeer * peer, const enet_uint8 * nonce, int accept)
 {
-    ENetProtocolHeader * header;
-    ENetProtocol * command;
-    ENetPeer * peer;
-    enet_uint8 * currentData;
-    size_t headerSize;
-    enet_uint16 peerID, flags;
+    ENetPeerCold * cold = ENET_PEER_COLD (peer);
+    enet_uint32 counter, distance;
+
+    memcpy (& counter, & nonce [sizeof (cold -> incomingNoncePrefix)], sizeof (enet_uint32));
+    counter = ENET_NET_TO_HOST_32 (counter);
+
+    if (cold -> incomingNonceWindow == 0)
+    {
+        if (accept)
+        {
+            memcpy (cold -> incomingNoncePrefix, nonce, sizeof (cold -> incomingNoncePrefix));
+            cold -> incomingNonce = counter;
+            cold -> incomingNonceWindow = 1;
+        }
+
+        return 1;
+    }
+
+    if (memcmp (cold -> incomingNoncePrefix, nonce, sizeof (cold -> incomingNoncePrefix)) != 0)
+      return 0;
+
+    if (counter > cold -> incomingNonce)
+    {
+        if (accept)
+        {
+            distance = counter - cold -> incomingNonce;
+            cold -> incomingNonceWindow = distance < 32 ? (cold -> incomingNonceWindow << distance) | 1 : 1;
+            cold -> incomingNonce = counter;
+        }
+
+        return 1;
+    }
+
+    distance = cold -> incomingNonce - counter;
+    if (distance >= 32 || (cold -> incomingNonceWindow & ((enet_uint32) 1 << distance)))
+      return 0;
+
+    if (accept)
+      cold -> incomingNonceWindow |= (enet_uint32) 1 << distance;
+
+    return 1;
+}
+
+/** Parses the header of a received datagram and finds the peer it is addressed to. Only reads
+    the host, so that pipeline workers may call it while the service thread waits for them.
+    @returns 1 if the datagram should be handled, 0 if it should be dropped
+*/
+static int
+enet_protocol_parse_header (ENetHost * host, const enet_uint8 * data, size_t dataLength, const ENetAddress * address, ENetPeer ** peer, enet_uint16 * flags, size_t * headerSize)
+{
+    const ENetProtocolHeader * header;
+    enet_uint16 peerID;
     enet_uint8 sessionID;
 
-    if (host -> receivedDataLength < (size_t) & ((ENetProtocolHeader *) 0) -> sentTime)
+    if (dataLength < (size_t) & ((ENetProtocolHeader *) 0) -> sentTime)
       return 0;
 
-    header = (ENetProtocolHeader *) host -> receivedData;
+    header = (const ENetProtocolHeader *) data;
 
     peerID = ENET_NET_TO_HOST_16 (header -> peerID);
     sessionID = (peerID & ENET_PROTOCOL_HEADER_SESSION_MASK) >> ENET_PROTOCOL_HEADER_SESSION_SHIFT;
-    flags = peerID & ENET_PROTOCOL_HEADER_FLAG_MASK;
+    * flags = peerID & ENET_PROTOCOL_HEADER_FLAG_MASK;
     peerID &= ~ (ENET_PROTOCOL_HEADER_FLAG_MASK | ENET_PROTOCOL_HEADER_SESSION_MASK);
 
-    headerSize = (flags & ENET_PROTOCOL_HEADER_FLAG_SENT_TIME ? sizeof (ENetProtocolHeader) : (size_t) & ((ENetProtocolHeader *) 0) -> sentTime);
-    if (host -> checksum != NULL)
-      headerSize += sizeof (enet_uint32);
+    * headerSize = (* flags & ENET_PROTOCOL_HEADER_FLAG_SENT_TIME ? sizeof (ENetProtocolHeader) : (size_t) & ((ENetProtocolHeader *) 0) -> sentTime);
+    if (peerID == ENET_PROTOCOL_EXTENDED_PEER_ID)
+    {
+        if (dataLength < * headerSize + sizeof (enet_uint16))
+          return 0;
+
+        peerID = ENET_NET_TO_HOST_16 (* (const enet_uint16 *) & data [* headerSize]);
+        if (peerID <= ENET_PROTOCOL_MAXIMUM_PEER_ID)
+          return 0;
+
+        * headerSize += sizeof (enet_uint16);
+    }
 
     if (peerID == ENET_PROTOCOL_MAXIMUM_PEER_ID)
-      peer = NULL;
+      * peer = NULL;
     else
-    if (peerID >= host -> peerCount)
+    {
+       ENetPeer * currentPeer = enet_host_get_peer (host, peerID);
+
+       if (currentPeer == NULL ||
+           currentPeer -> state == ENET_PEER_STATE_DISCONNECTED ||
+           currentPeer -> state == ENET_PEER_STATE_ZOMBIE ||
+           ((address -> host != currentPeer -> address.host ||
+             address -> port != currentPeer -> address.port) &&
+             currentPeer -> address.host != ENET_HOST_BROADCAST) ||
+           (currentPeer -> outgoingPeerID != ENET_PROTOCOL_MAXIMUM_PEER_ID &&
+            sessionID != currentPeer -> incomingSessionID))
+         return 0;
+
+       * peer = currentPeer;
+
+       if (currentPeer -> flags & ENET_PEER_FLAG_ENCRYPTED)
+         * headerSize += ENET_PROTOCOL_ENCRYPTION_NONCE_SIZE;
+    }
+
+    if (host -> checksum != NULL)
+      * headerSize += sizeof (enet_uint32);
+
+    if (dataLength < * headerSize)
       return 0;
-    else
+
+    return 1;
+}
+
+static int
+enet_protocol_handle_incoming_commands (ENetHost * host, ENetEvent * event, ENetPipelineDatagram * datagram)
+{
+    ENetProtocolHeader * header;
+    ENetProtocol * command;
+    ENetPeer * peer;
+    enet_uint8 * currentData;
+    size_t headerSize;
+    enet_uint16 flags;
+    int streamed = 0, verified = 0, decrypted = 0;
+
+    if (! enet_protocol_parse_header (host, host -> receivedData, host -> receivedDataLength, & host -> receivedAddress, & peer, & flags, & headerSize))
+      return 0;
+
+    header = (ENetProtocolHeader *) host -> receivedData;
+
+    /* a pipeline worker already did the work unless the peer changed since */
+    if (datagram != NULL &&
+        datagram -> status != ENET_PIPELINE_STATUS_PENDING &&
+        datagram -> peer == peer &&
+        (peer == NULL ||
+         (datagram -> connectID == peer -> connectID &&
+          datagram -> encrypt == ((peer -> flags & ENET_PEER_FLAG_ENCRYPTED) != 0))))
     {
-       peer = & host -> peers [peerID];
+        if (datagram -> status == ENET_PIPELINE_STATUS_REJECTED)
+          return 0;
 
-       if (peer -> state == ENET_PEER_STATE_DISCONNECTED ||
-           peer -> state == ENET_PEER_STATE_ZOMBIE ||
-           ((host -> receivedAddress.host != peer -> address.host ||
-             host -> receivedAddress.port != peer -> address.port) &&
-             peer -> address.host != ENET_HOST_BROADCAST) ||
-           (peer -> outgoingPeerID < ENET_PROTOCOL_MAXIMUM_PEER_ID &&
-            sessionID != peer -> incomingSessionID))
-         return 0;
+        if (datagram -> status == ENET_PIPELINE_STATUS_VERIFIED)
+        {
+            if (datagram -> outputLength > 0)
+            {
+                host -> receivedData = datagram -> output;
+                host -> receivedDataLength = datagram -> outputLength;
+            }
+
+            verified = 1;
+        }
+
+        decrypted = 1;
     }
- 
-    if (flags & ENET_PROTOCOL_HEADER_FLAG_COMPRESSED)
+
+    if (peer != NULL && (peer -> flags & ENET_PEER_FLAG_ENCRYPTED))
     {
-        size_t originalSize;
-        if (host -> compressor.context == NULL || host -> compressor.decompress == NULL)
+        enet_uint8 * nonce = enet_protocol_nonce (host, host -> receivedData, headerSize);
+
+        if (! enet_protocol_check_nonce (peer, nonce, 0))
           return 0;
 
-        originalSize = host -> compressor.decompress (host -> compressor.context,
-                                    host -> receivedData + headerSize, 
-                                    host -> receivedDataLength - headerSize, 
-                                    host -> packetData [1] + headerSize, 
-                                    sizeof (host -> packetData [1]) - headerSize);
+        if (! decrypted)
+        {
+            if (host -> receivedDataLength < headerSize + ENET_PROTOCOL_ENCRYPTION_TAG_SIZE ||
+                enet_chacha20_poly1305_decrypt (ENET_PEER_COLD (peer) -> incomingKey, nonce,
+                                                host -> receivedData, headerSize,
+                                                host -> receivedData + headerSize,
+                                                host -> receivedDataLength - headerSize - ENET_PROTOCOL_ENCRYPTION_TAG_SIZE,
+                                                & host -> receivedData [host -> receivedDataLength - ENET_PROTOCOL_ENCRYPTION_TAG_SIZE]) < 0)
+              return 0;
+
+            host -> receivedDataLength -= ENET_PROTOCOL_ENCRYPTION_TAG_SIZE;
+        }
+
+        enet_protocol_check_nonce (peer, nonce, 1);
+    }
+ 
+    if (! verified && (flags & ENET_PROTOCOL_HEADER_FLAG_COMPRESSED))
+    {
+        size_t originalSize;
+        if (peer != NULL && (peer -> capabilities & ENET_PROTOCOL_CAPABILITY_STREAM_COMPRESSION))
+        {
+            originalSize = enet_protocol_decompress_stream (host, peer, headerSize);
+            streamed = 1;
+        }
+        else
+        {
+            if (host -> compressor.context == NULL || host -> compressor.decompress == NULL)
+              return 0;
+
+            originalSize = host -> compressor.decompress (host -> compressor.context,
+                                        host -> receivedData + headerSize, 
+                                        host -> receivedDataLength - headerSize, 
+                                        host -> packetData [1] + headerSize, 
+                                        sizeof (host -> packetData [1]) - headerSize);
+        }
         if (originalSize <= 0 || originalSize > sizeof (host -> packetData [1]) - headerSize)
           return 0;
 
@@ -1058,7 +1422,7 @@ enet_protocol_handle_incoming_commands (ENetHost * host, ENetEvent * event)
         host -> receivedDataLength = headerSize + originalSize;
     }
 
-    if (host -> checksum != NULL)
+    if (! verified && host -> checksum != NULL)
     {
         enet_uint32 * checksum = (enet_uint32 *) & host -> receivedData [headerSize - sizeof (enet_uint32)],
                     desiredChecksum = * checksum;
@@ -1070,11 +1434,22 @@ enet_protocol_handle_incoming_commands (ENetHost * host, ENetEvent * event)
         buffer.dataLength = host -> receivedDataLength;
 
         if (host -> checksum (& buffer, 1) != desiredChecksum)
-          return 0;
+        {
+            if (streamed)
+              peer -> flags |= ENET_PEER_FLAG_STREAM_LOST;
+
+            return 0;
+        }
     }
        
     if (peer != NULL)
     {
+       if (peer -> address.host != host -> receivedAddress.host)
+       {
+           enet_list_remove (& peer -> lookupList);
+           enet_list_insert (enet_list_end (enet_host_peer_bucket (host, host -> receivedAddress.host)), & peer -> lookupList);
+       }
+
        peer -> address.host = host -> receivedAddress.host;
        peer -> address.port = host -> receivedAddress.port;
        peer -> incomingDataTotal += host -> receivedDataLength;
@@ -1100,6 +1475,19 @@ enet_protocol_handle_incoming_commands (ENetHost * host, ENetEvent * event)
        if (commandSize == 0 || currentData + commandSize > & host -> receivedData [host -> receivedDataLength])
          break;
 
+       if ((command -> header.command & ENET_PROTOCOL_COMMAND_FLAG_CAPABILITIES) &&
+           (commandNumber == ENET_PROTOCOL_COMMAND_CONNECT || commandNumber == ENET_PROTOCOL_COMMAND_VERIFY_CONNECT))
+       {
+           const ENetProtocolCapabilities * capabilities = (const ENetProtocolCapabilities *) (currentData + commandSize);
+
+           if (currentData + commandSize + ENET_PROTOCOL_MINIMUM_CAPABILITIES_LENGTH > & host -> receivedData [host -> receivedDataLength] ||
+               capabilities -> length < ENET_PROTOCOL_MINIMUM_CAPABILITIES_LENGTH ||
+               currentData + commandSize + capabilities -> length > & host -> receivedData [host -> receivedDataLength])
+             break;
+
+           commandSize += capabilities -> length;
+       }
+
        currentData += commandSize;
 
        if (peer == NULL && commandNumber != ENET_PROTOCOL_COMMAND_CONNECT)
@@ -1213,45 +1601,241 @@ commandError:
     return 0;
 }
  
-static int
-enet_protocol_receive_incoming_commands (ENetHost * host, ENetEvent * event)
+/** Decrypts, decompresses and verifies a received datagram on a pipeline worker. Datagrams compressed
+    with a peer's stream are left to the service thread, which has to process them in order.
+*/
+static void ENET_CALLBACK
+enet_protocol_pipeline_receive (ENetHost * host, void * compressorContext, ENetSendScratch * scratch, ENetPipelineDatagram * datagram)
 {
-    int packets;
+    enet_uint8 * data = datagram -> data;
+    size_t dataLength = datagram -> dataLength,
+           headerSize;
+    enet_uint16 flags;
+    ENetPeer * peer;
 
-    for (packets = 0; packets < 256; ++ packets)
+    (void) scratch;
+
+    datagram -> status = ENET_PIPELINE_STATUS_PENDING;
+    datagram -> encrypt = 0;
+    datagram -> outputLength = 0;
+
+    if (! enet_protocol_parse_header (host, data, dataLength, & datagram -> address, & peer, & flags, & headerSize))
+      return;
+
+    datagram -> peer = peer;
+    datagram -> connectID = peer != NULL ? peer -> connectID : 0;
+
+    /* replayed datagrams are decrypted all the same and left to the service thread to drop */
+    if (peer != NULL && (peer -> flags & ENET_PEER_FLAG_ENCRYPTED))
     {
-       int receivedLength;
-       ENetBuffer buffer;
+        if (dataLength < headerSize + ENET_PROTOCOL_ENCRYPTION_TAG_SIZE ||
+            enet_chacha20_poly1305_decrypt (ENET_PEER_COLD (peer) -> incomingKey, enet_protocol_nonce (host, data, headerSize),
+                                            data, headerSize,
+                                            data + headerSize,
+                                            dataLength - headerSize - ENET_PROTOCOL_ENCRYPTION_TAG_SIZE,
+                                            & data [dataLength - ENET_PROTOCOL_ENCRYPTION_TAG_SIZE]) < 0)
+        {
+            datagram -> status = ENET_PIPELINE_STATUS_REJECTED;
+            return;
+        }
 
-       buffer.data = host -> packetData [0];
-       buffer.dataLength = sizeof (host -> packetData [0]);
+        dataLength -= ENET_PROTOCOL_ENCRYPTION_TAG_SIZE;
+        datagram -> dataLength = dataLength;
+        datagram -> encrypt = 1;
+        datagram -> status = ENET_PIPELINE_STATUS_DECRYPTED;
+    }
 
-       receivedLength = enet_socket_receive (host -> socket,
-                                             & host -> receivedAddress,
-                                             & buffer,
-                                             1);
+    if (flags & ENET_PROTOCOL_HEADER_FLAG_COMPRESSED)
+    {
+        size_t originalSize;
 
-       if (receivedLength < 0)
-         return -1;
+        if (compressorContext == NULL || (peer != NULL && (peer -> capabilities & ENET_PROTOCOL_CAPABILITY_STREAM_COMPRESSION)))
+          return;
 
-       if (receivedLength == 0)
-         return 0;
+        originalSize = host -> compressor.decompress (compressorContext,
+                                    data + headerSize,
+                                    dataLength - headerSize,
+                                    datagram -> output + headerSize,
+                                    sizeof (datagram -> output) - headerSize);
+        if (originalSize <= 0 || originalSize > sizeof (datagram -> output) - headerSize)
+        {
+            datagram -> status = ENET_PIPELINE_STATUS_REJECTED;
+            return;
+        }
 
-       host -> receivedData = host -> packetData [0];
-       host -> receivedDataLength = receivedLength;
-      
-       host -> totalReceivedData += receivedLength;
-       host -> totalReceivedPackets ++;
+        memcpy (datagram -> output, data, headerSize);
+        data = datagram -> output;
+        dataLength = headerSize + originalSize;
+        datagram -> outputLength = dataLength;
+    }
 
-       if (host -> intercept != NULL)
-       {
-          switch (host -> intercept (host, event))
-          {
-          case 1:
-             if (event != NULL && event -> type != ENET_EVENT_TYPE_NONE)
-               return 1;
+    if (host -> checksum != NULL)
+    {
+        enet_uint32 * checksum = (enet_uint32 *) & data [headerSize - sizeof (enet_uint32)],
+                    desiredChecksum = * checksum;
+        ENetBuffer buffer;
 
-             continue;
+        * checksum = datagram -> connectID;
+
+        buffer.data = data;
+        buffer.dataLength = dataLength;
+
+        if (host -> checksum (& buffer, 1) != desiredChecksum)
+          datagram -> status = ENET_PIPELINE_STATUS_REJECTED;
+
+        /* the intercept callback still gets to see the datagram as it was received, if decrypted */
+        * checksum = desiredChecksum;
+
+        if (datagram -> status == ENET_PIPELINE_STATUS_REJECTED)
+          return;
+    }
+
+    datagram -> status = ENET_PIPELINE_STATUS_VERIFIED;
+}
+
+/* Sharded hosts read the datagrams their receive thread routed to them rather than the shared socket. */
+static int
+enet_protocol_receive_datagram (ENetHost * host, ENetAddress * address, ENetBuffer * buffer)
+{
+    if (host -> shard != NULL)
+      return enet_shard_receive (host -> shard, address, buffer);
+
+    return enet_socket_receive (host -> socket, address, buffer, 1);
+}
+
+/** Receives datagrams in batches that the pipeline workers decompress and verify, then handles them
+    in the order they arrived. Datagrams left over when an event is returned are handled on the next call.
+*/
+static int
+enet_protocol_receive_pipelined (ENetHost * host, ENetEvent * event)
+{
+    ENetPipeline * pipeline = host -> pipeline;
+    int packets = 0;
+
+    for (;;)
+    {
+       ENetPipelineDatagram * datagram;
+
+       if (pipeline -> receiveIndex >= pipeline -> receiveCount)
+       {
+          pipeline -> receiveIndex = 0;
+          pipeline -> receiveCount = 0;
+
+          while (pipeline -> receiveCount < ENET_PIPELINE_MAXIMUM_DATAGRAMS && packets < 256)
+          {
+             int receivedLength;
+             ENetBuffer buffer;
+
+             datagram = & pipeline -> receiveDatagrams [pipeline -> receiveCount];
+
+             buffer.data = datagram -> data;
+             buffer.dataLength = sizeof (datagram -> data);
+
+             receivedLength = enet_protocol_receive_datagram (host, & datagram -> address, & buffer);
+
+             if (receivedLength < 0)
+             {
+                if (pipeline -> receiveCount == 0)
+                  return -1;
+
+                break;
+             }
+
+             if (receivedLength == 0)
+               break;
+
+             datagram -> dataLength = receivedLength;
+
+             host -> totalReceivedData += receivedLength;
+             host -> totalReceivedPackets ++;
+
+             ++ pipeline -> receiveCount;
+             ++ packets;
+          }
+
+          if (pipeline -> receiveCount == 0)
+            return 0;
+
+          enet_pipeline_run (pipeline, enet_protocol_pipeline_receive, pipeline -> receiveDatagrams, pipeline -> receiveCount);
+       }
+
+       datagram = & pipeline -> receiveDatagrams [pipeline -> receiveIndex ++];
+
+       host -> receivedAddress = datagram -> address;
+       host -> receivedData = datagram -> data;
+       host -> receivedDataLength = datagram -> dataLength;
+
+       if (host -> intercept != NULL)
+       {
+          switch (host -> intercept (host, event))
+          {
+          case 1:
+             if (event != NULL && event -> type != ENET_EVENT_TYPE_NONE)
+               return 1;
+
+             continue;
+          
+          case -1:
+             return -1;
+        
+          default:
+             break;
+          }
+       }
+        
+       switch (enet_protocol_handle_incoming_commands (host, event, datagram))
+       {
+       case 1:
+          return 1;
+       
+       case -1:
+          return -1;
+
+       default:
+          break;
+       }
+    }
+}
+
+static int
+enet_protocol_receive_incoming_commands (ENetHost * host, ENetEvent * event)
+{
+    int packets;
+
+    if (host -> pipeline != NULL)
+      return enet_protocol_receive_pipelined (host, event);
+
+    for (packets = 0; packets < 256; ++ packets)
+    {
+       int receivedLength;
+       ENetBuffer buffer;
+
+       buffer.data = host -> packetData [0];
+       buffer.dataLength = sizeof (host -> packetData [0]);
+
+       receivedLength = enet_protocol_receive_datagram (host, & host -> receivedAddress, & buffer);
+
+       if (receivedLength < 0)
+         return -1;
+
+       if (receivedLength == 0)
+         return 0;
+
+       host -> receivedData = host -> packetData [0];
+       host -> receivedDataLength = receivedLength;
+      
+       host -> totalReceivedData += receivedLength;
+       host -> totalReceivedPackets ++;
+
+       if (host -> intercept != NULL)
+       {
+          switch (host -> intercept (host, event))
+          {
+          case 1:
+             if (event != NULL && event -> type != ENET_EVENT_TYPE_NONE)
+               return 1;
+
+             continue;
           
           case -1:
              return -1;
@@ -1261,7 +1845,7 @@ enet_protocol_receive_incoming_commands (ENetHost * host, ENetEvent * event)
           }
        }
         
-       switch (enet_protocol_handle_incoming_commands (host, event))
+       switch (enet_protocol_handle_incoming_commands (host, event, NULL))
        {
        case 1:
           return 1;
@@ -1278,10 +1862,10 @@ enet_protocol_receive_incoming_commands (ENetHost * host, ENetEvent * event)
 }
 
 static void
-enet_protocol_send_acknowledgements (ENetHost * host, ENetPeer * peer)
+enet_protocol_send_acknowledgements (ENetHost * host, ENetSendScratch * scratch, ENetPeer * peer)
 {
-    ENetProtocol * command = & host -> commands [host -> commandCount];
-    ENetBuffer * buffer = & host -> buffers [host -> bufferCount];
+    ENetProtocol * command = & scratch -> commands [scratch -> commandCount];
+    ENetBuffer * buffer = & scratch -> buffers [scratch -> bufferCount];
     ENetAcknowledgement * acknowledgement;
     ENetListIterator currentAcknowledgement;
     enet_uint16 reliableSequenceNumber;
@@ -1290,11 +1874,11 @@ enet_protocol_send_acknowledgements (ENetHost * host, ENetPeer * peer)
          
     while (currentAcknowledgement != enet_list_end (& peer -> acknowledgements))
     {
-       if (command >= & host -> commands [sizeof (host -> commands) / sizeof (ENetProtocol)] ||
-           buffer >= & host -> buffers [sizeof (host -> buffers) / sizeof (ENetBuffer)] ||
-           peer -> mtu - host -> packetSize < sizeof (ENetProtocolAcknowledge))
+       if (command >= & scratch -> commands [sizeof (scratch -> commands) / sizeof (ENetProtocol)] ||
+           buffer >= & scratch -> buffers [sizeof (scratch -> buffers) / sizeof (ENetBuffer)] ||
+           peer -> mtu - scratch -> packetSize < sizeof (ENetProtocolAcknowledge))
        {
-          host -> continueSending = 1;
+          scratch -> continueSending = 1;
 
           break;
        }
@@ -1306,7 +1890,7 @@ enet_protocol_send_acknowledgements (ENetHost * host, ENetPeer * peer)
        buffer -> data = command;
        buffer -> dataLength = sizeof (ENetProtocolAcknowledge);
 
-       host -> packetSize += buffer -> dataLength;
+       scratch -> packetSize += buffer -> dataLength;
 
        reliableSequenceNumber = ENET_HOST_TO_NET_16 (acknowledgement -> command.header.reliableSequenceNumber);
   
@@ -1317,7 +1901,12 @@ enet_protocol_send_acknowledgements (ENetHost * host, ENetPeer * peer)
        command -> acknowledge.receivedSentTime = ENET_HOST_TO_NET_16 (acknowledgement -> sentTime);
   
        if ((acknowledgement -> command.header.command & ENET_PROTOCOL_COMMAND_MASK) == ENET_PROTOCOL_COMMAND_DISCONNECT)
-         enet_protocol_dispatch_state (host, peer, ENET_PEER_STATE_ZOMBIE);
+       {
+          if (scratch -> deferred)
+            peer -> flags |= ENET_PEER_FLAG_PENDING_ZOMBIE;
+          else
+            enet_protocol_dispatch_state (host, peer, ENET_PEER_STATE_ZOMBIE);
+       }
 
        enet_list_remove (& acknowledgement -> acknowledgementList);
        enet_free (acknowledgement);
@@ -1326,8 +1915,8 @@ enet_protocol_send_acknowledgements (ENetHost * host, ENetPeer * peer)
        ++ buffer;
     }
 
-    host -> commandCount = command - host -> commands;
-    host -> bufferCount = buffer - host -> buffers;
+    scratch -> commandCount = command - scratch -> commands;
+    scratch -> bufferCount = buffer - scratch -> buffers;
 }
 
 static int
@@ -1367,6 +1956,9 @@ enet_protocol_check_timeouts (ENetHost * host, ENetPeer * peer, ENetEvent * even
           
        ++ peer -> packetsLost;
 
+       if (ENET_PEER_COLD (peer) -> outgoingStream != NULL)
+         peer -> flags |= ENET_PEER_FLAG_STREAM_RESET;
+
        outgoingCommand -> roundTripTimeout *= 2;
 
        enet_list_insert (insertPosition, enet_list_remove (& outgoingCommand -> outgoingCommandList));
@@ -1384,10 +1976,10 @@ enet_protocol_check_timeouts (ENetHost * host, ENetPeer * peer, ENetEvent * even
 }
 
 static int
-enet_protocol_check_outgoing_commands (ENetHost * host, ENetPeer * peer)
+enet_protocol_check_outgoing_commands (ENetHost * host, ENetSendScratch * scratch, ENetPeer * peer)
 {
-    ENetProtocol * command = & host -> commands [host -> commandCount];
-    ENetBuffer * buffer = & host -> buffers [host -> bufferCount];
+    ENetProtocol * command = & scratch -> commands [scratch -> commandCount];
+    ENetBuffer * buffer = & scratch -> buffers [scratch -> bufferCount];
     ENetOutgoingCommand * outgoingCommand;
     ENetListIterator currentCommand;
     ENetChannel *channel = NULL;
@@ -1442,14 +2034,14 @@ enet_protocol_check_outgoing_commands (ENetHost * host, ENetPeer * peer)
           canPing = 0;
        }
 
-       commandSize = commandSizes [outgoingCommand -> command.header.command & ENET_PROTOCOL_COMMAND_MASK];
-       if (command >= & host -> commands [sizeof (host -> commands) / sizeof (ENetProtocol)] ||
-           buffer + 1 >= & host -> buffers [sizeof (host -> buffers) / sizeof (ENetBuffer)] ||
-           peer -> mtu - host -> packetSize < commandSize ||
+       commandSize = enet_protocol_command_size (outgoingCommand -> command.header.command);
+       if (command >= & scratch -> commands [sizeof (scratch -> commands) / sizeof (ENetProtocol)] ||
+           buffer + 1 >= & scratch -> buffers [sizeof (scratch -> buffers) / sizeof (ENetBuffer)] ||
+           peer -> mtu - scratch -> packetSize < commandSize ||
            (outgoingCommand -> packet != NULL && 
-             (enet_uint16) (peer -> mtu - host -> packetSize) < (enet_uint16) (commandSize + outgoingCommand -> fragmentLength)))
+             (enet_uint16) (peer -> mtu - scratch -> packetSize) < (enet_uint16) (commandSize + outgoingCommand -> fragmentLength)))
        {
-          host -> continueSending = 1;
+          scratch -> continueSending = 1;
           
           break;
        }
@@ -1480,7 +2072,7 @@ enet_protocol_check_outgoing_commands (ENetHost * host, ENetPeer * peer)
 
           outgoingCommand -> sentTime = host -> serviceTime;
 
-          host -> headerFlags |= ENET_PROTOCOL_HEADER_FLAG_SENT_TIME;
+          scratch -> headerFlags |= ENET_PROTOCOL_HEADER_FLAG_SENT_TIME;
 
           peer -> reliableDataInTransit += outgoingCommand -> fragmentLength;
        }
@@ -1497,9 +2089,7 @@ enet_protocol_check_outgoing_commands (ENetHost * host, ENetPeer * peer)
                             unreliableSequenceNumber = outgoingCommand -> unreliableSequenceNumber;
                 for (;;)
                 {
-                   -- outgoingCommand -> packet -> referenceCount;
-
-                   if (outgoingCommand -> packet -> referenceCount == 0)
+                   if (ENET_ATOMIC_DECREMENT (& outgoingCommand -> packet -> referenceCount) == 0)
                      enet_packet_destroy (outgoingCommand -> packet);
 
                    enet_list_remove (& outgoingCommand -> outgoingCommandList);
@@ -1529,7 +2119,7 @@ enet_protocol_check_outgoing_commands (ENetHost * host, ENetPeer * peer)
        buffer -> data = command;
        buffer -> dataLength = commandSize;
 
-       host -> packetSize += buffer -> dataLength;
+       scratch -> packetSize += buffer -> dataLength;
 
        * command = outgoingCommand -> command;
 
@@ -1540,7 +2130,7 @@ enet_protocol_check_outgoing_commands (ENetHost * host, ENetPeer * peer)
           buffer -> data = outgoingCommand -> packet -> data + outgoingCommand -> fragmentOffset;
           buffer -> dataLength = outgoingCommand -> fragmentLength;
 
-          host -> packetSize += outgoingCommand -> fragmentLength;
+          scratch -> packetSize += outgoingCommand -> fragmentLength;
        }
        else
        if (! (outgoingCommand -> command.header.command & ENET_PROTOCOL_COMMAND_FLAG_ACKNOWLEDGE))
@@ -1552,151 +2142,692 @@ enet_protocol_check_outgoing_commands (ENetHost * host, ENetPeer * peer)
        ++ buffer;
     }
 
-    host -> commandCount = command - host -> commands;
-    host -> bufferCount = buffer - host -> buffers;
+    scratch -> commandCount = command - scratch -> commands;
+    scratch -> bufferCount = buffer - scratch -> buffers;
 
     if (peer -> state == ENET_PEER_STATE_DISCONNECT_LATER &&
         enet_list_empty (& peer -> outgoingCommands) &&
         enet_list_empty (& peer -> sentReliableCommands) &&
         enet_list_empty (& peer -> sentUnreliableCommands))
-      enet_peer_disconnect (peer, peer -> eventData);
+    {
+        if (scratch -> deferred)
+          peer -> flags |= ENET_PEER_FLAG_PENDING_DISCONNECT;
+        else
+          enet_peer_disconnect (peer, peer -> eventData);
+    }
 
     return canPing;
 }
 
+static size_t
+enet_protocol_compression_class (size_t size)
+{
+    size_t sizeClass = 0;
+
+    for (size >>= 6; size > 0 && sizeClass < ENET_PEER_COMPRESSION_CLASSES - 1; size >>= 1)
+      ++ sizeClass;
+
+    return sizeClass;
+}
+
 static int
-enet_protocol_send_outgoing_commands (ENetHost * host, ENetEvent * event, int checkForTimeouts)
+enet_protocol_should_compress (ENetHost * host, ENetPeer * peer, size_t size)
 {
-    enet_uint8 headerData [sizeof (ENetProtocolHeader) + sizeof (enet_uint32)];
-    ENetProtocolHeader * header = (ENetProtocolHeader *) headerData;
-    ENetPeer * currentPeer;
-    int sentLength;
-    size_t shouldCompress = 0;
- 
-    host -> continueSending = 1;
+    enet_uint8 * skip = & ENET_PEER_COLD (peer) -> compressionSkip [enet_protocol_compression_class (size)];
 
-    while (host -> continueSending)
-    for (host -> continueSending = 0,
-           currentPeer = host -> peers;
-         currentPeer < & host -> peers [host -> peerCount];
-         ++ currentPeer)
+    if (* skip > 0)
     {
-        if (currentPeer -> state == ENET_PEER_STATE_DISCONNECTED ||
-            currentPeer -> state == ENET_PEER_STATE_ZOMBIE)
-          continue;
+        -- * skip;
+        ++ host -> totalCompressionBypasses;
+        return 0;
+    }
 
-        host -> headerFlags = 0;
-        host -> commandCount = 0;
-        host -> bufferCount = 1;
-        host -> packetSize = sizeof (ENetProtocolHeader);
+    return 1;
+}
 
-        if (! enet_list_empty (& currentPeer -> acknowledgements))
-          enet_protocol_send_acknowledgements (host, currentPeer);
+/** Records the yield of one compression attempt. A datagram that does not shrink by at least
+    1/ENET_PEER_COMPRESSION_MINIMUM_YIELD doubles the number of datagrams of that size class the
+    peer sends uncompressed before the next attempt, up to ENET_PEER_COMPRESSION_MAXIMUM_BACKOFF,
+    while a worthwhile result clears it again.
+*/
+static void
+enet_protocol_update_compression (ENetHost * host, ENetPeer * peer, size_t originalSize, size_t compressedSize)
+{
+    size_t sizeClass = enet_protocol_compression_class (originalSize);
+    ENetPeerCold * cold = ENET_PEER_COLD (peer);
 
-        if (checkForTimeouts != 0 &&
-            ! enet_list_empty (& currentPeer -> sentReliableCommands) &&
-            ENET_TIME_GREATER_EQUAL (host -> serviceTime, currentPeer -> nextTimeout) &&
-            enet_protocol_check_timeouts (host, currentPeer, event) == 1)
-        {
-            if (event != NULL && event -> type != ENET_EVENT_TYPE_NONE)
-              return 1;
-            else
-              continue;
-        }
+    ++ host -> totalCompressionAttempts;
+    host -> totalCompressionInput += originalSize;
 
-        if ((enet_list_empty (& currentPeer -> outgoingCommands) ||
-              enet_protocol_check_outgoing_commands (host, currentPeer)) &&
-            enet_list_empty (& currentPeer -> sentReliableCommands) &&
-            ENET_TIME_DIFFERENCE (host -> serviceTime, currentPeer -> lastReceiveTime) >= currentPeer -> pingInterval &&
-            currentPeer -> mtu - host -> packetSize >= sizeof (ENetProtocolPing))
-        { 
-            enet_peer_ping (currentPeer);
-            enet_protocol_check_outgoing_commands (host, currentPeer);
-        }
+    if (compressedSize > 0 && compressedSize < originalSize)
+      host -> totalCompressionSaved += originalSize - compressedSize;
 
-        if (host -> commandCount == 0)
-          continue;
+    if (compressedSize > 0 && compressedSize < originalSize && (originalSize - compressedSize) * ENET_PEER_COMPRESSION_MINIMUM_YIELD >= originalSize)
+    {
+        cold -> compressionBackoff [sizeClass] = 0;
+        return;
+    }
+
+    if (cold -> compressionBackoff [sizeClass] == 0)
+      cold -> compressionBackoff [sizeClass] = 1;
+    else
+    if (cold -> compressionBackoff [sizeClass] < ENET_PEER_COMPRESSION_MAXIMUM_BACKOFF)
+      cold -> compressionBackoff [sizeClass] *= 2;
+
+    cold -> compressionSkip [sizeClass] = cold -> compressionBackoff [sizeClass];
+}
+
+/** Stream compresses the payload of a datagram being built for the peer into outData, behind its
+    stream byte. A pending reset is only cleared once a datagram carrying it has been produced, so the
+    receiver restarts its history exactly when the sender did. Stream compression only begins once
+    the handshake completed on this end, which implies the remote end expects it as well.
+    @returns the compressed size including the stream byte, 0 if the compressor failed
+*/
+static size_t
+enet_protocol_compress_stream (ENetHost * host, ENetPeer * peer, const ENetBuffer * buffers, size_t bufferCount, size_t originalSize, enet_uint8 * outData, size_t compressedLimit)
+{
+    ENetPeerCold * cold = ENET_PEER_COLD (peer);
+    enet_uint8 stream = cold -> outgoingStreamSequence & ENET_PROTOCOL_STREAM_SEQUENCE_MASK;
+    size_t compressedSize;
+
+    if (compressedLimit <= 1)
+      return 0;
 
-        if (currentPeer -> packetLossEpoch == 0)
-          currentPeer -> packetLossEpoch = host -> serviceTime;
+    if (peer -> flags & ENET_PEER_FLAG_STREAM_LOST)
+      stream |= ENET_PROTOCOL_STREAM_FLAG_REQUEST;
+
+    if (peer -> flags & ENET_PEER_FLAG_STREAM_RESET)
+    {
+        host -> streamCompressor.reset (cold -> outgoingStream);
+        stream |= ENET_PROTOCOL_STREAM_FLAG_RESET;
+    }
+
+    compressedSize = host -> streamCompressor.compress (cold -> outgoingStream,
+                                  buffers, bufferCount,
+                                  originalSize,
+                                  outData + 1,
+                                  compressedLimit - 1);
+    if (compressedSize <= 0)
+      return 0;
+
+    outData [0] = stream;
+    peer -> flags &= ~ ENET_PEER_FLAG_STREAM_RESET;
+    ++ cold -> outgoingStreamSequence;
+
+    return compressedSize + 1;
+}
+
+/** Assembles the datagram for a peer in scratch: its acknowledgements, its outgoing commands and a
+    ping if one is due, behind a header that still lacks the compressed flag and holds the connect ID
+    in place of the checksum. The timeouts of the peer must have been checked already.
+    @returns the size of the header, 0 if there is nothing to send
+*/
+static size_t
+enet_protocol_assemble (ENetHost * host, ENetSendScratch * scratch, ENetPeer * peer, int encrypt)
+{
+    ENetProtocolHeader * header = (ENetProtocolHeader *) scratch -> headerData;
+    ENetBuffer * headerBuffer = scratch -> buffers;
+
+    scratch -> headerFlags = 0;
+    scratch -> commandCount = 0;
+    scratch -> bufferCount = 1;
+    scratch -> packetSize = sizeof (ENetProtocolHeader);
+    if (peer -> flags & ENET_PEER_FLAG_EXTENDED_PEER_ID)
+      scratch -> packetSize += sizeof (enet_uint16);
+    if (encrypt)
+      scratch -> packetSize += ENET_PROTOCOL_ENCRYPTION_OVERHEAD;
+
+    if (! enet_list_empty (& peer -> acknowledgements))
+      enet_protocol_send_acknowledgements (host, scratch, peer);
+
+    if ((enet_list_empty (& peer -> outgoingCommands) ||
+          enet_protocol_check_outgoing_commands (host, scratch, peer)) &&
+        enet_list_empty (& peer -> sentReliableCommands) &&
+        ENET_TIME_DIFFERENCE (host -> serviceTime, peer -> lastReceiveTime) >= peer -> pingInterval &&
+        peer -> mtu - scratch -> packetSize >= sizeof (ENetProtocolPing))
+    {
+        /* queueing a command counts against the host's outgoing data */
+        if (scratch -> deferred)
+          peer -> flags |= ENET_PEER_FLAG_PENDING_PING;
         else
-        if (ENET_TIME_DIFFERENCE (host -> serviceTime, currentPeer -> packetLossEpoch) >= ENET_PEER_PACKET_LOSS_INTERVAL &&
-            currentPeer -> packetsSent > 0)
         {
-           enet_uint32 packetLoss = currentPeer -> packetsLost * ENET_PEER_PACKET_LOSS_SCALE / currentPeer -> packetsSent;
+            enet_peer_ping (peer);
+            enet_protocol_check_outgoing_commands (host, scratch, peer);
+        }
+    }
+
+    if (scratch -> commandCount == 0)
+      return 0;
+
+    if (peer -> packetLossEpoch == 0)
+      peer -> packetLossEpoch = host -> serviceTime;
+    else
+    if (ENET_TIME_DIFFERENCE (host -> serviceTime, peer -> packetLossEpoch) >= ENET_PEER_PACKET_LOSS_INTERVAL &&
+        peer -> packetsSent > 0)
+    {
+       enet_uint32 packetLoss = peer -> packetsLost * ENET_PEER_PACKET_LOSS_SCALE / peer -> packetsSent;
 
 #ifdef ENET_DEBUG
-           printf ("peer %u: %f%%+-%f%% packet loss, %u+-%u ms round trip time, %f%% throttle, %u outgoing, %u/%u incoming\n", currentPeer -> incomingPeerID, currentPeer -> packetLoss / (float) ENET_PEER_PACKET_LOSS_SCALE, currentPeer -> packetLossVariance / (float) ENET_PEER_PACKET_LOSS_SCALE, currentPeer -> roundTripTime, currentPeer -> roundTripTimeVariance, currentPeer -> packetThrottle / (float) ENET_PEER_PACKET_THROTTLE_SCALE, enet_list_size (& currentPeer -> outgoingCommands), currentPeer -> channels != NULL ? enet_list_size (& currentPeer -> channels -> incomingReliableCommands) : 0, currentPeer -> channels != NULL ? enet_list_size (& currentPeer -> channels -> incomingUnreliableCommands) : 0);
+       printf ("peer %u: %f%%+-%f%% packet loss, %u+-%u ms round trip time, %f%% throttle, %u outgoing, %u/%u incoming\n", peer -> incomingPeerID, peer -> packetLoss / (float) ENET_PEER_PACKET_LOSS_SCALE, peer -> packetLossVariance / (float) ENET_PEER_PACKET_LOSS_SCALE, peer -> roundTripTime, peer -> roundTripTimeVariance, peer -> packetThrottle / (float) ENET_PEER_PACKET_THROTTLE_SCALE, enet_list_size (& peer -> outgoingCommands), peer -> channels != NULL ? enet_list_size (& peer -> channels -> incomingReliableCommands) : 0, peer -> channels != NULL ? enet_list_size (& peer -> channels -> incomingUnreliableCommands) : 0);
 #endif
 
-           currentPeer -> packetLossVariance = (currentPeer -> packetLossVariance * 3 + ENET_DIFFERENCE (packetLoss, currentPeer -> packetLoss)) / 4;
-           currentPeer -> packetLoss = (currentPeer -> packetLoss * 7 + packetLoss) / 8;
+       peer -> packetLossVariance = (peer -> packetLossVariance * 3 + ENET_DIFFERENCE (packetLoss, peer -> packetLoss)) / 4;
+       peer -> packetLoss = (peer -> packetLoss * 7 + packetLoss) / 8;
 
-           currentPeer -> packetLossEpoch = host -> serviceTime;
-           currentPeer -> packetsSent = 0;
-           currentPeer -> packetsLost = 0;
-        }
+       peer -> packetLossEpoch = host -> serviceTime;
+       peer -> packetsSent = 0;
+       peer -> packetsLost = 0;
+    }
+
+    headerBuffer -> data = scratch -> headerData;
+    if (scratch -> headerFlags & ENET_PROTOCOL_HEADER_FLAG_SENT_TIME)
+    {
+        header -> sentTime = ENET_HOST_TO_NET_16 (host -> serviceTime & 0xFFFF);
+
+        headerBuffer -> dataLength = sizeof (ENetProtocolHeader);
+    }
+    else
+      headerBuffer -> dataLength = (size_t) & ((ENetProtocolHeader *) 0) -> sentTime;
+
+    if (peer -> flags & ENET_PEER_FLAG_EXTENDED_PEER_ID)
+    {
+        * (enet_uint16 *) & scratch -> headerData [headerBuffer -> dataLength] = ENET_HOST_TO_NET_16 (peer -> outgoingPeerID);
+        headerBuffer -> dataLength += sizeof (enet_uint16);
+    }
+
+    if (encrypt)
+    {
+        enet_uint32 nonce = ENET_HOST_TO_NET_32 (ENET_PEER_COLD (peer) -> outgoingNonce);
+
+        memcpy (& scratch -> headerData [headerBuffer -> dataLength], ENET_PEER_COLD (peer) -> outgoingNoncePrefix, sizeof (ENET_PEER_COLD (peer) -> outgoingNoncePrefix));
+        memcpy (& scratch -> headerData [headerBuffer -> dataLength + sizeof (ENET_PEER_COLD (peer) -> outgoingNoncePrefix)], & nonce, sizeof (enet_uint32));
+        headerBuffer -> dataLength += ENET_PROTOCOL_ENCRYPTION_NONCE_SIZE;
+
+        ++ ENET_PEER_COLD (peer) -> outgoingNonce;
+    }
 
-        host -> buffers -> data = headerData;
-        if (host -> headerFlags & ENET_PROTOCOL_HEADER_FLAG_SENT_TIME)
+    if (peer -> outgoingPeerID != ENET_PROTOCOL_MAXIMUM_PEER_ID)
+      scratch -> headerFlags |= peer -> outgoingSessionID << ENET_PROTOCOL_HEADER_SESSION_SHIFT;
+    if (peer -> flags & ENET_PEER_FLAG_EXTENDED_PEER_ID)
+      header -> peerID = ENET_HOST_TO_NET_16 (ENET_PROTOCOL_EXTENDED_PEER_ID | scratch -> headerFlags);
+    else
+      header -> peerID = ENET_HOST_TO_NET_16 (peer -> outgoingPeerID | scratch -> headerFlags);
+    if (host -> checksum != NULL)
+    {
+        * (enet_uint32 *) & scratch -> headerData [headerBuffer -> dataLength] = peer -> outgoingPeerID != ENET_PROTOCOL_MAXIMUM_PEER_ID ? peer -> connectID : 0;
+        headerBuffer -> dataLength += sizeof (enet_uint32);
+    }
+
+    return headerBuffer -> dataLength;
+}
+
+/** Assembles the datagram for a queued peer on a pipeline worker and copies it into the pipeline,
+    leaving the decision whether to compress it to the service thread.
+*/
+static void ENET_CALLBACK
+enet_protocol_pipeline_assemble (ENetHost * host, void * compressorContext, ENetSendScratch * scratch, ENetPipelineDatagram * datagram)
+{
+    ENetPeer * peer = datagram -> peer;
+    const ENetBuffer * buffer;
+    enet_uint8 * data = datagram -> data;
+
+    (void) compressorContext;
+
+    datagram -> compress = 0;
+    datagram -> outputLength = 0;
+    datagram -> dataLength = 0;
+    datagram -> headerSize = enet_protocol_assemble (host, scratch, peer, datagram -> encrypt);
+    if (datagram -> headerSize == 0)
+      return;
+
+    datagram -> address = peer -> address;
+    datagram -> checksumOffset = host -> checksum != NULL ? datagram -> headerSize - sizeof (enet_uint32) : 0;
+
+    for (buffer = scratch -> buffers;
+         buffer < & scratch -> buffers [scratch -> bufferCount];
+         ++ buffer)
+    {
+        memcpy (data, buffer -> data, buffer -> dataLength);
+        data += buffer -> dataLength;
+    }
+
+    datagram -> dataLength = data - datagram -> data;
+
+    peer -> lastSendTime = host -> serviceTime;
+
+    enet_protocol_remove_sent_unreliable_commands (peer);
+}
+
+/** Compresses, checksums and encrypts an outgoing datagram on a pipeline worker, exactly as the service
+    thread would: the checksum covers the uncompressed datagram with the compressed flag already set.
+*/
+static void ENET_CALLBACK
+enet_protocol_pipeline_send (ENetHost * host, void * compressorContext, ENetSendScratch * scratch, ENetPipelineDatagram * datagram)
+{
+    (void) scratch;
+
+    if (datagram -> dataLength == 0)
+      return;
+
+    if (datagram -> compress)
+    {
+        size_t originalSize = datagram -> dataLength - datagram -> headerSize,
+               compressedSize;
+        ENetBuffer buffer;
+
+        buffer.data = datagram -> data + datagram -> headerSize;
+        buffer.dataLength = originalSize;
+
+        compressedSize = host -> compressor.compress (compressorContext,
+                                    & buffer, 1,
+                                    originalSize,
+                                    datagram -> output + datagram -> headerSize,
+                                    originalSize);
+        if (compressedSize > 0 && compressedSize < originalSize)
+          datagram -> outputLength = datagram -> headerSize + compressedSize;
+    }
+
+    if (datagram -> outputLength > 0)
+      * (enet_uint16 *) datagram -> data |= ENET_HOST_TO_NET_16 (ENET_PROTOCOL_HEADER_FLAG_COMPRESSED);
+
+    if (datagram -> checksumOffset > 0)
+    {
+        ENetBuffer buffer;
+
+        buffer.data = datagram -> data;
+        buffer.dataLength = datagram -> dataLength;
+
+        * (enet_uint32 *) & datagram -> data [datagram -> checksumOffset] = host -> checksum (& buffer, 1);
+    }
+
+    if (datagram -> outputLength > 0)
+      memcpy (datagram -> output, datagram -> data, datagram -> headerSize);
+
+    if (datagram -> encrypt)
+    {
+        enet_uint8 * data = datagram -> outputLength > 0 ? datagram -> output : datagram -> data;
+        size_t dataLength = datagram -> outputLength > 0 ? datagram -> outputLength : datagram -> dataLength;
+
+        enet_chacha20_poly1305_encrypt (ENET_PEER_COLD (datagram -> peer) -> outgoingKey,
+                                        enet_protocol_nonce (host, data, datagram -> headerSize),
+                                        data, datagram -> headerSize,
+                                        data + datagram -> headerSize,
+                                        dataLength - datagram -> headerSize,
+                                        & data [dataLength]);
+    }
+}
+
+/** Carries out on the service thread what a pipeline worker left to it while assembling the datagram
+    for a peer, and decides how the datagram is compressed. Stream compression keeps per-connection
+    state and the packet compressor may not have been cloned for the workers, so both run here.
+*/
+static void
+enet_protocol_prepare_pipelined (ENetHost * host, ENetPipelineDatagram * datagram)
+{
+    ENetPeer * peer = datagram -> peer;
+    size_t originalSize, compressedSize = 0;
+    ENetBuffer buffer;
+
+    if (peer -> flags & ENET_PEER_FLAG_PENDING_ZOMBIE)
+      enet_protocol_dispatch_state (host, peer, ENET_PEER_STATE_ZOMBIE);
+
+    if (peer -> flags & ENET_PEER_FLAG_PENDING_DISCONNECT)
+      enet_peer_disconnect (peer, peer -> eventData);
+
+    /* another pass over the peers sends the ping right away, as it would have been without the pipeline */
+    if ((peer -> flags & ENET_PEER_FLAG_PENDING_PING) && peer -> state == ENET_PEER_STATE_CONNECTED)
+    {
+        enet_peer_ping (peer);
+
+        host -> continueSending = 1;
+    }
+
+    peer -> flags &= ~ (ENET_PEER_FLAG_PENDING_ZOMBIE | ENET_PEER_FLAG_PENDING_DISCONNECT | ENET_PEER_FLAG_PENDING_PING);
+
+    if (datagram -> dataLength == 0 ||
+        ! (ENET_PEER_COLD (peer) -> outgoingStream != NULL ?
+             peer -> state >= ENET_PEER_STATE_CONNECTION_PENDING :
+             host -> compressor.context != NULL && host -> compressor.compress != NULL))
+      return;
+
+    originalSize = datagram -> dataLength - datagram -> headerSize;
+
+    buffer.data = datagram -> data + datagram -> headerSize;
+    buffer.dataLength = originalSize;
+
+    /* a reset or a reset request has to get through even if the datagram does not shrink */
+    if (ENET_PEER_COLD (peer) -> outgoingStream != NULL &&
+        (peer -> flags & (ENET_PEER_FLAG_STREAM_RESET | ENET_PEER_FLAG_STREAM_LOST)))
+      compressedSize = enet_protocol_compress_stream (host, peer, & buffer, 1, originalSize,
+                         datagram -> output + datagram -> headerSize,
+                         sizeof (datagram -> output) - datagram -> headerSize - (datagram -> encrypt ? ENET_PROTOCOL_ENCRYPTION_TAG_SIZE : 0));
+    else
+    if (enet_protocol_should_compress (host, peer, originalSize))
+    {
+        if (ENET_PEER_COLD (peer) -> outgoingStream == NULL &&
+            host -> pipeline -> compressor.context != NULL)
+          datagram -> compress = 1;
+        else
         {
-            header -> sentTime = ENET_HOST_TO_NET_16 (host -> serviceTime & 0xFFFF);
+            if (ENET_PEER_COLD (peer) -> outgoingStream != NULL)
+              compressedSize = enet_protocol_compress_stream (host, peer, & buffer, 1, originalSize,
+                                 datagram -> output + datagram -> headerSize, originalSize - 1);
+            else
+              compressedSize = host -> compressor.compress (host -> compressor.context,
+                                          & buffer, 1,
+                                          originalSize,
+                                          datagram -> output + datagram -> headerSize,
+                                          originalSize);
+            enet_protocol_update_compression (host, peer, originalSize, compressedSize);
+            if (compressedSize >= originalSize)
+              compressedSize = 0;
+        }
+    }
+
+    if (compressedSize > 0)
+      datagram -> outputLength = datagram -> headerSize + compressedSize;
+}
 
-            host -> buffers -> dataLength = sizeof (ENetProtocolHeader);
+/** Has the pipeline assemble the datagrams of the queued peers, then compress and checksum them, and
+    sends them at once.
+    @returns 0 on success, < 0 if a send failed
+*/
+static int
+enet_protocol_send_pipelined (ENetHost * host)
+{
+    ENetPipeline * pipeline = host -> pipeline;
+    ENetPipelineDatagram * datagram;
+    ENetPipelineWorker * worker;
+    ENetAddress addresses [ENET_PIPELINE_MAXIMUM_SEND_DATAGRAMS];
+    ENetBuffer buffers [ENET_PIPELINE_MAXIMUM_SEND_DATAGRAMS];
+    size_t sendCount, bufferCount = 0;
+    int sentLength;
+
+    if (pipeline == NULL || pipeline -> sendCount == 0)
+      return 0;
+
+    sendCount = pipeline -> sendCount;
+    pipeline -> sendCount = 0;
+
+    enet_pipeline_run (pipeline, enet_protocol_pipeline_assemble, pipeline -> sendDatagrams, sendCount);
+
+    if (pipeline -> scratch.continueSending)
+      host -> continueSending = 1;
+    pipeline -> scratch.continueSending = 0;
+
+    for (worker = pipeline -> workers;
+         worker < & pipeline -> workers [pipeline -> workerCount];
+         ++ worker)
+    {
+        if (worker -> scratch.continueSending)
+          host -> continueSending = 1;
+        worker -> scratch.continueSending = 0;
+    }
+
+    for (datagram = pipeline -> sendDatagrams;
+         datagram < & pipeline -> sendDatagrams [sendCount];
+         ++ datagram)
+      enet_protocol_prepare_pipelined (host, datagram);
+
+    enet_pipeline_run (pipeline, enet_protocol_pipeline_send, pipeline -> sendDatagrams, sendCount);
+
+    for (datagram = pipeline -> sendDatagrams;
+         datagram < & pipeline -> sendDatagrams [sendCount];
+         ++ datagram)
+    {
+        ENetBuffer * buffer = & buffers [bufferCount];
+
+        if (datagram -> dataLength == 0)
+          continue;
+
+        if (datagram -> compress)
+          enet_protocol_update_compression (host, datagram -> peer,
+                                            datagram -> dataLength - datagram -> headerSize,
+                                            datagram -> outputLength > 0 ? datagram -> outputLength - datagram -> headerSize : 0);
+
+        if (datagram -> outputLength > 0)
+        {
+            buffer -> data = datagram -> output;
+            buffer -> dataLength = datagram -> outputLength;
         }
         else
-          host -> buffers -> dataLength = (size_t) & ((ENetProtocolHeader *) 0) -> sentTime;
+        {
+            buffer -> data = datagram -> data;
+            buffer -> dataLength = datagram -> dataLength;
+        }
+
+        if (datagram -> encrypt)
+          buffer -> dataLength += ENET_PROTOCOL_ENCRYPTION_TAG_SIZE;
 
-        shouldCompress = 0;
-        if (host -> compressor.context != NULL && host -> compressor.compress != NULL)
+        addresses [bufferCount ++] = datagram -> address;
+    }
+
+    if (bufferCount == 0)
+      return 0;
+
+    sentLength = enet_socket_send_batch (host -> socket, addresses, buffers, bufferCount);
+    if (sentLength < 0)
+      return -1;
+
+    host -> totalSentData += sentLength;
+    host -> totalSentPackets += bufferCount;
+
+    return 0;
+}
+
+/** Encrypts the payload of the datagram assembled in scratch into host -> packetData [1], which
+    already holds the payload if it was compressed, and appends the tag.
+*/
+static void
+enet_protocol_encrypt (ENetHost * host, ENetSendScratch * scratch, ENetPeer * peer, size_t compressedSize)
+{
+    enet_uint8 * header = (enet_uint8 *) scratch -> buffers -> data,
+               * payload = host -> packetData [1];
+    size_t headerSize = scratch -> buffers -> dataLength,
+           payloadLength = compressedSize;
+
+    if (payloadLength == 0)
+    {
+        const ENetBuffer * buffer;
+
+        for (buffer = & scratch -> buffers [1];
+             buffer < & scratch -> buffers [scratch -> bufferCount];
+             ++ buffer)
         {
-            size_t originalSize = host -> packetSize - sizeof(ENetProtocolHeader),
-                   compressedSize = host -> compressor.compress (host -> compressor.context,
-                                        & host -> buffers [1], host -> bufferCount - 1,
-                                        originalSize,
-                                        host -> packetData [1],
-                                        originalSize);
-            if (compressedSize > 0 && compressedSize < originalSize)
-            {
-                host -> headerFlags |= ENET_PROTOCOL_HEADER_FLAG_COMPRESSED;
-                shouldCompress = compressedSize;
-#ifdef ENET_DEBUG_COMPRESS
-                printf ("peer %u: compressed %u -> %u (%u%%)\n", currentPeer -> incomingPeerID, originalSize, compressedSize, (compressedSize * 100) / originalSize);
-#endif
-            }
+            memcpy (& payload [payloadLength], buffer -> data, buffer -> dataLength);
+            payloadLength += buffer -> dataLength;
         }
+    }
+
+    enet_chacha20_poly1305_encrypt (ENET_PEER_COLD (peer) -> outgoingKey,
+                                    enet_protocol_nonce (host, header, headerSize),
+                                    header, headerSize,
+                                    payload, payloadLength,
+                                    & payload [payloadLength]);
+
+    scratch -> buffers [1].data = payload;
+    scratch -> buffers [1].dataLength = payloadLength + ENET_PROTOCOL_ENCRYPTION_TAG_SIZE;
+    scratch -> bufferCount = 2;
+}
 
-        if (currentPeer -> outgoingPeerID < ENET_PROTOCOL_MAXIMUM_PEER_ID)
-          host -> headerFlags |= currentPeer -> outgoingSessionID << ENET_PROTOCOL_HEADER_SESSION_SHIFT;
-        header -> peerID = ENET_HOST_TO_NET_16 (currentPeer -> outgoingPeerID | host -> headerFlags);
-        if (host -> checksum != NULL)
+/** Assembles, compresses, checksums and sends the datagram for a peer on the service thread.
+    @returns 0 on success, < 0 if the send failed
+*/
+static int
+enet_protocol_send_datagram (ENetHost * host, ENetPeer * peer, int encrypt)
+{
+    ENetSendScratch * scratch = & host -> sendScratch;
+    size_t headerSize = enet_protocol_assemble (host, scratch, peer, encrypt),
+           shouldCompress = 0;
+    int sentLength;
+
+    if (headerSize == 0)
+      return 0;
+
+    if (ENET_PEER_COLD (peer) -> outgoingStream != NULL ?
+          peer -> state >= ENET_PEER_STATE_CONNECTION_PENDING :
+          host -> compressor.context != NULL && host -> compressor.compress != NULL)
+    {
+        size_t originalSize = scratch -> packetSize - sizeof(ENetProtocolHeader),
+               compressedSize;
+
+        if (peer -> flags & ENET_PEER_FLAG_EXTENDED_PEER_ID)
+          originalSize -= sizeof (enet_uint16);
+        if (encrypt)
+          originalSize -= ENET_PROTOCOL_ENCRYPTION_OVERHEAD;
+
+        compressedSize = 0;
+
+        /* a reset or a reset request has to get through even if the datagram does not shrink */
+        if (ENET_PEER_COLD (peer) -> outgoingStream != NULL &&
+            (peer -> flags & (ENET_PEER_FLAG_STREAM_RESET | ENET_PEER_FLAG_STREAM_LOST)))
+          compressedSize = enet_protocol_compress_stream (host, peer, & scratch -> buffers [1], scratch -> bufferCount - 1, originalSize,
+                             host -> packetData [1],
+                             sizeof (host -> packetData [1]) - (encrypt ? ENET_PROTOCOL_ENCRYPTION_TAG_SIZE : 0));
+        else
+        if (enet_protocol_should_compress (host, peer, originalSize))
         {
-            enet_uint32 * checksum = (enet_uint32 *) & headerData [host -> buffers -> dataLength];
-            * checksum = currentPeer -> outgoingPeerID < ENET_PROTOCOL_MAXIMUM_PEER_ID ? currentPeer -> connectID : 0;
-            host -> buffers -> dataLength += sizeof (enet_uint32);
-            * checksum = host -> checksum (host -> buffers, host -> bufferCount);
+            if (ENET_PEER_COLD (peer) -> outgoingStream != NULL)
+              compressedSize = enet_protocol_compress_stream (host, peer, & scratch -> buffers [1], scratch -> bufferCount - 1, originalSize,
+                                 host -> packetData [1], originalSize - 1);
+            else
+              compressedSize = host -> compressor.compress (host -> compressor.context,
+                                          & scratch -> buffers [1], scratch -> bufferCount - 1,
+                                          originalSize,
+                                          host -> packetData [1],
+                                          originalSize);
+            enet_protocol_update_compression (host, peer, originalSize, compressedSize);
+            if (compressedSize >= originalSize)
+              compressedSize = 0;
         }
 
-        if (shouldCompress > 0)
+        if (compressedSize > 0)
         {
-            host -> buffers [1].data = host -> packetData [1];
-            host -> buffers [1].dataLength = shouldCompress;
-            host -> bufferCount = 2;
+            * (enet_uint16 *) scratch -> headerData |= ENET_HOST_TO_NET_16 (ENET_PROTOCOL_HEADER_FLAG_COMPRESSED);
+            shouldCompress = compressedSize;
+#ifdef ENET_DEBUG_COMPRESS
+            printf ("peer %u: compressed %u -> %u (%u%%)\n", peer -> incomingPeerID, originalSize, compressedSize, (compressedSize * 100) / originalSize);
+#endif
         }
+    }
 
-        currentPeer -> lastSendTime = host -> serviceTime;
+    if (host -> checksum != NULL)
+      * (enet_uint32 *) & scratch -> headerData [headerSize - sizeof (enet_uint32)] = host -> checksum (scratch -> buffers, scratch -> bufferCount);
 
-        sentLength = enet_socket_send (host -> socket, & currentPeer -> address, host -> buffers, host -> bufferCount);
+    if (encrypt)
+      enet_protocol_encrypt (host, scratch, peer, shouldCompress);
+    else
+    if (shouldCompress > 0)
+    {
+        scratch -> buffers [1].data = host -> packetData [1];
+        scratch -> buffers [1].dataLength = shouldCompress;
+        scratch -> bufferCount = 2;
+    }
 
-        enet_protocol_remove_sent_unreliable_commands (currentPeer);
+    peer -> lastSendTime = host -> serviceTime;
 
-        if (sentLength < 0)
-          return -1;
+    sentLength = enet_socket_send (host -> socket, & peer -> address, scratch -> buffers, scratch -> bufferCount);
 
-        host -> totalSentData += sentLength;
-        host -> totalSentPackets ++;
+    enet_protocol_remove_sent_unreliable_commands (peer);
+
+    if (sentLength < 0)
+      return -1;
+
+    host -> totalSentData += sentLength;
+    host -> totalSentPackets ++;
+
+    return 0;
+}
+
+static int
+enet_protocol_send_outgoing_commands (ENetHost * host, ENetEvent * event, int checkForTimeouts)
+{
+    ENetPeerChunk * chunk;
+    ENetPeer * currentPeer;
+    int encrypt;
+
+    host -> continueSending = 1;
+
+    while (host -> continueSending)
+    {
+        host -> continueSending = 0;
+
+        for (chunk = host -> peerChunks;
+             chunk < & host -> peerChunks [host -> peerChunkCount];
+             ++ chunk)
+        for (currentPeer = chunk -> peers;
+             currentPeer < & chunk -> peers [chunk -> peerCount];
+             ++ currentPeer)
+        {
+            if (currentPeer -> state == ENET_PEER_STATE_DISCONNECTED ||
+                currentPeer -> state == ENET_PEER_STATE_ZOMBIE)
+              continue;
+
+            /* the CONNECT command goes out in the clear, everything after it is encrypted */
+            encrypt = (currentPeer -> flags & ENET_PEER_FLAG_ENCRYPTED) && currentPeer -> outgoingPeerID != ENET_PROTOCOL_MAXIMUM_PEER_ID;
+
+            /* a nonce must never repeat under the connection key */
+            if (encrypt && ENET_PEER_COLD (currentPeer) -> outgoingNonce == 0xFFFFFFFF)
+            {
+                if (enet_protocol_send_pipelined (host) < 0)
+                  return -1;
+
+                enet_protocol_notify_disconnect (host, currentPeer, event);
+
+                if (event != NULL && event -> type != ENET_EVENT_TYPE_NONE)
+                  return 1;
+                else
+                  continue;
+            }
+
+            if (checkForTimeouts != 0 &&
+                ! enet_list_empty (& currentPeer -> sentReliableCommands) &&
+                ENET_TIME_GREATER_EQUAL (host -> serviceTime, currentPeer -> nextTimeout) &&
+                enet_protocol_check_timeouts (host, currentPeer, event) == 1)
+            {
+                if (event != NULL && event -> type != ENET_EVENT_TYPE_NONE)
+                  return enet_protocol_send_pipelined (host) < 0 ? -1 : 1;
+                else
+                  continue;
+            }
+
+            if (enet_list_empty (& currentPeer -> acknowledgements) &&
+                enet_list_empty (& currentPeer -> outgoingCommands) &&
+                ! (enet_list_empty (& currentPeer -> sentReliableCommands) &&
+                   ENET_TIME_DIFFERENCE (host -> serviceTime, currentPeer -> lastReceiveTime) >= currentPeer -> pingInterval))
+              continue;
+
+            /* idle peers catch up with the bandwidth throttle once they have something to send, at the
+               latest with their next ping */
+            enet_peer_update_throttle (currentPeer);
+            enet_peer_update_bandwidth_limit (currentPeer);
+
+            if (host -> pipeline != NULL)
+            {
+                ENetPipelineDatagram * datagram = & host -> pipeline -> sendDatagrams [host -> pipeline -> sendCount ++];
+
+                datagram -> peer = currentPeer;
+                datagram -> encrypt = encrypt;
+
+                if (host -> pipeline -> sendCount >= ENET_PIPELINE_MAXIMUM_SEND_DATAGRAMS &&
+                    enet_protocol_send_pipelined (host) < 0)
+                  return -1;
+
+                continue;
+            }
+
+            if (enet_protocol_send_datagram (host, currentPeer, encrypt) < 0)
+              return -1;
+
+            host -> continueSending |= host -> sendScratch.continueSending;
+            host -> sendScratch.continueSending = 0;
+        }
+
+        /* a peer is queued at most once per pass, as the workers assemble its datagram in place */
+        if (enet_protocol_send_pipelined (host) < 0)
+          return -1;
     }
-   
+
     return 0;
 }
 
@@ -1753,6 +2884,8 @@ enet_host_service (ENetHost * host, ENetEvent * event, enet_uint32 timeout)
 {
     enet_uint32 waitCondition;
 
+    enet_host_run_submissions (host);
+
     if (event != NULL)
     {
         event -> type = ENET_EVENT_TYPE_NONE;
@@ -1783,7 +2916,16 @@ enet_host_service (ENetHost * host, ENetEvent * event, enet_uint32 timeout)
     do
     {
        if (ENET_TIME_DIFFERENCE (host -> serviceTime, host -> bandwidthThrottleEpoch) >= ENET_HOST_BANDWIDTH_THROTTLE_INTERVAL)
+       {
          enet_host_bandwidth_throttle (host);
+         enet_host_shrink_peers (host);
+       }
+
+       if (ENET_TIME_DIFFERENCE (host -> serviceTime, host -> statisticsEpoch) >= host -> statisticsInterval)
+         enet_host_publish_statistics (host);
+
+       if (host -> shard != NULL)
+         enet_shard_rebalance (host);
 
        switch (enet_protocol_send_outgoing_commands (host, event, 1))
        {
@@ -1864,6 +3006,12 @@ enet_host_service (ENetHost * host, ENetEvent * event, enet_uint32 timeout)
 
           waitCondition = ENET_SOCKET_WAIT_RECEIVE | ENET_SOCKET_WAIT_INTERRUPT;
 
+          if (host -> shard != NULL)
+          {
+             if (enet_shard_wait (host, & waitCondition, ENET_TIME_DIFFERENCE (timeout, host -> serviceTime)) != 0)
+               return -1;
+          }
+          else
           if (enet_socket_wait (host -> socket, & waitCondition, ENET_TIME_DIFFERENCE (timeout, host -> serviceTime)) != 0)
             return -1;
        }
@@ -0,0 +1,435 @@
+/**
+ @file  shard.c
+ @brief ENet hosts sharing one socket, each serviced on its own thread
+*/
+#include <string.h>
+#define ENET_BUILDING_LIB 1
+#include "enet/utility.h"
+#include "enet/time.h"
+#include "enet/enet.h"
+#include "enet/atomic.h"
+
+/* Peer IDs are handed out in chunks, and each shard starts out owning the chunks whose index is its
+   own modulo the number of shards. As peers migrate between shards their IDs change hands, so the
+   peer ID in the header is looked up in peerShards to find the shard. Connection requests do not
+   carry a peer ID yet, and go to the shard their connect ID hashes to, so that resends reach the
+   same shard while peers behind one address still spread out. A request that cannot be read, for
+   being compressed, falls back to its address. */
+static size_t
+enet_sharded_host_route (ENetShardedHost * sharded, const enet_uint8 * data, size_t dataLength, const ENetAddress * address)
+{
+    enet_uint16 peerID, flags;
+    size_t headerSize;
+    enet_uint32 hash;
+
+    if (dataLength < (size_t) & ((ENetProtocolHeader *) 0) -> sentTime)
+      return 0;
+
+    peerID = ENET_NET_TO_HOST_16 (((const ENetProtocolHeader *) data) -> peerID);
+    flags = peerID & ENET_PROTOCOL_HEADER_FLAG_MASK;
+    peerID &= ~ (ENET_PROTOCOL_HEADER_FLAG_MASK | ENET_PROTOCOL_HEADER_SESSION_MASK);
+
+    headerSize = (flags & ENET_PROTOCOL_HEADER_FLAG_SENT_TIME ? sizeof (ENetProtocolHeader) : (size_t) & ((ENetProtocolHeader *) 0) -> sentTime);
+    if (peerID == ENET_PROTOCOL_EXTENDED_PEER_ID)
+    {
+        if (dataLength < headerSize + sizeof (enet_uint16))
+          return 0;
+
+        peerID = ENET_NET_TO_HOST_16 (* (const enet_uint16 *) & data [headerSize]);
+    }
+
+    if (peerID != ENET_PROTOCOL_MAXIMUM_PEER_ID)
+    {
+        if (peerID >= sharded -> hosts [0] -> peerCount)
+          return 0;
+
+        return ENET_ATOMIC_LOAD_ACQUIRE (& sharded -> peerShards [peerID]) & ~ (ENET_SHARD_PEER_MIGRATING | ENET_SHARD_PEER_RETURNING);
+    }
+
+    if (sharded -> hosts [0] -> checksum != NULL)
+      headerSize += sizeof (enet_uint32);
+
+    if (! (flags & ENET_PROTOCOL_HEADER_FLAG_COMPRESSED) &&
+        dataLength >= headerSize + (size_t) & ((ENetProtocolConnect *) 0) -> data &&
+        (data [headerSize] & ENET_PROTOCOL_COMMAND_MASK) == ENET_PROTOCOL_COMMAND_CONNECT)
+      hash = ((const ENetProtocolConnect *) & data [headerSize]) -> connectID;
+    else
+      hash = address -> host ^ ((enet_uint32) address -> port * 0x9E3779B1U);
+
+    hash ^= hash >> 16;
+    hash *= 0x45D9F3B;
+    hash ^= hash >> 16;
+
+    return hash % sharded -> shardCount;
+}
+
+static void ENET_CALLBACK
+enet_sharded_host_receive (void * data)
+{
+    ENetShardedHost * sharded = (ENetShardedHost *) data;
+    enet_uint8 receivedData [ENET_PROTOCOL_MAXIMUM_MTU];
+
+    while (! ENET_ATOMIC_LOAD_ACQUIRE (& sharded -> stop))
+    {
+        enet_uint32 waitCondition = ENET_SOCKET_WAIT_RECEIVE | ENET_SOCKET_WAIT_INTERRUPT,
+                    routedShards = 0;
+        size_t shardIndex;
+        int packets;
+
+        if (enet_socket_wait (sharded -> socket, & waitCondition, ENET_SHARD_RECEIVE_TIMEOUT) != 0 ||
+            ! (waitCondition & ENET_SOCKET_WAIT_RECEIVE))
+          continue;
+
+        for (packets = 0; packets < ENET_SHARD_DATAGRAMS; ++ packets)
+        {
+            ENetAddress address;
+            ENetBuffer buffer;
+            ENetHostShard * shard;
+            ENetShardDatagram * datagram;
+            int receivedLength;
+
+            buffer.data = receivedData;
+            buffer.dataLength = sizeof (receivedData);
+
+            receivedLength = enet_socket_receive (sharded -> socket, & address, & buffer, 1);
+            if (receivedLength <= 0)
+              break;
+
+            shardIndex = enet_sharded_host_route (sharded, receivedData, receivedLength, & address);
+            shard = & sharded -> shards [shardIndex];
+
+            datagram = (ENetShardDatagram *) enet_ring_reserve (& shard -> datagrams);
+            if (datagram == NULL)
+            {
+                ++ shard -> droppedDatagrams;
+
+                continue;
+            }
+
+            datagram -> address = address;
+            datagram -> dataLength = receivedLength;
+            memcpy (datagram -> data, receivedData, receivedLength);
+
+            enet_ring_commit (& shard -> datagrams);
+
+            routedShards |= 1U << shardIndex;
+        }
+
+        if (routedShards == 0)
+          continue;
+
+        for (shardIndex = 0; shardIndex < sharded -> shardCount; ++ shardIndex)
+          if (routedShards & (1U << shardIndex))
+            enet_shard_wake (& sharded -> shards [shardIndex]);
+    }
+}
+
+/** Wakes a shard waiting in enet_shard_wait() after datagrams or submissions were queued for it. */
+void
+enet_shard_wake (ENetHostShard * shard)
+{
+    /* Pairs with the fence in enet_shard_wait(): either the shard sees what was queued before it
+       sleeps, or it is seen to be waiting here and woken. */
+    ENET_ATOMIC_FENCE ();
+
+    if (! ENET_ATOMIC_LOAD_ACQUIRE (& shard -> waiting))
+      return;
+
+    enet_mutex_lock (& shard -> mutex);
+    enet_condition_signal (& shard -> datagramsAvailable);
+    enet_mutex_unlock (& shard -> mutex);
+}
+
+/** Reads the next datagram routed to a shard, as enet_socket_receive() would from its socket.
+    @returns the length of the datagram, 0 if none is waiting
+*/
+int
+enet_shard_receive (ENetHostShard * shard, ENetAddress * address, ENetBuffer * buffer)
+{
+    const ENetShardDatagram * datagram = (const ENetShardDatagram *) enet_ring_peek (& shard -> datagrams);
+    size_t dataLength;
+
+    if (datagram == NULL)
+      return 0;
+
+    dataLength = datagram -> dataLength;
+    if (dataLength > buffer -> dataLength)
+      dataLength = buffer -> dataLength;
+
+    * address = datagram -> address;
+    memcpy (buffer -> data, datagram -> data, dataLength);
+
+    enet_ring_release (& shard -> datagrams);
+
+    return (int) dataLength;
+}
+
+/** Waits for a datagram to be routed to the shard of a host, as enet_socket_wait() would on its
+    socket. Sends submitted from other threads end the wait early, without a datagram, so that
+    enet_host_service() returns and runs them on its next call.
+*/
+int
+enet_shard_wait (ENetHost * host, enet_uint32 * condition, enet_uint32 timeout)
+{
+    ENetHostShard * shard = host -> shard;
+
+    * condition = ENET_SOCKET_WAIT_NONE;
+
+    if (enet_ring_peek (& shard -> datagrams) == NULL && timeout > 0)
+    {
+        enet_mutex_lock (& shard -> mutex);
+
+        ENET_ATOMIC_STORE_RELEASE (& shard -> waiting, 1);
+        ENET_ATOMIC_FENCE ();
+
+        if (enet_ring_peek (& shard -> datagrams) == NULL &&
+            ENET_ATOMIC_LOAD_POINTER_ACQUIRE (& host -> submissions) == NULL)
+          enet_condition_wait_timeout (& shard -> datagramsAvailable, & shard -> mutex, timeout);
+
+        ENET_ATOMIC_STORE_RELEASE (& shard -> waiting, 0);
+
+        enet_mutex_unlock (& shard -> mutex);
+    }
+
+    if (enet_ring_peek (& shard -> datagrams) != NULL)
+      * condition = ENET_SOCKET_WAIT_RECEIVE;
+
+    return 0;
+}
+
+/** Publishes the load of the shard of a host, and every rebalanceInterval milliseconds hands
+    peers over to the least loaded shard if it serves more than ENET_SHARD_REBALANCE_THRESHOLD
+    peers beyond it. Called by enet_host_service() on the hosts of an ENetShardedHost.
+*/
+void
+enet_shard_rebalance (ENetHost * host)
+{
+    ENetHostShard * shard = host -> shard, * target = NULL;
+    ENetShardedHost * sharded = shard -> sharded;
+    ENetPeerChunk * chunk;
+    ENetPeer * currentPeer;
+    size_t shardIndex, hostLoad, targetLoad = 0, peerCount;
+
+    ENET_ATOMIC_STORE_RELEASE (& shard -> load, (enet_uint32) host -> connectedPeers);
+
+    if (sharded -> rebalanceInterval == 0 ||
+        ENET_TIME_DIFFERENCE (host -> serviceTime, shard -> rebalanceEpoch) < sharded -> rebalanceInterval)
+      return;
+
+    shard -> rebalanceEpoch = host -> serviceTime;
+
+    /* Peers on their way to a shard count towards its load, so that shards rebalancing at the
+       same time do not all pick the same one and overload it. */
+    hostLoad = host -> connectedPeers + ENET_ATOMIC_LOAD_SIZE_ACQUIRE (& shard -> arrivingPeers);
+
+    for (shardIndex = 0; shardIndex < sharded -> shardCount; ++ shardIndex)
+    {
+        ENetHostShard * otherShard = & sharded -> shards [shardIndex];
+        size_t load;
+
+        if (otherShard == shard)
+          continue;
+
+        load = ENET_ATOMIC_LOAD_ACQUIRE (& otherShard -> load) + ENET_ATOMIC_LOAD_SIZE_ACQUIRE (& otherShard -> arrivingPeers);
+        if (target == NULL || load < targetLoad)
+        {
+            target = otherShard;
+            targetLoad = load;
+        }
+    }
+
+    if (target == NULL || hostLoad <= targetLoad + ENET_SHARD_REBALANCE_THRESHOLD)
+      return;
+
+    peerCount = (hostLoad - targetLoad) / 2;
+    if (peerCount > ENET_SHARD_REBALANCE_PEERS)
+      peerCount = ENET_SHARD_REBALANCE_PEERS;
+
+    for (chunk = host -> peerChunks;
+         chunk < & host -> peerChunks [host -> peerChunkCount] && peerCount > 0;
+         ++ chunk)
+    for (currentPeer = chunk -> peers;
+         currentPeer < & chunk -> peers [chunk -> peerCount] && peerCount > 0;
+         ++ currentPeer)
+    {
+       if (currentPeer -> state == ENET_PEER_STATE_CONNECTED &&
+           enet_peer_migrate (currentPeer, sharded -> hosts [target -> index]) == 0)
+         -- peerCount;
+    }
+}
+
+/** @defgroup host ENet host functions
+    @{
+*/
+
+/** Creates a set of hosts that share one socket and split the peers between them, so that each
+    may be serviced by its own thread with enet_host_service() while a receive thread reads the
+    socket and routes datagrams to the host owning their peer.
+    @param address the address at which other peers may connect to the hosts; if NULL, the hosts may not be connected to
+    @param shardCount number of hosts, at most ENET_SHARD_MAXIMUM_SHARDS
+    @param peerCount the maximum number of peers across all hosts, rounded up so that each host owns
+    as many chunks of ENET_HOST_PEER_CHUNK_SIZE peer IDs as the others
+    @param channelLimit, incomingBandwidth, outgoingBandwidth as for enet_host_create(), applied to each host
+    @returns the sharded host on success, NULL on failure
+    @remarks The hosts are in the hosts field, and each must only be used by one thread at a time.
+    Options such as compression, checksums or encryption should be set the same on all of them,
+    before any of them is serviced.
+    Connecting peers are spread by hash, so a host may fill before the others do; setting
+    rebalanceInterval lets the hosts even out by migrating peers with enet_peer_migrate(), which
+    an application that keeps per-peer state should look up by peer ID. Datagrams for a
+    host that falls more than ENET_SHARD_DATAGRAMS behind are dropped, and counted in
+    droppedDatagrams of its shard.
+*/
+ENetShardedHost *
+enet_sharded_host_create (const ENetAddress * address, size_t shardCount, size_t peerCount, size_t channelLimit, enet_uint32 incomingBandwidth, enet_uint32 outgoingBandwidth)
+{
+    ENetShardedHost * sharded;
+    size_t shardIndex, peerID, tableSize;
+
+    if (shardCount == 0 || shardCount > ENET_SHARD_MAXIMUM_SHARDS)
+      return NULL;
+
+    peerCount = (peerCount + shardCount * ENET_HOST_PEER_CHUNK_SIZE - 1) / (shardCount * ENET_HOST_PEER_CHUNK_SIZE);
+    if (peerCount == 0)
+      peerCount = 1;
+    else
+    if (peerCount > ENET_PROTOCOL_MAXIMUM_EXTENDED_PEER_ID / (shardCount * ENET_HOST_PEER_CHUNK_SIZE))
+      peerCount = ENET_PROTOCOL_MAXIMUM_EXTENDED_PEER_ID / (shardCount * ENET_HOST_PEER_CHUNK_SIZE);
+    peerCount *= shardCount * ENET_HOST_PEER_CHUNK_SIZE;
+
+    /* the hosts grow their peer tables past the reserved peer IDs as enet_host_create () does */
+    tableSize = peerCount;
+    if (tableSize > ENET_PROTOCOL_EXTENDED_PEER_ID)
+      tableSize = ENET_MIN (tableSize + ENET_PROTOCOL_MAXIMUM_PEER_ID + 1 - ENET_PROTOCOL_EXTENDED_PEER_ID,
+                            ENET_PROTOCOL_MAXIMUM_EXTENDED_PEER_ID);
+
+    sharded = (ENetShardedHost *) enet_malloc (sizeof (ENetShardedHost));
+    if (sharded == NULL)
+      return NULL;
+
+    memset (sharded, 0, sizeof (ENetShardedHost));
+
+    sharded -> socket = ENET_SOCKET_NULL;
+
+    sharded -> peerShards = (volatile enet_uint32 *) enet_malloc (tableSize * sizeof (enet_uint32));
+    if (sharded -> peerShards == NULL)
+    {
+        enet_free (sharded);
+
+        return NULL;
+    }
+
+    for (peerID = 0; peerID < tableSize; ++ peerID)
+      sharded -> peerShards [peerID] = (enet_uint32) ((peerID / ENET_HOST_PEER_CHUNK_SIZE) % shardCount);
+
+    for (shardIndex = 0; shardIndex < shardCount; ++ shardIndex)
+    {
+        ENetHostShard * shard = & sharded -> shards [shardIndex];
+        ENetHost * host;
+
+        host = enet_host_create (shardIndex == 0 ? address : NULL, peerCount, channelLimit, incomingBandwidth, outgoingBandwidth);
+        if (host == NULL)
+          goto failed;
+
+        if (enet_ring_create (& shard -> datagrams, ENET_SHARD_DATAGRAMS, sizeof (ENetShardDatagram)) < 0 ||
+            enet_mutex_create (& shard -> mutex) < 0)
+        {
+            enet_ring_destroy (& shard -> datagrams);
+            enet_host_destroy (host);
+
+            goto failed;
+        }
+
+        if (enet_condition_create (& shard -> datagramsAvailable) < 0)
+        {
+            enet_mutex_destroy (& shard -> mutex);
+            enet_ring_destroy (& shard -> datagrams);
+            enet_host_destroy (host);
+
+            goto failed;
+        }
+
+        if (shardIndex == 0)
+        {
+            sharded -> socket = host -> socket;
+            sharded -> address = host -> address;
+        }
+        else
+        {
+            enet_socket_destroy (host -> socket);
+
+            host -> socket = sharded -> socket;
+            host -> address = sharded -> address;
+        }
+
+        shard -> sharded = sharded;
+        shard -> index = (enet_uint32) shardIndex;
+
+        host -> shard = shard;
+        host -> peerChunkStride = shardCount;
+        host -> peerChunkOffset = shardIndex;
+
+        sharded -> hosts [shardIndex] = host;
+        sharded -> shardCount = shardIndex + 1;
+    }
+
+    if (enet_thread_create (& sharded -> receiver, enet_sharded_host_receive, sharded) < 0)
+      goto failed;
+
+    return sharded;
+
+failed:
+    for (shardIndex = 0; shardIndex < sharded -> shardCount; ++ shardIndex)
+    {
+        ENetHostShard * shard = & sharded -> shards [shardIndex];
+
+        enet_host_destroy (sharded -> hosts [shardIndex]);
+
+        enet_condition_destroy (& shard -> datagramsAvailable);
+        enet_mutex_destroy (& shard -> mutex);
+        enet_ring_destroy (& shard -> datagrams);
+    }
+
+    if (sharded -> socket != ENET_SOCKET_NULL)
+      enet_socket_destroy (sharded -> socket);
+
+    enet_free ((void *) sharded -> peerShards);
+    enet_free (sharded);
+
+    return NULL;
+}
+
+/** Stops the receive thread and destroys the hosts of a sharded host and their shared socket.
+    @param sharded sharded host to destroy
+    @remarks The threads servicing the hosts must be stopped first.
+*/
+void
+enet_sharded_host_destroy (ENetShardedHost * sharded)
+{
+    size_t shardIndex;
+
+    if (sharded == NULL)
+      return;
+
+    ENET_ATOMIC_STORE_RELEASE (& sharded -> stop, 1);
+
+    enet_thread_join (sharded -> receiver);
+
+    for (shardIndex = 0; shardIndex < sharded -> shardCount; ++ shardIndex)
+    {
+        ENetHostShard * shard = & sharded -> shards [shardIndex];
+
+        enet_host_destroy (sharded -> hosts [shardIndex]);
+
+        enet_condition_destroy (& shard -> datagramsAvailable);
+        enet_mutex_destroy (& shard -> mutex);
+        enet_ring_destroy (& shard -> datagrams);
+    }
+
+    enet_socket_destroy (sharded -> socket);
+
+    enet_free ((void *) sharded -> peerShards);
+    enet_free (sharded);
+}
+
+/** @} */
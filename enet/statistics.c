@@ -0,0 +1,151 @@
+/**
+ @file  statistics.c
+ @brief ENet host and peer statistics readable from other threads
+*/
+#define ENET_BUILDING_LIB 1
+#include "enet/enet.h"
+#include "enet/atomic.h"
+
+/* Each snapshot is a seqlock: the service thread makes its sequence odd, stores every field and
+   makes the sequence even again, while a reader copies the fields and retries until it saw the
+   same even sequence before and after. The fields are stored with release semantics, so a reader
+   that loads any new field also sees the odd sequence, and since every access is atomic a torn
+   copy is only ever retried, never returned. */
+static void
+enet_statistics_publish (volatile enet_uint32 * sequence, enet_uint32 * statistics, const enet_uint32 * values, size_t count)
+{
+    enet_uint32 next = * sequence + 1;
+    size_t index;
+
+    ENET_ATOMIC_STORE_RELEASE (sequence, next);
+
+    for (index = 0; index < count; ++ index)
+      ENET_ATOMIC_STORE_RELEASE (& statistics [index], values [index]);
+
+    ENET_ATOMIC_STORE_RELEASE (sequence, next + 1);
+}
+
+static void
+enet_statistics_read (const volatile enet_uint32 * sequence, const enet_uint32 * statistics, enet_uint32 * values, size_t count)
+{
+    enet_uint32 start;
+    size_t index;
+
+    do
+    {
+        start = ENET_ATOMIC_LOAD_ACQUIRE (sequence);
+
+        for (index = 0; index < count; ++ index)
+          values [index] = ENET_ATOMIC_LOAD_ACQUIRE (& statistics [index]);
+    } while ((start & 1) || ENET_ATOMIC_LOAD_ACQUIRE (sequence) != start);
+}
+
+static void
+enet_peer_publish_statistics (ENetPeer * peer)
+{
+    ENetPeerCold * cold = ENET_PEER_COLD (peer);
+    ENetPeerStatistics statistics;
+
+    statistics.time = peer -> host -> serviceTime;
+    statistics.state = peer -> state;
+    statistics.roundTripTime = peer -> roundTripTime;
+    statistics.roundTripTimeVariance = peer -> roundTripTimeVariance;
+    statistics.lowestRoundTripTime = peer -> lowestRoundTripTime;
+    statistics.packetLoss = peer -> packetLoss;
+    statistics.packetLossVariance = peer -> packetLossVariance;
+    statistics.packetThrottle = peer -> packetThrottle;
+    statistics.reliableDataInTransit = peer -> reliableDataInTransit;
+    statistics.windowSize = peer -> windowSize;
+    statistics.mtu = peer -> mtu;
+    statistics.incomingBandwidth = peer -> incomingBandwidth;
+    statistics.outgoingBandwidth = peer -> outgoingBandwidth;
+
+    enet_statistics_publish (& cold -> statisticsSequence, (enet_uint32 *) & cold -> statistics,
+                             (const enet_uint32 *) & statistics, sizeof (ENetPeerStatistics) / sizeof (enet_uint32));
+}
+
+/** Publishes the statistics of a host and its peers for other threads to read. Peers that stay
+    disconnected are skipped once their disconnection has been published.
+*/
+void
+enet_host_publish_statistics (ENetHost * host)
+{
+    ENetHostStatistics statistics;
+    ENetPeerChunk * chunk;
+    ENetPeer * currentPeer;
+
+    host -> statisticsEpoch = host -> serviceTime;
+
+    statistics.time = host -> serviceTime;
+    statistics.connectedPeers = (enet_uint32) host -> connectedPeers;
+    statistics.bandwidthLimitedPeers = (enet_uint32) host -> bandwidthLimitedPeers;
+    statistics.totalSentData = host -> totalSentData;
+    statistics.totalSentPackets = host -> totalSentPackets;
+    statistics.totalReceivedData = host -> totalReceivedData;
+    statistics.totalReceivedPackets = host -> totalReceivedPackets;
+    statistics.totalCompressionAttempts = host -> totalCompressionAttempts;
+    statistics.totalCompressionBypasses = host -> totalCompressionBypasses;
+    statistics.totalCompressionInput = host -> totalCompressionInput;
+    statistics.totalCompressionSaved = host -> totalCompressionSaved;
+
+    enet_statistics_publish (& host -> statisticsSequence, (enet_uint32 *) & host -> statistics,
+                             (const enet_uint32 *) & statistics, sizeof (ENetHostStatistics) / sizeof (enet_uint32));
+
+    for (chunk = host -> peerChunks;
+         chunk < & host -> peerChunks [host -> peerChunkCount];
+         ++ chunk)
+    for (currentPeer = chunk -> peers;
+         currentPeer < & chunk -> peers [chunk -> peerCount];
+         ++ currentPeer)
+    {
+       if (currentPeer -> state == ENET_PEER_STATE_DISCONNECTED &&
+           ENET_PEER_COLD (currentPeer) -> statistics.state == ENET_PEER_STATE_DISCONNECTED)
+         continue;
+
+       enet_peer_publish_statistics (currentPeer);
+    }
+}
+
+/** @defgroup host ENet host functions
+    @{
+*/
+
+/** Reads the statistics a host last published. Unlike the fields of the host, this may be done
+    from any thread while another services the host.
+    @param host host to read the statistics of
+    @param statistics where to copy the statistics
+    @remarks The thread servicing the host publishes them every statisticsInterval milliseconds,
+    so they may lag behind by as much, but all of them come from the same moment.
+*/
+void
+enet_host_get_statistics (const ENetHost * host, ENetHostStatistics * statistics)
+{
+    enet_statistics_read (& host -> statisticsSequence, (const enet_uint32 *) & host -> statistics,
+                          (enet_uint32 *) statistics, sizeof (ENetHostStatistics) / sizeof (enet_uint32));
+}
+
+/** @} */
+
+/** @defgroup peer ENet peer functions
+    @{
+*/
+
+/** Reads the statistics last published for a peer. Unlike the fields of the peer, this may be
+    done from any thread while another services its host.
+    @param peer peer to read the statistics of
+    @param statistics where to copy the statistics
+    @remarks As with enet_host_get_statistics(), the statistics may lag behind by up to the
+    statisticsInterval of the host. The peer must stay allocated, which the host ensures unless
+    enet_host_release_peer_chunks() is enabled and the host is not serviced by enet_host_thread_create(). A peer that
+    disconnects and is reused for a new connection shows the statistics of the new one.
+*/
+void
+enet_peer_get_statistics (const ENetPeer * peer, ENetPeerStatistics * statistics)
+{
+    const ENetPeerCold * cold = ENET_PEER_COLD (peer);
+
+    enet_statistics_read (& cold -> statisticsSequence, (const enet_uint32 *) & cold -> statistics,
+                          (enet_uint32 *) statistics, sizeof (ENetPeerStatistics) / sizeof (enet_uint32));
+}
+
+/** @} */
@@ -0,0 +1,423 @@
+/**
+ @file  thread.c
+ @brief ENet host serviced on a dedicated thread
+*/
+#include <string.h>
+#define ENET_BUILDING_LIB 1
+#include "enet/enet.h"
+#include "enet/atomic.h"
+
+/** Sets up an empty ring.
+    @param ring ring to set up
+    @param capacity minimum number of entries the ring holds, rounded up to a power of two
+    @param entrySize size of each entry
+    @returns 0 on success, < 0 on failure
+*/
+int
+enet_ring_create (ENetRing * ring, size_t capacity, size_t entrySize)
+{
+    size_t entryCount = 1;
+
+    memset (ring, 0, sizeof (ENetRing));
+
+    if (capacity > 0x40000000)
+      return -1;
+
+    while (entryCount < capacity)
+      entryCount <<= 1;
+
+    ring -> entries = (enet_uint8 *) enet_malloc (entryCount * entrySize);
+    if (ring -> entries == NULL)
+      return -1;
+
+    ring -> entrySize = entrySize;
+    ring -> mask = (enet_uint32) entryCount - 1;
+
+    return 0;
+}
+
+void
+enet_ring_destroy (ENetRing * ring)
+{
+    if (ring -> entries != NULL)
+      enet_free (ring -> entries);
+
+    ring -> entries = NULL;
+}
+
+/** Checks whether the ring is full. Must only be called by the producer. */
+int
+enet_ring_full (ENetRing * ring)
+{
+    enet_uint32 head = ring -> head;
+
+    if (head - ring -> tailCache <= ring -> mask)
+      return 0;
+
+    ring -> tailCache = ENET_ATOMIC_LOAD_ACQUIRE (& ring -> tail);
+
+    return head - ring -> tailCache > ring -> mask;
+}
+
+/** Returns the next free entry of the ring, to be filled in and then published with
+    enet_ring_commit(). Must only be called by the producer.
+    @returns the entry, or NULL if the ring is full
+*/
+void *
+enet_ring_reserve (ENetRing * ring)
+{
+    if (enet_ring_full (ring))
+      return NULL;
+
+    return & ring -> entries [(ring -> head & ring -> mask) * ring -> entrySize];
+}
+
+/** Publishes the entry returned by enet_ring_reserve() to the consumer. */
+void
+enet_ring_commit (ENetRing * ring)
+{
+    ENET_ATOMIC_STORE_RELEASE (& ring -> head, ring -> head + 1);
+}
+
+/** Copies an entry into the ring. Must only be called by the producer.
+    @returns 0 on success, < 0 if the ring is full
+*/
+int
+enet_ring_push (ENetRing * ring, const void * entry)
+{
+    void * slot = enet_ring_reserve (ring);
+
+    if (slot == NULL)
+      return -1;
+
+    memcpy (slot, entry, ring -> entrySize);
+
+    enet_ring_commit (ring);
+
+    return 0;
+}
+
+/** Returns the oldest entry of the ring without removing it, so that the consumer may read it in
+    place before calling enet_ring_release(). Must only be called by the consumer.
+    @returns the entry, or NULL if the ring is empty
+*/
+void *
+enet_ring_peek (ENetRing * ring)
+{
+    enet_uint32 tail = ring -> tail;
+
+    if (tail == ring -> headCache)
+    {
+        ring -> headCache = ENET_ATOMIC_LOAD_ACQUIRE (& ring -> head);
+
+        if (tail == ring -> headCache)
+          return NULL;
+    }
+
+    return & ring -> entries [(tail & ring -> mask) * ring -> entrySize];
+}
+
+/** Removes the entry returned by enet_ring_peek(), handing its space back to the producer. */
+void
+enet_ring_release (ENetRing * ring)
+{
+    ENET_ATOMIC_STORE_RELEASE (& ring -> tail, ring -> tail + 1);
+}
+
+/** Copies the oldest entry out of the ring. Must only be called by the consumer.
+    @returns 1 if an entry was removed, 0 if the ring is empty
+*/
+int
+enet_ring_pop (ENetRing * ring, void * entry)
+{
+    const void * slot = enet_ring_peek (ring);
+
+    if (slot == NULL)
+      return 0;
+
+    memcpy (entry, slot, ring -> entrySize);
+
+    enet_ring_release (ring);
+
+    return 1;
+}
+
+/* Only called with room in the event queue. */
+static void
+enet_host_thread_queue_event (ENetHostThread * thread, const ENetEvent * event)
+{
+    enet_ring_push (& thread -> events, event);
+
+    ++ thread -> eventsQueued;
+
+    if (event -> type == ENET_EVENT_TYPE_CONNECT)
+      thread -> connectEvents [event -> peer -> incomingPeerID] = thread -> eventsQueued;
+}
+
+static void
+enet_host_thread_run_commands (ENetHostThread * thread)
+{
+    ENetHostCommand command;
+
+    while (enet_ring_pop (& thread -> commands, & command))
+    {
+        /* A request made before the application received the latest connect event of its peer
+           was meant for an earlier connection that used the same peer. */
+        if (command.peer != NULL &&
+            (enet_uint32) (command.eventCount - thread -> connectEvents [command.peer -> incomingPeerID]) > 0x7FFFFFFF)
+        {
+            if (command.packet != NULL && command.packet -> referenceCount == 0)
+              enet_packet_destroy (command.packet);
+
+            continue;
+        }
+
+        switch (command.type)
+        {
+        case ENET_HOST_COMMAND_SEND:
+            if (enet_peer_send (command.peer, command.channelID, command.packet) < 0 &&
+                command.packet -> referenceCount == 0)
+              enet_packet_destroy (command.packet);
+            break;
+
+        case ENET_HOST_COMMAND_BROADCAST:
+            enet_host_broadcast (thread -> host, command.channelID, command.packet);
+            break;
+
+        case ENET_HOST_COMMAND_DISCONNECT:
+            enet_peer_disconnect (command.peer, command.data);
+            break;
+
+        case ENET_HOST_COMMAND_DISCONNECT_NOW:
+            enet_peer_disconnect_now (command.peer, command.data);
+            break;
+
+        case ENET_HOST_COMMAND_DISCONNECT_LATER:
+            enet_peer_disconnect_later (command.peer, command.data);
+            break;
+        }
+    }
+}
+
+static void ENET_CALLBACK
+enet_host_thread_run (void * data)
+{
+    ENetHostThread * thread = (ENetHostThread *) data;
+    ENetEvent event;
+    int result;
+
+    while (! ENET_ATOMIC_LOAD_ACQUIRE (& thread -> stop))
+    {
+        enet_host_thread_run_commands (thread);
+
+        while (! enet_ring_full (& thread -> events) &&
+               enet_host_check_events (thread -> host, & event) > 0)
+          enet_host_thread_queue_event (thread, & event);
+
+        /* With the event queue full the host is still serviced, but without an event, so received
+           packets wait in the peers' queues while acknowledgements keep flowing. */
+        if (enet_ring_full (& thread -> events))
+        {
+            ++ thread -> eventsDeferred;
+
+            result = enet_host_service (thread -> host, NULL, thread -> serviceTimeout);
+        }
+        else
+        {
+            result = enet_host_service (thread -> host, & event, thread -> serviceTimeout);
+            if (result > 0)
+              enet_host_thread_queue_event (thread, & event);
+        }
+
+        if (result < 0)
+        {
+            ENET_ATOMIC_STORE_RELEASE (& thread -> error, 1);
+
+            break;
+        }
+    }
+}
+
+static int
+enet_host_thread_queue_command (ENetHostThread * thread, ENetHostCommandType type, ENetPeer * peer, enet_uint8 channelID, enet_uint32 data, ENetPacket * packet)
+{
+    ENetHostCommand command;
+
+    command.type = type;
+    command.peer = peer;
+    command.eventCount = thread -> eventsReceived;
+    command.channelID = channelID;
+    command.data = data;
+    command.packet = packet;
+
+    return enet_ring_push (& thread -> commands, & command);
+}
+
+/** @defgroup host ENet host functions
+    @{
+*/
+
+/** Starts a thread that takes over servicing a host, so that a slow application never delays the
+    protocol. Until the thread is destroyed, the application must not call any function on the host
+    or its peers, and instead receives events with enet_host_thread_receive() and makes requests with
+    enet_host_thread_send() and the related functions. Peers may still be told apart by their
+    incomingPeerID and data fields.
+    @param host host to service, which must not be in use by another thread
+    @param eventCapacity number of events that may wait for the application; once that many are
+    waiting, received packets stay queued on their peers until the application catches up
+    @param commandCapacity number of requests that may wait for the service thread
+    @param serviceTimeout longest time in milliseconds the thread waits for a datagram, and so the
+    longest a request may wait before it is carried out
+    @returns the thread on success, NULL on failure
+    @remarks Peer storage is never released while the thread runs, so peer pointers held by the
+    application stay valid. Requests for a peer that made a new connection since the application
+    received its last connect event are ignored.
+*/
+ENetHostThread *
+enet_host_thread_create (ENetHost * host, size_t eventCapacity, size_t commandCapacity, enet_uint32 serviceTimeout)
+{
+    ENetHostThread * thread;
+
+    thread = (ENetHostThread *) enet_malloc (sizeof (ENetHostThread));
+    if (thread == NULL)
+      return NULL;
+
+    memset (thread, 0, sizeof (ENetHostThread));
+
+    thread -> host = host;
+    thread -> serviceTimeout = serviceTimeout;
+
+    thread -> connectEvents = (enet_uint32 *) enet_malloc (host -> peerCount * sizeof (enet_uint32));
+    if (thread -> connectEvents == NULL)
+      goto failed;
+
+    memset (thread -> connectEvents, 0, host -> peerCount * sizeof (enet_uint32));
+
+    if (enet_ring_create (& thread -> events, eventCapacity, sizeof (ENetEvent)) < 0 ||
+        enet_ring_create (& thread -> commands, commandCapacity, sizeof (ENetHostCommand)) < 0)
+      goto failed;
+
+    host -> keepPeerChunks = 1;
+
+    if (enet_thread_create (& thread -> thread, enet_host_thread_run, thread) < 0)
+    {
+        host -> keepPeerChunks = 0;
+
+        goto failed;
+    }
+
+    return thread;
+
+failed:
+    enet_ring_destroy (& thread -> commands);
+    enet_ring_destroy (& thread -> events);
+
+    if (thread -> connectEvents != NULL)
+      enet_free (thread -> connectEvents);
+
+    enet_free (thread);
+
+    return NULL;
+}
+
+/** Stops the thread servicing a host and hands the host back to the caller. Requests already made
+    are carried out first; events the application has not received are dropped.
+    @param thread thread to stop
+*/
+void
+enet_host_thread_destroy (ENetHostThread * thread)
+{
+    ENetEvent event;
+
+    ENET_ATOMIC_STORE_RELEASE (& thread -> stop, 1);
+
+    enet_thread_join (thread -> thread);
+
+    enet_host_thread_run_commands (thread);
+
+    while (enet_ring_pop (& thread -> events, & event))
+    {
+        if (event.packet != NULL)
+          enet_packet_destroy (event.packet);
+    }
+
+    thread -> host -> keepPeerChunks = 0;
+
+    enet_ring_destroy (& thread -> commands);
+    enet_ring_destroy (& thread -> events);
+
+    enet_free (thread -> connectEvents);
+    enet_free (thread);
+}
+
+/** Receives the next event from the thread servicing a host, without waiting.
+    @param thread thread servicing the host
+    @param event an event structure where the event, if any, will be placed
+    @returns 1 if an event was received, 0 if none is waiting, < 0 if the thread stopped on a socket error
+*/
+int
+enet_host_thread_receive (ENetHostThread * thread, ENetEvent * event)
+{
+    if (enet_ring_pop (& thread -> events, event) ||
+        (ENET_ATOMIC_LOAD_ACQUIRE (& thread -> error) && enet_ring_pop (& thread -> events, event)))
+    {
+        ++ thread -> eventsReceived;
+
+        return 1;
+    }
+
+    event -> type = ENET_EVENT_TYPE_NONE;
+    event -> peer = NULL;
+    event -> packet = NULL;
+
+    return ENET_ATOMIC_LOAD_ACQUIRE (& thread -> error) ? -1 : 0;
+}
+
+/** Asks the thread servicing a host to send a packet to a peer, as enet_peer_send() would.
+    @returns 0 if the request was queued, < 0 if the request queue is full
+    @remarks Once queued, the packet belongs to the service thread, which destroys it if it cannot be sent.
+    On failure the caller keeps the packet.
+*/
+int
+enet_host_thread_send (ENetHostThread * thread, ENetPeer * peer, enet_uint8 channelID, ENetPacket * packet)
+{
+    return enet_host_thread_queue_command (thread, ENET_HOST_COMMAND_SEND, peer, channelID, 0, packet);
+}
+
+/** Asks the thread servicing a host to broadcast a packet, as enet_host_broadcast() would.
+    @returns 0 if the request was queued, < 0 if the request queue is full
+*/
+int
+enet_host_thread_broadcast (ENetHostThread * thread, enet_uint8 channelID, ENetPacket * packet)
+{
+    return enet_host_thread_queue_command (thread, ENET_HOST_COMMAND_BROADCAST, NULL, channelID, 0, packet);
+}
+
+/** Asks the thread servicing a host to disconnect a peer, as enet_peer_disconnect() would.
+    @returns 0 if the request was queued, < 0 if the request queue is full
+*/
+int
+enet_host_thread_disconnect (ENetHostThread * thread, ENetPeer * peer, enet_uint32 data)
+{
+    return enet_host_thread_queue_command (thread, ENET_HOST_COMMAND_DISCONNECT, peer, 0, data, NULL);
+}
+
+/** Asks the thread servicing a host to disconnect a peer immediately, as enet_peer_disconnect_now() would.
+    @returns 0 if the request was queued, < 0 if the request queue is full
+*/
+int
+enet_host_thread_disconnect_now (ENetHostThread * thread, ENetPeer * peer, enet_uint32 data)
+{
+    return enet_host_thread_queue_command (thread, ENET_HOST_COMMAND_DISCONNECT_NOW, peer, 0, data, NULL);
+}
+
+/** Asks the thread servicing a host to disconnect a peer once its queued packets are sent, as enet_peer_disconnect_later() would.
+    @returns 0 if the request was queued, < 0 if the request queue is full
+*/
+int
+enet_host_thread_disconnect_later (ENetHostThread * thread, ENetPeer * peer, enet_uint32 data)
+{
+    return enet_host_thread_queue_command (thread, ENET_HOST_COMMAND_DISCONNECT_LATER, peer, 0, data, NULL);
+}
+
+/** @} */
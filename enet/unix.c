@@ -4,6 +4,10 @@
 */
 #ifndef _WIN32
 
+#if defined(HAS_SENDMMSG) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/ioctl.h>
@@ -11,6 +15,7 @@
 #include <netinet/tcp.h>
 #include <netdb.h>
 #include <unistd.h>
+#include <stdio.h>
 #include <string.h>
 #include <errno.h>
 #include <time.h>
@@ -66,6 +71,9 @@ static enet_uint32 timeBase = 0;
 int
 enet_initialize (void)
 {
+    enet_checksum_initialize ();
+    enet_crypto_initialize ();
+
     return 0;
 }
 
@@ -80,6 +88,24 @@ enet_host_random_seed (void)
     return (enet_uint32) time (NULL);
 }
 
+int
+enet_random_bytes (void * data, size_t dataLength)
+{
+    FILE * source = fopen ("/dev/urandom", "rb");
+    size_t readLength;
+
+    if (source == NULL)
+      return -1;
+
+    setvbuf (source, NULL, _IONBF, 0);
+
+    readLength = fread (data, 1, dataLength, source);
+
+    fclose (source);
+
+    return readLength == dataLength ? 0 : -1;
+}
+
 enet_uint32
 enet_time_get (void)
 {
@@ -467,6 +493,80 @@ enet_socket_send (ENetSocket socket,
     return sentLength;
 }
 
+/** Sends one datagram per buffer, the first to the first address and so on, with as few system calls
+    as the platform allows. Datagrams that would block are dropped, as with enet_socket_send().
+    @returns the number of bytes sent, < 0 on failure
+*/
+int
+enet_socket_send_batch (ENetSocket socket,
+                        const ENetAddress * addresses,
+                        const ENetBuffer * buffers,
+                        size_t datagramCount)
+{
+#ifdef HAS_SENDMMSG
+    struct mmsghdr msgHdrs [64];
+    struct sockaddr_in sins [64];
+    size_t datagramIndex = 0;
+    int sentLength = 0;
+
+    while (datagramIndex < datagramCount)
+    {
+        size_t batchCount = datagramCount - datagramIndex, i;
+        int sentCount;
+
+        if (batchCount > sizeof (msgHdrs) / sizeof (struct mmsghdr))
+          batchCount = sizeof (msgHdrs) / sizeof (struct mmsghdr);
+
+        memset (msgHdrs, 0, batchCount * sizeof (struct mmsghdr));
+        memset (sins, 0, batchCount * sizeof (struct sockaddr_in));
+
+        for (i = 0; i < batchCount; ++ i)
+        {
+            sins [i].sin_family = AF_INET;
+            sins [i].sin_port = ENET_HOST_TO_NET_16 (addresses [datagramIndex + i].port);
+            sins [i].sin_addr.s_addr = addresses [datagramIndex + i].host;
+
+            msgHdrs [i].msg_hdr.msg_name = & sins [i];
+            msgHdrs [i].msg_hdr.msg_namelen = sizeof (struct sockaddr_in);
+            msgHdrs [i].msg_hdr.msg_iov = (struct iovec *) & buffers [datagramIndex + i];
+            msgHdrs [i].msg_hdr.msg_iovlen = 1;
+        }
+
+        sentCount = sendmmsg (socket, msgHdrs, batchCount, MSG_NOSIGNAL);
+        if (sentCount <= 0)
+        {
+            if (sentCount < 0 && errno != EWOULDBLOCK)
+              return -1;
+
+            ++ datagramIndex;
+
+            continue;
+        }
+
+        for (i = 0; i < (size_t) sentCount; ++ i)
+          sentLength += msgHdrs [i].msg_len;
+
+        datagramIndex += sentCount;
+    }
+
+    return sentLength;
+#else
+    size_t datagramIndex;
+    int sentLength = 0;
+
+    for (datagramIndex = 0; datagramIndex < datagramCount; ++ datagramIndex)
+    {
+        int datagramLength = enet_socket_send (socket, & addresses [datagramIndex], & buffers [datagramIndex], 1);
+        if (datagramLength < 0)
+          return -1;
+
+        sentLength += datagramLength;
+    }
+
+    return sentLength;
+#endif
+}
+
 int
 enet_socket_receive (ENetSocket socket,
                      ENetAddress * address,
@@ -611,5 +711,121 @@ enet_socket_wait (ENetSocket socket, enet_uint32 * condition, enet_uint32 timeou
 #endif
 }
 
-#endif
+typedef struct _ENetThreadStart
+{
+    ENetThreadFunction function;
+    void * data;
+} ENetThreadStart;
+
+static void *
+enet_thread_start (void * data)
+{
+    ENetThreadStart start = * (ENetThreadStart *) data;
+
+    enet_free (data);
+
+    start.function (start.data);
+
+    return NULL;
+}
 
+int
+enet_thread_create (ENetThread * thread, ENetThreadFunction function, void * data)
+{
+    ENetThreadStart * start = (ENetThreadStart *) enet_malloc (sizeof (ENetThreadStart));
+    if (start == NULL)
+      return -1;
+
+    start -> function = function;
+    start -> data = data;
+
+    if (pthread_create (thread, NULL, enet_thread_start, start) != 0)
+    {
+        enet_free (start);
+
+        return -1;
+    }
+
+    return 0;
+}
+
+void
+enet_thread_join (ENetThread thread)
+{
+    pthread_join (thread, NULL);
+}
+
+int
+enet_mutex_create (ENetMutex * mutex)
+{
+    return pthread_mutex_init (mutex, NULL) == 0 ? 0 : -1;
+}
+
+void
+enet_mutex_destroy (ENetMutex * mutex)
+{
+    pthread_mutex_destroy (mutex);
+}
+
+void
+enet_mutex_lock (ENetMutex * mutex)
+{
+    pthread_mutex_lock (mutex);
+}
+
+void
+enet_mutex_unlock (ENetMutex * mutex)
+{
+    pthread_mutex_unlock (mutex);
+}
+
+int
+enet_condition_create (ENetCondition * condition)
+{
+    return pthread_cond_init (condition, NULL) == 0 ? 0 : -1;
+}
+
+void
+enet_condition_destroy (ENetCondition * condition)
+{
+    pthread_cond_destroy (condition);
+}
+
+void
+enet_condition_wait (ENetCondition * condition, ENetMutex * mutex)
+{
+    pthread_cond_wait (condition, mutex);
+}
+
+void
+enet_condition_wait_timeout (ENetCondition * condition, ENetMutex * mutex, enet_uint32 timeout)
+{
+    struct timeval now;
+    struct timespec deadline;
+
+    gettimeofday (& now, NULL);
+
+    deadline.tv_sec = now.tv_sec + timeout / 1000;
+    deadline.tv_nsec = now.tv_usec * 1000 + (long) (timeout % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000)
+    {
+        ++ deadline.tv_sec;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    pthread_cond_timedwait (condition, mutex, & deadline);
+}
+
+void
+enet_condition_signal (ENetCondition * condition)
+{
+    pthread_cond_signal (condition);
+}
+
+void
+enet_condition_broadcast (ENetCondition * condition)
+{
+    pthread_cond_broadcast (condition);
+}
+
+#endif
@@ -4,6 +4,7 @@
 */
 #ifdef _WIN32
 
+#define _CRT_RAND_S
 #define ENET_BUILDING_LIB 1
 #include "enet/enet.h"
 #include <windows.h>
@@ -30,6 +31,9 @@ enet_initialize (void)
 
     timeBeginPeriod (1);
 
+    enet_checksum_initialize ();
+    enet_crypto_initialize ();
+
     return 0;
 }
 
@@ -47,6 +51,27 @@ enet_host_random_seed (void)
     return (enet_uint32) timeGetTime ();
 }
 
+int
+enet_random_bytes (void * data, size_t dataLength)
+{
+    enet_uint8 * bytes = (enet_uint8 *) data;
+
+    while (dataLength > 0)
+    {
+        unsigned int value;
+        size_t valueLength = dataLength < sizeof (value) ? dataLength : sizeof (value);
+
+        if (rand_s (& value) != 0)
+          return -1;
+
+        memcpy (bytes, & value, valueLength);
+        bytes += valueLength;
+        dataLength -= valueLength;
+    }
+
+    return 0;
+}
+
 enet_uint32
 enet_time_get (void)
 {
@@ -346,6 +371,27 @@ enet_socket_send (ENetSocket socket,
     return (int) sentLength;
 }
 
+int
+enet_socket_send_batch (ENetSocket socket,
+                        const ENetAddress * addresses,
+                        const ENetBuffer * buffers,
+                        size_t datagramCount)
+{
+    size_t datagramIndex;
+    int sentLength = 0;
+
+    for (datagramIndex = 0; datagramIndex < datagramCount; ++ datagramIndex)
+    {
+        int datagramLength = enet_socket_send (socket, & addresses [datagramIndex], & buffers [datagramIndex], 1);
+        if (datagramLength < 0)
+          return -1;
+
+        sentLength += datagramLength;
+    }
+
+    return sentLength;
+}
+
 int
 enet_socket_receive (ENetSocket socket,
                      ENetAddress * address,
@@ -438,5 +484,114 @@ enet_socket_wait (ENetSocket socket, enet_uint32 * condition, enet_uint32 timeou
     return 0;
 } 
 
-#endif
+typedef struct _ENetThreadStart
+{
+    ENetThreadFunction function;
+    void * data;
+} ENetThreadStart;
+
+static DWORD WINAPI
+enet_thread_start (LPVOID data)
+{
+    ENetThreadStart start = * (ENetThreadStart *) data;
+
+    enet_free (data);
+
+    start.function (start.data);
+
+    return 0;
+}
+
+int
+enet_thread_create (ENetThread * thread, ENetThreadFunction function, void * data)
+{
+    ENetThreadStart * start = (ENetThreadStart *) enet_malloc (sizeof (ENetThreadStart));
+    if (start == NULL)
+      return -1;
+
+    start -> function = function;
+    start -> data = data;
+
+    * thread = CreateThread (NULL, 0, enet_thread_start, start, 0, NULL);
+    if (* thread == NULL)
+    {
+        enet_free (start);
+
+        return -1;
+    }
+
+    return 0;
+}
+
+void
+enet_thread_join (ENetThread thread)
+{
+    WaitForSingleObject (thread, INFINITE);
+    CloseHandle (thread);
+}
+
+int
+enet_mutex_create (ENetMutex * mutex)
+{
+    InitializeCriticalSection (mutex);
+
+    return 0;
+}
+
+void
+enet_mutex_destroy (ENetMutex * mutex)
+{
+    DeleteCriticalSection (mutex);
+}
 
+void
+enet_mutex_lock (ENetMutex * mutex)
+{
+    EnterCriticalSection (mutex);
+}
+
+void
+enet_mutex_unlock (ENetMutex * mutex)
+{
+    LeaveCriticalSection (mutex);
+}
+
+int
+enet_condition_create (ENetCondition * condition)
+{
+    InitializeConditionVariable (condition);
+
+    return 0;
+}
+
+void
+enet_condition_destroy (ENetCondition * condition)
+{
+    (void) condition;
+}
+
+void
+enet_condition_wait (ENetCondition * condition, ENetMutex * mutex)
+{
+    SleepConditionVariableCS (condition, mutex, INFINITE);
+}
+
+void
+enet_condition_wait_timeout (ENetCondition * condition, ENetMutex * mutex, enet_uint32 timeout)
+{
+    SleepConditionVariableCS (condition, mutex, timeout);
+}
+
+void
+enet_condition_signal (ENetCondition * condition)
+{
+    WakeConditionVariable (condition);
+}
+
+void
+enet_condition_broadcast (ENetCondition * condition)
+{
+    WakeAllConditionVariable (condition);
+}
+
+#endif
@@ -0,0 +1,445 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if ENET_LIB_CHOICE == ENET_LIB_CHOICE_ORIGINAL
+	#include <enet/enet.h>
+#else
+	#include <enet.h>
+#endif
+
+
+// Latency benchmark
+// Runs a chat server whose event handler is deliberately slow, as if every
+// message were printed to a slow terminal, and measures what its clients
+// see: the round trip time ENet measures from acknowledgements, and the time
+// for a message to be echoed back by the server.
+//
+// The server either services its host between events, like server.c does by
+// default, or leaves the host to a host thread (enet_host_thread_create) and
+// only handles events, like server.c -t. Clients and server run in this one
+// process and talk over the loopback interface.
+
+
+#ifdef _WINDOWS
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+typedef struct
+{
+	int clients;
+	int rate;
+	int delay_us;
+	int seconds;
+	size_t event_capacity;
+} Config;
+#if ENET_LIB_CHOICE == ENET_LIB_CHOICE_ORIGINAL
+typedef struct
+{
+	const Config *config;
+	ENetHost *host;
+	// NULL when the server services its host between events
+	ENetHostThread *thread;
+	volatile bool stop;
+	unsigned long events;
+} Server;
+#endif
+typedef struct
+{
+	double *samples;
+	size_t count;
+	size_t capacity;
+} Samples;
+bool run(const Config *config, bool threaded);
+void samples_add(Samples *samples, double value);
+void samples_print(const char *name, Samples *samples);
+void samples_destroy(Samples *samples);
+#define MESSAGE_SIZE 64
+#define WARMUP_SECONDS 1
+#define RTT_SAMPLE_INTERVAL_MS 50
+
+
+static void usage(const char *program)
+{
+	fprintf(stderr,
+		"Usage: %s [options] [inline|threaded]\n"
+		"  -c COUNT  number of clients (default 8)\n"
+		"  -r RATE   messages per second from each client (default 10)\n"
+		"  -d USEC   time the server takes over each event (default 5000)\n"
+		"  -t SECS   seconds to measure for (default 5)\n"
+		"  -e COUNT  events the host thread may queue for the server (default 256)\n",
+		program);
+}
+
+int main(int argc, char *argv[])
+{
+	Config config = { 8, 10, 5000, 5, 256 };
+	const char *mode = NULL;
+	for (int i = 1; i < argc; i++)
+	{
+		const char *arg = argv[i];
+		if (arg[0] != '-' && mode == NULL && i + 1 == argc)
+		{
+			mode = arg;
+			break;
+		}
+		if (arg[0] != '-' || arg[1] == '\0' || arg[2] != '\0' || i + 1 >= argc)
+		{
+			usage(argv[0]);
+			return 1;
+		}
+		const char *value = argv[++i];
+		switch (arg[1])
+		{
+			case 'c':
+				config.clients = atoi(value);
+				break;
+			case 'r':
+				config.rate = atoi(value);
+				break;
+			case 'd':
+				config.delay_us = atoi(value);
+				break;
+			case 't':
+				config.seconds = atoi(value);
+				break;
+			case 'e':
+				config.event_capacity = strtoul(value, NULL, 10);
+				break;
+			default:
+				usage(argv[0]);
+				return 1;
+		}
+	}
+	if (config.clients <= 0 || config.rate <= 0 || config.delay_us < 0 ||
+		config.seconds <= 0 || config.event_capacity == 0 ||
+		(mode != NULL && strcmp(mode, "inline") != 0 && strcmp(mode, "threaded") != 0))
+	{
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (enet_initialize() != 0)
+	{
+		fprintf(stderr, "An error occurred while initializing ENet\n");
+		return 1;
+	}
+	printf("%d clients sending %d messages/s, server takes %d us per event\n",
+		config.clients, config.rate, config.delay_us);
+	printf("%-22s %9s %9s %9s %9s %9s\n", "", "samples", "mean ms", "p50 ms", "p99 ms", "max ms");
+	bool ok = true;
+	if (mode == NULL || strcmp(mode, "inline") == 0)
+	{
+		ok = run(&config, false) && ok;
+	}
+	if (mode == NULL || strcmp(mode, "threaded") == 0)
+	{
+		ok = run(&config, true) && ok;
+	}
+	enet_deinitialize();
+	return ok ? 0 : 1;
+}
+
+#if ENET_LIB_CHOICE == ENET_LIB_CHOICE_ORIGINAL
+
+static double now_ms(void)
+{
+#ifdef _WINDOWS
+	static LARGE_INTEGER frequency;
+	LARGE_INTEGER counter;
+	if (frequency.QuadPart == 0)
+	{
+		QueryPerformanceFrequency(&frequency);
+	}
+	QueryPerformanceCounter(&counter);
+	return (double)counter.QuadPart * 1e3 / (double)frequency.QuadPart;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec * 1e3 + (double)ts.tv_nsec / 1e6;
+#endif
+}
+
+static void sleep_us(int us)
+{
+#ifdef _WINDOWS
+	Sleep((us + 999) / 1000);
+#else
+	struct timespec ts;
+	ts.tv_sec = us / 1000000;
+	ts.tv_nsec = (long)(us % 1000000) * 1000;
+	nanosleep(&ts, NULL);
+#endif
+}
+
+// The slow consumer: takes its time over every event, then echoes messages
+// back to their sender
+static void handle_event(Server *server, ENetEvent *event)
+{
+	server->events++;
+	sleep_us(server->config->delay_us);
+	if (event->type != ENET_EVENT_TYPE_RECEIVE)
+	{
+		return;
+	}
+	ENetPacket *echo = enet_packet_create(
+		event->packet->data, event->packet->dataLength, ENET_PACKET_FLAG_RELIABLE);
+	enet_packet_destroy(event->packet);
+	int sent = server->thread != NULL ?
+		enet_host_thread_send(server->thread, event->peer, 0, echo) :
+		enet_peer_send(event->peer, 0, echo);
+	if (sent < 0)
+	{
+		enet_packet_destroy(echo);
+	}
+}
+
+static void ENET_CALLBACK run_server(void *data)
+{
+	Server *server = data;
+	while (!server->stop)
+	{
+		ENetEvent event;
+		int check = server->thread != NULL ?
+			enet_host_thread_receive(server->thread, &event) :
+			enet_host_service(server->host, &event, 1);
+		if (check > 0)
+		{
+			handle_event(server, &event);
+		}
+		else if (check < 0)
+		{
+			fprintf(stderr, "Error servicing host\n");
+			break;
+		}
+		else if (server->thread != NULL)
+		{
+			sleep_us(100);
+		}
+	}
+}
+
+bool run(const Config *config, bool threaded)
+{
+	bool ok = false;
+	Server server;
+	memset(&server, 0, sizeof server);
+	server.config = config;
+	ENetAddress address;
+	enet_address_set_host(&address, "127.0.0.1");
+	address.port = ENET_PORT_ANY;
+	server.host = enet_host_create(&address, config->clients, 1, 0, 0);
+	ENetHost *client = enet_host_create(NULL, config->clients, 1, 0, 0);
+	if (server.host == NULL || client == NULL)
+	{
+		fprintf(stderr, "Failed to open ENet hosts\n");
+		goto failed_hosts;
+	}
+	if (threaded)
+	{
+		server.thread = enet_host_thread_create(server.host, config->event_capacity, 256, 1);
+		if (server.thread == NULL)
+		{
+			fprintf(stderr, "Failed to start the host thread\n");
+			goto failed_hosts;
+		}
+	}
+	ENetThread server_thread;
+	if (enet_thread_create(&server_thread, run_server, &server) != 0)
+	{
+		fprintf(stderr, "Failed to start the server\n");
+		goto failed_thread;
+	}
+
+	// Connect every client, and keep servicing the clients for the
+	// rest of the run so that they never delay anything themselves
+	address.port = server.host->address.port;
+	ENetPeer **peers = calloc(config->clients, sizeof *peers);
+	double *next_send = calloc(config->clients, sizeof *next_send);
+	int connected = 0;
+	for (int i = 0; peers != NULL && i < config->clients; i++)
+	{
+		peers[i] = enet_host_connect(client, &address, 1, 0);
+	}
+	Samples rtt, echo;
+	memset(&rtt, 0, sizeof rtt);
+	memset(&echo, 0, sizeof echo);
+	double start = now_ms();
+	double measure_from = 0, end = start + 5000, next_rtt_sample = 0;
+	unsigned long sent = 0;
+	while (peers != NULL && next_send != NULL && now_ms() < end)
+	{
+		ENetEvent event;
+		while (enet_host_service(client, &event, 1) > 0)
+		{
+			switch (event.type)
+			{
+				case ENET_EVENT_TYPE_CONNECT:
+					if (++connected == config->clients)
+					{
+						// Everyone is in, start sending
+						measure_from = now_ms() + WARMUP_SECONDS * 1000;
+						end = measure_from + config->seconds * 1000;
+					}
+					break;
+				case ENET_EVENT_TYPE_RECEIVE:
+				{
+					double sent_at;
+					memcpy(&sent_at, event.packet->data, sizeof sent_at);
+					if (sent_at >= measure_from)
+					{
+						samples_add(&echo, now_ms() - sent_at);
+					}
+					enet_packet_destroy(event.packet);
+					break;
+				}
+				case ENET_EVENT_TYPE_DISCONNECT:
+					fprintf(stderr, "A client lost its connection\n");
+					end = 0;
+					break;
+				default:
+					break;
+			}
+		}
+		if (connected < config->clients)
+		{
+			continue;
+		}
+		double now = now_ms();
+		for (int i = 0; i < config->clients; i++)
+		{
+			if (now < next_send[i])
+			{
+				continue;
+			}
+			// Spread the clients out over the send interval
+			next_send[i] = next_send[i] == 0 ?
+				now + 1000.0 * i / config->clients / config->rate :
+				next_send[i] + 1000.0 / config->rate;
+			enet_uint8 message[MESSAGE_SIZE];
+			memset(message, ' ', sizeof message);
+			memcpy(message, &now, sizeof now);
+			snprintf((char *)message + sizeof now, sizeof message - sizeof now,
+				"Client %d says hello", i);
+			ENetPacket *packet = enet_packet_create(message, sizeof message, ENET_PACKET_FLAG_RELIABLE);
+			if (enet_peer_send(peers[i], 0, packet) < 0)
+			{
+				enet_packet_destroy(packet);
+			}
+			else if (now >= measure_from)
+			{
+				sent++;
+			}
+		}
+		if (now >= measure_from && now >= next_rtt_sample)
+		{
+			next_rtt_sample = now + RTT_SAMPLE_INTERVAL_MS;
+			for (int i = 0; i < config->clients; i++)
+			{
+				samples_add(&rtt, peers[i]->roundTripTime);
+			}
+		}
+	}
+	ok = connected == config->clients && end > 0;
+	if (connected < config->clients)
+	{
+		fprintf(stderr, "Only %d of %d clients connected\n", connected, config->clients);
+	}
+
+	server.stop = true;
+	enet_thread_join(server_thread);
+	printf("%s: %lu messages sent, %lu echoed, server handled %lu events\n",
+		threaded ? "threaded" : "inline", sent, (unsigned long)echo.count, server.events);
+	samples_print("  ENet round trip", &rtt);
+	samples_print("  echo", &echo);
+	if (server.thread != NULL)
+	{
+		printf("  host thread found the event queue full %lu times\n",
+			(unsigned long)server.thread->eventsDeferred);
+	}
+	samples_destroy(&rtt);
+	samples_destroy(&echo);
+	free(next_send);
+	free(peers);
+failed_thread:
+	if (server.thread != NULL)
+	{
+		enet_host_thread_destroy(server.thread);
+	}
+	enet_host_destroy(server.host);
+	enet_host_destroy(client);
+	return ok;
+
+failed_hosts:
+	if (server.host != NULL)
+	{
+		enet_host_destroy(server.host);
+	}
+	if (client != NULL)
+	{
+		enet_host_destroy(client);
+	}
+	return ok;
+}
+
+#else
+
+bool run(const Config *config, bool threaded)
+{
+	(void)config;
+	(void)threaded;
+	fprintf(stderr, "The latency benchmark needs host threads, which only the original ENet has\n");
+	return false;
+}
+
+#endif
+
+void samples_add(Samples *samples, double value)
+{
+	if (samples->count == samples->capacity)
+	{
+		size_t capacity = samples->capacity > 0 ? samples->capacity * 2 : 1024;
+		double *grown = realloc(samples->samples, capacity * sizeof *grown);
+		if (grown == NULL)
+		{
+			return;
+		}
+		samples->samples = grown;
+		samples->capacity = capacity;
+	}
+	samples->samples[samples->count++] = value;
+}
+
+static int compare_samples(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+	return x < y ? -1 : x > y;
+}
+
+void samples_print(const char *name, Samples *samples)
+{
+	if (samples->count == 0)
+	{
+		printf("%-22s %9d\n", name, 0);
+		return;
+	}
+	qsort(samples->samples, samples->count, sizeof *samples->samples, compare_samples);
+	double total = 0;
+	for (size_t i = 0; i < samples->count; i++)
+	{
+		total += samples->samples[i];
+	}
+	printf("%-22s %9lu %9.2f %9.2f %9.2f %9.2f\n", name, (unsigned long)samples->count,
+		total / samples->count,
+		samples->samples[samples->count / 2],
+		samples->samples[samples->count * 99 / 100],
+		samples->samples[samples->count - 1]);
+}
+
+void samples_destroy(Samples *samples)
+{
+	free(samples->samples);
+	memset(samples, 0, sizeof *samples);
+}
@@ -0,0 +1,312 @@
+#include "log.h"
+#include "threads.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <errno.h>
+#include <unistd.h>
+#endif
+
+
+// The ring is a bounded multi-producer queue: every slot carries a
+// sequence number that tells producers when it is free and the writer
+// when it is filled, so neither side takes a lock and a producer only
+// ever does one compare-and-swap and a copy. The writer sleeps on a
+// condition variable when it finds the ring empty; it raises waiting
+// before checking the ring once more, and a producer checks waiting
+// after filling its slot, so with a fence on both sides one of them
+// sees the other, and producers only take the lock to wake it.
+
+// Bytes of text the writer gathers before each write call
+#define LOG_BATCH_SIZE 16384
+// Longest line a record may format to, including the newline
+#define LOG_LINE_SIZE 1024
+
+typedef struct
+{
+	// Equals the claiming position while free, and one past it once filled
+	volatile unsigned sequence;
+	LogFormat format;
+	union
+	{
+		unsigned char bytes[LOG_RECORD_SIZE];
+		// Keep payloads aligned for whatever struct a caller logs
+		long long align_integer;
+		double align_float;
+		void *align_pointer;
+	} data;
+} LogSlot;
+
+struct LogSink
+{
+	int fd;
+	LogSlot *slots;
+	unsigned mask;
+	// Next position a producer claims
+	volatile unsigned head;
+	// Next position the writer reads; only the writer touches it
+	unsigned tail;
+	volatile unsigned dropped;
+	volatile unsigned stop;
+	// Set while the writer is about to sleep or sleeping on wake
+	volatile unsigned waiting;
+	Mutex lock;
+	Condition wake;
+	Thread thread;
+	char batch[LOG_BATCH_SIZE];
+};
+
+static LogSlot *log_claim(LogSink *sink, unsigned *position)
+{
+	unsigned pos = ATOMIC_LOAD(&sink->head);
+	for (;;)
+	{
+		LogSlot *slot = &sink->slots[pos & sink->mask];
+		const int diff = (int)(ATOMIC_LOAD(&slot->sequence) - pos);
+		if (diff == 0)
+		{
+			if (ATOMIC_CAS(&sink->head, pos, pos + 1))
+			{
+				*position = pos;
+				return slot;
+			}
+		}
+		else if (diff < 0)
+		{
+			// The writer has not freed this slot yet, so the ring is full
+			ATOMIC_INCREMENT(&sink->dropped);
+			return NULL;
+		}
+		pos = ATOMIC_LOAD(&sink->head);
+	}
+}
+
+static void log_flush(LogSink *sink, size_t length)
+{
+	const char *data = sink->batch;
+	while (length > 0)
+	{
+#ifdef _WIN32
+		const int written = _write(sink->fd, data, (unsigned)length);
+#else
+		const ssize_t written = write(sink->fd, data, length);
+		if (written < 0 && errno == EINTR)
+		{
+			continue;
+		}
+#endif
+		if (written <= 0)
+		{
+			// Nowhere left to report it; drop the batch
+			return;
+		}
+		data += written;
+		length -= (size_t)written;
+	}
+}
+
+// Sleeps until a producer fills the next slot or the sink stops
+static void log_wait(LogSink *sink)
+{
+	LogSlot *slot = &sink->slots[sink->tail & sink->mask];
+	mutex_lock(&sink->lock);
+	ATOMIC_STORE(&sink->waiting, 1);
+	ATOMIC_FENCE();
+	while (ATOMIC_LOAD(&slot->sequence) != sink->tail + 1 && !ATOMIC_LOAD(&sink->stop))
+	{
+		condition_wait(&sink->wake, &sink->lock);
+	}
+	ATOMIC_STORE(&sink->waiting, 0);
+	mutex_unlock(&sink->lock);
+}
+
+// Wakes the writer if it sleeps, once a producer has filled a slot
+static void log_notify(LogSink *sink)
+{
+	ATOMIC_FENCE();
+	if (ATOMIC_LOAD(&sink->waiting))
+	{
+		mutex_lock(&sink->lock);
+		condition_signal(&sink->wake);
+		mutex_unlock(&sink->lock);
+	}
+}
+
+static void log_run(LogSink *sink)
+{
+	unsigned reported = 0;
+	for (;;)
+	{
+		// Read the flag before draining, so that everything queued before
+		// log_sink_destroy still gets written
+		const unsigned stop = ATOMIC_LOAD(&sink->stop);
+		size_t length = 0;
+		for (;;)
+		{
+			LogSlot *slot = &sink->slots[sink->tail & sink->mask];
+			if (ATOMIC_LOAD(&slot->sequence) != sink->tail + 1)
+			{
+				break;
+			}
+			if (LOG_BATCH_SIZE - length < LOG_LINE_SIZE)
+			{
+				log_flush(sink, length);
+				length = 0;
+			}
+			char *line = sink->batch + length;
+			int n = slot->format(line, LOG_LINE_SIZE - 1, slot->data.bytes);
+			if (n < 0)
+			{
+				n = 0;
+			}
+			else if (n > LOG_LINE_SIZE - 2)
+			{
+				n = LOG_LINE_SIZE - 2;
+			}
+			line[n] = '\n';
+			length += (size_t)n + 1;
+			ATOMIC_STORE(&slot->sequence, sink->tail + sink->mask + 1);
+			sink->tail++;
+		}
+		const unsigned dropped = ATOMIC_LOAD(&sink->dropped);
+		if (dropped != reported)
+		{
+			if (LOG_BATCH_SIZE - length < LOG_LINE_SIZE)
+			{
+				log_flush(sink, length);
+				length = 0;
+			}
+			length += (size_t)snprintf(sink->batch + length, LOG_LINE_SIZE,
+				"Log: %u messages dropped\n", dropped - reported);
+			reported = dropped;
+		}
+		if (length > 0)
+		{
+			log_flush(sink, length);
+		}
+		else if (stop)
+		{
+			return;
+		}
+		else
+		{
+			log_wait(sink);
+		}
+	}
+}
+
+static ThreadResult THREAD_CALL log_thread(void *arg)
+{
+	log_run((LogSink *)arg);
+	return 0;
+}
+
+LogSink *log_sink_create(int fd, size_t capacity)
+{
+	unsigned slots = 2;
+	while (slots < capacity)
+	{
+		slots <<= 1;
+	}
+	LogSink *sink = malloc(sizeof *sink);
+	if (sink == NULL)
+	{
+		return NULL;
+	}
+	sink->slots = malloc(slots * sizeof *sink->slots);
+	if (sink->slots == NULL)
+	{
+		free(sink);
+		return NULL;
+	}
+	for (unsigned i = 0; i < slots; i++)
+	{
+		sink->slots[i].sequence = i;
+	}
+	sink->fd = fd;
+	sink->mask = slots - 1;
+	sink->head = 0;
+	sink->tail = 0;
+	sink->dropped = 0;
+	sink->stop = 0;
+	sink->waiting = 0;
+	mutex_init(&sink->lock);
+	condition_init(&sink->wake);
+	if (!thread_create(&sink->thread, log_thread, sink))
+	{
+		condition_destroy(&sink->wake);
+		mutex_destroy(&sink->lock);
+		free(sink->slots);
+		free(sink);
+		return NULL;
+	}
+	return sink;
+}
+
+bool log_sink_write(LogSink *sink, LogFormat format, const void *data, size_t size)
+{
+	if (size > LOG_RECORD_SIZE)
+	{
+		return false;
+	}
+	unsigned pos;
+	LogSlot *slot = log_claim(sink, &pos);
+	if (slot == NULL)
+	{
+		return false;
+	}
+	slot->format = format;
+	memcpy(slot->data.bytes, data, size);
+	ATOMIC_STORE(&slot->sequence, pos + 1);
+	log_notify(sink);
+	return true;
+}
+
+static int log_format_text(char *out, size_t size, const void *data)
+{
+	return snprintf(out, size, "%s", (const char *)data);
+}
+
+bool log_sink_text(LogSink *sink, const char *s)
+{
+	unsigned pos;
+	LogSlot *slot = log_claim(sink, &pos);
+	if (slot == NULL)
+	{
+		return false;
+	}
+	size_t length = strlen(s);
+	if (length > LOG_RECORD_SIZE - 1)
+	{
+		length = LOG_RECORD_SIZE - 1;
+	}
+	slot->format = log_format_text;
+	memcpy(slot->data.bytes, s, length);
+	slot->data.bytes[length] = '\0';
+	ATOMIC_STORE(&slot->sequence, pos + 1);
+	log_notify(sink);
+	return true;
+}
+
+unsigned log_sink_dropped(LogSink *sink)
+{
+	return ATOMIC_LOAD(&sink->dropped);
+}
+
+void log_sink_destroy(LogSink *sink)
+{
+	mutex_lock(&sink->lock);
+	ATOMIC_STORE(&sink->stop, 1);
+	condition_signal(&sink->wake);
+	mutex_unlock(&sink->lock);
+	thread_join(sink->thread);
+	condition_destroy(&sink->wake);
+	mutex_destroy(&sink->lock);
+	free(sink->slots);
+	free(sink);
+}
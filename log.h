@@ -0,0 +1,33 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+
+// Asynchronous log sink
+// Callers copy a small binary record into a lock-free ring buffer and
+// return straight away; a background thread turns the records into text
+// and writes them out in batches. When the ring is full the record is
+// dropped and counted instead of blocking the caller, and the writer
+// reports the count with the next batch.
+
+// The largest payload a single record can carry
+#define LOG_RECORD_SIZE 256
+
+// Turns a record payload into one line of text (without the newline),
+// returning the length like snprintf. Runs on the writer thread.
+typedef int (*LogFormat)(char *out, size_t size, const void *data);
+
+typedef struct LogSink LogSink;
+
+// Starts a sink writing to the file descriptor fd
+// capacity is the number of records the ring holds, rounded up to a power
+// of two
+LogSink *log_sink_create(int fd, size_t capacity);
+// Queues a record of size bytes, which format turns into text later
+// Safe to call from any number of threads; returns false if dropped
+bool log_sink_write(LogSink *sink, LogFormat format, const void *data, size_t size);
+// Queues an already formatted line, truncated to fit a record
+bool log_sink_text(LogSink *sink, const char *s);
+// Number of records dropped so far because the ring was full
+unsigned log_sink_dropped(LogSink *sink);
+// Writes out everything queued, then stops the writer thread
+void log_sink_destroy(LogSink *sink);
@@ -0,0 +1,311 @@
+#include "pool.h"
+#include "threads.h"
+
+#include <stdlib.h>
+
+
+// Tasks are queued on strands, one per key hash. A strand is scheduled,
+// that is put on a worker's deque, when its first task arrives, and stays
+// scheduled until a worker runs it dry, so no two workers ever run the
+// same strand and its tasks keep their order. Workers take the newest
+// strand from their own deque and steal the oldest from the others when
+// theirs is empty.
+
+// Number of serial queues that keys are hashed to
+#define POOL_STRANDS 256
+
+typedef struct
+{
+	Mutex lock;
+	PoolTask *head;
+	PoolTask *tail;
+	// Set from when the strand is put on a deque until it is run dry
+	bool scheduled;
+} PoolStrand;
+
+typedef struct
+{
+	HandlerPool *pool;
+	int index;
+	Thread thread;
+	// Strands scheduled on this worker; a strand is on at most one deque,
+	// so each holds every strand at most
+	Mutex lock;
+	PoolStrand *deque[POOL_STRANDS];
+	unsigned first;
+	unsigned count;
+} PoolWorker;
+
+struct HandlerPool
+{
+	PoolHandler handle;
+	void *context;
+	int worker_count;
+	PoolWorker *workers;
+	PoolStrand strands[POOL_STRANDS];
+	// Guards pending and stop, and wakes idle workers
+	Mutex lock;
+	Condition work;
+	// Strands on the deques that no worker has claimed yet
+	unsigned pending;
+	bool stop;
+	// Handled tasks waiting for handler_pool_completed
+	Mutex completed_lock;
+	PoolTask *completed_head;
+	PoolTask *completed_tail;
+};
+
+static void pool_schedule(HandlerPool *pool, PoolWorker *worker, PoolStrand *strand)
+{
+	mutex_lock(&worker->lock);
+	worker->deque[(worker->first + worker->count++) % POOL_STRANDS] = strand;
+	mutex_unlock(&worker->lock);
+
+	mutex_lock(&pool->lock);
+	pool->pending++;
+	condition_signal(&pool->work);
+	mutex_unlock(&pool->lock);
+}
+
+static PoolStrand *pool_pop(PoolWorker *worker)
+{
+	PoolStrand *strand = NULL;
+	mutex_lock(&worker->lock);
+	if (worker->count > 0)
+	{
+		worker->count--;
+		strand = worker->deque[(worker->first + worker->count) % POOL_STRANDS];
+	}
+	mutex_unlock(&worker->lock);
+	return strand;
+}
+
+static PoolStrand *pool_steal(PoolWorker *victim)
+{
+	PoolStrand *strand = NULL;
+	mutex_lock(&victim->lock);
+	if (victim->count > 0)
+	{
+		strand = victim->deque[victim->first];
+		victim->first = (victim->first + 1) % POOL_STRANDS;
+		victim->count--;
+	}
+	mutex_unlock(&victim->lock);
+	return strand;
+}
+
+// Waits for a scheduled strand, or returns NULL once the pool stops with
+// nothing left to run
+static PoolStrand *pool_take(HandlerPool *pool, PoolWorker *worker)
+{
+	mutex_lock(&pool->lock);
+	while (pool->pending == 0 && !pool->stop)
+	{
+		condition_wait(&pool->work, &pool->lock);
+	}
+	if (pool->pending == 0)
+	{
+		mutex_unlock(&pool->lock);
+		return NULL;
+	}
+	pool->pending--;
+	mutex_unlock(&pool->lock);
+
+	// Claiming one of pending guarantees a strand on some deque that no
+	// other worker will take
+	for (;;)
+	{
+		PoolStrand *strand = pool_pop(worker);
+		for (int i = 1; strand == NULL && i < pool->worker_count; i++)
+		{
+			strand = pool_steal(&pool->workers[(worker->index + i) % pool->worker_count]);
+		}
+		if (strand != NULL)
+		{
+			return strand;
+		}
+	}
+}
+
+static void pool_run(HandlerPool *pool, PoolWorker *worker, PoolStrand *strand)
+{
+	// Take everything queued so far; later tasks wait for the next run
+	mutex_lock(&strand->lock);
+	PoolTask *tasks = strand->head;
+	strand->head = NULL;
+	strand->tail = NULL;
+	mutex_unlock(&strand->lock);
+
+	PoolTask *last = NULL;
+	for (PoolTask *task = tasks; task != NULL; task = task->next)
+	{
+		pool->handle(task, pool->context);
+		last = task;
+	}
+
+	if (last != NULL)
+	{
+		mutex_lock(&pool->completed_lock);
+		if (pool->completed_tail != NULL)
+		{
+			pool->completed_tail->next = tasks;
+		}
+		else
+		{
+			pool->completed_head = tasks;
+		}
+		pool->completed_tail = last;
+		mutex_unlock(&pool->completed_lock);
+	}
+
+	mutex_lock(&strand->lock);
+	const bool more = strand->head != NULL;
+	if (!more)
+	{
+		strand->scheduled = false;
+	}
+	mutex_unlock(&strand->lock);
+	if (more)
+	{
+		pool_schedule(pool, worker, strand);
+	}
+}
+
+static void pool_work(PoolWorker *worker)
+{
+	PoolStrand *strand;
+	while ((strand = pool_take(worker->pool, worker)) != NULL)
+	{
+		pool_run(worker->pool, worker, strand);
+	}
+}
+
+static ThreadResult THREAD_CALL pool_thread(void *arg)
+{
+	pool_work((PoolWorker *)arg);
+	return 0;
+}
+
+static void pool_join(HandlerPool *pool, int started)
+{
+	mutex_lock(&pool->lock);
+	pool->stop = true;
+	condition_broadcast(&pool->work);
+	mutex_unlock(&pool->lock);
+
+	for (int i = 0; i < started; i++)
+	{
+		thread_join(pool->workers[i].thread);
+	}
+}
+
+static void pool_free(HandlerPool *pool)
+{
+	for (int i = 0; i < pool->worker_count; i++)
+	{
+		mutex_destroy(&pool->workers[i].lock);
+	}
+	for (int i = 0; i < POOL_STRANDS; i++)
+	{
+		mutex_destroy(&pool->strands[i].lock);
+	}
+	mutex_destroy(&pool->lock);
+	condition_destroy(&pool->work);
+	mutex_destroy(&pool->completed_lock);
+	free(pool->workers);
+	free(pool);
+}
+
+HandlerPool *handler_pool_create(int workers, PoolHandler handle, void *context)
+{
+	if (workers < 1 || workers > POOL_MAX_WORKERS)
+	{
+		return NULL;
+	}
+	HandlerPool *pool = calloc(1, sizeof *pool);
+	if (pool == NULL)
+	{
+		return NULL;
+	}
+	pool->workers = calloc((size_t)workers, sizeof *pool->workers);
+	if (pool->workers == NULL)
+	{
+		free(pool);
+		return NULL;
+	}
+	pool->handle = handle;
+	pool->context = context;
+	pool->worker_count = workers;
+	for (int i = 0; i < POOL_STRANDS; i++)
+	{
+		mutex_init(&pool->strands[i].lock);
+	}
+	mutex_init(&pool->lock);
+	condition_init(&pool->work);
+	mutex_init(&pool->completed_lock);
+	for (int i = 0; i < workers; i++)
+	{
+		pool->workers[i].pool = pool;
+		pool->workers[i].index = i;
+		mutex_init(&pool->workers[i].lock);
+	}
+	for (int i = 0; i < workers; i++)
+	{
+		if (!thread_create(&pool->workers[i].thread, pool_thread, &pool->workers[i]))
+		{
+			pool_join(pool, i);
+			pool_free(pool);
+			return NULL;
+		}
+	}
+	return pool;
+}
+
+void handler_pool_submit(HandlerPool *pool, unsigned key, PoolTask *task)
+{
+	// Spread neighbouring keys, such as peer IDs, over the strands
+	const unsigned hash = (key * 2654435761u) >> 16;
+	const unsigned index = hash % POOL_STRANDS;
+	PoolStrand *strand = &pool->strands[index];
+
+	task->next = NULL;
+	task->key = key;
+
+	mutex_lock(&strand->lock);
+	if (strand->tail != NULL)
+	{
+		strand->tail->next = task;
+	}
+	else
+	{
+		strand->head = task;
+	}
+	strand->tail = task;
+	const bool schedule = !strand->scheduled;
+	strand->scheduled = true;
+	mutex_unlock(&strand->lock);
+
+	if (schedule)
+	{
+		// The same worker gets a strand each time unless it is stolen
+		pool_schedule(pool, &pool->workers[index % pool->worker_count], strand);
+	}
+}
+
+PoolTask *handler_pool_completed(HandlerPool *pool)
+{
+	mutex_lock(&pool->completed_lock);
+	PoolTask *tasks = pool->completed_head;
+	pool->completed_head = NULL;
+	pool->completed_tail = NULL;
+	mutex_unlock(&pool->completed_lock);
+	return tasks;
+}
+
+PoolTask *handler_pool_destroy(HandlerPool *pool)
+{
+	pool_join(pool, pool->worker_count);
+	PoolTask *tasks = pool->completed_head;
+	pool_free(pool);
+	return tasks;
+}
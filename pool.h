@@ -0,0 +1,36 @@
+#pragma once
+#include <stdbool.h>
+
+// Work-stealing handler pool
+// Tasks are handed to worker threads, and each task comes back to the
+// submitting thread once handled, in batches taken with
+// handler_pool_completed. Tasks with the same key are hashed to the same
+// serial queue, so they are handled one at a time and complete in the
+// order they were submitted, while different keys run in parallel.
+
+// The largest number of worker threads a pool may have
+#define POOL_MAX_WORKERS 64
+
+// A unit of work; embed as the first member of your own task struct
+typedef struct PoolTask
+{
+	struct PoolTask *next;
+	unsigned key;
+} PoolTask;
+
+// Handles one task on a worker thread
+typedef void (*PoolHandler)(PoolTask *task, void *context);
+
+typedef struct HandlerPool HandlerPool;
+
+// Starts worker threads that run handle on each submitted task
+HandlerPool *handler_pool_create(int workers, PoolHandler handle, void *context);
+// Queues a task behind all earlier tasks with the same key
+// The handler must leave the task's next and key alone
+void handler_pool_submit(HandlerPool *pool, unsigned key, PoolTask *task);
+// Takes the tasks handled so far, linked through next in completion
+// order, or NULL if there are none
+PoolTask *handler_pool_completed(HandlerPool *pool);
+// Finishes every queued task, stops the workers and returns the handled
+// tasks that were never taken
+PoolTask *handler_pool_destroy(HandlerPool *pool);
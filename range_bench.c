@@ -0,0 +1,408 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if ENET_LIB_CHOICE == ENET_LIB_CHOICE_ORIGINAL
+	#include <enet/enet.h>
+#else
+	#include <enet.h>
+#endif
+
+
+// Range coder benchmark and fuzzer
+// The bench mode measures the compress and decompress throughput in MB/s of
+// the range coder (enet_range_coder_*) and the compression ratio it
+// reaches, by packet size, for chat text, for bytes skewed towards small
+// values as in binary game state, and for random bytes that do not compress.
+//
+// The fuzz mode compresses random packets of every kind and size, split into
+// as many as four buffers as ENet hands them over, and checks that each one
+// decompresses to what went in, also into too small buffers, and that
+// corrupt and truncated input never writes past the end of the output. The
+// coded streams are hashed, and with the default seed and count the hash is
+// checked against the one the previous tree walking coder produced, so a
+// change to the coder that alters its output is noticed. Build it with
+// -fsanitize=address,undefined to catch out of bounds accesses.
+
+
+#ifdef _WINDOWS
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+typedef struct
+{
+	double bytes;
+	int iterations;
+	size_t count;
+	enet_uint32 seed;
+} Config;
+typedef enum
+{
+	CONTENT_TEXT,
+	CONTENT_SKEWED,
+	CONTENT_RANDOM,
+	CONTENT_COUNT
+} Content;
+bool bench(const Config *config);
+bool fuzz(const Config *config);
+#define LARGEST_PACKET ENET_PROTOCOL_MAXIMUM_MTU
+// Room for the coded stream of a packet that does not compress
+#define CODED_BUFFER_SIZE (2 * LARGEST_PACKET)
+#define FUZZ_COUNT 100000
+#define FUZZ_SEED 1
+// The hash of the coded streams for FUZZ_COUNT packets from FUZZ_SEED
+#define FUZZ_HASH 0x1e3e0e37u
+
+
+static const char *const content_names[CONTENT_COUNT] = { "text", "skewed", "random" };
+static const size_t sizes[] = { 32, 64, 128, 256, 576, 1400, LARGEST_PACKET };
+#define SIZE_COUNT (sizeof sizes / sizeof sizes[0])
+
+
+static void usage(const char *program)
+{
+	fprintf(stderr,
+		"Usage: %s [options] [bench|fuzz]\n"
+		"  -m MB     megabytes to compress per measurement (default 8)\n"
+		"  -i COUNT  measurements per packet size, the best is reported (default 3)\n"
+		"  -n COUNT  packets to fuzz (default %d)\n"
+		"  -s SEED   seed for generating packets (default %d)\n",
+		program, FUZZ_COUNT, FUZZ_SEED);
+}
+
+int main(int argc, char *argv[])
+{
+	Config config = { 8.0 * 1024 * 1024, 3, FUZZ_COUNT, FUZZ_SEED };
+	const char *mode = NULL;
+	for (int i = 1; i < argc; i++)
+	{
+		const char *arg = argv[i];
+		if (arg[0] != '-' && mode == NULL && i + 1 == argc)
+		{
+			mode = arg;
+			break;
+		}
+		if (arg[0] != '-' || arg[1] == '\0' || arg[2] != '\0' || i + 1 >= argc)
+		{
+			usage(argv[0]);
+			return 1;
+		}
+		const char *value = argv[++i];
+		switch (arg[1])
+		{
+			case 'm':
+				config.bytes = atof(value) * 1024 * 1024;
+				break;
+			case 'i':
+				config.iterations = atoi(value);
+				break;
+			case 'n':
+				config.count = strtoul(value, NULL, 10);
+				break;
+			case 's':
+				config.seed = (enet_uint32)strtoul(value, NULL, 10);
+				break;
+			default:
+				usage(argv[0]);
+				return 1;
+		}
+	}
+	if (config.bytes <= 0 || config.iterations <= 0 || config.count == 0 ||
+		(mode != NULL && strcmp(mode, "bench") != 0 && strcmp(mode, "fuzz") != 0))
+	{
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (enet_initialize() != 0)
+	{
+		fprintf(stderr, "An error occurred while initializing ENet\n");
+		return 1;
+	}
+	bool ok = true;
+	if (mode == NULL || strcmp(mode, "fuzz") == 0)
+	{
+		ok = fuzz(&config) && ok;
+	}
+	if (ok && (mode == NULL || strcmp(mode, "bench") == 0))
+	{
+		ok = bench(&config) && ok;
+	}
+	enet_deinitialize();
+	return ok ? 0 : 1;
+}
+
+
+static double now_ns(void)
+{
+#ifdef _WINDOWS
+	static LARGE_INTEGER frequency;
+	LARGE_INTEGER counter;
+	if (frequency.QuadPart == 0)
+	{
+		QueryPerformanceFrequency(&frequency);
+	}
+	QueryPerformanceCounter(&counter);
+	return (double)counter.QuadPart * 1e9 / (double)frequency.QuadPart;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+#endif
+}
+
+static enet_uint32 next_random(enet_uint32 *state)
+{
+	// xorshift32, so a seed generates the same packets everywhere
+	enet_uint32 x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+	return x;
+}
+
+static void fill_packet(enet_uint8 *packet, size_t length, Content content, enet_uint32 *random)
+{
+	static const char *const words[] =
+	{
+		"hi", "hello", "anyone", "here", "lol", "ok", "yes", "no", "the",
+		"a", "is", "it", "that", "to", "and", "you", "I", "game", "map",
+		"round", "ready", "wait", "brb", "back", "gg", "nice", "shot",
+		"Client", "says:", "connected", "disconnected", "!", "?", ":)",
+	};
+	const size_t word_count = sizeof words / sizeof words[0];
+	size_t i = 0;
+	switch (content)
+	{
+		case CONTENT_TEXT:
+			while (i < length)
+			{
+				const char *word = words[next_random(random) % word_count];
+				while (*word != '\0' && i < length)
+				{
+					packet[i++] = (enet_uint8)*word++;
+				}
+				if (i < length)
+				{
+					packet[i++] = ' ';
+				}
+			}
+			break;
+		case CONTENT_SKEWED:
+			// A byte shifted down by up to 7 bits, so small values are far
+			// more likely
+			for (; i < length; i++)
+			{
+				enet_uint32 x = next_random(random);
+				packet[i] = (enet_uint8)((x & 0xFF) >> ((x >> 8) & 7));
+			}
+			break;
+		default:
+			for (; i < length; i++)
+			{
+				packet[i] = (enet_uint8)next_random(random);
+			}
+			break;
+	}
+}
+
+bool bench(const Config *config)
+{
+	static enet_uint8 packet[LARGEST_PACKET], compressed[CODED_BUFFER_SIZE], decompressed[LARGEST_PACKET];
+	void *context = enet_range_coder_create();
+	if (context == NULL)
+	{
+		fprintf(stderr, "Failed to create the range coder\n");
+		return false;
+	}
+	printf("%-20s", "");
+	for (size_t k = 0; k < SIZE_COUNT; k++)
+	{
+		printf(" %8lu", (unsigned long)sizes[k]);
+	}
+	printf("\n");
+	for (int content = 0; content < CONTENT_COUNT; content++)
+	{
+		double ratio[SIZE_COUNT], compress[SIZE_COUNT], decompress[SIZE_COUNT];
+		for (size_t k = 0; k < SIZE_COUNT; k++)
+		{
+			size_t size = sizes[k];
+			enet_uint32 random = config->seed != 0 ? config->seed : 1;
+			fill_packet(packet, size, (Content)content, &random);
+			ENetBuffer buffer = { .data = packet, .dataLength = size };
+			// Packets that do not compress are measured all the same, with
+			// room for the coded stream to grow
+			size_t length = enet_range_coder_compress(context, &buffer, 1, size, compressed, sizeof compressed);
+			if (length == 0 || enet_range_coder_decompress(context, compressed, length, decompressed, size) != size ||
+				memcmp(packet, decompressed, size) != 0)
+			{
+				fprintf(stderr, "The range coder does not round trip %lu %s bytes\n",
+					(unsigned long)size, content_names[content]);
+				enet_range_coder_destroy(context);
+				return false;
+			}
+			ratio[k] = (double)length / size;
+			size_t calls = (size_t)(config->bytes / size) + 1;
+			volatile size_t sink = 0;
+			compress[k] = decompress[k] = 0;
+			for (int i = 0; i < config->iterations; i++)
+			{
+				double start = now_ns();
+				for (size_t j = 0; j < calls; j++)
+				{
+					sink += enet_range_coder_compress(context, &buffer, 1, size, compressed, sizeof compressed);
+				}
+				double rate = (double)calls * size * 1e3 / (now_ns() - start);
+				compress[k] = rate > compress[k] ? rate : compress[k];
+
+				start = now_ns();
+				for (size_t j = 0; j < calls; j++)
+				{
+					sink += enet_range_coder_decompress(context, compressed, length, decompressed, size);
+				}
+				rate = (double)calls * size * 1e3 / (now_ns() - start);
+				decompress[k] = rate > decompress[k] ? rate : decompress[k];
+			}
+			(void)sink;
+		}
+		char name[32];
+		snprintf(name, sizeof name, "%s ratio", content_names[content]);
+		printf("%-20s", name);
+		for (size_t k = 0; k < SIZE_COUNT; k++)
+		{
+			printf(" %8.3f", ratio[k]);
+		}
+		snprintf(name, sizeof name, "%s compress MB/s", content_names[content]);
+		printf("\n%-20s", name);
+		for (size_t k = 0; k < SIZE_COUNT; k++)
+		{
+			printf(" %8.1f", compress[k]);
+		}
+		snprintf(name, sizeof name, "%s decompress MB/s", content_names[content]);
+		printf("\n%-20s", name);
+		for (size_t k = 0; k < SIZE_COUNT; k++)
+		{
+			printf(" %8.1f", decompress[k]);
+		}
+		printf("\n");
+		fflush(stdout);
+	}
+	enet_range_coder_destroy(context);
+	return true;
+}
+
+static enet_uint32 hash_bytes(enet_uint32 hash, const enet_uint8 *data, size_t length)
+{
+	// FNV-1a
+	for (size_t i = 0; i < length; i++)
+	{
+		hash = (hash ^ data[i]) * 16777619u;
+	}
+	return hash;
+}
+
+// Decompresses into a buffer of limit bytes followed by a guard and checks
+// that the guard is left alone
+static bool decompress_guarded(void *context, const enet_uint8 *data, size_t length, size_t limit, size_t *result)
+{
+	static enet_uint8 out[LARGEST_PACKET + 16];
+	memset(out + limit, 0xA5, 16);
+	*result = enet_range_coder_decompress(context, data, length, out, limit);
+	for (size_t i = limit; i < limit + 16; i++)
+	{
+		if (out[i] != 0xA5)
+		{
+			return false;
+		}
+	}
+	return *result <= limit;
+}
+
+bool fuzz(const Config *config)
+{
+	static enet_uint8 packet[LARGEST_PACKET], compressed[CODED_BUFFER_SIZE], decompressed[LARGEST_PACKET];
+	enet_uint32 random = config->seed != 0 ? config->seed : 1;
+	enet_uint32 hash = 2166136261u;
+	size_t compressible = 0;
+	void *context = enet_range_coder_create();
+	if (context == NULL)
+	{
+		fprintf(stderr, "Failed to create the range coder\n");
+		return false;
+	}
+	for (size_t n = 0; n < config->count; n++)
+	{
+		// Mostly small packets, as ENet compresses whole datagrams
+		enet_uint32 pick = next_random(&random);
+		size_t length = 1 + next_random(&random) % ((pick & 3) == 0 ? LARGEST_PACKET : 256);
+		Content content = (Content)((pick >> 2) % CONTENT_COUNT);
+		fill_packet(packet, length, content, &random);
+
+		ENetBuffer buffers[4];
+		size_t buffer_count = 1 + (pick >> 4) % 4, offset = 0;
+		for (size_t i = 0; i < buffer_count; i++)
+		{
+			size_t part = i + 1 < buffer_count ? next_random(&random) % (length - offset + 1) : length - offset;
+			buffers[i].data = packet + offset;
+			buffers[i].dataLength = part;
+			offset += part;
+		}
+
+		// ENet only sends packets that shrink
+		size_t result = enet_range_coder_compress(context, buffers, buffer_count, length, compressed, length);
+		enet_uint8 result_bytes[2] = { (enet_uint8)(result >> 8), (enet_uint8)result };
+		hash = hash_bytes(hash, result_bytes, sizeof result_bytes);
+		hash = hash_bytes(hash, compressed, result);
+		if (result > 0)
+		{
+			compressible++;
+			if (enet_range_coder_decompress(context, compressed, result, decompressed, length) != length ||
+				memcmp(packet, decompressed, length) != 0)
+			{
+				fprintf(stderr, "Packet %lu of %lu %s bytes does not round trip\n",
+					(unsigned long)n, (unsigned long)length, content_names[content]);
+				enet_range_coder_destroy(context);
+				return false;
+			}
+		}
+		else
+		{
+			// Still check the coder on it, with room to grow
+			result = enet_range_coder_compress(context, buffers, buffer_count, length, compressed, sizeof compressed);
+		}
+
+		size_t decoded;
+		if (result > 0 &&
+			(!decompress_guarded(context, compressed, result, length - 1, &decoded) ||
+			 !decompress_guarded(context, compressed, result - 1 - next_random(&random) % result, length, &decoded)))
+		{
+			fprintf(stderr, "Packet %lu decompressed past its buffer when truncated\n", (unsigned long)n);
+			enet_range_coder_destroy(context);
+			return false;
+		}
+		if (result > 0)
+		{
+			compressed[next_random(&random) % result] ^= (enet_uint8)(1 + next_random(&random) % 255);
+			if (!decompress_guarded(context, compressed, result, length, &decoded))
+			{
+				fprintf(stderr, "Packet %lu decompressed past its buffer when corrupt\n", (unsigned long)n);
+				enet_range_coder_destroy(context);
+				return false;
+			}
+		}
+	}
+	enet_range_coder_destroy(context);
+
+	printf("fuzzed %lu packets, %lu compressible, hash %08lx\n",
+		(unsigned long)config->count, (unsigned long)compressible, (unsigned long)hash);
+	if (config->count == FUZZ_COUNT && config->seed == FUZZ_SEED && hash != FUZZ_HASH)
+	{
+		fprintf(stderr, "The coded streams differ from those of the previous range coder, expected hash %08lx\n",
+			(unsigned long)FUZZ_HASH);
+		return false;
+	}
+	return true;
+}
@@ -1,5 +1,7 @@
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <signal.h>
 
 #if ENET_LIB_CHOICE == ENET_LIB_CHOICE_ORIGINAL
@@ -8,11 +10,23 @@
 	#include <enet.h>
 #endif
 #include "common.h"
+#include "log.h"
+#include "pool.h"
 
 
 // Simple LAN chat server
 // Clients can send simple string messages to the server, which simply
 // gets broadcast to all connected clients.
+//
+// With -t the host is serviced on its own thread, so that acks and pings
+// keep flowing while the main loop prints or scans.
+//
+// Client events are handled on a pool of worker threads (-w sets how
+// many), in order for each client, and come back to the main loop in
+// batches to be broadcast.
+//
+// Output goes through an asynchronous log sink, so a slow terminal or pipe
+// on stdout never holds up the network loop.
 
 
 #ifdef _WINDOWS
@@ -29,24 +43,67 @@ typedef struct
 	ENetHost *host;
 	// The socket for listening and responding to client scans
 	ENetSocket listen;
+	// Everything printed to stdout goes through here
+	LogSink *log;
+	// Handles client events off the main loop
+	HandlerPool *pool;
+#if ENET_LIB_CHOICE == ENET_LIB_CHOICE_ORIGINAL
+	// Services the host when running threaded, otherwise NULL
+	ENetHostThread *thread;
+#endif
 } ENetLANServer;
-bool start_server(ENetLANServer *server);
+// A discovery probe as logged by listen_for_clients
+typedef struct
+{
+	ENetAddress from;
+	char probe;
+} ScanLog;
+// A client event on its way through the handler pool
+typedef struct
+{
+	// Must be first, the pool hands this back
+	PoolTask task;
+	ENetEventType type;
+	int client;
+	// The received message, destroyed once the event is back
+	ENetPacket *packet;
+	// What to broadcast, filled in by the handler
+	char text[256];
+} ChatEvent;
+bool start_server(ENetLANServer *server, bool threaded, int workers);
 void listen_for_clients(ENetLANServer *server);
-void send_string(ENetHost *host, char *s);
+int format_scan(char *out, size_t size, const void *data);
+int service_server(ENetLANServer *server, ENetEvent *event);
+void submit_event(ENetLANServer *server, const ENetEvent *event);
+void handle_event(PoolTask *task, void *context);
+void broadcast_handled(ENetLANServer *server, PoolTask *tasks);
+void send_string(ENetLANServer *server, char *s);
 void stop_server(ENetLANServer *server);
 #define MAX_CLIENTS 16
+#define DEFAULT_WORKERS 2
 
 
 int main(int argc, char *argv[])
 {
-	(void)argc;
-	(void)argv;
+	bool threaded = false;
+	int workers = DEFAULT_WORKERS;
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-t") == 0)
+		{
+			threaded = true;
+		}
+		else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc)
+		{
+			workers = atoi(argv[++i]);
+		}
+	}
 	// Stop server on interrupt
 	signal(SIGINT, sigint_handle);
 
 	// Start server
 	ENetLANServer server;
-	if (!start_server(&server))
+	if (!start_server(&server, threaded, workers))
 	{
 		return 1;
 	}
@@ -59,38 +116,17 @@ int main(int argc, char *argv[])
 		listen_for_clients(&server);
 
 		ENetEvent event;
-		check = enet_host_service(server.host, &event, 0);
+		check = service_server(&server, &event);
 		if (check > 0)
 		{
-			// Whenever a client connects or disconnects, broadcast a message
-			// Whenever a client says something, broadcast it including
-			// which client it was from
-			char buf[256];
-			switch (event.type)
-			{
-				case ENET_EVENT_TYPE_CONNECT:
-					sprintf(buf, "New client connected: id %d", event.peer->incomingPeerID);
-					send_string(server.host, buf);
-					printf("%s\n", buf);
-					break;
-				case ENET_EVENT_TYPE_RECEIVE:
-					sprintf(buf, "Client %d says: %s", event.peer->incomingPeerID, event.packet->data);
-					send_string(server.host, buf);
-					printf("%s\n", buf);
-					break;
-				case ENET_EVENT_TYPE_DISCONNECT:
-					sprintf(buf, "Client %d disconnected", event.peer->incomingPeerID);
-					send_string(server.host, buf);
-					printf("%s\n", buf);
-					break;
-				default:
-					break;
-			}
+			submit_event(&server, &event);
 		}
 		else if (check < 0)
 		{
 			fprintf(stderr, "Error servicing host\n");
 		}
+		// Broadcast whatever the pool has finished handling
+		broadcast_handled(&server, handler_pool_completed(server.pool));
 		// Sleep a bit so we don't consume 100% CPU
 		Sleep(1);
 	} while (!stop && check >= 0);
@@ -108,8 +144,22 @@ void sigint_handle(int signum)
 	}
 }
 
-bool start_server(ENetLANServer *server)
+bool start_server(ENetLANServer *server, bool threaded, int workers)
 {
+	// Start the log writer first so that all output goes through it
+	server->log = log_sink_create(1, 1024);
+	if (server->log == NULL)
+	{
+		fprintf(stderr, "Failed to start log writer\n");
+		return false;
+	}
+	server->pool = handler_pool_create(workers, handle_event, NULL);
+	if (server->pool == NULL)
+	{
+		fprintf(stderr, "Failed to start %d handler threads\n", workers);
+		return false;
+	}
+
 	// Start server
 	if (enet_initialize() != 0)
 	{
@@ -142,7 +192,9 @@ bool start_server(ENetLANServer *server)
 		fprintf(stderr, "Cannot get listen socket address\n");
 		return false;
 	}
-	printf("Listening for scans on port %d\n", listenaddr.port);
+	char buf[256];
+	snprintf(buf, sizeof buf, "Listening for scans on port %d", listenaddr.port);
+	log_sink_text(server->log, buf);
 
 	ENetAddress addr;
 	addr.host = ENET_HOST_ANY;
@@ -153,8 +205,29 @@ bool start_server(ENetLANServer *server)
 		fprintf(stderr, "Failed to open ENet host\n");
 		return false;
 	}
-	printf("ENet host started on port %d (press ctrl-C to exit)\n",
+	snprintf(buf, sizeof buf, "ENet host started on port %d (press ctrl-C to exit)",
 		server->host->address.port);
+	log_sink_text(server->log, buf);
+
+#if ENET_LIB_CHOICE == ENET_LIB_CHOICE_ORIGINAL
+	server->thread = NULL;
+	if (threaded)
+	{
+		server->thread = enet_host_thread_create(server->host, 256, 256, 1);
+		if (server->thread == NULL)
+		{
+			fprintf(stderr, "Failed to start host thread\n");
+			return false;
+		}
+		log_sink_text(server->log, "Host serviced on its own thread");
+	}
+#else
+	if (threaded)
+	{
+		fprintf(stderr, "Host threads are only available with the original ENet\n");
+		return false;
+	}
+#endif
 
 	return true;
 }
@@ -180,10 +253,12 @@ void listen_for_clients(ENetLANServer *server)
 	{
 		return;
 	}
-	char addrbuf[256];
-	enet_address_get_host_ip(&recvaddr, addrbuf, sizeof addrbuf);
-	printf("Listen port: received (%d) from %s:%d\n",
-		*(char *)recvbuf.data, addrbuf, recvaddr.port);
+	// Log the raw probe; the address is only turned into text on the
+	// log thread
+	ScanLog scan;
+	scan.from = recvaddr;
+	scan.probe = buf;
+	log_sink_write(server->log, format_scan, &scan, sizeof scan);
 	// Reply to scanner client with our info
 	ServerInfo sinfo;
 	if (enet_address_get_host(&server->host->address, sinfo.hostname, sizeof sinfo.hostname) != 0)
@@ -200,21 +275,129 @@ void listen_for_clients(ENetLANServer *server)
 	}
 }
 
-void send_string(ENetHost *host, char *s)
+int format_scan(char *out, size_t size, const void *data)
+{
+	const ScanLog *scan = data;
+	char addrbuf[256];
+	enet_address_get_host_ip(&scan->from, addrbuf, sizeof addrbuf);
+	return snprintf(out, size, "Listen port: received (%d) from %s:%d",
+		scan->probe, addrbuf, scan->from.port);
+}
+
+int service_server(ENetLANServer *server, ENetEvent *event)
+{
+#if ENET_LIB_CHOICE == ENET_LIB_CHOICE_ORIGINAL
+	if (server->thread != NULL)
+	{
+		return enet_host_thread_receive(server->thread, event);
+	}
+#endif
+	return enet_host_service(server->host, event, 0);
+}
+
+void submit_event(ENetLANServer *server, const ENetEvent *event)
+{
+	if (event->type != ENET_EVENT_TYPE_CONNECT &&
+		event->type != ENET_EVENT_TYPE_RECEIVE &&
+		event->type != ENET_EVENT_TYPE_DISCONNECT)
+	{
+		return;
+	}
+	ChatEvent *chat = malloc(sizeof *chat);
+	if (chat == NULL)
+	{
+		fprintf(stderr, "Out of memory, client event dropped\n");
+		if (event->type == ENET_EVENT_TYPE_RECEIVE)
+		{
+			enet_packet_destroy(event->packet);
+		}
+		return;
+	}
+	chat->type = event->type;
+	chat->client = event->peer->incomingPeerID;
+	chat->packet = event->type == ENET_EVENT_TYPE_RECEIVE ? event->packet : NULL;
+	// Keyed by client, so each client's events are handled in order
+	handler_pool_submit(server->pool, (unsigned)chat->client, &chat->task);
+}
+
+// Runs on the pool's worker threads, so it must not touch the host
+void handle_event(PoolTask *task, void *context)
+{
+	(void)context;
+	ChatEvent *chat = (ChatEvent *)task;
+	// Whenever a client connects or disconnects, broadcast a message
+	// Whenever a client says something, broadcast it including
+	// which client it was from
+	switch (chat->type)
+	{
+		case ENET_EVENT_TYPE_CONNECT:
+			snprintf(chat->text, sizeof chat->text, "New client connected: id %d", chat->client);
+			break;
+		case ENET_EVENT_TYPE_RECEIVE:
+		{
+			// Stop at the end of the packet if the string is not terminated
+			const char *data = (const char *)chat->packet->data;
+			const char *end = memchr(data, '\0', chat->packet->dataLength);
+			const int length = (int)(end != NULL ? (size_t)(end - data) : chat->packet->dataLength);
+			snprintf(chat->text, sizeof chat->text, "Client %d says: %.*s", chat->client, length, data);
+			break;
+		}
+		default:
+			snprintf(chat->text, sizeof chat->text, "Client %d disconnected", chat->client);
+			break;
+	}
+}
+
+void broadcast_handled(ENetLANServer *server, PoolTask *tasks)
+{
+	while (tasks != NULL)
+	{
+		ChatEvent *chat = (ChatEvent *)tasks;
+		tasks = tasks->next;
+		send_string(server, chat->text);
+		log_sink_text(server->log, chat->text);
+		if (chat->packet != NULL)
+		{
+			enet_packet_destroy(chat->packet);
+		}
+		free(chat);
+	}
+}
+
+void send_string(ENetLANServer *server, char *s)
 {
 	ENetPacket *packet = enet_packet_create(
 		s, strlen(s) + 1, ENET_PACKET_FLAG_RELIABLE);
-	enet_host_broadcast(host, 0, packet);
+#if ENET_LIB_CHOICE == ENET_LIB_CHOICE_ORIGINAL
+	if (server->thread != NULL)
+	{
+		if (enet_host_thread_broadcast(server->thread, 0, packet) != 0)
+		{
+			fprintf(stderr, "Host thread is falling behind, message dropped\n");
+			enet_packet_destroy(packet);
+		}
+		return;
+	}
+#endif
+	enet_host_broadcast(server->host, 0, packet);
 }
 
 void stop_server(ENetLANServer *server)
 {
-	printf("Server closing\n");
+	log_sink_text(server->log, "Server closing");
+	broadcast_handled(server, handler_pool_destroy(server->pool));
 	if (enet_socket_shutdown(server->listen, ENET_SOCKET_SHUTDOWN_READ_WRITE) != 0)
 	{
 		fprintf(stderr, "Failed to shutdown listen socket\n");
 	}
 	enet_socket_destroy(server->listen);
+#if ENET_LIB_CHOICE == ENET_LIB_CHOICE_ORIGINAL
+	if (server->thread != NULL)
+	{
+		enet_host_thread_destroy(server->thread);
+	}
+#endif
 	enet_host_destroy(server->host);
 	enet_deinitialize();
+	log_sink_destroy(server->log);
 }
@@ -0,0 +1,347 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if ENET_LIB_CHOICE == ENET_LIB_CHOICE_ORIGINAL
+	#include <enet/enet.h>
+#else
+	#include <enet.h>
+#endif
+
+
+// Host startup benchmark
+// Measures what provisioning a host for many peers costs when few of them
+// are used. Connects a few clients from a second host, as a server usually
+// sees at first, and reports the heap of both hosts and the growth of the
+// resident memory of the process with them connected. Then measures the
+// time enet_host_create and enet_host_destroy take, and the heap a host
+// holds before anyone connects.
+//
+// Heap use is counted by the allocator ENet is initialized with, so it is
+// exact and the same on every platform. Resident memory is only reported
+// where the process can read it, on Linux.
+
+
+#ifdef _WINDOWS
+#include <windows.h>
+#else
+#include <time.h>
+#include <unistd.h>
+#endif
+typedef struct
+{
+	int peers;
+	int clients;
+	int iterations;
+} Config;
+typedef struct
+{
+	double *samples;
+	size_t count;
+	size_t capacity;
+} Samples;
+bool run(const Config *config);
+void samples_add(Samples *samples, double value);
+void samples_print(const char *name, Samples *samples);
+void samples_destroy(Samples *samples);
+#define CONNECT_SECONDS 30
+#define CONNECT_BATCH 64
+
+
+// Every allocation is preceded by its size, so frees can be counted too
+typedef union
+{
+	size_t size;
+	double align;
+} AllocationHeader;
+
+static size_t heap_bytes;
+
+static void *ENET_CALLBACK counting_malloc(size_t size)
+{
+	AllocationHeader *header = malloc(sizeof *header + size);
+	if (header == NULL)
+	{
+		return NULL;
+	}
+	header->size = size;
+	heap_bytes += size;
+	return header + 1;
+}
+
+static void ENET_CALLBACK counting_free(void *memory)
+{
+	if (memory == NULL)
+	{
+		return;
+	}
+	AllocationHeader *header = (AllocationHeader *)memory - 1;
+	heap_bytes -= header->size;
+	free(header);
+}
+
+
+static void usage(const char *program)
+{
+	fprintf(stderr,
+		"Usage: %s [options]\n"
+		"  -n COUNT    peers to provision the host for (default 4095)\n"
+		"  -c COUNT    clients to connect (default 10)\n"
+		"  -i COUNT    hosts to create and destroy (default 200)\n",
+		program);
+}
+
+int main(int argc, char *argv[])
+{
+	Config config = { 4095, 10, 200 };
+	for (int i = 1; i < argc; i++)
+	{
+		const char *arg = argv[i];
+		if (arg[0] != '-' || arg[1] == '\0' || arg[2] != '\0' || i + 1 >= argc)
+		{
+			usage(argv[0]);
+			return 1;
+		}
+		const char *value = argv[++i];
+		switch (arg[1])
+		{
+			case 'n':
+				config.peers = atoi(value);
+				break;
+			case 'c':
+				config.clients = atoi(value);
+				break;
+			case 'i':
+				config.iterations = atoi(value);
+				break;
+			default:
+				usage(argv[0]);
+				return 1;
+		}
+	}
+	if (config.peers <= 0 || config.clients < 0 || config.clients > config.peers || config.iterations <= 0)
+	{
+		usage(argv[0]);
+		return 1;
+	}
+
+	ENetCallbacks callbacks;
+	memset(&callbacks, 0, sizeof callbacks);
+	callbacks.malloc = counting_malloc;
+	callbacks.free = counting_free;
+	if (enet_initialize_with_callbacks(ENET_VERSION, &callbacks) != 0)
+	{
+		fprintf(stderr, "An error occurred while initializing ENet\n");
+		return 1;
+	}
+	bool ok = run(&config);
+	enet_deinitialize();
+	return ok ? 0 : 1;
+}
+
+static double now_us(void)
+{
+#ifdef _WINDOWS
+	static LARGE_INTEGER frequency;
+	LARGE_INTEGER counter;
+	if (frequency.QuadPart == 0)
+	{
+		QueryPerformanceFrequency(&frequency);
+	}
+	QueryPerformanceCounter(&counter);
+	return (double)counter.QuadPart * 1e6 / (double)frequency.QuadPart;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec * 1e6 + (double)ts.tv_nsec / 1e3;
+#endif
+}
+
+// Resident memory of the process in bytes, or 0 where it cannot be read
+static size_t resident_bytes(void)
+{
+#ifdef __linux__
+	FILE *file = fopen("/proc/self/statm", "r");
+	unsigned long size = 0, resident = 0;
+	if (file == NULL)
+	{
+		return 0;
+	}
+	if (fscanf(file, "%lu %lu", &size, &resident) != 2)
+	{
+		resident = 0;
+	}
+	fclose(file);
+	return (size_t)resident * (size_t)sysconf(_SC_PAGESIZE);
+#else
+	return 0;
+#endif
+}
+
+static void service(ENetHost *server, ENetHost *client)
+{
+	ENetEvent event;
+	while (enet_host_service(server, &event, 0) > 0)
+	{
+	}
+	while (enet_host_service(client, &event, 0) > 0)
+	{
+	}
+}
+
+// Connects the clients a batch at a time, as a burst of connections
+// overflows the socket buffers of the server, and services both hosts until
+// the server has all its peers, or gives up
+static bool connect_all(ENetHost *server, ENetHost *client, int client_count)
+{
+	ENetAddress address = server->address;
+	enet_address_set_host(&address, "127.0.0.1");
+	double end = now_us() + CONNECT_SECONDS * 1e6;
+	int issued = 0;
+	while (issued < client_count || server->connectedPeers < (size_t)issued)
+	{
+		if (now_us() > end)
+		{
+			fprintf(stderr, "Only %lu of the clients connected\n", (unsigned long)server->connectedPeers);
+			return false;
+		}
+		while (issued < client_count && (size_t)issued < server->connectedPeers + CONNECT_BATCH)
+		{
+			if (enet_host_connect(client, &address, 1, 0) == NULL)
+			{
+				fprintf(stderr, "Failed to connect\n");
+				return false;
+			}
+			issued++;
+		}
+		service(server, client);
+	}
+	return true;
+}
+
+bool run(const Config *config)
+{
+	ENetAddress address;
+	enet_address_set_host(&address, "127.0.0.1");
+	address.port = ENET_PORT_ANY;
+	printf("host for %d peers\n", config->peers);
+
+	size_t resident_before = resident_bytes();
+	size_t heap_before = heap_bytes;
+	ENetHost *server = enet_host_create(&address, config->peers, 1, 0, 0);
+	ENetHost *client = enet_host_create(NULL, config->clients > 0 ? config->clients : 1, 1, 0, 0);
+	bool ok = server != NULL && client != NULL;
+	if (!ok)
+	{
+		fprintf(stderr, "Failed to create ENet hosts\n");
+	}
+	else if (connect_all(server, client, config->clients))
+	{
+		// Both hosts are counted, the client one being provisioned for just
+		// the clients
+		printf("%-24s %9.1f KiB\n", "heap with clients", (heap_bytes - heap_before) / 1024.0);
+		size_t resident_after = resident_bytes();
+		if (resident_before != 0 && resident_after != 0)
+		{
+			printf("%-24s %9.1f KiB\n", "resident with clients",
+				resident_after > resident_before ? (resident_after - resident_before) / 1024.0 : 0.0);
+		}
+		printf("%-24s %9d\n", "clients connected", config->clients);
+	}
+	else
+	{
+		ok = false;
+	}
+	if (client != NULL)
+	{
+		enet_host_destroy(client);
+	}
+	if (server != NULL)
+	{
+		enet_host_destroy(server);
+	}
+	if (!ok)
+	{
+		return false;
+	}
+
+	Samples create, destroy;
+	memset(&create, 0, sizeof create);
+	memset(&destroy, 0, sizeof destroy);
+	size_t host_bytes = 0;
+	for (int i = 0; i < config->iterations; i++)
+	{
+		size_t before = heap_bytes;
+		double start = now_us();
+		ENetHost *host = enet_host_create(&address, config->peers, 1, 0, 0);
+		samples_add(&create, now_us() - start);
+		if (host == NULL)
+		{
+			fprintf(stderr, "Failed to create an ENet host\n");
+			samples_destroy(&create);
+			samples_destroy(&destroy);
+			return false;
+		}
+		host_bytes = heap_bytes - before;
+		start = now_us();
+		enet_host_destroy(host);
+		samples_add(&destroy, now_us() - start);
+	}
+	printf("%-24s %9s %9s %9s %9s %9s\n", "", "calls", "mean us", "p50 us", "p99 us", "max us");
+	samples_print("enet_host_create", &create);
+	samples_print("enet_host_destroy", &destroy);
+	samples_destroy(&create);
+	samples_destroy(&destroy);
+	printf("%-24s %9.1f KiB\n", "heap after create", host_bytes / 1024.0);
+
+	return true;
+}
+
+void samples_add(Samples *samples, double value)
+{
+	if (samples->count == samples->capacity)
+	{
+		size_t capacity = samples->capacity > 0 ? samples->capacity * 2 : 1024;
+		double *grown = realloc(samples->samples, capacity * sizeof *grown);
+		if (grown == NULL)
+		{
+			return;
+		}
+		samples->samples = grown;
+		samples->capacity = capacity;
+	}
+	samples->samples[samples->count++] = value;
+}
+
+static int compare_samples(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+	return x < y ? -1 : x > y;
+}
+
+void samples_print(const char *name, Samples *samples)
+{
+	if (samples->count == 0)
+	{
+		printf("%-24s %9d\n", name, 0);
+		return;
+	}
+	qsort(samples->samples, samples->count, sizeof *samples->samples, compare_samples);
+	double total = 0;
+	for (size_t i = 0; i < samples->count; i++)
+	{
+		total += samples->samples[i];
+	}
+	printf("%-24s %9lu %9.2f %9.2f %9.2f %9.2f\n", name, (unsigned long)samples->count,
+		total / samples->count,
+		samples->samples[samples->count / 2],
+		samples->samples[samples->count * 99 / 100],
+		samples->samples[samples->count - 1]);
+}
+
+void samples_destroy(Samples *samples)
+{
+	free(samples->samples);
+	memset(samples, 0, sizeof *samples);
+}
@@ -0,0 +1,310 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if ENET_LIB_CHOICE == ENET_LIB_CHOICE_ORIGINAL
+	#include <enet/enet.h>
+#else
+	#include <enet.h>
+#endif
+
+
+// Peer sweep benchmark
+// Connects a server host to a full set of idle clients and measures the
+// passes over all its peers that every service makes: the send pass of
+// enet_host_flush and a whole enet_host_service that finds no datagrams.
+// Both only look at a few fields of each peer, so their cost follows from
+// how many cache lines the peers span, which is what building ENet with
+// ENET_PEER_COLD_SPLIT changes. Run it against both builds to compare.
+//
+// Clients and server run in this one process and talk over the loopback
+// interface. The clients are serviced between measurements so that the
+// connections stay up.
+
+
+#ifdef _WINDOWS
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+typedef struct
+{
+	int peers;
+	int iterations;
+} Config;
+typedef struct
+{
+	double *samples;
+	size_t count;
+	size_t capacity;
+} Samples;
+bool run(const Config *config);
+void samples_add(Samples *samples, double value);
+void samples_print(const char *name, Samples *samples);
+void samples_destroy(Samples *samples);
+#define CONNECT_SECONDS 60
+#define CONNECT_BATCH 64
+// Peers of each client host, which only has 12-bit peer IDs for connecting
+#define CLIENT_PEERS 2048
+
+
+static void usage(const char *program)
+{
+	fprintf(stderr,
+		"Usage: %s [options]\n"
+		"  -n COUNT    number of peers (default 4095)\n"
+		"  -i COUNT    sweeps to measure (default 2000)\n",
+		program);
+}
+
+int main(int argc, char *argv[])
+{
+	Config config = { 4095, 2000 };
+	for (int i = 1; i < argc; i++)
+	{
+		const char *arg = argv[i];
+		if (arg[0] != '-' || arg[1] == '\0' || arg[2] != '\0' || i + 1 >= argc)
+		{
+			usage(argv[0]);
+			return 1;
+		}
+		const char *value = argv[++i];
+		switch (arg[1])
+		{
+			case 'n':
+				config.peers = atoi(value);
+				break;
+			case 'i':
+				config.iterations = atoi(value);
+				break;
+			default:
+				usage(argv[0]);
+				return 1;
+		}
+	}
+	if (config.peers <= 0 || config.iterations <= 0)
+	{
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (enet_initialize() != 0)
+	{
+		fprintf(stderr, "An error occurred while initializing ENet\n");
+		return 1;
+	}
+	bool ok = run(&config);
+	enet_deinitialize();
+	return ok ? 0 : 1;
+}
+
+#if ENET_LIB_CHOICE == ENET_LIB_CHOICE_ORIGINAL
+
+static double now_us(void)
+{
+#ifdef _WINDOWS
+	static LARGE_INTEGER frequency;
+	LARGE_INTEGER counter;
+	if (frequency.QuadPart == 0)
+	{
+		QueryPerformanceFrequency(&frequency);
+	}
+	QueryPerformanceCounter(&counter);
+	return (double)counter.QuadPart * 1e6 / (double)frequency.QuadPart;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec * 1e6 + (double)ts.tv_nsec / 1e3;
+#endif
+}
+
+static void service(ENetHost *server, ENetHost **clients, int client_count)
+{
+	ENetEvent event;
+	while (server != NULL && enet_host_service(server, &event, 0) > 0)
+	{
+	}
+	for (int i = 0; i < client_count; i++)
+	{
+		while (clients[i] != NULL && enet_host_service(clients[i], &event, 0) > 0)
+		{
+		}
+	}
+}
+
+// Connects the clients a batch at a time, as a burst of connections
+// overflows the socket buffers of the server, and services every host until
+// the server has all its peers, or gives up
+static bool connect_all(ENetHost *server, ENetHost **clients, int client_count)
+{
+	ENetAddress address = server->address;
+	enet_address_set_host(&address, "127.0.0.1");
+	double end = now_us() + CONNECT_SECONDS * 1e6;
+	int client = 0;
+	size_t issued = 0, connecting = 0;
+	while (client < client_count || server->connectedPeers < connecting)
+	{
+		if (now_us() > end)
+		{
+			fprintf(stderr, "Only %lu of the peers connected\n", (unsigned long)server->connectedPeers);
+			return false;
+		}
+		while (client < client_count && connecting < server->connectedPeers + CONNECT_BATCH)
+		{
+			if (issued == clients[client]->peerCount)
+			{
+				client++;
+				issued = 0;
+				continue;
+			}
+			if (enet_host_connect(clients[client], &address, 1, 0) == NULL)
+			{
+				fprintf(stderr, "Failed to connect\n");
+				return false;
+			}
+			issued++;
+			connecting++;
+		}
+		service(server, clients, client_count);
+	}
+	return true;
+}
+
+bool run(const Config *config)
+{
+	bool ok = false;
+	int client_count = (config->peers + CLIENT_PEERS - 1) / CLIENT_PEERS;
+	ENetHost **clients = calloc(client_count, sizeof *clients);
+	ENetAddress address;
+	enet_address_set_host(&address, "127.0.0.1");
+	address.port = ENET_PORT_ANY;
+	ENetHost *server = enet_host_create(&address, config->peers, 1, 0, 0);
+	if (server == NULL || clients == NULL)
+	{
+		fprintf(stderr, "Failed to open ENet hosts\n");
+		goto failed;
+	}
+	for (int i = 0; i < client_count; i++)
+	{
+		int peers = config->peers - i * CLIENT_PEERS < CLIENT_PEERS ? config->peers - i * CLIENT_PEERS : CLIENT_PEERS;
+		clients[i] = enet_host_create(NULL, peers, 1, 0, 0);
+		if (clients[i] == NULL)
+		{
+			fprintf(stderr, "Failed to open ENet hosts\n");
+			goto failed;
+		}
+	}
+	if (!connect_all(server, clients, client_count))
+	{
+		goto failed;
+	}
+#ifdef ENET_PEER_COLD_SPLIT
+	printf("%d peers, %lu bytes each and %lu in the side table\n", config->peers,
+		(unsigned long)sizeof(ENetPeer), (unsigned long)sizeof(ENetPeerCold));
+#else
+	printf("%d peers, %lu bytes each\n", config->peers, (unsigned long)sizeof(ENetPeer));
+#endif
+	printf("%-24s %9s %9s %9s %9s %9s\n", "", "calls", "mean us", "p50 us", "p99 us", "max us");
+
+	Samples flush, idle;
+	memset(&flush, 0, sizeof flush);
+	memset(&idle, 0, sizeof idle);
+	ENetEvent event;
+	for (int i = 0; i < config->iterations; i++)
+	{
+		double start = now_us();
+		enet_host_flush(server);
+		samples_add(&flush, now_us() - start);
+
+		start = now_us();
+		if (enet_host_service(server, &event, 0) == 0)
+		{
+			samples_add(&idle, now_us() - start);
+		}
+
+		// Drain what the sweeps sent, such as pings, so the clients keep
+		// answering them and nothing is measured with a backlog
+		service(NULL, clients, client_count);
+	}
+
+	samples_print("flush", &flush);
+	samples_print("service without events", &idle);
+	samples_destroy(&flush);
+	samples_destroy(&idle);
+	ok = true;
+
+failed:
+	for (int i = 0; clients != NULL && i < client_count; i++)
+	{
+		if (clients[i] != NULL)
+		{
+			enet_host_destroy(clients[i]);
+		}
+	}
+	free(clients);
+	if (server != NULL)
+	{
+		enet_host_destroy(server);
+	}
+	return ok;
+}
+
+#else
+
+bool run(const Config *config)
+{
+	(void)config;
+	fprintf(stderr, "The peer sweep benchmark needs the peer layout of the original ENet\n");
+	return false;
+}
+
+#endif
+
+void samples_add(Samples *samples, double value)
+{
+	if (samples->count == samples->capacity)
+	{
+		size_t capacity = samples->capacity > 0 ? samples->capacity * 2 : 1024;
+		double *grown = realloc(samples->samples, capacity * sizeof *grown);
+		if (grown == NULL)
+		{
+			return;
+		}
+		samples->samples = grown;
+		samples->capacity = capacity;
+	}
+	samples->samples[samples->count++] = value;
+}
+
+static int compare_samples(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+	return x < y ? -1 : x > y;
+}
+
+void samples_print(const char *name, Samples *samples)
+{
+	if (samples->count == 0)
+	{
+		printf("%-24s %9d\n", name, 0);
+		return;
+	}
+	qsort(samples->samples, samples->count, sizeof *samples->samples, compare_samples);
+	double total = 0;
+	for (size_t i = 0; i < samples->count; i++)
+	{
+		total += samples->samples[i];
+	}
+	printf("%-24s %9lu %9.2f %9.2f %9.2f %9.2f\n", name, (unsigned long)samples->count,
+		total / samples->count,
+		samples->samples[samples->count / 2],
+		samples->samples[samples->count * 99 / 100],
+		samples->samples[samples->count - 1]);
+}
+
+void samples_destroy(Samples *samples)
+{
+	free(samples->samples);
+	memset(samples, 0, sizeof *samples);
+}
@@ -0,0 +1,67 @@
+#pragma once
+// Threads, locks and atomics for the server's helpers, over Win32 or
+// pthreads, so that they build against every ENET_LIB_CHOICE
+
+#ifdef _WIN32
+#include <windows.h>
+
+typedef HANDLE Thread;
+typedef DWORD ThreadResult;
+#define THREAD_CALL WINAPI
+// Starts entry(arg) on a new thread; true on success
+#define thread_create(t, entry, arg) \
+	((*(t) = CreateThread(NULL, 0, (entry), (arg), 0, NULL)) != NULL)
+#define thread_join(t) \
+	((void)WaitForSingleObject((t), INFINITE), (void)CloseHandle(t))
+
+typedef CRITICAL_SECTION Mutex;
+typedef CONDITION_VARIABLE Condition;
+#define mutex_init(m) InitializeCriticalSection(m)
+#define mutex_destroy(m) DeleteCriticalSection(m)
+#define mutex_lock(m) EnterCriticalSection(m)
+#define mutex_unlock(m) LeaveCriticalSection(m)
+#define condition_init(c) InitializeConditionVariable(c)
+#define condition_destroy(c) ((void)(c))
+#define condition_wait(c, m) SleepConditionVariableCS((c), (m), INFINITE)
+#define condition_signal(c) WakeConditionVariable(c)
+#define condition_broadcast(c) WakeAllConditionVariable(c)
+#else
+#include <pthread.h>
+
+typedef pthread_t Thread;
+typedef void *ThreadResult;
+#define THREAD_CALL
+#define thread_create(t, entry, arg) \
+	(pthread_create((t), NULL, (entry), (arg)) == 0)
+#define thread_join(t) ((void)pthread_join((t), NULL))
+
+typedef pthread_mutex_t Mutex;
+typedef pthread_cond_t Condition;
+#define mutex_init(m) pthread_mutex_init((m), NULL)
+#define mutex_destroy(m) pthread_mutex_destroy(m)
+#define mutex_lock(m) pthread_mutex_lock(m)
+#define mutex_unlock(m) pthread_mutex_unlock(m)
+#define condition_init(c) pthread_cond_init((c), NULL)
+#define condition_destroy(c) pthread_cond_destroy(c)
+#define condition_wait(c, m) pthread_cond_wait((c), (m))
+#define condition_signal(c) pthread_cond_signal(c)
+#define condition_broadcast(c) pthread_cond_broadcast(c)
+#endif
+
+// Atomics on volatile unsigned; loads acquire and stores release, while
+// the compare-and-swap and the fence order everything
+#ifdef _MSC_VER
+#define ATOMIC_LOAD(p) ((unsigned)InterlockedOr((volatile LONG *)(p), 0))
+#define ATOMIC_STORE(p, v) ((void)InterlockedExchange((volatile LONG *)(p), (LONG)(v)))
+#define ATOMIC_CAS(p, expected, desired) \
+	(InterlockedCompareExchange((volatile LONG *)(p), (LONG)(desired), (LONG)(expected)) == (LONG)(expected))
+#define ATOMIC_INCREMENT(p) ((void)InterlockedIncrement((volatile LONG *)(p)))
+#define ATOMIC_FENCE() MemoryBarrier()
+#else
+#define ATOMIC_LOAD(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define ATOMIC_STORE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define ATOMIC_CAS(p, expected, desired) \
+	__sync_bool_compare_and_swap((p), (expected), (desired))
+#define ATOMIC_INCREMENT(p) ((void)__atomic_add_fetch((p), 1, __ATOMIC_RELAXED))
+#define ATOMIC_FENCE() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#endif
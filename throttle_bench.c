@@ -0,0 +1,343 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if ENET_LIB_CHOICE == ENET_LIB_CHOICE_ORIGINAL
+	#include <enet/enet.h>
+#else
+	#include <enet.h>
+#endif
+
+
+// Bandwidth throttle benchmark
+// Connects a server host with incoming and outgoing bandwidth limits to a
+// full set of clients, some of which advertise bandwidth limits of their
+// own, and measures the CPU the server spends on the bandwidth throttle
+// (enet_host_bandwidth_throttle) that runs once a second, with and without
+// recalculating the bandwidth limits as it does after peers come and go. It
+// also measures the service pass that follows, in which the other peers
+// catch up with the throttle, against one with nothing to catch up with.
+//
+// Clients and server run in this one process and talk over the loopback
+// interface. The server is serviced between throttles as usual, and each
+// throttle is made due by moving the time of the last one back.
+
+
+#ifdef _WINDOWS
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+typedef struct
+{
+	int peers;
+	int limited_percent;
+	int iterations;
+} Config;
+typedef struct
+{
+	double *samples;
+	size_t count;
+	size_t capacity;
+} Samples;
+bool run(const Config *config);
+void samples_add(Samples *samples, double value);
+void samples_print(const char *name, Samples *samples);
+void samples_destroy(Samples *samples);
+#define SERVER_BANDWIDTH (1024 * 1024)
+#define CLIENT_INCOMING_BANDWIDTH (64 * 1024)
+#define CLIENT_OUTGOING_BANDWIDTH (16 * 1024)
+#define CONNECT_SECONDS 60
+#define CONNECT_BATCH 64
+// Peers of each client host, which only has 12-bit peer IDs for connecting
+#define CLIENT_PEERS 2048
+
+
+static void usage(const char *program)
+{
+	fprintf(stderr,
+		"Usage: %s [options]\n"
+		"  -n COUNT    number of peers (default 4095)\n"
+		"  -l PERCENT  peers that advertise a bandwidth limit (default 10)\n"
+		"  -i COUNT    throttles to measure (default 500)\n",
+		program);
+}
+
+int main(int argc, char *argv[])
+{
+	Config config = { 4095, 10, 500 };
+	for (int i = 1; i < argc; i++)
+	{
+		const char *arg = argv[i];
+		if (arg[0] != '-' || arg[1] == '\0' || arg[2] != '\0' || i + 1 >= argc)
+		{
+			usage(argv[0]);
+			return 1;
+		}
+		const char *value = argv[++i];
+		switch (arg[1])
+		{
+			case 'n':
+				config.peers = atoi(value);
+				break;
+			case 'l':
+				config.limited_percent = atoi(value);
+				break;
+			case 'i':
+				config.iterations = atoi(value);
+				break;
+			default:
+				usage(argv[0]);
+				return 1;
+		}
+	}
+	if (config.peers <= 0 || config.limited_percent < 0 || config.limited_percent > 100 ||
+		config.iterations <= 0)
+	{
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (enet_initialize() != 0)
+	{
+		fprintf(stderr, "An error occurred while initializing ENet\n");
+		return 1;
+	}
+	bool ok = run(&config);
+	enet_deinitialize();
+	return ok ? 0 : 1;
+}
+
+#if ENET_LIB_CHOICE == ENET_LIB_CHOICE_ORIGINAL
+
+static double now_us(void)
+{
+#ifdef _WINDOWS
+	static LARGE_INTEGER frequency;
+	LARGE_INTEGER counter;
+	if (frequency.QuadPart == 0)
+	{
+		QueryPerformanceFrequency(&frequency);
+	}
+	QueryPerformanceCounter(&counter);
+	return (double)counter.QuadPart * 1e6 / (double)frequency.QuadPart;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec * 1e6 + (double)ts.tv_nsec / 1e3;
+#endif
+}
+
+// Lets the hosts exchange what is pending, such as the bandwidth limit
+// commands queued by a throttle and their acknowledgements
+static void service(ENetHost *server, ENetHost **clients, int client_count)
+{
+	ENetEvent event;
+	while (enet_host_service(server, &event, 0) > 0)
+	{
+	}
+	for (int i = 0; i < client_count; i++)
+	{
+		while (clients[i] != NULL && enet_host_service(clients[i], &event, 0) > 0)
+		{
+		}
+	}
+}
+
+// Connects the clients a batch at a time, as a burst of connections
+// overflows the socket buffers of the server, and services every host until
+// the server has all its peers, or gives up
+static bool connect_all(ENetHost *server, ENetHost **clients, int client_count)
+{
+	ENetAddress address = server->address;
+	enet_address_set_host(&address, "127.0.0.1");
+	double end = now_us() + CONNECT_SECONDS * 1e6;
+	int client = 0;
+	size_t issued = 0, connecting = 0;
+	while (client < client_count || server->connectedPeers < connecting)
+	{
+		if (now_us() > end)
+		{
+			fprintf(stderr, "Only %lu of the peers connected\n", (unsigned long)server->connectedPeers);
+			return false;
+		}
+		while (client < client_count && connecting < server->connectedPeers + CONNECT_BATCH)
+		{
+			if (issued == clients[client]->peerCount)
+			{
+				client++;
+				issued = 0;
+				continue;
+			}
+			if (enet_host_connect(clients[client], &address, 1, 0) == NULL)
+			{
+				fprintf(stderr, "Failed to connect\n");
+				return false;
+			}
+			issued++;
+			connecting++;
+		}
+		service(server, clients, client_count);
+	}
+	return true;
+}
+
+bool run(const Config *config)
+{
+	bool ok = false;
+	int limited = config->peers * config->limited_percent / 100;
+	// Peers that advertise a limit and the others come from separate client
+	// hosts, as every peer of a host advertises the bandwidth of the host,
+	// and each client host only connects to so many
+	int limited_clients = (limited + CLIENT_PEERS - 1) / CLIENT_PEERS;
+	int client_count = limited_clients + (config->peers - limited + CLIENT_PEERS - 1) / CLIENT_PEERS;
+	ENetHost **clients = calloc(client_count, sizeof *clients);
+	ENetAddress address;
+	enet_address_set_host(&address, "127.0.0.1");
+	address.port = ENET_PORT_ANY;
+	ENetHost *server = enet_host_create(&address, config->peers, 1, SERVER_BANDWIDTH, SERVER_BANDWIDTH);
+	if (server == NULL || clients == NULL)
+	{
+		fprintf(stderr, "Failed to open ENet hosts\n");
+		goto failed;
+	}
+	for (int i = 0; i < client_count; i++)
+	{
+		int first = i < limited_clients ? i * CLIENT_PEERS : limited + (i - limited_clients) * CLIENT_PEERS;
+		int last = i < limited_clients ? limited : config->peers;
+		int peers = last - first < CLIENT_PEERS ? last - first : CLIENT_PEERS;
+		clients[i] = i < limited_clients ?
+			enet_host_create(NULL, peers, 1, CLIENT_INCOMING_BANDWIDTH, CLIENT_OUTGOING_BANDWIDTH) :
+			enet_host_create(NULL, peers, 1, 0, 0);
+		if (clients[i] == NULL)
+		{
+			fprintf(stderr, "Failed to open ENet hosts\n");
+			goto failed;
+		}
+	}
+	if (!connect_all(server, clients, client_count))
+	{
+		goto failed;
+	}
+	printf("%d peers, %d with a bandwidth limit\n", config->peers, limited);
+	printf("%-24s %9s %9s %9s %9s %9s\n", "", "calls", "mean us", "p50 us", "p99 us", "max us");
+
+	Samples throttle, recalculate, flush, catch_up;
+	memset(&throttle, 0, sizeof throttle);
+	memset(&recalculate, 0, sizeof recalculate);
+	memset(&flush, 0, sizeof flush);
+	memset(&catch_up, 0, sizeof catch_up);
+	for (int i = 0; i < config->iterations; i++)
+	{
+		// Throttles are told apart by their time in milliseconds, so keep
+		// the hosts going until the clock moves on
+		enet_uint32 last = server->bandwidthThrottleEpoch;
+		do
+		{
+			service(server, clients, client_count);
+		}
+		while (enet_time_get() == last);
+
+		bool recalculating = i % 2 == 1;
+		server->bandwidthThrottleEpoch -= ENET_HOST_BANDWIDTH_THROTTLE_INTERVAL;
+		if (recalculating)
+		{
+			server->recalculateBandwidthLimits = 1;
+		}
+		double start = now_us();
+		enet_host_bandwidth_throttle(server);
+		samples_add(recalculating ? &recalculate : &throttle, now_us() - start);
+
+		start = now_us();
+		enet_host_flush(server);
+		samples_add(&catch_up, now_us() - start);
+		start = now_us();
+		enet_host_flush(server);
+		samples_add(&flush, now_us() - start);
+	}
+
+	samples_print("throttle", &throttle);
+	samples_print("throttle + recalculate", &recalculate);
+	samples_print("flush after throttle", &catch_up);
+	samples_print("flush", &flush);
+	samples_destroy(&throttle);
+	samples_destroy(&recalculate);
+	samples_destroy(&flush);
+	samples_destroy(&catch_up);
+	ok = true;
+
+failed:
+	for (int i = 0; clients != NULL && i < client_count; i++)
+	{
+		if (clients[i] != NULL)
+		{
+			enet_host_destroy(clients[i]);
+		}
+	}
+	free(clients);
+	if (server != NULL)
+	{
+		enet_host_destroy(server);
+	}
+	return ok;
+}
+
+#else
+
+bool run(const Config *config)
+{
+	(void)config;
+	fprintf(stderr, "The throttle benchmark needs the internals of the original ENet\n");
+	return false;
+}
+
+#endif
+
+void samples_add(Samples *samples, double value)
+{
+	if (samples->count == samples->capacity)
+	{
+		size_t capacity = samples->capacity > 0 ? samples->capacity * 2 : 1024;
+		double *grown = realloc(samples->samples, capacity * sizeof *grown);
+		if (grown == NULL)
+		{
+			return;
+		}
+		samples->samples = grown;
+		samples->capacity = capacity;
+	}
+	samples->samples[samples->count++] = value;
+}
+
+static int compare_samples(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+	return x < y ? -1 : x > y;
+}
+
+void samples_print(const char *name, Samples *samples)
+{
+	if (samples->count == 0)
+	{
+		printf("%-24s %9d\n", name, 0);
+		return;
+	}
+	qsort(samples->samples, samples->count, sizeof *samples->samples, compare_samples);
+	double total = 0;
+	for (size_t i = 0; i < samples->count; i++)
+	{
+		total += samples->samples[i];
+	}
+	printf("%-24s %9lu %9.2f %9.2f %9.2f %9.2f\n", name, (unsigned long)samples->count,
+		total / samples->count,
+		samples->samples[samples->count / 2],
+		samples->samples[samples->count * 99 / 100],
+		samples->samples[samples->count - 1]);
+}
+
+void samples_destroy(Samples *samples)
+{
+	free(samples->samples);
+	memset(samples, 0, sizeof *samples);
+}
@@ -0,0 +1,303 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if ENET_LIB_CHOICE == ENET_LIB_CHOICE_ORIGINAL
+	#include <enet/enet.h>
+#else
+	#include <enet.h>
+#endif
+
+
+// Bulk throughput benchmark
+// Sends large reliable packets, such as chat attachments, from a client to
+// a server on one channel as fast as ENet lets them through, and measures
+// the throughput the server receives. Neither host has a bandwidth limit,
+// so the reliable window is the only thing that limits how much data is in
+// flight.
+//
+// Runs once with the fixed reliable window of plain ENet and once with the
+// window the peers size from the measured bandwidth-delay product
+// (ENET_PROTOCOL_CAPABILITY_ADAPTIVE_WINDOW). The client and the server run
+// in this one process, the server on a thread of its own, and talk over the
+// loopback interface. Throughput is counted from the data the server has
+// acknowledged.
+
+
+#ifdef _WINDOWS
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+typedef struct
+{
+	size_t packet_size;
+	size_t queue_bytes;
+	int seconds;
+} Config;
+bool run(const Config *config, bool adaptive);
+#define WARMUP_SECONDS 1
+#define CONNECT_SECONDS 5
+
+
+static void usage(const char *program)
+{
+	fprintf(stderr,
+		"Usage: %s [options] [fixed|adaptive]\n"
+		"  -s BYTES  size of each packet (default 65536)\n"
+		"  -q BYTES  data the client keeps queued ahead of the server (default 8388608)\n"
+		"  -t SECS   seconds to measure for (default 5)\n",
+		program);
+}
+
+int main(int argc, char *argv[])
+{
+	Config config = { 65536, 8 * 1024 * 1024, 5 };
+	const char *mode = NULL;
+	for (int i = 1; i < argc; i++)
+	{
+		const char *arg = argv[i];
+		if (arg[0] != '-' && mode == NULL && i + 1 == argc)
+		{
+			mode = arg;
+			break;
+		}
+		if (arg[0] != '-' || arg[1] == '\0' || arg[2] != '\0' || i + 1 >= argc)
+		{
+			usage(argv[0]);
+			return 1;
+		}
+		const char *value = argv[++i];
+		switch (arg[1])
+		{
+			case 's':
+				config.packet_size = strtoul(value, NULL, 10);
+				break;
+			case 'q':
+				config.queue_bytes = strtoul(value, NULL, 10);
+				break;
+			case 't':
+				config.seconds = atoi(value);
+				break;
+			default:
+				usage(argv[0]);
+				return 1;
+		}
+	}
+	if (config.packet_size == 0 || config.queue_bytes < config.packet_size || config.seconds <= 0 ||
+		(mode != NULL && strcmp(mode, "fixed") != 0 && strcmp(mode, "adaptive") != 0))
+	{
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (enet_initialize() != 0)
+	{
+		fprintf(stderr, "An error occurred while initializing ENet\n");
+		return 1;
+	}
+	printf("%lu byte reliable packets, %lu bytes queued\n",
+		(unsigned long)config.packet_size, (unsigned long)config.queue_bytes);
+	printf("%-10s %10s %10s %12s\n", "", "MB/s", "packets/s", "window KiB");
+	bool ok = true;
+	if (mode == NULL || strcmp(mode, "fixed") == 0)
+	{
+		ok = run(&config, false) && ok;
+	}
+	if (mode == NULL || strcmp(mode, "adaptive") == 0)
+	{
+		ok = run(&config, true) && ok;
+	}
+	enet_deinitialize();
+	return ok ? 0 : 1;
+}
+
+#if ENET_LIB_CHOICE == ENET_LIB_CHOICE_ORIGINAL
+
+static double now_us(void)
+{
+#ifdef _WINDOWS
+	static LARGE_INTEGER frequency;
+	LARGE_INTEGER counter;
+	if (frequency.QuadPart == 0)
+	{
+		QueryPerformanceFrequency(&frequency);
+	}
+	QueryPerformanceCounter(&counter);
+	return (double)counter.QuadPart * 1e6 / (double)frequency.QuadPart;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec * 1e6 + (double)ts.tv_nsec / 1e3;
+#endif
+}
+
+typedef struct
+{
+	ENetHost *host;
+	volatile bool stop;
+	bool failed;
+} Server;
+
+// The client counts what the server acknowledged, as ENet releases each
+// packet once it is acknowledged
+static size_t acknowledged_bytes;
+
+static void ENET_CALLBACK count_acknowledged(ENetPacket *packet)
+{
+	acknowledged_bytes += packet->dataLength;
+}
+
+static void ENET_CALLBACK run_server(void *data)
+{
+	Server *server = data;
+	ENetEvent event;
+	while (!server->stop)
+	{
+		int result = enet_host_service(server->host, &event, 1);
+		if (result < 0)
+		{
+			server->failed = true;
+			return;
+		}
+		if (result > 0 && event.type == ENET_EVENT_TYPE_RECEIVE)
+		{
+			enet_packet_destroy(event.packet);
+		}
+	}
+}
+
+static bool service_client(ENetHost *client)
+{
+	ENetEvent event;
+	int result;
+	while ((result = enet_host_service(client, &event, 0)) > 0)
+	{
+		if (event.type == ENET_EVENT_TYPE_DISCONNECT)
+		{
+			fprintf(stderr, "The server disconnected\n");
+			return false;
+		}
+	}
+	return result == 0;
+}
+
+bool run(const Config *config, bool adaptive)
+{
+	bool ok = false;
+	enet_uint8 *data = calloc(1, config->packet_size);
+	ENetAddress address;
+	enet_address_set_host(&address, "127.0.0.1");
+	address.port = ENET_PORT_ANY;
+	Server server;
+	memset(&server, 0, sizeof server);
+	server.host = enet_host_create(&address, 1, 1, 0, 0);
+	ENetHost *client = enet_host_create(NULL, 1, 1, 0, 0);
+	ENetThread server_thread;
+	bool started = false;
+	if (data == NULL || server.host == NULL || client == NULL)
+	{
+		fprintf(stderr, "Failed to open ENet hosts\n");
+		goto failed;
+	}
+	if (!adaptive)
+	{
+		server.host->capabilities &= ~ENET_PROTOCOL_CAPABILITY_ADAPTIVE_WINDOW;
+		client->capabilities &= ~ENET_PROTOCOL_CAPABILITY_ADAPTIVE_WINDOW;
+	}
+	if (enet_thread_create(&server_thread, run_server, &server) != 0)
+	{
+		fprintf(stderr, "Failed to start the server thread\n");
+		goto failed;
+	}
+	started = true;
+
+	address.port = server.host->address.port;
+	ENetPeer *peer = enet_host_connect(client, &address, 1, 0);
+	double end = now_us() + CONNECT_SECONDS * 1e6;
+	while (peer != NULL && peer->state != ENET_PEER_STATE_CONNECTED)
+	{
+		if (now_us() > end || !service_client(client))
+		{
+			peer = NULL;
+		}
+	}
+	if (peer == NULL)
+	{
+		fprintf(stderr, "Failed to connect\n");
+		goto failed;
+	}
+
+	// Warm up first so the window has grown, then measure
+	size_t sent_bytes = 0, start_bytes = 0;
+	acknowledged_bytes = 0;
+	double start = now_us();
+	end = start + (WARMUP_SECONDS + config->seconds) * 1e6;
+	bool warm = false;
+	for (double now = start; now < end; now = now_us())
+	{
+		if (!warm && now >= start + WARMUP_SECONDS * 1e6)
+		{
+			warm = true;
+			start = now;
+			start_bytes = acknowledged_bytes;
+		}
+		while (sent_bytes - acknowledged_bytes + config->packet_size <= config->queue_bytes)
+		{
+			ENetPacket *packet = enet_packet_create(data, config->packet_size, ENET_PACKET_FLAG_RELIABLE);
+			if (packet == NULL)
+			{
+				fprintf(stderr, "Failed to send\n");
+				goto failed;
+			}
+			packet->freeCallback = count_acknowledged;
+			if (enet_peer_send(peer, 0, packet) < 0)
+			{
+				enet_packet_destroy(packet);
+				fprintf(stderr, "Failed to send\n");
+				goto failed;
+			}
+			sent_bytes += config->packet_size;
+		}
+		if (!service_client(client) || server.failed)
+		{
+			goto failed;
+		}
+	}
+	double seconds = (now_us() - start) / 1e6;
+	printf("%-10s %10.1f %10.0f %12.1f\n", adaptive ? "adaptive" : "fixed",
+		(acknowledged_bytes - start_bytes) / seconds / 1e6,
+		(acknowledged_bytes - start_bytes) / (double)config->packet_size / seconds,
+		peer->windowSize / 1024.0);
+	ok = true;
+
+failed:
+	if (started)
+	{
+		server.stop = true;
+		enet_thread_join(server_thread);
+	}
+	if (client != NULL)
+	{
+		enet_host_destroy(client);
+	}
+	if (server.host != NULL)
+	{
+		enet_host_destroy(server.host);
+	}
+	free(data);
+	return ok;
+}
+
+#else
+
+bool run(const Config *config, bool adaptive)
+{
+	(void)config;
+	(void)adaptive;
+	fprintf(stderr, "The throughput benchmark needs the adaptive window of the original ENet\n");
+	return false;
+}
+
+#endif
@@ -0,0 +1,293 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if ENET_LIB_CHOICE == ENET_LIB_CHOICE_ORIGINAL
+	#include <enet/enet.h>
+#else
+	#include <enet.h>
+#endif
+
+
+// Dictionary trainer
+// Trains a dictionary for enet_lz_create_with_dictionary on captured
+// datagrams and writes it to a file, which the application then ships with
+// both its clients and its servers. The datagrams are read from corpus
+// files as compress_bench reads and writes them: one record per datagram, a
+// 2 byte length in network byte order followed by the datagram.
+//
+// Part of the datagrams are held out of training, and the trainer reports
+// how well LZ compresses them with and without the dictionary, so a
+// dictionary that does not help is noticed before it ships.
+// compress_bench -d replays a corpus with the dictionary.
+
+
+typedef struct
+{
+	ENetBuffer *datagrams;
+	size_t count;
+	size_t capacity;
+	size_t total;
+} Corpus;
+typedef struct
+{
+	const char *output;
+	size_t size;
+	int held_out;
+} Config;
+bool corpus_add(Corpus *corpus, const void *data, size_t length);
+bool corpus_read(Corpus *corpus, const char *path);
+void corpus_destroy(Corpus *corpus);
+bool train(const Config *config, const Corpus *corpus);
+#define DATAGRAM_BUFFER_SIZE ENET_PROTOCOL_MAXIMUM_MTU
+// The LZ window, the most of a dictionary that is used
+#define LARGEST_DICTIONARY 32768
+
+
+static void usage(const char *program)
+{
+	fprintf(stderr,
+		"Usage: %s [options] -o FILE corpus...\n"
+		"  -o FILE     write the dictionary to FILE\n"
+		"  -s BYTES    size of the dictionary, at most %d (default 16384)\n"
+		"  -e PERCENT  datagrams held out of training to evaluate on (default 25)\n",
+		program, LARGEST_DICTIONARY);
+}
+
+int main(int argc, char *argv[])
+{
+	Config config = { NULL, 16384, 25 };
+	int first_corpus = argc;
+	for (int i = 1; i < argc; i++)
+	{
+		const char *arg = argv[i];
+		if (arg[0] != '-')
+		{
+			first_corpus = i;
+			break;
+		}
+		if (arg[1] == '\0' || arg[2] != '\0' || i + 1 >= argc)
+		{
+			usage(argv[0]);
+			return 1;
+		}
+		const char *value = argv[++i];
+		switch (arg[1])
+		{
+			case 'o':
+				config.output = value;
+				break;
+			case 's':
+				config.size = strtoul(value, NULL, 10);
+				break;
+			case 'e':
+				config.held_out = atoi(value);
+				break;
+			default:
+				usage(argv[0]);
+				return 1;
+		}
+	}
+	if (config.output == NULL || first_corpus == argc || config.size == 0 || config.size > LARGEST_DICTIONARY ||
+		config.held_out < 0 || config.held_out >= 100)
+	{
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (enet_initialize() != 0)
+	{
+		fprintf(stderr, "An error occurred while initializing ENet\n");
+		return 1;
+	}
+	Corpus corpus;
+	memset(&corpus, 0, sizeof corpus);
+	bool ok = true;
+	for (int i = first_corpus; i < argc && ok; i++)
+	{
+		ok = corpus_read(&corpus, argv[i]);
+	}
+	if (ok && corpus.count == 0)
+	{
+		fprintf(stderr, "No datagrams to train on\n");
+		ok = false;
+	}
+	if (ok)
+	{
+		ok = train(&config, &corpus);
+	}
+	corpus_destroy(&corpus);
+	enet_deinitialize();
+	return ok ? 0 : 1;
+}
+
+
+bool corpus_add(Corpus *corpus, const void *data, size_t length)
+{
+	if (corpus->count == corpus->capacity)
+	{
+		size_t capacity = corpus->capacity ? corpus->capacity * 2 : 1024;
+		ENetBuffer *datagrams = realloc(corpus->datagrams, capacity * sizeof *datagrams);
+		if (datagrams == NULL)
+		{
+			return false;
+		}
+		corpus->datagrams = datagrams;
+		corpus->capacity = capacity;
+	}
+	void *copy = malloc(length > 0 ? length : 1);
+	if (copy == NULL)
+	{
+		return false;
+	}
+	memcpy(copy, data, length);
+	corpus->datagrams[corpus->count].data = copy;
+	corpus->datagrams[corpus->count].dataLength = length;
+	corpus->count++;
+	corpus->total += length;
+	return true;
+}
+
+bool corpus_read(Corpus *corpus, const char *path)
+{
+	FILE *file = fopen(path, "rb");
+	if (file == NULL)
+	{
+		fprintf(stderr, "Failed to open %s\n", path);
+		return false;
+	}
+	bool ok = true;
+	enet_uint8 header[2];
+	enet_uint8 datagram[DATAGRAM_BUFFER_SIZE];
+	while (ok && fread(header, 1, sizeof header, file) == sizeof header)
+	{
+		size_t length = ((size_t)header[0] << 8) | header[1];
+		if (length > sizeof datagram || fread(datagram, 1, length, file) != length)
+		{
+			fprintf(stderr, "Corrupt record %lu in %s\n", (unsigned long)corpus->count, path);
+			ok = false;
+		}
+		else if (!corpus_add(corpus, datagram, length))
+		{
+			fprintf(stderr, "Out of memory\n");
+			ok = false;
+		}
+	}
+	fclose(file);
+	return ok;
+}
+
+void corpus_destroy(Corpus *corpus)
+{
+	for (size_t i = 0; i < corpus->count; i++)
+	{
+		free(corpus->datagrams[i].data);
+	}
+	free(corpus->datagrams);
+	memset(corpus, 0, sizeof *corpus);
+}
+
+#if ENET_LIB_CHOICE == ENET_LIB_CHOICE_ORIGINAL
+
+// Bytes the datagrams take on the wire with a compressor, ENet sending
+// those that do not compress unchanged
+static size_t compressed_bytes(void *context, const ENetBuffer *datagrams, size_t count)
+{
+	enet_uint8 out[DATAGRAM_BUFFER_SIZE];
+	size_t total = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		size_t length = datagrams[i].dataLength;
+		size_t compressed = enet_lz_compress(context, &datagrams[i], 1, length, out, length);
+		total += compressed > 0 ? compressed : length;
+	}
+	return total;
+}
+
+static bool write_dictionary(const char *path, const enet_uint8 *dictionary, size_t length)
+{
+	FILE *file = fopen(path, "wb");
+	if (file == NULL)
+	{
+		fprintf(stderr, "Failed to create %s\n", path);
+		return false;
+	}
+	bool ok = fwrite(dictionary, 1, length, file) == length;
+	if (fclose(file) != 0 || !ok)
+	{
+		fprintf(stderr, "Failed to write %s\n", path);
+		return false;
+	}
+	return true;
+}
+
+bool train(const Config *config, const Corpus *corpus)
+{
+	// The held out datagrams are the last ones, as an application would
+	// train on traffic it captured earlier
+	size_t samples = corpus->count - corpus->count * config->held_out / 100;
+	if (samples == 0)
+	{
+		samples = corpus->count;
+	}
+	enet_uint8 *dictionary = malloc(config->size);
+	if (dictionary == NULL)
+	{
+		fprintf(stderr, "Out of memory\n");
+		return false;
+	}
+	size_t length = enet_lz_train_dictionary(corpus->datagrams, samples, dictionary, config->size);
+	if (length == 0)
+	{
+		fprintf(stderr, "Failed to train dictionary\n");
+		free(dictionary);
+		return false;
+	}
+	printf("trained a %lu byte dictionary on %lu of %lu datagrams\n",
+		(unsigned long)length, (unsigned long)samples, (unsigned long)corpus->count);
+
+	if (samples < corpus->count)
+	{
+		const ENetBuffer *held_out = corpus->datagrams + samples;
+		size_t count = corpus->count - samples, total = 0;
+		for (size_t i = 0; i < count; i++)
+		{
+			total += held_out[i].dataLength;
+		}
+		void *plain = enet_lz_create();
+		void *primed = enet_lz_create_with_dictionary(dictionary, length);
+		if (plain == NULL || primed == NULL)
+		{
+			fprintf(stderr, "Failed to create LZ compressors\n");
+			enet_lz_destroy(plain);
+			enet_lz_destroy(primed);
+			free(dictionary);
+			return false;
+		}
+		printf("%-20s %12s %8s\n", "held out datagrams", "bytes", "ratio");
+		printf("%-20s %12lu %8.3f\n", "uncompressed", (unsigned long)total, 1.0);
+		size_t bytes = compressed_bytes(plain, held_out, count);
+		printf("%-20s %12lu %8.3f\n", "lz", (unsigned long)bytes, (double)total / bytes);
+		bytes = compressed_bytes(primed, held_out, count);
+		printf("%-20s %12lu %8.3f\n", "lz with dictionary", (unsigned long)bytes, (double)total / bytes);
+		enet_lz_destroy(plain);
+		enet_lz_destroy(primed);
+	}
+
+	bool ok = write_dictionary(config->output, dictionary, length);
+	free(dictionary);
+	return ok;
+}
+
+#else
+
+bool train(const Config *config, const Corpus *corpus)
+{
+	(void)config;
+	(void)corpus;
+	fprintf(stderr, "Training a dictionary needs the LZ compressor of the original ENet\n");
+	return false;
+}
+
+#endif